@@ -62,6 +62,7 @@
 
 #include <stdint.h>
 #include <stdarg.h>
+#include <string.h>
 #include <ctype.h>
 #include <math.h>
 
@@ -310,11 +311,108 @@ static int parseYyyyMmDd(const char *zDate, DateTime *p){
     return 0;
 }
 
+/*
+ ** Tipbit: a fast path for exactly YYYY-MM-DDTHH:MM:SS.SSSZ, which is the
+ ** form that -[NSDate iso8601String_24] writes, and so nearly everything
+ ** that we parse.
+ **
+ ** The string is loaded as three 64-bit words and each word is checked in
+ ** one go (SWAR) against the layout below: the separators must match
+ ** exactly, and every other byte must be '0'-'9'.  The digits are then read
+ ** straight out of those words.  Fields are range-checked the same way as
+ ** parseYyyyMmDd and parseHhMmSs, and the result is computed in integer
+ ** milliseconds, so there is no floating-point rounding in the fraction.
+ */
+#define FIXED24_DIGITS0     0x00FFFF00FFFFFFFFULL   /* "YYYY-MM-" */
+#define FIXED24_SEPS0       0x2D00002D00000000ULL
+#define FIXED24_DIGITS1     0xFFFF00FFFF00FFFFULL   /* "DDTHH:MM" */
+#define FIXED24_SEPS1       0x00003A0000540000ULL
+#define FIXED24_DIGITS2     0x00FFFFFF00FFFF00ULL   /* ":SS.SSSZ" */
+#define FIXED24_SEPS2       0x5A0000002E00003AULL
+
+#define SWAR_HIGH_NIBBLES   0xF0F0F0F0F0F0F0F0ULL
+#define SWAR_LOW_NIBBLES    0x0F0F0F0F0F0F0F0FULL
+#define SWAR_ASCII_ZEROS    0x3030303030303030ULL
+#define SWAR_SIXES          0x0606060606060606ULL
+#define SWAR_CARRIES        0x1010101010101010ULL
+
+#define SWAR_DIGIT(w, i)    ((int)(((w) >> (8 * (i))) & 0xF))
+
+/*
+ ** Return 1 if the separators in w are exactly seps and every byte
+ ** selected by digits is an ASCII digit.  A byte is a digit if its high
+ ** nibble is 3 and its low nibble plus 6 does not carry into bit 4.
+ */
+static int swarMatches(uint64_t w, uint64_t digits, uint64_t seps){
+    return (w & ~digits)==seps
+        && (w & digits & SWAR_HIGH_NIBBLES)==(SWAR_ASCII_ZEROS & digits)
+        && (((w & SWAR_LOW_NIBBLES) + SWAR_SIXES) & SWAR_CARRIES & digits)==0;
+}
+
+/*
+ ** The number of days from 1970-01-01 to the given date in the proleptic
+ ** Gregorian calendar, the same as computeJD.  D may run past the end of
+ ** the month, in which case it rolls over (also the same as computeJD).
+ ** See http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+ */
+static sqlite3_int64 daysFromCivil(int Y, int M, int D){
+    int era, yoe, doy, doe;
+    Y -= M<=2;
+    era = (Y>=0 ? Y : Y-399) / 400;
+    yoe = Y - era*400;
+    doy = (153*(M>2 ? M-3 : M+9) + 2)/5 + D-1;
+    doe = yoe*365 + yoe/4 - yoe/100 + doy;
+    return (sqlite3_int64)era*146097 + doe - 719468;
+}
+
+int CBLParseISO8601Date24(const char* zDate, int64_t* pMsec){
+#if defined(__LITTLE_ENDIAN__) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__)
+    uint64_t w0, w1, w2;
+    int Y, M, D, h, m, s, ms;
+
+    if( strnlen(zDate, 25)!=24 ){
+        return 1;
+    }
+    memcpy(&w0, zDate, 8);
+    memcpy(&w1, zDate + 8, 8);
+    memcpy(&w2, zDate + 16, 8);
+    if( !swarMatches(w0, FIXED24_DIGITS0, FIXED24_SEPS0)
+     || !swarMatches(w1, FIXED24_DIGITS1, FIXED24_SEPS1)
+     || !swarMatches(w2, FIXED24_DIGITS2, FIXED24_SEPS2) ){
+        return 1;
+    }
+    Y = SWAR_DIGIT(w0,0)*1000 + SWAR_DIGIT(w0,1)*100 + SWAR_DIGIT(w0,2)*10 + SWAR_DIGIT(w0,3);
+    M = SWAR_DIGIT(w0,5)*10 + SWAR_DIGIT(w0,6);
+    D = SWAR_DIGIT(w1,0)*10 + SWAR_DIGIT(w1,1);
+    h = SWAR_DIGIT(w1,3)*10 + SWAR_DIGIT(w1,4);
+    m = SWAR_DIGIT(w1,6)*10 + SWAR_DIGIT(w1,7);
+    s = SWAR_DIGIT(w2,1)*10 + SWAR_DIGIT(w2,2);
+    ms = SWAR_DIGIT(w2,4)*100 + SWAR_DIGIT(w2,5)*10 + SWAR_DIGIT(w2,6);
+    if( M<1 || M>12 || D<1 || D>31 || h>24 || m>59 || s>59 ){
+        return 1;
+    }
+    *pMsec = daysFromCivil(Y, M, D)*86400000
+           + h*3600000 + m*60000 + s*1000 + ms;
+    return 0;
+#else
+    return 1;
+#endif
+}
+
 // Here's the main public function.
 double CBLParseISO8601Date(const char* zDate) {
+    int64_t msec;
+    if (CBLParseISO8601Date24(zDate, &msec) == 0)
+        return msec / 1000.0;
+
     DateTime x;
     if (parseYyyyMmDd(zDate,&x))
         return NAN;
     computeJD(&x);
     return x.iJD/1000.0 - 210866760000.0;
 }
+
+void CBLParseISO8601Dates(const char* const* dateStrs, size_t count, double* results) {
+    for (size_t i = 0; i < count; i++)
+        results[i] = (dateStrs[i] == NULL ? NAN : CBLParseISO8601Date(dateStrs[i]));
+}
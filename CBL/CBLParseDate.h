@@ -9,8 +9,21 @@
 #ifndef CouchbaseLite_CBLParseDate_h
 #define CouchbaseLite_CBLParseDate_h
 
+#include <stddef.h>
+#include <stdint.h>
+
 /** Parses a C string as an ISO-8601 date-time, returning a UNIX timestamp (number of seconds
     since 1/1/1970), or a NAN if the string is not valid. */
 double CBLParseISO8601Date(const char* dateStr);
 
+/** Parses count C strings with CBLParseISO8601Date, writing the results into the results array.
+    NULL entries give NAN. */
+void CBLParseISO8601Dates(const char* const* dateStrs, size_t count, double* results);
+
+/** Parses a C string of exactly the form YYYY-MM-DDTHH:MM:SS.SSSZ, writing the number of
+    milliseconds since 1/1/1970 into *msec.  Returns 0 on success, or 1 if the string is in any
+    other form or is not valid, in which case *msec is untouched.  This is the fast path that
+    CBLParseISO8601Date tries first. */
+int CBLParseISO8601Date24(const char* dateStr, int64_t* msec);
+
 #endif
@@ -0,0 +1,57 @@
+//
+//  TTTFormatterCache.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/10/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * A bounded, thread-safe memo of formatted strings, shared by the FormatterKit formatters that have cachesResults
+ * set.
+ *
+ * Entries are keyed by a configuration string, which the formatter builds from everything that affects its output
+ * (including its class and locale), and an input quantized to an int64_t such that every input with the same
+ * quantized value gives the same string.  Formatters with the same configuration therefore share entries.
+ *
+ * The whole cache is cleared on NSCurrentLocaleDidChangeNotification.
+ */
+@interface TTTFormatterCache : NSObject
+
+/**
+ * The cache used by the formatters.  This holds up to 2000 strings.
+ */
++(TTTFormatterCache *)sharedCache;
+
+/**
+ * @param countLimit The maximum number of strings to hold.  Must be greater than zero.
+ */
+-(instancetype)initWithCountLimit:(NSUInteger)countLimit;
+
+/**
+ * @return The string for the given configuration and input, or nil if it is not in the cache.
+ */
+-(NSString *)stringForConfiguration:(NSString *)configuration input:(int64_t)input;
+
+-(void)setString:(NSString *)string forConfiguration:(NSString *)configuration input:(int64_t)input __attribute__((nonnull));
+
+-(void)removeAllStrings;
+
+/**
+ * The number of calls to stringForConfiguration:input: that found a string, and that didn't, since this cache was
+ * created or resetStatistics was called.
+ */
+@property (nonatomic, readonly) uint64_t hits;
+@property (nonatomic, readonly) uint64_t misses;
+
+/**
+ * hits / (hits + misses), or 0 if there have been no lookups.
+ */
+@property (nonatomic, readonly) double hitRate;
+
+-(void)resetStatistics;
+
+@end
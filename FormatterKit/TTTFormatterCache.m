@@ -0,0 +1,146 @@
+//
+//  TTTFormatterCache.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/10/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <libkern/OSAtomic.h>
+
+#import "LRUCache.h"
+
+#import "TTTFormatterCache.h"
+
+
+#define SHARED_CACHE_COUNT_LIMIT 2000
+
+
+@interface TTTFormatterCacheKey : NSObject <NSCopying>
+{
+@public
+    NSString * configuration;
+    int64_t input;
+    NSUInteger hash;
+}
+@end
+
+
+@implementation TTTFormatterCacheKey
+
+
+-(instancetype)initWithConfiguration:(NSString *)configuration_ input:(int64_t)input_ {
+    self = [super init];
+    if (self) {
+        configuration = configuration_;
+        input = input_;
+        hash = configuration_.hash ^ (NSUInteger)(input_ * 2654435761LL);
+    }
+    return self;
+}
+
+
+-(NSUInteger)hash {
+    return hash;
+}
+
+
+-(BOOL)isEqual:(id)object {
+    if (![object isKindOfClass:[TTTFormatterCacheKey class]]) {
+        return NO;
+    }
+    TTTFormatterCacheKey * other = object;
+    return (input == other->input && (configuration == other->configuration || [configuration isEqualToString:other->configuration]));
+}
+
+
+/**
+ * Keys are immutable.
+ */
+-(id)copyWithZone:(__unused NSZone *)zone {
+    return self;
+}
+
+
+@end
+
+
+@implementation TTTFormatterCache
+{
+    LRUCache * cache;
+    id localeObserver;
+    volatile int64_t hits;
+    volatile int64_t misses;
+}
+
+
++(TTTFormatterCache *)sharedCache {
+    static TTTFormatterCache * sharedCache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedCache = [[TTTFormatterCache alloc] initWithCountLimit:SHARED_CACHE_COUNT_LIMIT];
+    });
+    return sharedCache;
+}
+
+
+-(instancetype)initWithCountLimit:(NSUInteger)countLimit {
+    self = [super init];
+    if (self) {
+        cache = [[LRUCache alloc] initWithCountLimit:countLimit];
+        __weak TTTFormatterCache * weakSelf = self;
+        localeObserver = [[NSNotificationCenter defaultCenter] addObserverForName:NSCurrentLocaleDidChangeNotification object:nil queue:nil usingBlock:^(__unused NSNotification * note) {
+            [weakSelf removeAllStrings];
+        }];
+    }
+    return self;
+}
+
+
+-(void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:localeObserver];
+}
+
+
+-(NSString *)stringForConfiguration:(NSString *)configuration input:(int64_t)input {
+    TTTFormatterCacheKey * key = [[TTTFormatterCacheKey alloc] initWithConfiguration:configuration input:input];
+    NSString * result = [cache objectForKey:key];
+    OSAtomicIncrement64(result == nil ? &misses : &hits);
+    return result;
+}
+
+
+-(void)setString:(NSString *)string forConfiguration:(NSString *)configuration input:(int64_t)input {
+    [cache setObject:string forKey:[[TTTFormatterCacheKey alloc] initWithConfiguration:configuration input:input]];
+}
+
+
+-(void)removeAllStrings {
+    [cache removeAllObjects];
+}
+
+
+-(uint64_t)hits {
+    return (uint64_t)hits;
+}
+
+
+-(uint64_t)misses {
+    return (uint64_t)misses;
+}
+
+
+-(double)hitRate {
+    uint64_t h = self.hits;
+    uint64_t total = h + self.misses;
+    return (total == 0 ? 0.0 : (double)h / (double)total);
+}
+
+
+-(void)resetStatistics {
+    hits = 0;
+    misses = 0;
+}
+
+
+@end
@@ -165,6 +165,26 @@ extern TTTLocationCardinalDirection TTTLocationCardinalDirectionFromBearing(CLLo
 - (NSString *)stringFromDistanceAndBearingFromLocation:(CLLocation *)originLocation
                                             toLocation:(CLLocation *)destinationLocation;
 
+/**
+ Returns a string representation of a given distance and bearing formatted using the receiver’s current settings, in the same form as `stringFromDistanceAndBearingFromLocation:toLocation:`.
+
+ @param distance The distance to format.
+ @param bearing The bearing to format.
+ */
+- (NSString *)stringFromDistance:(CLLocationDistance)distance
+                      andBearing:(CLLocationDegrees)bearing;
+
+/**
+ Returns string representations of the given distances, and bearings if specified, formatted using the receiver’s current settings. This is for distances that have been computed in bulk, for example by `GeoDistancesAndBearings`, which is much faster than `CLLocation` for hundreds of destinations.
+
+ @param distances The distances to format.
+ @param bearings The bearings to format, or `NULL`, in which case the strings are as `stringFromDistance:`.
+ @param count The number of entries in `distances` and `bearings`.
+ */
+- (NSArray *)stringsFromDistances:(const CLLocationDistance *)distances
+                         bearings:(const CLLocationDegrees *)bearings
+                            count:(NSUInteger)count;
+
 /**
  Returns a string representation of the velocity traveling between two specified locations at a given speed formatted using the receiver’s current settings.
 
@@ -301,7 +301,25 @@ static inline double CLLocationSpeedToMilesPerHour(CLLocationSpeed speed) {
 - (NSString *)stringFromDistanceAndBearingFromLocation:(CLLocation *)originLocation
                                             toLocation:(CLLocation *)destinationLocation
 {
-    return [NSString stringWithFormat:NSLocalizedStringWithDefaultValue(@"Dimension Format String", @"FormatterKit", [NSBundle mainBundle], @"%@ %@", @"#{Dimensional Quantity} #{Direction}"), [self stringFromDistanceFromLocation:originLocation toLocation:destinationLocation], [self stringFromBearingFromLocation:originLocation toLocation:destinationLocation]];
+    return [self stringFromDistance:[destinationLocation distanceFromLocation:originLocation] andBearing:CLLocationDegreesBearingBetweenCoordinates(originLocation.coordinate, destinationLocation.coordinate)];
+}
+
+- (NSString *)stringFromDistance:(CLLocationDistance)distance
+                      andBearing:(CLLocationDegrees)bearing
+{
+    return [NSString stringWithFormat:NSLocalizedStringWithDefaultValue(@"Dimension Format String", @"FormatterKit", [NSBundle mainBundle], @"%@ %@", @"#{Dimensional Quantity} #{Direction}"), [self stringFromDistance:distance], [self stringFromBearing:bearing]];
+}
+
+- (NSArray *)stringsFromDistances:(const CLLocationDistance *)distances
+                         bearings:(const CLLocationDegrees *)bearings
+                            count:(NSUInteger)count
+{
+    NSMutableArray *strings = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [strings addObject:(bearings ? [self stringFromDistance:distances[i] andBearing:bearings[i]] : [self stringFromDistance:distances[i]])];
+    }
+
+    return strings;
 }
 
 - (NSString *)stringFromVelocityFromLocation:(CLLocation *)originLocation
@@ -67,4 +67,11 @@ typedef NS_ENUM(NSUInteger, TTTOrdinalNumberFormatterPredicateGrammaticalNumber)
  */
 @property (nonatomic, assign) TTTOrdinalNumberFormatterPredicateGrammaticalNumber grammaticalNumber;
 
+/**
+ Specifies whether to memoize results in `+[TTTFormatterCache sharedCache]`, shared with other formatters that have the same configuration. Only whole numbers are cached. `NO` by default.
+
+ @discussion The configuration includes the properties above and every inherited `NSNumberFormatter` setting that affects the string, so formatters that are configured differently never share entries, and changing a setting takes effect immediately.
+ */
+@property (nonatomic, assign) BOOL cachesResults;
+
 @end
@@ -22,12 +22,18 @@
 
 #import "TTTOrdinalNumberFormatter.h"
 
+#import "TTTFormatterCache.h"
+
 static NSString * const kTTTOrdinalNumberFormatterDefaultOrdinalIndicator = @".";
 
-@implementation TTTOrdinalNumberFormatter
+@implementation TTTOrdinalNumberFormatter {
+    NSString *_cacheConfiguration;
+}
+
 @synthesize ordinalIndicator = _ordinalIndicator;
 @synthesize grammaticalGender = _grammaticalGender;
 @synthesize grammaticalNumber = _grammaticalNumber;
+@synthesize cachesResults = _cachesResults;
 
 - (id)init {
     self = [super init];
@@ -213,13 +219,169 @@ static NSString * const kTTTOrdinalNumberFormatterDefaultOrdinalIndicator = @"."
     return @"\u7b2c";
 }
 
+#pragma mark - Caching
+
+/**
+ Everything that affects the result of `stringForObjectValue:`. This is rebuilt when one of those settings changes (each setter clears it). It is built under `@synchronized(self)`, as `stringForObjectValue:` is.
+
+ The positive prefix and suffix are left out, because `uncachedStringForNumber:` always overwrites them.
+ */
+- (NSString *)cacheConfiguration {
+    @synchronized(self) {
+        if (!_cacheConfiguration) {
+            NSString *ordinal = [NSString stringWithFormat:@"%@\x1f%@\x1f%@\x1f%lu\x1f%lu",
+                                 NSStringFromClass([self class]),
+                                 [[self locale] localeIdentifier],
+                                 self.ordinalIndicator,
+                                 (unsigned long)self.grammaticalGender,
+                                 (unsigned long)self.grammaticalNumber];
+            NSString *digits = [NSString stringWithFormat:@"%lu\x1f%lu\x1f%lu\x1f%lu\x1f%lu\x1f%d\x1f%lu\x1f%lu\x1f%@\x1f%lu\x1f%@\x1f%lu\x1f%lu\x1f%lu\x1f%d\x1f%@\x1f%@\x1f%d\x1f%lu\x1f%@",
+                                (unsigned long)[self numberStyle],
+                                (unsigned long)[self minimumIntegerDigits],
+                                (unsigned long)[self maximumIntegerDigits],
+                                (unsigned long)[self minimumFractionDigits],
+                                (unsigned long)[self maximumFractionDigits],
+                                [self usesSignificantDigits],
+                                (unsigned long)[self minimumSignificantDigits],
+                                (unsigned long)[self maximumSignificantDigits],
+                                [self multiplier],
+                                (unsigned long)[self roundingMode],
+                                [self roundingIncrement],
+                                (unsigned long)[self formatWidth],
+                                (unsigned long)[self paddingPosition],
+                                (unsigned long)[self groupingSize],
+                                [self usesGroupingSeparator],
+                                [self groupingSeparator],
+                                [self decimalSeparator],
+                                [self alwaysShowsDecimalSeparator],
+                                (unsigned long)[self secondaryGroupingSize],
+                                [self paddingCharacter]];
+            NSString *symbols = [NSString stringWithFormat:@"%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@",
+                                 [self negativeFormat],
+                                 [self negativePrefix],
+                                 [self negativeSuffix],
+                                 [self zeroSymbol],
+                                 [self minusSign],
+                                 [self plusSign],
+                                 [self currencyCode],
+                                 [self currencySymbol],
+                                 [self internationalCurrencySymbol],
+                                 [self percentSymbol],
+                                 [self perMillSymbol],
+                                 [self exponentSymbol]];
+            _cacheConfiguration = [NSString stringWithFormat:@"%@\x1e%@\x1e%@", ordinal, digits, symbols];
+        }
+
+        return _cacheConfiguration;
+    }
+}
+
+- (void)setCachesResults:(BOOL)cachesResults {
+    _cachesResults = cachesResults;
+    _cacheConfiguration = nil;
+}
+
+- (void)setOrdinalIndicator:(NSString *)ordinalIndicator {
+    _ordinalIndicator = [ordinalIndicator copy];
+    _cacheConfiguration = nil;
+}
+
+- (void)setGrammaticalGender:(TTTOrdinalNumberFormatterPredicateGrammaticalGender)grammaticalGender {
+    _grammaticalGender = grammaticalGender;
+    _cacheConfiguration = nil;
+}
+
+- (void)setGrammaticalNumber:(TTTOrdinalNumberFormatterPredicateGrammaticalNumber)grammaticalNumber {
+    _grammaticalNumber = grammaticalNumber;
+    _cacheConfiguration = nil;
+}
+
+- (void)setLocale:(NSLocale *)locale {
+    [super setLocale:locale];
+    _cacheConfiguration = nil;
+}
+
+- (void)setNumberStyle:(NSNumberFormatterStyle)numberStyle {
+    [super setNumberStyle:numberStyle];
+    _cacheConfiguration = nil;
+}
+
+- (void)setUsesGroupingSeparator:(BOOL)usesGroupingSeparator {
+    [super setUsesGroupingSeparator:usesGroupingSeparator];
+    _cacheConfiguration = nil;
+}
+
+- (void)setGroupingSeparator:(NSString *)groupingSeparator {
+    [super setGroupingSeparator:groupingSeparator];
+    _cacheConfiguration = nil;
+}
+
+// The rest of the inherited settings that are in cacheConfiguration.  Each one just clears it, like the setters above.
+#define TTT_INVALIDATING_SETTER(setter, type) \
+    - (void)setter:(type)value { \
+        [super setter:value]; \
+        _cacheConfiguration = nil; \
+    }
+
+TTT_INVALIDATING_SETTER(setMinimumIntegerDigits, NSUInteger)
+TTT_INVALIDATING_SETTER(setMaximumIntegerDigits, NSUInteger)
+TTT_INVALIDATING_SETTER(setMinimumFractionDigits, NSUInteger)
+TTT_INVALIDATING_SETTER(setMaximumFractionDigits, NSUInteger)
+TTT_INVALIDATING_SETTER(setUsesSignificantDigits, BOOL)
+TTT_INVALIDATING_SETTER(setMinimumSignificantDigits, NSUInteger)
+TTT_INVALIDATING_SETTER(setMaximumSignificantDigits, NSUInteger)
+TTT_INVALIDATING_SETTER(setMultiplier, NSNumber *)
+TTT_INVALIDATING_SETTER(setRoundingMode, NSNumberFormatterRoundingMode)
+TTT_INVALIDATING_SETTER(setRoundingIncrement, NSNumber *)
+TTT_INVALIDATING_SETTER(setFormatWidth, NSUInteger)
+TTT_INVALIDATING_SETTER(setPaddingPosition, NSNumberFormatterPadPosition)
+TTT_INVALIDATING_SETTER(setPaddingCharacter, NSString *)
+TTT_INVALIDATING_SETTER(setGroupingSize, NSUInteger)
+TTT_INVALIDATING_SETTER(setSecondaryGroupingSize, NSUInteger)
+TTT_INVALIDATING_SETTER(setDecimalSeparator, NSString *)
+TTT_INVALIDATING_SETTER(setAlwaysShowsDecimalSeparator, BOOL)
+TTT_INVALIDATING_SETTER(setPositiveFormat, NSString *)
+TTT_INVALIDATING_SETTER(setNegativeFormat, NSString *)
+TTT_INVALIDATING_SETTER(setNegativePrefix, NSString *)
+TTT_INVALIDATING_SETTER(setNegativeSuffix, NSString *)
+TTT_INVALIDATING_SETTER(setZeroSymbol, NSString *)
+TTT_INVALIDATING_SETTER(setMinusSign, NSString *)
+TTT_INVALIDATING_SETTER(setPlusSign, NSString *)
+TTT_INVALIDATING_SETTER(setCurrencyCode, NSString *)
+TTT_INVALIDATING_SETTER(setCurrencySymbol, NSString *)
+TTT_INVALIDATING_SETTER(setInternationalCurrencySymbol, NSString *)
+TTT_INVALIDATING_SETTER(setPercentSymbol, NSString *)
+TTT_INVALIDATING_SETTER(setPerMillSymbol, NSString *)
+TTT_INVALIDATING_SETTER(setExponentSymbol, NSString *)
+
+#undef TTT_INVALIDATING_SETTER
+
 #pragma mark - NSFormatter
 
 - (NSString *)stringForObjectValue:(id)anObject {
     if (![anObject isKindOfClass:[NSNumber class]]) {
         return nil;
     }
-    
+
+    double value = [(NSNumber *)anObject doubleValue];
+    if (!self.cachesResults || !(fabs(value) < 9.2e18 && value == floor(value))) {
+        return [self uncachedStringForNumber:(NSNumber *)anObject];
+    }
+
+    TTTFormatterCache *cache = [TTTFormatterCache sharedCache];
+    NSString *configuration = [self cacheConfiguration];
+    NSString *string = [cache stringForConfiguration:configuration input:(int64_t)value];
+    if (!string) {
+        string = [self uncachedStringForNumber:(NSNumber *)anObject];
+        if (string) {
+            [cache setString:string forConfiguration:configuration input:(int64_t)value];
+        }
+    }
+
+    return string;
+}
+
+- (NSString *)uncachedStringForNumber:(NSNumber *)anObject {
     NSString *indicator = self.ordinalIndicator;
     if (!indicator) {
         indicator = [self localizedOrdinalIndicatorStringFromNumber:(NSNumber *)anObject];
@@ -270,6 +432,7 @@ static NSString * const kTTTOrdinalNumberFormatterDefaultOrdinalIndicator = @"."
     formatter.ordinalIndicator = [self.ordinalIndicator copyWithZone:zone];
     formatter.grammaticalGender = self.grammaticalGender;
     formatter.grammaticalNumber = self.grammaticalNumber;
+    formatter.cachesResults = self.cachesResults;
 
     return formatter;
 }
@@ -284,6 +447,7 @@ static NSString * const kTTTOrdinalNumberFormatterDefaultOrdinalIndicator = @"."
     self.ordinalIndicator = [aDecoder decodeObjectForKey:NSStringFromSelector(@selector(ordinalIndicator))];
     self.grammaticalGender = (TTTOrdinalNumberFormatterPredicateGrammaticalGender)[aDecoder decodeIntegerForKey:NSStringFromSelector(@selector(grammaticalGender))];
     self.grammaticalNumber = (TTTOrdinalNumberFormatterPredicateGrammaticalNumber)[aDecoder decodeIntegerForKey:NSStringFromSelector(@selector(grammaticalNumber))];
+    self.cachesResults = [aDecoder decodeBoolForKey:NSStringFromSelector(@selector(cachesResults))];
 #pragma clang diagnostic pop
 
     return self;
@@ -295,6 +459,7 @@ static NSString * const kTTTOrdinalNumberFormatterDefaultOrdinalIndicator = @"."
     [aCoder encodeObject:self.ordinalIndicator forKey:NSStringFromSelector(@selector(ordinalIndicator))];
     [aCoder encodeInteger:self.grammaticalGender forKey:NSStringFromSelector(@selector(grammaticalGender))];
     [aCoder encodeInteger:self.grammaticalNumber forKey:NSStringFromSelector(@selector(grammaticalNumber))];
+    [aCoder encodeBool:self.cachesResults forKey:NSStringFromSelector(@selector(cachesResults))];
 }
 
 @end
@@ -122,6 +122,17 @@
  */
 @property (nonatomic, assign) BOOL usesAbbreviatedCalendarUnits;
 
+///------------------------
+/// @name Caching Results
+///------------------------
+
+/**
+ Specifies whether to memoize the results of `stringForTimeInterval:` in `+[TTTFormatterCache sharedCache]`, shared with other formatters that have the same configuration. `NO` by default.
+
+ @discussion Intervals are truncated to whole seconds for the cache, and intervals within `presentTimeIntervalMargin` of the present are not cached. A cached result is one that was computed during the current minute. The configuration includes the calendar's identifier and time zone at the time that they were set, so changes to a calendar that has already been set are not seen.
+ */
+@property (nonatomic, assign) BOOL cachesResults;
+
 ///-------------------------
 /// @name Converting Objects
 ///-------------------------
@@ -22,6 +22,8 @@
 
 #import "TTTTimeIntervalFormatter.h"
 
+#import "TTTFormatterCache.h"
+
 #if (defined(__IPHONE_OS_VERSION_MAX_ALLOWED) && __IPHONE_OS_VERSION_MAX_ALLOWED >= 70000) || (defined(__MAC_OS_X_VERSION_MAX_ALLOWED) && __MAC_OS_X_VERSION_MAX_ALLOWED >= 1090)
     #define TTTCalendarUnitYear NSCalendarUnitYear
     #define TTTCalendarUnitMonth NSCalendarUnitMonth
@@ -70,7 +72,11 @@ static inline NSComparisonResult NSCalendarUnitCompareSignificance(NSCalendarUni
     }
 }
 
-@implementation TTTTimeIntervalFormatter
+@implementation TTTTimeIntervalFormatter {
+    NSString *_cacheConfiguration;
+    int64_t _cacheConfigurationMinute;
+}
+
 @synthesize locale = _locale;
 @synthesize calendar = _calendar;
 @synthesize pastDeicticExpression = _pastDeicticExpression;
@@ -86,6 +92,7 @@ static inline NSComparisonResult NSCalendarUnitCompareSignificance(NSCalendarUni
 @synthesize numberOfSignificantUnits = _numberOfSignificantUnits;
 @synthesize leastSignificantUnit = _leastSignificantUnit;
 @synthesize significantUnits = _significantUnits;
+@synthesize cachesResults = _cachesResults;
 
 - (id)init {
     self = [super init];
@@ -115,7 +122,25 @@ static inline NSComparisonResult NSCalendarUnitCompareSignificance(NSCalendarUni
 
 - (NSString *)stringForTimeInterval:(NSTimeInterval)seconds {
     NSDate *date = [NSDate date];
-    return [self stringForTimeIntervalFromDate:date toDate:[NSDate dateWithTimeInterval:seconds sinceDate:date]];
+
+    // Every interval that truncates to the same whole number of seconds gives the same components, and the same
+    // side of presentTimeIntervalMargin as long as the truncated value is outside it.
+    double truncated = trunc(seconds);
+    if (!self.cachesResults || !(fabs(truncated) >= self.presentTimeIntervalMargin && fabs(truncated) < 1e15)) {
+        return [self stringForTimeIntervalFromDate:date toDate:[NSDate dateWithTimeInterval:seconds sinceDate:date]];
+    }
+
+    TTTFormatterCache *cache = [TTTFormatterCache sharedCache];
+    NSString *configuration = [self cacheConfigurationForMinute:(int64_t)floor([date timeIntervalSinceReferenceDate] / 60.0)];
+    NSString *string = [cache stringForConfiguration:configuration input:(int64_t)truncated];
+    if (!string) {
+        string = [self stringForTimeIntervalFromDate:date toDate:[NSDate dateWithTimeInterval:seconds sinceDate:date]];
+        if (string) {
+            [cache setString:string forConfiguration:configuration input:(int64_t)truncated];
+        }
+    }
+
+    return string;
 }
 
 - (NSString *)stringForTimeIntervalFromDate:(NSDate *)startingDate
@@ -453,6 +478,120 @@ static inline NSComparisonResult NSCalendarUnitCompareSignificance(NSCalendarUni
     return nil;
 }
 
+#pragma mark - Caching
+
+/**
+ Everything that affects the result of `stringForTimeInterval:`, including the minute that "now" is in. This is rebuilt when a property changes (each setter clears it), or when the minute changes. It is built under `@synchronized(self)` so that concurrent callers don't race to replace it.
+ */
+- (NSString *)cacheConfigurationForMinute:(int64_t)minute {
+    @synchronized(self) {
+        if (!_cacheConfiguration || _cacheConfigurationMinute != minute) {
+            _cacheConfiguration = [NSString stringWithFormat:@"%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%@\x1f%a\x1f%d\x1f%d\x1f%lu\x1f%lu\x1f%lu\x1f%d\x1f%lld",
+                                   NSStringFromClass([self class]),
+                                   [self.locale localeIdentifier],
+                                   [self.calendar calendarIdentifier],
+                                   [[self.calendar timeZone] name],
+                                   self.pastDeicticExpression,
+                                   self.presentDeicticExpression,
+                                   self.futureDeicticExpression,
+                                   self.deicticExpressionFormat,
+                                   self.suffixExpressionFormat,
+                                   self.approximateQualifierFormat,
+                                   self.presentTimeIntervalMargin,
+                                   self.usesIdiomaticDeicticExpressions,
+                                   self.usesApproximateQualifier,
+                                   (unsigned long)self.significantUnits,
+                                   (unsigned long)self.numberOfSignificantUnits,
+                                   (unsigned long)self.leastSignificantUnit,
+                                   self.usesAbbreviatedCalendarUnits,
+                                   minute];
+            _cacheConfigurationMinute = minute;
+        }
+
+        return _cacheConfiguration;
+    }
+}
+
+- (void)setCachesResults:(BOOL)cachesResults {
+    _cachesResults = cachesResults;
+    _cacheConfiguration = nil;
+}
+
+- (void)setLocale:(NSLocale *)locale {
+    _locale = locale;
+    _cacheConfiguration = nil;
+}
+
+- (void)setCalendar:(NSCalendar *)calendar {
+    _calendar = calendar;
+    _cacheConfiguration = nil;
+}
+
+- (void)setPastDeicticExpression:(NSString *)pastDeicticExpression {
+    _pastDeicticExpression = [pastDeicticExpression copy];
+    _cacheConfiguration = nil;
+}
+
+- (void)setPresentDeicticExpression:(NSString *)presentDeicticExpression {
+    _presentDeicticExpression = [presentDeicticExpression copy];
+    _cacheConfiguration = nil;
+}
+
+- (void)setFutureDeicticExpression:(NSString *)futureDeicticExpression {
+    _futureDeicticExpression = [futureDeicticExpression copy];
+    _cacheConfiguration = nil;
+}
+
+- (void)setDeicticExpressionFormat:(NSString *)deicticExpressionFormat {
+    _deicticExpressionFormat = [deicticExpressionFormat copy];
+    _cacheConfiguration = nil;
+}
+
+- (void)setSuffixExpressionFormat:(NSString *)suffixExpressionFormat {
+    _suffixExpressionFormat = suffixExpressionFormat;
+    _cacheConfiguration = nil;
+}
+
+- (void)setApproximateQualifierFormat:(NSString *)approximateQualifierFormat {
+    _approximateQualifierFormat = [approximateQualifierFormat copy];
+    _cacheConfiguration = nil;
+}
+
+- (void)setPresentTimeIntervalMargin:(NSTimeInterval)presentTimeIntervalMargin {
+    _presentTimeIntervalMargin = presentTimeIntervalMargin;
+    _cacheConfiguration = nil;
+}
+
+- (void)setUsesIdiomaticDeicticExpressions:(BOOL)usesIdiomaticDeicticExpressions {
+    _usesIdiomaticDeicticExpressions = usesIdiomaticDeicticExpressions;
+    _cacheConfiguration = nil;
+}
+
+- (void)setUsesApproximateQualifier:(BOOL)usesApproximateQualifier {
+    _usesApproximateQualifier = usesApproximateQualifier;
+    _cacheConfiguration = nil;
+}
+
+- (void)setSignificantUnits:(NSUInteger)significantUnits {
+    _significantUnits = significantUnits;
+    _cacheConfiguration = nil;
+}
+
+- (void)setNumberOfSignificantUnits:(NSUInteger)numberOfSignificantUnits {
+    _numberOfSignificantUnits = numberOfSignificantUnits;
+    _cacheConfiguration = nil;
+}
+
+- (void)setLeastSignificantUnit:(NSCalendarUnit)leastSignificantUnit {
+    _leastSignificantUnit = leastSignificantUnit;
+    _cacheConfiguration = nil;
+}
+
+- (void)setUsesAbbreviatedCalendarUnits:(BOOL)usesAbbreviatedCalendarUnits {
+    _usesAbbreviatedCalendarUnits = usesAbbreviatedCalendarUnits;
+    _cacheConfiguration = nil;
+}
+
 #pragma mark - NSFormatter
 
 - (NSString *)stringForObjectValue:(id)anObject {
@@ -487,6 +626,7 @@ static inline NSComparisonResult NSCalendarUnitCompareSignificance(NSCalendarUni
     formatter.usesAbbreviatedCalendarUnits = self.usesAbbreviatedCalendarUnits;
     formatter.usesApproximateQualifier = self.usesApproximateQualifier;
     formatter.usesIdiomaticDeicticExpressions = self.usesIdiomaticDeicticExpressions;
+    formatter.cachesResults = self.cachesResults;
 
     return formatter;
 }
@@ -508,6 +648,7 @@ static inline NSComparisonResult NSCalendarUnitCompareSignificance(NSCalendarUni
     self.usesAbbreviatedCalendarUnits = [aDecoder decodeBoolForKey:NSStringFromSelector(@selector(usesAbbreviatedCalendarUnits))];
     self.usesApproximateQualifier = [aDecoder decodeBoolForKey:NSStringFromSelector(@selector(usesApproximateQualifier))];
     self.usesIdiomaticDeicticExpressions = [aDecoder decodeBoolForKey:NSStringFromSelector(@selector(usesIdiomaticDeicticExpressions))];
+    self.cachesResults = [aDecoder decodeBoolForKey:NSStringFromSelector(@selector(cachesResults))];
 #pragma clang diagnostic pop
 
     return self;
@@ -526,6 +667,7 @@ static inline NSComparisonResult NSCalendarUnitCompareSignificance(NSCalendarUni
     [aCoder encodeBool:self.usesAbbreviatedCalendarUnits forKey:NSStringFromSelector(@selector(usesAbbreviatedCalendarUnits))];
     [aCoder encodeBool:self.usesApproximateQualifier forKey:NSStringFromSelector(@selector(usesApproximateQualifier))];
     [aCoder encodeBool:self.usesIdiomaticDeicticExpressions forKey:NSStringFromSelector(@selector(usesIdiomaticDeicticExpressions))];
+    [aCoder encodeBool:self.cachesResults forKey:NSStringFromSelector(@selector(cachesResults))];
 }
 
 @end
@@ -55,6 +55,46 @@
  */
 + (NSString *)WgetCommandFromURLRequest:(NSURLRequest *)request;
 
+///--------------------------------------
+/// @name Writing Commands to Streams
+///--------------------------------------
+
+/**
+ Writes a `curl` command equivalent of the specified request object to a stream, a buffer at a time, so that requests with large bodies don't need the whole command in memory.
+
+ With a nil `bodyFileURL`, this writes exactly what `cURLCommandFromURLRequest:escape:` returns, as UTF-8. Otherwise the body is written to that file, and the command refers to it with `--data-binary "@file"`.
+
+ @param request The request to format.
+ @param escape Whether to escape the body (or body file path) for the shell.
+ @param bodyFileURL The file to write the body to, or nil to include the body in the command.
+ @param stream The stream to write to. It must already be open, and is left open.
+ @param error Set if writing the stream or the body file failed.
+
+ @return `YES` on success.
+ */
++ (BOOL)writeCURLCommandFromURLRequest:(NSURLRequest *)request
+                                escape:(BOOL)escape
+                           bodyFileURL:(NSURL *)bodyFileURL
+                              toStream:(NSOutputStream *)stream
+                                 error:(NSError *__autoreleasing *)error;
+
+/**
+ Writes a `wget` command equivalent of the specified request object to a stream, a buffer at a time.
+
+ With a nil `bodyFileURL`, this writes exactly what `WgetCommandFromURLRequest:` returns, as UTF-8. Otherwise the body is written to that file, and the command refers to it with `--post-file`, its path escaped for the shell.
+
+ @param request The request to format.
+ @param bodyFileURL The file to write the body to, or nil to include the body in the command.
+ @param stream The stream to write to. It must already be open, and is left open.
+ @param error Set if writing the stream or the body file failed.
+
+ @return `YES` on success.
+ */
++ (BOOL)writeWgetCommandFromURLRequest:(NSURLRequest *)request
+                           bodyFileURL:(NSURL *)bodyFileURL
+                              toStream:(NSOutputStream *)stream
+                                 error:(NSError *__autoreleasing *)error;
+
 @end
 
 #pragma mark -
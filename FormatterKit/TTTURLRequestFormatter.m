@@ -22,14 +22,248 @@
 
 #import "TTTURLRequestFormatter.h"
 
-@interface NSMutableString (TTTURLRequestFormatter)
-- (void)appendCommandLineArgument:(NSString *)arg;
+#define kTTTCommandWriterBufferSize 16384
+
+/**
+ Returns whether the given bytes are well-formed UTF-8, i.e. whether `-[NSString initWithData:encoding:]` would accept them as `NSUTF8StringEncoding`.
+ */
+static BOOL TTTIsValidUTF8(const uint8_t *bytes, NSUInteger length) {
+    NSUInteger i = 0;
+    while (i < length) {
+        uint8_t c = bytes[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+
+        NSUInteger n;
+        uint8_t lower = 0x80, upper = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+            if (c == 0xE0) {
+                lower = 0xA0;
+            } else if (c == 0xED) {
+                upper = 0x9F;
+            }
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+            if (c == 0xF0) {
+                lower = 0x90;
+            } else if (c == 0xF4) {
+                upper = 0x8F;
+            }
+        } else {
+            return NO;
+        }
+
+        if (length - i <= n || bytes[i + 1] < lower || bytes[i + 1] > upper) {
+            return NO;
+        }
+        for (NSUInteger j = 2; j <= n; j++) {
+            if ((bytes[i + j] & 0xC0) != 0x80) {
+                return NO;
+            }
+        }
+        i += n + 1;
+    }
+
+    return YES;
+}
+
+/**
+ Returns the length of the given UTF-8 bytes without any trailing characters in `+[NSCharacterSet whitespaceCharacterSet]`.
+ */
+static NSUInteger TTTLengthWithoutTrailingWhitespace(const uint8_t *bytes, NSUInteger length) {
+    NSCharacterSet *whitespace = [NSCharacterSet whitespaceCharacterSet];
+    while (length > 0) {
+        NSUInteger start = length - 1;
+        while (start > 0 && length - start < 4 && (bytes[start] & 0xC0) == 0x80) {
+            start--;
+        }
+
+        NSString *character = [[NSString alloc] initWithBytes:bytes + start length:length - start encoding:NSUTF8StringEncoding];
+        if ([character length] != 1 || ![whitespace characterIsMember:[character characterAtIndex:0]]) {
+            break;
+        }
+        length = start;
+    }
+
+    return length;
+}
+
+/**
+ Writes a command to a stream through a single reusable buffer, so that nothing the size of the command is held in memory.
+ */
+@interface TTTCommandWriter : NSObject
+@property (readonly, nonatomic, strong) NSError *streamError;
+
+- (id)initWithOutputStream:(NSOutputStream *)stream;
+- (void)appendBytes:(const void *)bytes length:(NSUInteger)length;
+- (void)appendString:(NSString *)string;
+- (BOOL)flush;
 @end
 
-@implementation NSMutableString (TTTURLRequestFormatter)
+@implementation TTTCommandWriter {
+    NSOutputStream *_stream;
+    uint8_t _buffer[kTTTCommandWriterBufferSize];
+    NSUInteger _length;
+}
+
+@synthesize streamError = _streamError;
+
+- (id)initWithOutputStream:(NSOutputStream *)stream {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    _stream = stream;
+
+    return self;
+}
+
+- (void)appendBytes:(const void *)bytes
+             length:(NSUInteger)length
+{
+    while (length > 0 && !_streamError) {
+        if (_length == kTTTCommandWriterBufferSize) {
+            [self flush];
+            continue;
+        }
+
+        NSUInteger n = MIN(length, kTTTCommandWriterBufferSize - _length);
+        memcpy(_buffer + _length, bytes, n);
+        _length += n;
+        bytes = (const uint8_t *)bytes + n;
+        length -= n;
+    }
+}
+
+/**
+ Appends the given string as UTF-8, or "(null)" if it is nil, as `%@` would.
+ */
+- (void)appendString:(NSString *)string {
+    if (!string) {
+        string = @"(null)";
+    }
+
+    NSRange remaining = NSMakeRange(0, [string length]);
+    while (remaining.length > 0 && !_streamError) {
+        NSUInteger used = 0;
+        NSRange left;
+        [string getBytes:_buffer + _length maxLength:kTTTCommandWriterBufferSize - _length usedLength:&used encoding:NSUTF8StringEncoding options:NSStringEncodingConversionAllowLossy range:remaining remainingRange:&left];
+        _length += used;
+        if (left.length == remaining.length) {
+            if (_length == 0) {
+                // Nothing fits even in an empty buffer, so this can't be converted.
+                break;
+            }
+            [self flush];
+        }
+        remaining = left;
+    }
+}
+
+/**
+ Appends the given string, with a backslash before each occurrence of `character`.
+ */
+- (void)appendString:(NSString *)string
+  escapingCharacter:(NSString *)character
+{
+    if (!string) {
+        [self appendString:nil];
+        return;
+    }
+
+    NSRange searchRange = NSMakeRange(0, [string length]);
+    NSRange found;
+    while ((found = [string rangeOfString:character options:NSLiteralSearch range:searchRange]).location != NSNotFound) {
+        [self appendString:[string substringWithRange:NSMakeRange(searchRange.location, found.location - searchRange.location)]];
+        [self appendBytes:"\\" length:1];
+        [self appendString:character];
+        searchRange = NSMakeRange(NSMaxRange(found), [string length] - NSMaxRange(found));
+    }
+    [self appendString:[string substringWithRange:searchRange]];
+}
+
+/**
+ Appends the given UTF-8 bytes, with a backslash before each `\`, `` ` ``, `"`, and `$` if `escape` is set. These are all ASCII, and so never part of a multibyte character.
+ */
+- (void)appendBytes:(const uint8_t *)bytes
+             length:(NSUInteger)length
+   escapingForShell:(BOOL)escape
+{
+    if (!escape) {
+        [self appendBytes:bytes length:length];
+        return;
+    }
+
+    NSUInteger runStart = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        uint8_t c = bytes[i];
+        if (c == '\\' || c == '`' || c == '"' || c == '$') {
+            [self appendBytes:bytes + runStart length:i - runStart];
+            [self appendBytes:"\\" length:1];
+            runStart = i;
+        }
+    }
+    [self appendBytes:bytes + runStart length:length - runStart];
+}
+
+/**
+ Starts a new argument on a new line. Arguments are trimmed of whitespace, but the only one that could start or end with any is the unquoted wget body, which is trimmed by the caller.
+ */
+- (void)appendArgumentPrefix:(NSString *)prefix {
+    [self appendBytes:"\n" length:1];
+    [self appendString:prefix];
+}
+
+- (void)appendHeaderFieldsOfRequest:(NSURLRequest *)request
+                         withPrefix:(NSString *)prefix
+{
+    for (id field in [request allHTTPHeaderFields]) {
+        [self appendArgumentPrefix:prefix];
+        [self appendBytes:"'" length:1];
+        [self appendString:field];
+        [self appendBytes:": " length:2];
+        [self appendString:[request valueForHTTPHeaderField:field] escapingCharacter:@"'"];
+        [self appendBytes:"'" length:1];
+    }
+}
+
+- (BOOL)flush {
+    if (_streamError) {
+        return NO;
+    }
+
+    NSUInteger offset = 0;
+    while (offset < _length) {
+        NSInteger n = [_stream write:_buffer + offset maxLength:_length - offset];
+        if (n <= 0) {
+            NSError *error = [_stream streamError];
+            _streamError = error ?: [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil];
+            return NO;
+        }
+        offset += (NSUInteger)n;
+    }
+
+    _length = 0;
+
+    return YES;
+}
+
+- (BOOL)finish:(NSError *__autoreleasing *)error {
+    if ([self flush]) {
+        return YES;
+    }
 
-- (void)appendCommandLineArgument:(NSString *)arg {
-    [self appendFormat:@"\n%@", [arg stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]]];
+    if (error) {
+        *error = _streamError;
+    }
+
+    return NO;
 }
 
 @end
@@ -48,58 +282,121 @@
 }
 + (NSString *)cURLCommandFromURLRequest:(NSURLRequest *)request escape:(BOOL)escape
 {
-    NSMutableString *command = [NSMutableString stringWithFormat:@"curl -X %@ \"%@\"", [request HTTPMethod], [[request URL] absoluteString]];
-    
-    if ([[request HTTPBody] length] > 0) {
-        NSMutableString *HTTPBodyString = [[NSMutableString alloc] initWithData:[request HTTPBody] encoding:NSUTF8StringEncoding];
-        if (escape) {
-            [HTTPBodyString replaceOccurrencesOfString:@"\\" withString:@"\\\\" options:0 range:NSMakeRange(0, [HTTPBodyString length])];
-            [HTTPBodyString replaceOccurrencesOfString:@"`" withString:@"\\`" options:0 range:NSMakeRange(0, [HTTPBodyString length])];
-            [HTTPBodyString replaceOccurrencesOfString:@"\"" withString:@"\\\"" options:0 range:NSMakeRange(0, [HTTPBodyString length])];
-            [HTTPBodyString replaceOccurrencesOfString:@"$" withString:@"\\$" options:0 range:NSMakeRange(0, [HTTPBodyString length])];
+    NSOutputStream *stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    [self writeCURLCommandFromURLRequest:request escape:escape bodyFileURL:nil toStream:stream error:nil];
+    [stream close];
+
+    return [[NSString alloc] initWithData:[stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey] encoding:NSUTF8StringEncoding];
+}
+
++ (NSString *)WgetCommandFromURLRequest:(NSURLRequest *)request {
+    NSOutputStream *stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    [self writeWgetCommandFromURLRequest:request bodyFileURL:nil toStream:stream error:nil];
+    [stream close];
+
+    return [[NSString alloc] initWithData:[stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey] encoding:NSUTF8StringEncoding];
+}
+
++ (BOOL)writeCURLCommandFromURLRequest:(NSURLRequest *)request
+                                escape:(BOOL)escape
+                           bodyFileURL:(NSURL *)bodyFileURL
+                              toStream:(NSOutputStream *)stream
+                                 error:(NSError *__autoreleasing *)error
+{
+    TTTCommandWriter *writer = [[TTTCommandWriter alloc] initWithOutputStream:stream];
+    [writer appendString:@"curl -X "];
+    [writer appendString:[request HTTPMethod]];
+    [writer appendBytes:" \"" length:2];
+    [writer appendString:[[request URL] absoluteString]];
+    [writer appendBytes:"\"" length:1];
+
+    NSData *HTTPBody = [request HTTPBody];
+    if ([HTTPBody length] > 0) {
+        if (bodyFileURL) {
+            if (![HTTPBody writeToURL:bodyFileURL options:NSDataWritingAtomic error:error]) {
+                return NO;
+            }
+
+            NSData *path = [[bodyFileURL path] dataUsingEncoding:NSUTF8StringEncoding];
+            [writer appendArgumentPrefix:@"--data-binary \"@"];
+            [writer appendBytes:[path bytes] length:[path length] escapingForShell:escape];
+            [writer appendBytes:"\"" length:1];
+        } else {
+            [writer appendArgumentPrefix:@"-d \""];
+            if (TTTIsValidUTF8([HTTPBody bytes], [HTTPBody length])) {
+                [writer appendBytes:[HTTPBody bytes] length:[HTTPBody length] escapingForShell:escape];
+            } else {
+                [writer appendString:@"(null)"];
+            }
+            [writer appendBytes:"\"" length:1];
         }
-        
-        [command appendCommandLineArgument:[NSString stringWithFormat:@"-d \"%@\"", HTTPBodyString]];
     }
 
-    for (id field in [request allHTTPHeaderFields]) {
-        [command appendCommandLineArgument:[NSString stringWithFormat:@"-H %@", [NSString stringWithFormat:@"'%@: %@'", field, [[request valueForHTTPHeaderField:field] stringByReplacingOccurrencesOfString:@"\'" withString:@"\\\'"]]]];
-    }
-    
+    [writer appendHeaderFieldsOfRequest:request withPrefix:@"-H "];
+
     if ([request URL]) {
         NSArray *cookies = [[NSHTTPCookieStorage sharedHTTPCookieStorage] cookiesForURL:[request URL]];
         for (NSHTTPCookie *cookie in cookies) {
-            [command appendCommandLineArgument:[NSString stringWithFormat:@"--cookie \"%@=%@\"", [cookie name], [cookie value]]];
+            [writer appendArgumentPrefix:@"--cookie \""];
+            [writer appendString:[cookie name]];
+            [writer appendBytes:"=" length:1];
+            [writer appendString:[cookie value]];
+            [writer appendBytes:"\"" length:1];
         }
     }
 
     NSString *acceptEncodingHeader = [[request allHTTPHeaderFields] valueForKey:@"Accept-Encoding"];
     if ([acceptEncodingHeader rangeOfString:@"gzip"].location != NSNotFound) {
-        [command appendCommandLineArgument:@"--compressed"];
+        [writer appendArgumentPrefix:@"--compressed"];
     }
-    
-    return [NSString stringWithString:command];
+
+    return [writer finish:error];
 }
 
-+ (NSString *)WgetCommandFromURLRequest:(NSURLRequest *)request {
++ (BOOL)writeWgetCommandFromURLRequest:(NSURLRequest *)request
+                           bodyFileURL:(NSURL *)bodyFileURL
+                              toStream:(NSOutputStream *)stream
+                                 error:(NSError *__autoreleasing *)error
+{
     if (!([[request HTTPMethod] isEqualToString:@"GET"] || [[request HTTPMethod] isEqualToString:@"POST"])) {
         [NSException raise:@"Invalid HTTP Method" format:@"Wget can only make GET and POST requests"];
     }
 
-    NSMutableString *command = [NSMutableString stringWithString:@"wget"];
+    TTTCommandWriter *writer = [[TTTCommandWriter alloc] initWithOutputStream:stream];
+    [writer appendString:@"wget"];
 
-    if ([[request HTTPBody] length] > 0) {
-        NSString *HTTPBodyString = [[NSString alloc] initWithData:[request HTTPBody] encoding:NSUTF8StringEncoding];
-        [command appendCommandLineArgument:[NSString stringWithFormat:@"-d %@", HTTPBodyString]];
-    }
+    NSData *HTTPBody = [request HTTPBody];
+    if ([HTTPBody length] > 0) {
+        if (bodyFileURL) {
+            if (![HTTPBody writeToURL:bodyFileURL options:NSDataWritingAtomic error:error]) {
+                return NO;
+            }
 
-    for (id field in [request allHTTPHeaderFields]) {
-        [command appendCommandLineArgument:[NSString stringWithFormat:@"--header=%@", [NSString stringWithFormat:@"'%@: %@'", field, [[request valueForHTTPHeaderField:field] stringByReplacingOccurrencesOfString:@"\'" withString:@"\\\'"]]]];
+            NSData *path = [[bodyFileURL path] dataUsingEncoding:NSUTF8StringEncoding];
+            [writer appendArgumentPrefix:@"--post-file=\""];
+            [writer appendBytes:[path bytes] length:[path length] escapingForShell:YES];
+            [writer appendBytes:"\"" length:1];
+        } else {
+            // The body isn't quoted, so it is trimmed of trailing whitespace like every other argument, and so is the space after -d if that is all there is.
+            if (TTTIsValidUTF8([HTTPBody bytes], [HTTPBody length])) {
+                NSUInteger length = TTTLengthWithoutTrailingWhitespace([HTTPBody bytes], [HTTPBody length]);
+                [writer appendArgumentPrefix:(length > 0 ? @"-d " : @"-d")];
+                [writer appendBytes:[HTTPBody bytes] length:length];
+            } else {
+                [writer appendArgumentPrefix:@"-d (null)"];
+            }
+        }
     }
 
-    [command appendCommandLineArgument:[NSString stringWithFormat:@"\"%@\"", [[request URL] absoluteString]]];
+    [writer appendHeaderFieldsOfRequest:request withPrefix:@"--header="];
+
+    [writer appendArgumentPrefix:@"\""];
+    [writer appendString:[[request URL] absoluteString]];
+    [writer appendBytes:"\"" length:1];
 
-    return [NSString stringWithString:command];
+    return [writer finish:error];
 }
 
 @end
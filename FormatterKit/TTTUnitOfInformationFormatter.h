@@ -56,9 +56,16 @@ typedef enum {
 
 /**
  Specifies the `NSNumberFormatter` object used to format numeric values in all formatted strings. By default, this uses the `NSNumberFormatterDecimalStyle` number style, and sets a rounding increment of `0.01f`.
+
+ @discussion The receiver reads the settings of this formatter when it is first needed, and formats most values arithmetically if they match the default ones. It observes the formatter, so changes made to it later are seen too.
  */
 @property (nonatomic, readonly) NSNumberFormatter *numberFormatter;
 
+/**
+ Tells the receiver to read the settings of `numberFormatter` again. Changes to `numberFormatter`'s own settings are seen without this; it is only needed if something else that affects its output changes, such as the process's localizations.
+ */
+- (void)numberFormatterDidChange;
+
 ///-------------------------------
 /// @name Configuring Use of Bytes
 ///-------------------------------
@@ -82,6 +89,17 @@ typedef enum {
  */
 @property (nonatomic, assign) BOOL usesIECBinaryPrefixesForDisplay;
 
+///------------------------
+/// @name Caching Results
+///------------------------
+
+/**
+ Specifies whether to memoize results in `+[TTTFormatterCache sharedCache]`, shared with other formatters that have the same configuration. Only whole numbers of bits are cached. `NO` by default.
+
+ @discussion The configuration includes the settings of `numberFormatter`, and is rebuilt whenever they change.
+ */
+@property (nonatomic, assign) BOOL cachesResults;
+
 ///-------------------------
 /// @name Converting Objects
 ///-------------------------
@@ -113,4 +131,13 @@ typedef enum {
                         ofUnit:(TTTUnitOfInformation)unit
                     withPrefix:(TTTUnitPrefix)prefix;
 
+/**
+ Returns string representations of the given numbers of bytes formatted using the receiver’s current settings. This is equivalent to calling `stringFromNumber:ofUnit:` with `TTTByte` for each, but is faster for large batches, such as the sizes in a file list.
+
+ @param numbersOfBytes The numbers of bytes to format.
+ @param count The number of entries in `numbersOfBytes`.
+ */
+- (NSArray *)stringsFromNumbersOfBytes:(const uint64_t *)numbersOfBytes
+                                 count:(NSUInteger)count;
+
 @end
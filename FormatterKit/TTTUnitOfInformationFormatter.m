@@ -22,6 +22,10 @@
 
 #import "TTTUnitOfInformationFormatter.h"
 
+#import <libkern/OSAtomic.h>
+
+#import "TTTFormatterCache.h"
+
 static inline NSUInteger TTTNumberOfBitsInUnit(TTTUnitOfInformation unit) {
     switch (unit) {
         case TTTBit:
@@ -139,15 +143,284 @@ static inline NSString * TTTByteUnitStringForSIPrefix(TTTUnitPrefix prefix) {
     }
 }
 
+static inline TTTUnitPrefix TTTPrefixForInteger(const double *scaleFactors, NSUInteger value) {
+    for (TTTUnitPrefix prefix = TTTExa; prefix > TTTKilo; prefix--) {
+        if (scaleFactors[prefix] < value) {
+            return prefix;
+        }
+    }
+
+    return TTTKilo;
+}
+
+#pragma mark -
+
+/**
+ The rounding increment that `init` gives `numberFormatter`, as it reads it back.
+ */
+static const double TTTRoundingIncrement = (double)0.01f;
+
+#define TTTMaximumSeparatorLength 4
+#define TTTMaximumSuffixLength 24
+#define TTTNumberOfUnitStrings (TTTExa + 2)
+
+static volatile int32_t TTTCurrentLocaleGeneration = 0;
+
+/**
+ What `numberFormatter` and the localized unit strings would produce, captured once so that common values can be formatted without them. `isFast` is `NO` if `numberFormatter` doesn't format the probe values the way that `TTTWriteValue` does (for example if it has been reconfigured, or the locale uses other digits), in which case every value goes through `numberFormatter`.
+ */
+@interface TTTUnitOfInformationNumberFormat : NSObject {
+@public
+    int32_t localeGeneration;
+    BOOL isFast;
+    BOOL displaysInTermsOfBytes;
+    double scaleFactors[TTTExa + 1];
+    unichar decimalSeparator[TTTMaximumSeparatorLength];
+    NSUInteger decimalSeparatorLength;
+    unichar groupingSeparator[TTTMaximumSeparatorLength];
+    NSUInteger groupingSeparatorLength;
+    // Index 0 is bytes or bits, and index prefix + 1 is that prefix.  The length is NSNotFound if the unit has no suffix that the fast path can use.
+    unichar suffixes[TTTNumberOfUnitStrings][TTTMaximumSuffixLength];
+    NSUInteger suffixLengths[TTTNumberOfUnitStrings];
+}
+
+- (id)initWithFormatter:(TTTUnitOfInformationFormatter *)formatter;
+
+@end
+
+static inline unichar *TTTWriteDigits(unichar *buffer, uint32_t value, NSUInteger minimumDigits) {
+    unichar digits[10];
+    NSUInteger count = 0;
+    do {
+        digits[count++] = (unichar)('0' + value % 10);
+        value /= 10;
+    } while (value != 0 || count < minimumDigits);
+
+    while (count > 0) {
+        *buffer++ = digits[--count];
+    }
+
+    return buffer;
+}
+
+/**
+ Writes value as `numberFormatter` would, if it is a decimal style formatter rounding to 0.01 with the given separators. Values below 10,000 are supported.
+
+ @return The number of characters written, or 0 if value needs `numberFormatter`. This includes values within a hair of a rounding tie, because `numberFormatter` rounds in decimal rather than binary, and so may go the other way.
+ */
+static NSUInteger TTTWriteValue(TTTUnitOfInformationNumberFormat *format, double value, unichar *buffer) {
+    if (!(value >= 0.0 && value < 10000.0)) {
+        return 0;
+    }
+
+    double steps = value / TTTRoundingIncrement;
+    double whole = floor(steps);
+    double fraction = steps - whole;
+    if (fabs(fraction - 0.5) < 1e-6) {
+        return 0;
+    }
+
+    uint32_t hundredths = (uint32_t)whole + (fraction > 0.5 ? 1 : 0);
+    uint32_t integer = hundredths / 100;
+    uint32_t fractional = hundredths % 100;
+    if (integer >= 10000) {
+        return 0;
+    }
+
+    unichar *p = buffer;
+    if (integer >= 1000) {
+        p = TTTWriteDigits(p, integer / 1000, 1);
+        memcpy(p, format->groupingSeparator, format->groupingSeparatorLength * sizeof(unichar));
+        p += format->groupingSeparatorLength;
+        p = TTTWriteDigits(p, integer % 1000, 3);
+    } else {
+        p = TTTWriteDigits(p, integer, 1);
+    }
+
+    if (fractional != 0) {
+        memcpy(p, format->decimalSeparator, format->decimalSeparatorLength * sizeof(unichar));
+        p += format->decimalSeparatorLength;
+        *p++ = (unichar)('0' + fractional / 10);
+        if (fractional % 10 != 0) {
+            *p++ = (unichar)('0' + fractional % 10);
+        }
+    }
+
+    return (NSUInteger)(p - buffer);
+}
+
+/**
+ The same as `-[TTTUnitOfInformationFormatter numberFormatterStringFromNumberOfBits:]`, but without `NSNumberFormatter` or any allocation other than the result.
+
+ @return The formatted string, or nil if this value needs the slow path.
+ */
+static NSString *TTTFastStringFromNumberOfBits(TTTUnitOfInformationNumberFormat *format, double bits) {
+    if (!format->isFast || !(bits >= 0.0 && bits < 18446744073709551616.0)) {
+        return nil;
+    }
+
+    double doubleValue = bits;
+    if (format->displaysInTermsOfBytes) {
+        doubleValue /= TTTNumberOfBitsInUnit(TTTByte);
+    }
+
+    NSUInteger unitIndex = 0;
+    if (!(doubleValue < format->scaleFactors[TTTKilo])) {
+        TTTUnitPrefix prefix = TTTPrefixForInteger(format->scaleFactors, (NSUInteger)round(doubleValue));
+        doubleValue /= format->scaleFactors[prefix];
+        unitIndex = prefix + 1;
+    }
+
+    NSUInteger suffixLength = format->suffixLengths[unitIndex];
+    if (suffixLength == NSNotFound) {
+        return nil;
+    }
+
+    unichar buffer[64];
+    NSUInteger length = TTTWriteValue(format, doubleValue, buffer);
+    if (length == 0) {
+        return nil;
+    }
+
+    memcpy(buffer + length, format->suffixes[unitIndex], suffixLength * sizeof(unichar));
+
+    return [[NSString alloc] initWithCharacters:buffer length:length + suffixLength];
+}
+
+static BOOL TTTCopySeparator(NSString *string, NSRange range, unichar *separator, NSUInteger *separatorLength) {
+    if (range.length > TTTMaximumSeparatorLength) {
+        return NO;
+    }
+
+    [string getCharacters:separator range:range];
+    *separatorLength = range.length;
+
+    return YES;
+}
+
+@implementation TTTUnitOfInformationNumberFormat
+
+- (id)initWithFormatter:(TTTUnitOfInformationFormatter *)formatter {
+    self = [super init];
+    if (!self) {
+        return nil;
+    }
+
+    localeGeneration = TTTCurrentLocaleGeneration;
+    displaysInTermsOfBytes = formatter.displaysInTermsOfBytes;
+    for (TTTUnitPrefix prefix = TTTKilo; prefix <= TTTExa; prefix++) {
+        scaleFactors[prefix] = formatter.usesIECBinaryPrefixesForCalculation ? TTTScaleFactorForIECPrefix(prefix) : TTTScaleFactorForSIPrefix(prefix);
+    }
+
+    NSString *formatString = NSLocalizedStringWithDefaultValue(@"Unit of Information Format String", @"FormatterKit", [NSBundle mainBundle], @"%@ %@", @"#{Value} #{Unit}");
+    BOOL usesSpaceSeparatedFormat = [formatString isEqualToString:@"%@ %@"];
+    for (NSUInteger i = 0; i < TTTNumberOfUnitStrings; i++) {
+        NSString *unitString;
+        if (i == 0) {
+            unitString = displaysInTermsOfBytes ? NSLocalizedStringFromTable(@"bytes", @"FormatterKit", @"Byte Unit") : NSLocalizedStringFromTable(@"bits", @"FormatterKit", @"Bit Unit");
+        } else if (displaysInTermsOfBytes) {
+            unitString = formatter.usesIECBinaryPrefixesForDisplay ? TTTByteUnitStringForIECPrefix((TTTUnitPrefix)(i - 1)) : TTTByteUnitStringForSIPrefix((TTTUnitPrefix)(i - 1));
+        } else {
+            unitString = formatter.usesIECBinaryPrefixesForDisplay ? TTTBitUnitStringForIECPrefix((TTTUnitPrefix)(i - 1)) : TTTBitUnitStringForSIPrefix((TTTUnitPrefix)(i - 1));
+        }
+
+        if (usesSpaceSeparatedFormat && unitString && [unitString length] < TTTMaximumSuffixLength) {
+            suffixes[i][0] = ' ';
+            [unitString getCharacters:suffixes[i] + 1 range:NSMakeRange(0, [unitString length])];
+            suffixLengths[i] = [unitString length] + 1;
+        } else {
+            suffixLengths[i] = NSNotFound;
+        }
+    }
+
+    isFast = [self matchesNumberFormatter:formatter.numberFormatter];
+
+    return self;
+}
+
+/**
+ Learns the separators from one probe, and then checks that `TTTWriteValue` agrees with `numberFormatter` on some others.
+ */
+- (BOOL)matchesNumberFormatter:(NSNumberFormatter *)numberFormatter {
+    NSString *probe = [numberFormatter stringFromNumber:@1234.5678];
+    if ([probe length] < 7 || ![probe hasPrefix:@"1"] || ![probe hasSuffix:@"57"]) {
+        return NO;
+    }
+
+    NSRange hundreds = [probe rangeOfString:@"234" options:(NSStringCompareOptions)0 range:NSMakeRange(1, [probe length] - 3)];
+    if (hundreds.location == NSNotFound || hundreds.location + 3 >= [probe length] - 2) {
+        return NO;
+    }
+
+    if (!TTTCopySeparator(probe, NSMakeRange(1, hundreds.location - 1), groupingSeparator, &groupingSeparatorLength) ||
+        !TTTCopySeparator(probe, NSMakeRange(hundreds.location + 3, [probe length] - 2 - (hundreds.location + 3)), decimalSeparator, &decimalSeparatorLength))
+    {
+        return NO;
+    }
+
+    for (NSNumber *value in @[@0, @1, @0.5, @0.994, @7.25, @12.3, @1.0546875, @999.999, @1000, @1023.75, @4096.1]) {
+        unichar buffer[64];
+        NSUInteger length = TTTWriteValue(self, [value doubleValue], buffer);
+        if (length == 0 || ![[numberFormatter stringFromNumber:value] isEqualToString:[[NSString alloc] initWithCharacters:buffer length:length]]) {
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+@end
+
+#pragma mark -
+
 @interface TTTUnitOfInformationFormatter ()
 @property (readwrite, nonatomic, strong) NSNumberFormatter *numberFormatter;
 @end
 
-@implementation TTTUnitOfInformationFormatter
+static void * TTTUnitOfInformationNumberFormatterContext = &TTTUnitOfInformationNumberFormatterContext;
+
+/**
+ The `NSNumberFormatter` settings that can change its output. The receiver observes all of them on `numberFormatter`, so that a change made in place is seen without `numberFormatterDidChange`.
+ */
+static NSArray * TTTObservedNumberFormatterKeys() {
+    static NSArray *_keys = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        _keys = @[@"locale", @"numberStyle", @"formatterBehavior",
+                  @"positiveFormat", @"negativeFormat", @"positivePrefix", @"positiveSuffix", @"negativePrefix", @"negativeSuffix",
+                  @"minimumIntegerDigits", @"maximumIntegerDigits", @"minimumFractionDigits", @"maximumFractionDigits",
+                  @"usesSignificantDigits", @"minimumSignificantDigits", @"maximumSignificantDigits",
+                  @"roundingIncrement", @"roundingMode", @"multiplier",
+                  @"usesGroupingSeparator", @"groupingSeparator", @"groupingSize", @"secondaryGroupingSize",
+                  @"decimalSeparator", @"alwaysShowsDecimalSeparator",
+                  @"formatWidth", @"paddingCharacter", @"paddingPosition",
+                  @"zeroSymbol", @"minusSign", @"plusSign", @"exponentSymbol",
+                  @"currencyCode", @"currencySymbol", @"internationalCurrencySymbol", @"percentSymbol", @"perMillSymbol"];
+    });
+
+    return _keys;
+}
+
+@implementation TTTUnitOfInformationFormatter {
+    NSString *_cacheConfiguration;
+    TTTUnitOfInformationNumberFormat *_numberFormat;
+}
+
 @synthesize displaysInTermsOfBytes = _displaysInTermsOfBytes;
 @synthesize usesIECBinaryPrefixesForCalculation = _usesIECBinaryPrefixesForCalculation;
 @synthesize usesIECBinaryPrefixesForDisplay = _usesIECBinaryPrefixesForDisplay;
 @synthesize numberFormatter = _numberFormatter;
+@synthesize cachesResults = _cachesResults;
+
++ (void)initialize {
+    if (self != [TTTUnitOfInformationFormatter class]) {
+        return;
+    }
+
+    [[NSNotificationCenter defaultCenter] addObserverForName:NSCurrentLocaleDidChangeNotification object:nil queue:nil usingBlock:^(__unused NSNotification *note) {
+        OSAtomicIncrement32Barrier(&TTTCurrentLocaleGeneration);
+    }];
+}
 
 - (id)init {
     self = [super init];
@@ -155,9 +428,10 @@ static inline NSString * TTTByteUnitStringForSIPrefix(TTTUnitPrefix prefix) {
         return nil;
     }
 
-    _numberFormatter = [[NSNumberFormatter alloc] init];
-    [_numberFormatter setNumberStyle:NSNumberFormatterDecimalStyle];
-    [_numberFormatter setRoundingIncrement:@(0.01f)];
+    NSNumberFormatter *numberFormatter = [[NSNumberFormatter alloc] init];
+    [numberFormatter setNumberStyle:NSNumberFormatterDecimalStyle];
+    [numberFormatter setRoundingIncrement:@(0.01f)];
+    self.numberFormatter = numberFormatter;
 
     self.displaysInTermsOfBytes = YES;
     self.usesIECBinaryPrefixesForCalculation = YES;
@@ -166,6 +440,10 @@ static inline NSString * TTTByteUnitStringForSIPrefix(TTTUnitPrefix prefix) {
     return self;
 }
 
+- (void)dealloc {
+    [self stopObservingNumberFormatter];
+}
+
 #pragma mark -
 
 - (double)scaleFactorForPrefix:(TTTUnitPrefix)prefix {
@@ -191,6 +469,36 @@ static inline NSString * TTTByteUnitStringForSIPrefix(TTTUnitPrefix prefix) {
 #pragma mark -
 
 - (NSString *)stringFromNumberOfBits:(NSNumber *)number {
+    return [self stringFromBits:[number doubleValue] numberFormat:[self numberFormat]];
+}
+
+- (NSString *)stringFromBits:(double)bits
+                numberFormat:(TTTUnitOfInformationNumberFormat *)numberFormat
+{
+    if (!self.cachesResults || !(bits >= 0 && bits < 9.2e18 && bits == floor(bits))) {
+        return [self uncachedStringFromBits:bits numberFormat:numberFormat];
+    }
+
+    TTTFormatterCache *cache = [TTTFormatterCache sharedCache];
+    NSString *configuration = [self cacheConfiguration];
+    NSString *string = [cache stringForConfiguration:configuration input:(int64_t)bits];
+    if (!string) {
+        string = [self uncachedStringFromBits:bits numberFormat:numberFormat];
+        [cache setString:string forConfiguration:configuration input:(int64_t)bits];
+    }
+
+    return string;
+}
+
+- (NSString *)uncachedStringFromBits:(double)bits
+                        numberFormat:(TTTUnitOfInformationNumberFormat *)numberFormat
+{
+    NSString *string = TTTFastStringFromNumberOfBits(numberFormat, bits);
+
+    return string ?: [self numberFormatterStringFromNumberOfBits:@(bits)];
+}
+
+- (NSString *)numberFormatterStringFromNumberOfBits:(NSNumber *)number {
     NSString *unitString = nil;
     double doubleValue = [number doubleValue];
 
@@ -217,7 +525,7 @@ static inline NSString * TTTByteUnitStringForSIPrefix(TTTUnitPrefix prefix) {
 - (NSString *)stringFromNumber:(NSNumber *)number
                         ofUnit:(TTTUnitOfInformation)unit
 {
-    return [self stringFromNumberOfBits:@([number unsignedLongLongValue] * TTTNumberOfBitsInUnit(unit))];
+    return [self stringFromBits:(double)([number unsignedLongLongValue] * TTTNumberOfBitsInUnit(unit)) numberFormat:[self numberFormat]];
 }
 
 - (NSString *)stringFromNumber:(NSNumber *)number
@@ -227,6 +535,127 @@ static inline NSString * TTTByteUnitStringForSIPrefix(TTTUnitPrefix prefix) {
     return [self stringFromNumber:@([self scaleFactorForPrefix:prefix] * [number unsignedIntegerValue]) ofUnit:unit];
 }
 
+- (NSArray *)stringsFromNumbersOfBytes:(const uint64_t *)numbersOfBytes
+                                 count:(NSUInteger)count
+{
+    TTTUnitOfInformationNumberFormat *numberFormat = [self numberFormat];
+    NSMutableArray *strings = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [strings addObject:[self stringFromBits:(double)(numbersOfBytes[i] * TTTNumberOfBitsInUnit(TTTByte)) numberFormat:numberFormat]];
+    }
+
+    return strings;
+}
+
+#pragma mark - Fast Path
+
+/**
+ The captured state for `TTTFastStringFromNumberOfBits`. Like `cacheConfiguration`, this is rebuilt when a property changes, and also when the current locale changes.
+ */
+- (TTTUnitOfInformationNumberFormat *)numberFormat {
+    @synchronized(self) {
+        if (!_numberFormat || _numberFormat->localeGeneration != TTTCurrentLocaleGeneration) {
+            _numberFormat = [[TTTUnitOfInformationNumberFormat alloc] initWithFormatter:self];
+        }
+
+        return _numberFormat;
+    }
+}
+
+- (void)numberFormatterDidChange {
+    @synchronized(self) {
+        _numberFormat = nil;
+        _cacheConfiguration = nil;
+    }
+}
+
+- (void)startObservingNumberFormatter {
+    for (NSString *key in TTTObservedNumberFormatterKeys()) {
+        [_numberFormatter addObserver:self forKeyPath:key options:0 context:TTTUnitOfInformationNumberFormatterContext];
+    }
+}
+
+- (void)stopObservingNumberFormatter {
+    for (NSString *key in TTTObservedNumberFormatterKeys()) {
+        [_numberFormatter removeObserver:self forKeyPath:key context:TTTUnitOfInformationNumberFormatterContext];
+    }
+}
+
+- (void)observeValueForKeyPath:(NSString *)keyPath
+                      ofObject:(id)object
+                        change:(NSDictionary *)change
+                       context:(void *)context
+{
+    if (context == TTTUnitOfInformationNumberFormatterContext) {
+        [self numberFormatterDidChange];
+    } else {
+        [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+    }
+}
+
+#pragma mark - Caching
+
+/**
+ Everything that affects the result of `stringFromNumberOfBits:`. This is rebuilt when a property changes (each setter clears it, and so does any change to `numberFormatter`, which is observed). It is built under `@synchronized(self)` so that concurrent callers don't race to replace it.
+ */
+- (NSString *)cacheConfiguration {
+    @synchronized(self) {
+        if (!_cacheConfiguration) {
+            NSNumberFormatter *numberFormatter = self.numberFormatter;
+            _cacheConfiguration = [NSString stringWithFormat:@"%@\x1f%d\x1f%d\x1f%d\x1f%@\x1f%@\x1f%@\x1f%lu\x1f%@\x1f%@\x1f%d\x1f%@\x1f%@\x1f%lu\x1f%@",
+                                   NSStringFromClass([self class]),
+                                   self.displaysInTermsOfBytes,
+                                   self.usesIECBinaryPrefixesForCalculation,
+                                   self.usesIECBinaryPrefixesForDisplay,
+                                   [[numberFormatter locale] localeIdentifier],
+                                   [numberFormatter positiveFormat],
+                                   [numberFormatter roundingIncrement],
+                                   (unsigned long)[numberFormatter roundingMode],
+                                   [numberFormatter decimalSeparator],
+                                   [numberFormatter groupingSeparator],
+                                   [numberFormatter usesGroupingSeparator],
+                                   [numberFormatter multiplier],
+                                   [numberFormatter zeroSymbol],
+                                   (unsigned long)[numberFormatter formatWidth],
+                                   [numberFormatter paddingCharacter]];
+        }
+
+        return _cacheConfiguration;
+    }
+}
+
+- (void)setCachesResults:(BOOL)cachesResults {
+    _cachesResults = cachesResults;
+    _cacheConfiguration = nil;
+    _numberFormat = nil;
+}
+
+- (void)setDisplaysInTermsOfBytes:(BOOL)displaysInTermsOfBytes {
+    _displaysInTermsOfBytes = displaysInTermsOfBytes;
+    _cacheConfiguration = nil;
+    _numberFormat = nil;
+}
+
+- (void)setUsesIECBinaryPrefixesForCalculation:(BOOL)usesIECBinaryPrefixesForCalculation {
+    _usesIECBinaryPrefixesForCalculation = usesIECBinaryPrefixesForCalculation;
+    _cacheConfiguration = nil;
+    _numberFormat = nil;
+}
+
+- (void)setUsesIECBinaryPrefixesForDisplay:(BOOL)usesIECBinaryPrefixesForDisplay {
+    _usesIECBinaryPrefixesForDisplay = usesIECBinaryPrefixesForDisplay;
+    _cacheConfiguration = nil;
+    _numberFormat = nil;
+}
+
+- (void)setNumberFormatter:(NSNumberFormatter *)numberFormatter {
+    [self stopObservingNumberFormatter];
+    _numberFormatter = numberFormatter;
+    [self startObservingNumberFormatter];
+    _cacheConfiguration = nil;
+    _numberFormat = nil;
+}
+
 #pragma mark - NSFormatter
 
 - (NSString *)stringForObjectValue:(id)obj {
@@ -255,6 +684,7 @@ static inline NSString * TTTByteUnitStringForSIPrefix(TTTUnitPrefix prefix) {
     formatter.displaysInTermsOfBytes = self.displaysInTermsOfBytes;
     formatter.usesIECBinaryPrefixesForCalculation = self.usesIECBinaryPrefixesForCalculation;
     formatter.usesIECBinaryPrefixesForDisplay = self.usesIECBinaryPrefixesForDisplay;
+    formatter.cachesResults = self.cachesResults;
 
     return formatter;
 }
@@ -270,6 +700,7 @@ static inline NSString * TTTByteUnitStringForSIPrefix(TTTUnitPrefix prefix) {
     self.displaysInTermsOfBytes = [aDecoder decodeBoolForKey:NSStringFromSelector(@selector(displaysInTermsOfBytes))];
     self.usesIECBinaryPrefixesForCalculation = [aDecoder decodeBoolForKey:NSStringFromSelector(@selector(usesIECBinaryPrefixesForCalculation))];
     self.usesIECBinaryPrefixesForDisplay = [aDecoder decodeBoolForKey:NSStringFromSelector(@selector(usesIECBinaryPrefixesForDisplay))];
+    self.cachesResults = [aDecoder decodeBoolForKey:NSStringFromSelector(@selector(cachesResults))];
 #pragma clang diagnostic pop
     
     return self;
@@ -282,6 +713,7 @@ static inline NSString * TTTByteUnitStringForSIPrefix(TTTUnitPrefix prefix) {
     [aCoder encodeBool:self.displaysInTermsOfBytes forKey:NSStringFromSelector(@selector(displaysInTermsOfBytes))];
     [aCoder encodeBool:self.usesIECBinaryPrefixesForCalculation forKey:NSStringFromSelector(@selector(usesIECBinaryPrefixesForCalculation))];
     [aCoder encodeBool:self.usesIECBinaryPrefixesForDisplay forKey:NSStringFromSelector(@selector(usesIECBinaryPrefixesForDisplay))];
+    [aCoder encodeBool:self.cachesResults forKey:NSStringFromSelector(@selector(cachesResults))];
 }
 
 @end
@@ -6,6 +6,8 @@
 //  Copyright (c) 2012 Mysterious Trousers. All rights reserved.
 //
 
+#import "ComplexKeyPath.h"
+
 #import "NSObject+MTJSONUtils.h"
 
 
@@ -34,57 +36,9 @@
 
 - (id)valueForComplexKeyPath:(NSString *)keyPath {
 
-	id currentObject = self;
-
-	NSMutableString *path			= [NSMutableString string];
-	NSMutableString *subscriptKey	= [NSMutableString string];
-	NSMutableString *string			= path;
-
-	for (NSUInteger i = 0; i < keyPath.length; i++) {
-
-		unichar c = [keyPath characterAtIndex:i];
-
-		if (c == '[') {
-			NSString *trimmedPath = [path stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@". \n"]];
-			currentObject = [currentObject valueForKeyPath:trimmedPath];
-			[subscriptKey setString:@""];
-			string = subscriptKey;
-			continue;
-		}
-
-		if (c == ']') {
-			if (!currentObject) return nil;
-			if (![currentObject isKindOfClass:[NSArray class]]) return nil;
-            NSArray * currentArray = currentObject;
-			NSUInteger index = 0;
-			if ([subscriptKey isEqualToString:@"first"]) {
-				index = 0;
-			}
-			else if ([subscriptKey isEqualToString:@"last"]) {
-				index = [currentArray count] - 1;
-			}
-			else {
-				index = [subscriptKey intValue];
-			}
-            if ([currentArray count] == 0) return nil;
-			if (index > [currentArray count] - 1) return nil;
-			currentObject = [currentArray objectAtIndex:index];
-			if ([currentObject isKindOfClass:[NSNull class]]) return nil;
-			[path setString:@""];
-			string = path;
-			continue;
-		}
-
-		[string appendString:[NSString stringWithCharacters:&c length:1]];
-
-		if (i == keyPath.length - 1) {
-			NSString *trimmedPath = [path stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@". \n"]];
-			currentObject = [currentObject valueForKeyPath:trimmedPath];
-			break;
-		}
-	}
-
-	return currentObject;
+	// The path is compiled once and cached; see ComplexKeyPath.
+	if (keyPath.length == 0) return self;
+	return [[ComplexKeyPath keyPathWithString:keyPath] valueForObject:self];
 }
 
 - (NSString *)stringValueForComplexKeyPath:(NSString *)key {
@@ -20,7 +20,11 @@
 - (NSString *)IDNAEncodedString;
 - (NSString *)IDNADecodedString;
 
-// These methods currently expect self to start with a valid scheme.
+// These methods split self into components per RFC 3986 (see URLParser.h), so self should be an absolute URL
+// or a network-path reference ("//host/path").  The host (or for URLs such as mailto: with no authority part,
+// the domain after the last '@') is IDNA encoded or decoded, and the path and query are percent encoded or
+// decoded.  Components that don't need changing are copied as-is, and if nothing needs changing then the
+// result is equal to self.
 - (NSString *)encodedURLString;
 - (NSString *)decodedURLString;
 
@@ -11,388 +11,391 @@
 
 #import "NSStringPunycodeAdditions.h"
 
-// Encoding/decoding adapted/lifted from the example code in the IDNA Punycode spec (RFC 3492).
-// For some other stuff, see RFC 3490 (Internationalizing Domain Names in Applications)
-
-enum {
-	base = 36,
-	tmin = 1,
-	tmax = 26,
-	skew = 38,
-	damp = 700,
-	initial_bias = 72,
-	initial_n = 0x80,
-	delimiter = '-'
-};
-
-/* basic(cp) tests whether cp is a basic code point: */
-#define basic(cp) ((unsigned)(cp) < 0x80)
-
-/* delim(cp) tests whether cp is a delimiter: */
-#define delim(cp) ((cp) == delimiter)
-
-/* decode_digit(cp) returns the numeric value of a basic code */
-/* point (for use in representing integers) in the range 0 to */
-/* base-1, or base if cp is does not represent a value.       */
-
-static NSUInteger decode_digit(unsigned cp)
-{
-	return  cp - 48 < 10 ? cp - 22 :  cp - 65 < 26 ? cp - 65 :
-	cp - 97 < 26 ? cp - 97 : base;
+#import "LRUCache.h"
+#import "PunycodeCore.h"
+#import "URLParser.h"
+
+// The Punycode and IDNA encoding and decoding is done by PunycodeCore.c, on code point buffers.
+// This file converts to and from NSString, using stack buffers where the strings are short enough,
+// and caches the IDNA results for hostnames, because the same domains turn up over and over again.
+
+#define STACK_BUFFER_LENGTH 256
+#define HOSTNAME_CACHE_COUNT_LIMIT 1000
+
+static LRUCache *IDNAEncodeCache(void) {
+	static LRUCache *cache;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		cache = [[LRUCache alloc] initWithCountLimit:HOSTNAME_CACHE_COUNT_LIMIT];
+	});
+	return cache;
 }
 
-/* encode_digit(d,flag) returns the basic code point whose value      */
-/* (when used for representing integers) is d, which needs to be in   */
-/* the range 0 to base-1.  The lowercase form is used unless flag is  */
-/* nonzero, in which case the uppercase form is used.  The behavior   */
-/* is undefined if flag is nonzero and digit d has no uppercase form. */
-
-static char encode_digit(unsigned d, int flag)
-{
-	return (char)(d + 22 + 75 * (d < 26) - ((flag != 0) << 5));
-	/*  0..25 map to ASCII a..z or A..Z */
-	/* 26..35 map to ASCII 0..9         */
+static LRUCache *IDNADecodeCache(void) {
+	static LRUCache *cache;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		cache = [[LRUCache alloc] initWithCountLimit:HOSTNAME_CACHE_COUNT_LIMIT];
+	});
+	return cache;
 }
 
-/* flagged(bcp) tests whether a basic code point is flagged */
-/* (uppercase).  The behavior is undefined if bcp is not a  */
-/* basic code point.                                        */
+/**
+ * Convert s to UTF-32 code points.  The result is written to stackBuf if it fits in STACK_BUFFER_LENGTH,
+ * otherwise it is malloc'd and the caller must free it if it is not equal to stackBuf.
+ * Unpaired surrogates are passed through as-is.
+ */
+static uint32_t *codePointsOfString(NSString *s, uint32_t *stackBuf, size_t *count) {
+	CFIndex len = CFStringGetLength((__bridge CFStringRef)s);
+	uint32_t *result = (len <= STACK_BUFFER_LENGTH ? stackBuf : malloc(len * sizeof(uint32_t)));
+	if (result == NULL)
+		return NULL;
+
+	CFStringInlineBuffer inlineBuffer;
+	CFStringInitInlineBuffer((__bridge CFStringRef)s, &inlineBuffer, CFRangeMake(0, len));
+
+	size_t n = 0;
+	for (CFIndex i = 0; i < len; i++) {
+		UniChar c = CFStringGetCharacterFromInlineBuffer(&inlineBuffer, i);
+		if (CFStringIsSurrogateHighCharacter(c) && i + 1 < len) {
+			UniChar c2 = CFStringGetCharacterFromInlineBuffer(&inlineBuffer, i + 1);
+			if (CFStringIsSurrogateLowCharacter(c2)) {
+				result[n++] = (uint32_t)CFStringGetLongCharacterForSurrogatePair(c, c2);
+				i++;
+				continue;
+			}
+		}
+		result[n++] = c;
+	}
 
-#define flagged(bcp) ((unsigned)(bcp) - 65 < 26)
+	*count = n;
+	return result;
+}
 
-/*** Platform-specific constants ***/
+static NSString *stringWithCodePoints(const uint32_t *codePoints, size_t count) {
+	UniChar stackBuf[STACK_BUFFER_LENGTH * 2];
+	UniChar *buf = (count <= STACK_BUFFER_LENGTH ? stackBuf : malloc(count * 2 * sizeof(UniChar)));
+	if (buf == NULL)
+		return nil;
+
+	size_t n = 0;
+	for (size_t i = 0; i < count; i++) {
+		uint32_t c = codePoints[i];
+		if (c > 0xFFFF) {
+			UniChar surrogates[2];
+			CFStringGetSurrogatePairForLongCharacter(c, surrogates);
+			buf[n++] = surrogates[0];
+			buf[n++] = surrogates[1];
+		}
+		else
+			buf[n++] = (UniChar)c;
+	}
 
-/* maxint is the maximum value of a punycode_uint variable: */
-static const unsigned maxint = UINT_MAX;
+	NSString *result = [[NSString alloc] initWithCharacters:buf length:n];
+	if (buf != stackBuf)
+		free(buf);
 
-/*** Bias adaptation function ***/
+#if __has_feature(objc_arc)
+	return result;
+#else
+	return [result autorelease];
+#endif
+}
 
-static NSUInteger adapt(unsigned delta, unsigned numpoints, BOOL firsttime) {
-	unsigned k;
-	
-	delta = firsttime ? delta / damp : delta >> 1;
-	delta += delta / numpoints;
-	
-	for (k = 0;  delta > ((base - tmin) * tmax) / 2;  k += base) {
-		delta /= base - tmin;
+static BOOL isASCII(NSString *s) {
+	CFIndex len = CFStringGetLength((__bridge CFStringRef)s);
+	CFStringInlineBuffer inlineBuffer;
+	CFStringInitInlineBuffer((__bridge CFStringRef)s, &inlineBuffer, CFRangeMake(0, len));
+	for (CFIndex i = 0; i < len; i++) {
+		if (CFStringGetCharacterFromInlineBuffer(&inlineBuffer, i) >= 0x80)
+			return NO;
 	}
-	
-	return k + (base - tmin + 1) * delta / (delta + skew);
+	return YES;
 }
 
-@interface NSString (PunycodePrivate)
+typedef punycode_status (*EncodeFunc)(const uint32_t *, size_t, char *, size_t *);
+typedef punycode_status (*DecodeFunc)(const uint32_t *, size_t, uint32_t *, size_t *);
+
+/**
+ * Run encoder over the code points of s, producing an ASCII string.  The output goes into a stack buffer,
+ * and we only fall back to the heap if the output is too big for that.
+ */
+static NSString *encodeString(NSString *s, EncodeFunc encoder) {
+	uint32_t stackInput[STACK_BUFFER_LENGTH];
+	size_t inputLength;
+	uint32_t *input = codePointsOfString(s, stackInput, &inputLength);
+	if (input == NULL)
+		return nil;
+
+	char stackOutput[STACK_BUFFER_LENGTH * 4];
+	char *output = stackOutput;
+	size_t capacity = sizeof(stackOutput);
+	NSString *result = nil;
+
+	while (true) {
+		size_t outputLength = capacity;
+		punycode_status status = encoder(input, inputLength, output, &outputLength);
+		if (status == punycode_success) {
+			result = [[NSString alloc] initWithBytes:output length:outputLength encoding:NSASCIIStringEncoding];
+#if !__has_feature(objc_arc)
+			[result autorelease];
+#endif
+			break;
+		}
+		if (status != punycode_big_output)
+			break;
+
+		if (output != stackOutput)
+			free(output);
+		capacity *= 2;
+		output = malloc(capacity);
+		if (output == NULL)
+			break;
+	}
 
-- (NSDictionary *)URLParts;
+	if (output != stackOutput)
+		free(output);
+	if (input != stackInput)
+		free(input);
 
-@end
+	return result;
+}
 
-@implementation NSString (PunycodeAdditions)
+/**
+ * Run decoder over the code points of s.  Neither Punycode nor IDNA decoding can produce more code points
+ * than they consume, so the output buffer is the same size as the input.
+ */
+static NSString *decodeString(NSString *s, DecodeFunc decoder) {
+	uint32_t stackInput[STACK_BUFFER_LENGTH];
+	size_t inputLength;
+	uint32_t *input = codePointsOfString(s, stackInput, &inputLength);
+	if (input == NULL)
+		return nil;
+
+	uint32_t stackOutput[STACK_BUFFER_LENGTH];
+	uint32_t *output = (inputLength <= STACK_BUFFER_LENGTH ? stackOutput : malloc(inputLength * sizeof(uint32_t)));
+	NSString *result = nil;
+
+	if (output != NULL) {
+		size_t outputLength = inputLength;
+		if (decoder(input, inputLength, output, &outputLength) == punycode_success)
+			result = stringWithCodePoints(output, outputLength);
+		if (output != stackOutput)
+			free(output);
+	}
 
-/*** Main encode function ***/
+	if (input != stackInput)
+		free(input);
 
-#if BYTE_ORDER == LITTLE_ENDIAN
-#define UTF32_ENCODING NSUTF32LittleEndianStringEncoding
-#elif BYTE_ORDER == BIG_ENDIAN
-#define UTF32_ENCODING NSUTF32BigEndianStringEncoding
-#else
-#error Unsupported endianness!
-#endif
-
-- (const UTF32Char *)longCharactersWithCount:(NSUInteger *)count {
-	NSData *data = [self dataUsingEncoding:UTF32_ENCODING];
-	*count = [data length] / sizeof(UTF32Char);
-	return [data bytes];
+	return result;
 }
 
-- (NSString *)punycodeEncodedString {
-	NSMutableString *ret = [NSMutableString string];
-	unsigned delta, outLen, bias, j, m, q, k, t;
-	NSUInteger input_length;
-	const UTF32Char *longchars = [self longCharactersWithCount:&input_length];	
-	
-	UTF32Char n = initial_n;
-	delta = outLen = 0;
-	bias = initial_bias;
-		
-	for (j = 0;  j < input_length;  ++j) {
-		if (basic(longchars[j])) {
-			[ret appendFormat:@"%C", (unichar)longchars[j]];
-			++outLen;
-		}
-	}
-	
-	NSUInteger b;
-	NSUInteger h = b = outLen;
-	
-	if (b > 0)
-		[ret appendFormat:@"%C", (unichar)delimiter];
-	
-	/* Main encoding loop: */
-	
-	while (h < input_length) {
-		for (m = maxint, j = 0;  j < input_length;  ++j) {
-			unsigned c = longchars[j];
-			
-			if (c >= n && c < m)
-				m = longchars[j];
+/**
+ * punycode_decode takes ASCII input; this adapts it to DecodeFunc by rejecting anything else.
+ */
+static punycode_status punycodeDecodeCodePoints(const uint32_t *input, size_t inputLength, uint32_t *output, size_t *outputLength) {
+	char stackBuf[STACK_BUFFER_LENGTH];
+	char *buf = (inputLength <= STACK_BUFFER_LENGTH ? stackBuf : malloc(inputLength));
+	if (buf == NULL)
+		return punycode_big_output;
+
+	punycode_status status = punycode_success;
+	for (size_t i = 0; i < inputLength; i++) {
+		if (input[i] >= 0x80) {
+			status = punycode_bad_input;
+			break;
 		}
-		
-		if (m - n > (maxint - delta) / (h + 1))
-			return nil; //punycode_overflow;
-		delta += (m - n) * (h + 1);
-		n = m;
-		
-		for (j = 0;  j < input_length;  ++j) {
-			unsigned c = longchars[j];
-			
-			if (c < n /* || basic([self characterAtIndex:j]) */ ) {
-				if (++delta == 0)
-					return nil; //punycode_overflow;
-			}
-			
-			if (c == n) {				
-				for (q = delta, k = base;  ;  k += base) {
-					t = k <= bias /* + tmin */ ? tmin :     /* +tmin not needed */
-						k >= bias + tmax ? tmax : k - bias;
-					if (q < t)
-						break;
-					[ret appendFormat:@"%C", (unichar)encode_digit(t + (q - t) % (base - t), 0)];
-					q = (q - t) / (base - t);
-				}
-				
-				[ret appendFormat:@"%c", encode_digit(q, 0)];
-				bias = (unsigned)adapt(delta, (unsigned)h + 1, h == b);
-				delta = 0;
-				++h;
-			}
-		}
-		
-		++delta, ++n;
+		buf[i] = (char)input[i];
 	}
-	
-	return ret;
+	if (status == punycode_success)
+		status = punycode_decode(buf, inputLength, output, outputLength);
+
+	if (buf != stackBuf)
+		free(buf);
+	return status;
 }
 
-/*** Main decode function ***/
+/**
+ * For a URL with no authority part, such as mailto:user@host, the domain is the part of the path after the last '@'.
+ * This sets *local to the part of the path up to and including the '@', and *domain to the rest.
+ * @return NO if there is no authority part and no '@' in the path.
+ */
+static BOOL opaqueMailboxRanges(NSString *url, const URLRanges *ranges, NSRange *local, NSRange *domain) {
+	if (ranges->host.location != NSNotFound || ranges->path.length == 0)
+		return NO;
+	NSRange at = [url rangeOfString:@"@" options:NSBackwardsSearch | NSLiteralSearch range:ranges->path];
+	if (at.location == NSNotFound)
+		return NO;
+	*local = NSMakeRange(ranges->path.location, NSMaxRange(at) - ranges->path.location);
+	*domain = NSMakeRange(NSMaxRange(at), NSMaxRange(ranges->path) - NSMaxRange(at));
+	return YES;
+}
 
-- (NSString *)punycodeDecodedString {
-	NSUInteger b, i, j;
-	
-	NSMutableData *utf32data = [NSMutableData data];
-	
-	/* Initialize the state: */
-	NSUInteger input_length = [self length];
-	UTF32Char n = initial_n;
-	NSUInteger outLen = i = 0;
-	NSUInteger max_out = NSUIntegerMax;
-	NSUInteger bias = initial_bias;
-	
-	for (b = j = 0;  j < input_length;  ++j)
-		if (delim([self characterAtIndex:j]))
-			b = j;
-	
-	if (b > max_out)
-		return nil; //punycode_big_output;
-	
-	for (j = 0;  j < b;  ++j) {
-		UTF32Char c = (UTF32Char)[self characterAtIndex:j];
-		
-		if (!basic([self characterAtIndex:j]))
-			return nil; //punycode_bad_input;
-		
-		[utf32data appendBytes:&c length:sizeof(c)];
-		++outLen;
+static BOOL rangeHasACEPrefix(NSString *url, NSRange range) {
+	return range.location != NSNotFound && [url rangeOfString:@"xn--" options:NSCaseInsensitiveSearch | NSLiteralSearch range:range].location != NSNotFound;
+}
+
+static NSUInteger copyRange(unichar *dest, NSString *url, NSRange range) {
+	[url getCharacters:dest range:range];
+	return range.length;
+}
+
+static NSUInteger copyString(unichar *dest, NSString *s) {
+	return copyRange(dest, s, NSMakeRange(0, [s length]));
+}
+
+static NSUInteger copyPercentEncodedIfNeeded(unichar *dest, NSString *url, NSRange range) {
+	return (URLRangeNeedsPercentEncoding(url, range) ?
+			URLPercentEncodeRange(url, range, dest) :
+			copyRange(dest, url, range));
+}
+
+static NSUInteger copyPercentDecodedIfNeeded(unichar *dest, NSString *url, NSRange range) {
+	if (URLRangeHasPercentEscapes(url, range)) {
+		NSString *decoded = [[url substringWithRange:range] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+		if (decoded != nil)
+			return copyString(dest, decoded);
 	}
-	
-	for (NSUInteger inPos = b > 0 ? b + 1 : 0; inPos < input_length; ++outLen, ++i) {
-		NSUInteger k, w, t, oldi;
-		
-		for (oldi = i, w = 1, k = base; /* nada */ ; k += base) {
-			if (inPos >= input_length)
-				return nil; // punycode_bad_input;
-			unsigned digit = (unsigned)decode_digit([self characterAtIndex:inPos++]);
-			if (digit >= base)
-				return nil; // punycode_bad_input;
-			if (digit > (maxint - i) / w)
-				return nil; // punycode_overflow;
-			i += digit * w;
-			t = k <= bias /* + tmin */ ? tmin :     /* +tmin not needed */
-				k >= bias + tmax ? tmax : k - bias;
-			if (digit < t)
-				break;
-			if (w > maxint / (base - t))
-				return nil; // punycode_overflow;
-			w *= (base - t);
+	return copyRange(dest, url, range);
+}
+
+typedef NSUInteger (*RangeTransform)(unichar *dest, NSString *url, NSRange range);
+
+/**
+ * Put the URL back together again, with the given replacement host (or nil to leave the host alone),
+ * and with transform applied to the path (or mailbox local part) and query.
+ */
+static NSString *reassembleURL(NSString *url, const URLRanges *ranges, NSString *host, BOOL isMailbox, NSRange mailboxLocal, NSRange mailboxDomain, NSUInteger capacity, RangeTransform transform) {
+	unichar stackBuf[STACK_BUFFER_LENGTH * 4];
+	unichar *buf = (capacity <= sizeof(stackBuf) / sizeof(unichar) ? stackBuf : malloc(capacity * sizeof(unichar)));
+	if (buf == NULL)
+		return nil;
+
+	NSUInteger n = 0;
+	if (ranges->scheme.location != NSNotFound) {
+		n += copyRange(buf + n, url, ranges->scheme);
+		buf[n++] = ':';
+	}
+	if (ranges->host.location != NSNotFound) {
+		buf[n++] = '/';
+		buf[n++] = '/';
+		if (ranges->userinfo.location != NSNotFound) {
+			n += copyRange(buf + n, url, ranges->userinfo);
+			buf[n++] = '@';
+		}
+		n += (host == nil ? copyRange(buf + n, url, ranges->host) : copyString(buf + n, host));
+		if (ranges->port.location != NSNotFound) {
+			buf[n++] = ':';
+			n += copyRange(buf + n, url, ranges->port);
 		}
-		
-		bias = adapt((unsigned)i - (unsigned)oldi, (unsigned)outLen + 1, oldi == 0);
-		
-		if (i / (outLen + 1) > maxint - n)
-			return nil; // punycode_overflow;
-		n += i / (outLen + 1);
-		i %= (outLen + 1);
-		
-		[utf32data replaceBytesInRange:NSMakeRange(i * sizeof(UTF32Char), 0) withBytes:&n length:sizeof(n)];
 	}
-	
+	if (isMailbox) {
+		n += transform(buf + n, url, mailboxLocal);
+		n += (host == nil ? copyRange(buf + n, url, mailboxDomain) : copyString(buf + n, host));
+	}
+	else
+		n += transform(buf + n, url, ranges->path);
+	if (ranges->query.location != NSNotFound) {
+		buf[n++] = '?';
+		n += transform(buf + n, url, ranges->query);
+	}
+	if (ranges->fragment.location != NSNotFound) {
+		buf[n++] = '#';
+		n += copyRange(buf + n, url, ranges->fragment);
+	}
+
+	NSString *result = [[NSString alloc] initWithCharacters:buf length:n];
+	if (buf != stackBuf)
+		free(buf);
 #if __has_feature(objc_arc)
-	return [[NSString alloc] initWithData:utf32data encoding:UTF32_ENCODING];
+	return result;
 #else
-	return [[[NSString alloc] initWithData:utf32data encoding:UTF32_ENCODING] autorelease];
+	return [result autorelease];
 #endif
 }
 
+@implementation NSString (PunycodeAdditions)
+
+- (NSString *)punycodeEncodedString {
+	return encodeString(self, punycode_encode);
+}
+
+- (NSString *)punycodeDecodedString {
+	return decodeString(self, punycodeDecodeCodePoints);
+}
+
 - (NSString *)IDNAEncodedString {
-	NSCharacterSet *nonAscii = [[NSCharacterSet characterSetWithRange:NSMakeRange(1, 127)] invertedSet];
-	NSMutableString *ret = [NSMutableString string];
-	NSScanner *s = [NSScanner scannerWithString:[self precomposedStringWithCompatibilityMapping]];
-	NSCharacterSet *dotAt = [NSCharacterSet characterSetWithCharactersInString:@".@"];
-	NSString *input = nil;
-	
-	while (![s isAtEnd]) {
-		if ([s scanUpToCharactersFromSet:dotAt intoString:&input]) {
-			if ([input rangeOfCharacterFromSet:nonAscii].location != NSNotFound) {
-				[ret appendFormat:@"xn--%@", [input punycodeEncodedString]];
-			} else
-				[ret appendString:input];
-		}
-		
-		if ([s scanCharactersFromSet:dotAt intoString:&input])
-			[ret appendString:input];
-	}
-		
+	if (isASCII(self))
+		return [NSString stringWithString:self];
+
+	LRUCache *cache = IDNAEncodeCache();
+	NSString *ret = [cache objectForKey:self];
+	if (ret != nil)
+		return ret;
+
+	ret = encodeString([self precomposedStringWithCompatibilityMapping], idna_encode);
+	if (ret != nil)
+		[cache setObject:ret forKey:self];
 	return ret;
 }
 
 - (NSString *)IDNADecodedString {
-	NSMutableString *ret = [NSMutableString string];
-	NSScanner *s = [NSScanner scannerWithString:self];
-	NSCharacterSet *dotAt = [NSCharacterSet characterSetWithCharactersInString:@".@"];
-	NSString *input = nil;
-	
-	while (![s isAtEnd]) {
-		if ([s scanUpToCharactersFromSet:dotAt intoString:&input]) {
-			if ([[input lowercaseString] hasPrefix:@"xn--"]) {
-				NSString *substr = [[input substringFromIndex:4] punycodeDecodedString];
-				
-				if (substr)
-					[ret appendString:substr];
-			} else
-				[ret appendString:input];
-		}
-		
-		if ([s scanCharactersFromSet:dotAt intoString:&input])
-			[ret appendString:input];
-	}
-	
-	return ret;
-}
+	if ([self rangeOfString:@"xn--" options:NSCaseInsensitiveSearch | NSLiteralSearch].location == NSNotFound)
+		return [NSString stringWithString:self];
 
-- (NSDictionary *)URLParts {
-	NSCharacterSet *colonSlash = [NSCharacterSet characterSetWithCharactersInString:@":/"];
-	NSScanner *s = [NSScanner scannerWithString:[self precomposedStringWithCompatibilityMapping]];
-	NSString *scheme = @"";
-	NSString *delim = @"";
-	NSString *username = nil;
-	NSString *password = nil;
-	NSString *host = @"";
-	NSString *path = @"";
-	NSString *fragment = nil;
-	
-	if ([s scanUpToCharactersFromSet:colonSlash intoString:&host]) {
-		if (![s isAtEnd] && [self characterAtIndex:[s scanLocation]] == ':') {
-			scheme = host;
-			
-			if (![s isAtEnd])
-				[s scanCharactersFromSet:colonSlash intoString:&delim];
-			if (![s isAtEnd])
-				[s scanUpToCharactersFromSet:colonSlash intoString:&host];
-		}
-	}
-	
-	if (![s isAtEnd])
-		[s scanUpToString:@"#" intoString:&path];
+	LRUCache *cache = IDNADecodeCache();
+	NSString *ret = [cache objectForKey:self];
+	if (ret != nil)
+		return ret;
 
-	if (![s isAtEnd]) {
-		[s scanString:@"#" intoString:nil];
-		[s scanUpToCharactersFromSet:[NSCharacterSet newlineCharacterSet] intoString:&fragment];
-	}
-	
-	NSCharacterSet *colonAt = [NSCharacterSet characterSetWithCharactersInString:@":@"];
-	
-	s = [NSScanner scannerWithString:host];
-	NSString *temp = nil;
-	
-	if ([s scanUpToCharactersFromSet:colonAt intoString:&temp]) {
-		if (![s isAtEnd]) {
-			username = temp;
-			
-			if ([host characterAtIndex:[s scanLocation]] == ':') {
-				[s scanCharactersFromSet:colonAt intoString:&temp];
-								
-				if (![s isAtEnd] && [s scanUpToCharactersFromSet:colonAt intoString:&temp])
-					password = temp;
-			}
-			
-			[s scanCharactersFromSet:colonAt intoString:nil];
-						
-			if (![s isAtEnd] && [s scanUpToCharactersFromSet:colonAt intoString:&temp])
-				host = temp;
-		}
-	}
-	
-	NSMutableDictionary *parts = [NSMutableDictionary dictionaryWithObjectsAndKeys:
-								  scheme,	@"scheme",
-								  delim,	@"delim",
-								  host,		@"host",
-								  path,		@"path",
-								  nil];
-	
-	if (username)
-		parts[@"username"] = username;
-	if (password)
-		parts[@"password"] = password;
-	if (fragment)
-		parts[@"fragment"] = fragment;
-	
-	return parts;
+	ret = decodeString(self, idna_decode);
+	if (ret != nil)
+		[cache setObject:ret forKey:self];
+	return ret;
 }
 
 - (NSString *)encodedURLString {
-	// We can't get the parts of an URL for an international domain name, so a custom method is used instead.
-	NSDictionary *urlParts = [self URLParts];
-	NSString *path = urlParts[@"path"];
-	path = (__bridge_transfer NSString *)CFURLCreateStringByAddingPercentEscapes(NULL, (__bridge CFStringRef)path, CFSTR("%"), NULL, kCFStringEncodingUTF8);
-	
-#if !__has_feature(objc_arc)
-	[path autorelease];
-#endif
-	
-	NSMutableString *ret = [NSMutableString stringWithFormat:@"%@%@", urlParts[@"scheme"], urlParts[@"delim"]];
-	if (urlParts[@"username"]) {
-		if (urlParts[@"password"])
-			[ret appendFormat:@"%@:%@@", urlParts[@"username"], urlParts[@"password"]];
-		else
-			[ret appendFormat:@"%@@", urlParts[@"username"]];
-	}
-	
-	[ret appendFormat:@"%@%@", [urlParts[@"host"] IDNAEncodedString], path];
-	
-	if (urlParts[@"fragment"])
-		[ret appendFormat:@"#%@", urlParts[@"fragment"]];
-			
-	return ret;
+	// We can't get the parts of an URL for an international domain name using NSURL, so we parse it ourselves,
+	// and only touch the host and the path and query if they need it.
+	// The whole URL is precomposed, not just the host, so that the path and query are percent-encoded in
+	// their precomposed form.  All-ASCII strings are unchanged by that, so they skip it.
+	NSString *url = (isASCII(self) ? self : [self precomposedStringWithCompatibilityMapping]);
+
+	URLRanges ranges;
+	parseURLRanges(url, &ranges);
+
+	NSRange mailboxLocal, mailboxDomain;
+	BOOL isMailbox = opaqueMailboxRanges(url, &ranges, &mailboxLocal, &mailboxDomain);
+	NSRange hostRange = (isMailbox ? mailboxDomain : ranges.host);
+
+	NSString *host = (URLRangeHasNonASCII(url, hostRange) ? [[url substringWithRange:hostRange] IDNAEncodedString] : nil);
+	if (host == nil &&
+		!URLRangeNeedsPercentEncoding(url, ranges.path) &&
+		!URLRangeNeedsPercentEncoding(url, ranges.query))
+		return [NSString stringWithString:url];
+
+	// Percent-encoding can expand each character to 9, and the encoded host is separate.
+	NSUInteger capacity = 9 * [url length] + [host length] + 8;
+	return reassembleURL(url, &ranges, host, isMailbox, mailboxLocal, mailboxDomain, capacity, copyPercentEncodedIfNeeded);
 }
 
 - (NSString *)decodedURLString {
-	NSDictionary *urlParts = [self URLParts];
-	
-	NSString *ret = [NSString stringWithFormat:@"%@%@%@%@", urlParts[@"scheme"], urlParts[@"delim"], [urlParts[@"host"] IDNADecodedString], [urlParts[@"path"] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
-	
-	if (urlParts[@"fragment"])
-		ret = [ret stringByAppendingFormat:@"#%@", urlParts[@"fragment"]];
-	
-	return ret;
+	URLRanges ranges;
+	parseURLRanges(self, &ranges);
+
+	NSRange mailboxLocal, mailboxDomain;
+	BOOL isMailbox = opaqueMailboxRanges(self, &ranges, &mailboxLocal, &mailboxDomain);
+	NSRange hostRange = (isMailbox ? mailboxDomain : ranges.host);
+
+	NSString *host = (rangeHasACEPrefix(self, hostRange) ? [[self substringWithRange:hostRange] IDNADecodedString] : nil);
+	if (host == nil &&
+		!URLRangeHasPercentEscapes(self, ranges.path) &&
+		!URLRangeHasPercentEscapes(self, ranges.query))
+		return [NSString stringWithString:self];
+
+	// Percent-decoding only ever shrinks things, and the decoded host is separate.
+	NSUInteger capacity = [self length] + [host length] + 8;
+	return reassembleURL(self, &ranges, host, isMailbox, mailboxLocal, mailboxDomain, capacity, copyPercentDecodedIfNeeded);
 }
 
 @end
@@ -0,0 +1,366 @@
+//
+//  PunycodeCore.c
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/24/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+//  The Punycode encoder and decoder are adapted from the sample implementation in RFC 3492,
+//  as was the original code in NSStringPunycodeAdditions.m.
+//
+
+#include <string.h>
+
+#include "PunycodeCore.h"
+
+
+enum {
+    base = 36,
+    tmin = 1,
+    tmax = 26,
+    skew = 38,
+    damp = 700,
+    initial_bias = 72,
+    initial_n = 0x80,
+    delimiter = '-'
+};
+
+#define maxint ((uint32_t)UINT32_MAX)
+
+#define basic(cp) ((uint32_t)(cp) < 0x80)
+
+#define is_label_separator(cp) ((cp) == '.' || (cp) == '@')
+
+#define ACE_PREFIX "xn--"
+#define ACE_PREFIX_LEN 4
+
+
+/**
+ * @return The numeric value of a basic code point (for use in representing integers) in the range 0 to base - 1,
+ * or base if cp does not represent a value.
+ */
+static uint32_t decode_digit(uint32_t cp) {
+    return (cp - 48 < 10 ? cp - 22 :
+            cp - 65 < 26 ? cp - 65 :
+            cp - 97 < 26 ? cp - 97 :
+            base);
+}
+
+
+/**
+ * @return The lowercase basic code point whose value is d, which must be in the range 0 to base - 1.
+ * 0..25 map to ASCII a..z, 26..35 map to ASCII 0..9.
+ */
+static char encode_digit(uint32_t d) {
+    return (char)(d + 22 + 75 * (d < 26));
+}
+
+
+static uint32_t adapt(uint32_t delta, uint32_t numpoints, int firsttime) {
+    uint32_t k;
+
+    delta = firsttime ? delta / damp : delta >> 1;
+    delta += delta / numpoints;
+
+    for (k = 0; delta > ((base - tmin) * tmax) / 2; k += base) {
+        delta /= base - tmin;
+    }
+
+    return k + (base - tmin + 1) * delta / (delta + skew);
+}
+
+
+int punycode_has_non_ascii(const uint32_t * input, size_t input_length) {
+    for (size_t i = 0; i < input_length; i++) {
+        if (!basic(input[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+punycode_status punycode_encode(const uint32_t * input, size_t input_length, char * output, size_t * output_length) {
+    size_t max_out = *output_length;
+    size_t out = 0;
+
+    if (input_length > maxint - 1) {
+        return punycode_overflow;
+    }
+
+    for (size_t j = 0; j < input_length; j++) {
+        if (basic(input[j])) {
+            if (out >= max_out) {
+                return punycode_big_output;
+            }
+            output[out++] = (char)input[j];
+        }
+    }
+
+    uint32_t b = (uint32_t)out;
+    uint32_t h = b;
+
+    if (b > 0) {
+        if (out >= max_out) {
+            return punycode_big_output;
+        }
+        output[out++] = delimiter;
+    }
+
+    uint32_t n = initial_n;
+    uint32_t delta = 0;
+    uint32_t bias = initial_bias;
+
+    while (h < input_length) {
+        uint32_t m = maxint;
+        for (size_t j = 0; j < input_length; j++) {
+            if (input[j] >= n && input[j] < m) {
+                m = input[j];
+            }
+        }
+
+        if (m - n > (maxint - delta) / (h + 1)) {
+            return punycode_overflow;
+        }
+        delta += (m - n) * (h + 1);
+        n = m;
+
+        for (size_t j = 0; j < input_length; j++) {
+            uint32_t c = input[j];
+            if (c < n) {
+                if (++delta == 0) {
+                    return punycode_overflow;
+                }
+            }
+
+            if (c == n) {
+                uint32_t q = delta;
+                for (uint32_t k = base; ; k += base) {
+                    if (out >= max_out) {
+                        return punycode_big_output;
+                    }
+                    uint32_t t = (k <= bias ? tmin :
+                                  k >= bias + tmax ? tmax :
+                                  k - bias);
+                    if (q < t) {
+                        break;
+                    }
+                    output[out++] = encode_digit(t + (q - t) % (base - t));
+                    q = (q - t) / (base - t);
+                }
+
+                output[out++] = encode_digit(q);
+                bias = adapt(delta, h + 1, h == b);
+                delta = 0;
+                h++;
+            }
+        }
+
+        delta++;
+        n++;
+    }
+
+    *output_length = out;
+    return punycode_success;
+}
+
+
+/**
+ * The input is either a char or a uint32_t array, depending on wide.  This is so that idna_decode can decode
+ * labels in place without first copying them into a char buffer.
+ */
+static inline uint32_t input_at(const void * input, int wide, size_t j) {
+    return wide ? ((const uint32_t *)input)[j] : (unsigned char)((const char *)input)[j];
+}
+
+
+static punycode_status decode(const void * input, int wide, size_t input_length, uint32_t * output, size_t * output_length) {
+    size_t max_out = *output_length;
+    size_t out = 0;
+
+    // b is the position of the last delimiter, or 0 if there is none.
+    size_t b = 0;
+    for (size_t j = 0; j < input_length; j++) {
+        if (input_at(input, wide, j) == delimiter) {
+            b = j;
+        }
+    }
+    if (b > max_out) {
+        return punycode_big_output;
+    }
+
+    for (size_t j = 0; j < b; j++) {
+        uint32_t c = input_at(input, wide, j);
+        if (!basic(c)) {
+            return punycode_bad_input;
+        }
+        output[out++] = c;
+    }
+
+    uint32_t n = initial_n;
+    uint32_t i = 0;
+    uint32_t bias = initial_bias;
+
+    for (size_t in = (b > 0 ? b + 1 : 0); in < input_length; out++) {
+        uint32_t oldi = i;
+        uint32_t w = 1;
+        for (uint32_t k = base; ; k += base) {
+            if (in >= input_length) {
+                return punycode_bad_input;
+            }
+            uint32_t digit = decode_digit(input_at(input, wide, in++));
+            if (digit >= base) {
+                return punycode_bad_input;
+            }
+            if (digit > (maxint - i) / w) {
+                return punycode_overflow;
+            }
+            i += digit * w;
+            uint32_t t = (k <= bias ? tmin :
+                          k >= bias + tmax ? tmax :
+                          k - bias);
+            if (digit < t) {
+                break;
+            }
+            if (w > maxint / (base - t)) {
+                return punycode_overflow;
+            }
+            w *= (base - t);
+        }
+
+        bias = adapt(i - oldi, (uint32_t)out + 1, oldi == 0);
+
+        if (i / (out + 1) > maxint - n) {
+            return punycode_overflow;
+        }
+        n += i / (out + 1);
+        i %= (out + 1);
+
+        // Only Unicode scalar values are allowed; anything else can't be turned back into a string.
+        if (n > 0x10FFFF || (n >= 0xD800 && n <= 0xDFFF)) {
+            return punycode_bad_input;
+        }
+
+        if (out >= max_out) {
+            return punycode_big_output;
+        }
+
+        memmove(output + i + 1, output + i, (out - i) * sizeof(*output));
+        output[i++] = n;
+    }
+
+    *output_length = out;
+    return punycode_success;
+}
+
+
+punycode_status punycode_decode(const char * input, size_t input_length, uint32_t * output, size_t * output_length) {
+    return decode(input, 0, input_length, output, output_length);
+}
+
+
+punycode_status idna_encode(const uint32_t * input, size_t input_length, char * output, size_t * output_length) {
+    size_t max_out = *output_length;
+    size_t out = 0;
+    size_t pos = 0;
+
+    while (pos < input_length) {
+        size_t label_end = pos;
+        while (label_end < input_length && !is_label_separator(input[label_end])) {
+            label_end++;
+        }
+
+        size_t label_len = label_end - pos;
+        if (punycode_has_non_ascii(input + pos, label_len)) {
+            if (max_out - out < ACE_PREFIX_LEN) {
+                return punycode_big_output;
+            }
+            memcpy(output + out, ACE_PREFIX, ACE_PREFIX_LEN);
+            out += ACE_PREFIX_LEN;
+
+            size_t puny_len = max_out - out;
+            punycode_status status = punycode_encode(input + pos, label_len, output + out, &puny_len);
+            if (status != punycode_success) {
+                return status;
+            }
+            out += puny_len;
+        }
+        else {
+            if (max_out - out < label_len) {
+                return punycode_big_output;
+            }
+            for (size_t j = pos; j < label_end; j++) {
+                output[out++] = (char)input[j];
+            }
+        }
+
+        // Copy the run of separators, as the NSScanner-based implementation did.
+        while (label_end < input_length && is_label_separator(input[label_end])) {
+            if (out >= max_out) {
+                return punycode_big_output;
+            }
+            output[out++] = (char)input[label_end++];
+        }
+
+        pos = label_end;
+    }
+
+    *output_length = out;
+    return punycode_success;
+}
+
+
+static int has_ace_prefix(const uint32_t * label, size_t label_len) {
+    return (label_len >= ACE_PREFIX_LEN &&
+            (label[0] | 0x20) == 'x' &&
+            (label[1] | 0x20) == 'n' &&
+            label[2] == '-' &&
+            label[3] == '-');
+}
+
+
+punycode_status idna_decode(const uint32_t * input, size_t input_length, uint32_t * output, size_t * output_length) {
+    size_t max_out = *output_length;
+    size_t out = 0;
+    size_t pos = 0;
+
+    while (pos < input_length) {
+        size_t label_end = pos;
+        while (label_end < input_length && !is_label_separator(input[label_end])) {
+            label_end++;
+        }
+
+        size_t label_len = label_end - pos;
+        if (has_ace_prefix(input + pos, label_len)) {
+            size_t decoded_len = max_out - out;
+            punycode_status status = decode(input + pos + ACE_PREFIX_LEN, 1, label_len - ACE_PREFIX_LEN,
+                                            output + out, &decoded_len);
+            if (status == punycode_success) {
+                out += decoded_len;
+            }
+            else if (status == punycode_big_output) {
+                return status;
+            }
+            // Otherwise this label is dropped.
+        }
+        else {
+            if (max_out - out < label_len) {
+                return punycode_big_output;
+            }
+            memcpy(output + out, input + pos, label_len * sizeof(*output));
+            out += label_len;
+        }
+
+        while (label_end < input_length && is_label_separator(input[label_end])) {
+            if (out >= max_out) {
+                return punycode_big_output;
+            }
+            output[out++] = input[label_end++];
+        }
+
+        pos = label_end;
+    }
+
+    *output_length = out;
+    return punycode_success;
+}
@@ -0,0 +1,67 @@
+//
+//  PunycodeCore.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/24/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#ifndef Tidbits_PunycodeCore_h
+#define Tidbits_PunycodeCore_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * Plain C Punycode (RFC 3492) and IDNA (RFC 3490) codec, working on code point buffers.
+ *
+ * None of these functions allocate.  The caller provides the output buffer, and *output_length
+ * is the capacity of that buffer on entry and the number of units written on success.
+ * If the output does not fit, punycode_big_output is returned and the contents of the output
+ * buffer are undefined.
+ *
+ * NSStringPunycodeAdditions is built on top of these.
+ */
+
+typedef enum {
+    punycode_success = 0,
+    punycode_bad_input,
+    punycode_big_output,
+    punycode_overflow
+} punycode_status;
+
+
+/**
+ * Encode the given code points as Punycode.  The output is ASCII and is not NUL-terminated.
+ */
+punycode_status punycode_encode(const uint32_t * input, size_t input_length, char * output, size_t * output_length);
+
+/**
+ * Decode the given Punycode into code points.  Uppercase and lowercase digits are both accepted.
+ * punycode_bad_input is returned if a decoded code point is above U+10FFFF or is a surrogate.
+ */
+punycode_status punycode_decode(const char * input, size_t input_length, uint32_t * output, size_t * output_length);
+
+/**
+ * Encode a hostname (or "user@host" string) by splitting it at '.' and '@' and encoding each label
+ * that contains non-ASCII characters as "xn--" + Punycode.  ASCII labels are copied as-is.
+ *
+ * The caller is responsible for any Unicode normalization of the input.
+ */
+punycode_status idna_encode(const uint32_t * input, size_t input_length, char * output, size_t * output_length);
+
+/**
+ * The inverse of idna_encode.  Labels starting with "xn--" (in any case) are Punycode-decoded.
+ * A label that fails to decode is dropped from the output, matching the historical behavior of
+ * -[NSString IDNADecodedString].
+ */
+punycode_status idna_decode(const uint32_t * input, size_t input_length, uint32_t * output, size_t * output_length);
+
+/**
+ * @return true if any of the given code points is outside the ASCII range.
+ */
+int punycode_has_non_ascii(const uint32_t * input, size_t input_length);
+
+
+#endif
@@ -9,6 +9,7 @@
 #import "NSStringPunycodeAdditions.h"
 
 #import "TBTestCaseBase.h"
+#import "TBTestHelpers.h"
 
 
 @interface PunycodeTests : TBTestCaseBase
@@ -41,4 +42,222 @@
 }
 
 
+-(void)testPunycodeDecodingRejectsNonASCII {
+	XCTAssertNil([@"bücher-kva" punycodeDecodedString]);
+}
+
+
+-(void)testPunycodeDecodingRejectsNonScalarValues {
+	// These decode to U+110000 and U+D800 respectively.
+	XCTAssertNil([@"en32g" punycodeDecodedString]);
+	XCTAssertNil([@"ib9b" punycodeDecodedString]);
+	// And this is U+10FFFF, which is fine.
+	XCTAssertEqualObjects([@"dn32g" punycodeDecodedString], @"\U0010FFFF");
+}
+
+
+-(void)testPunycodeAstralPlane {
+	NSString *s = @"a\U0001F600b";
+	XCTAssertEqualObjects([[s punycodeEncodedString] punycodeDecodedString], s);
+}
+
+
+-(void)testIDNAEncoding {
+	NSDictionary *dict = @{@"bücher.de": @"xn--bcher-kva.de",
+						   @"user@bücher.de": @"user@xn--bcher-kva.de",
+						   @"www.президент.рф": @"www.xn--d1abbgf6aiiy.xn--p1ai",
+						   @"example.com": @"example.com",
+						   @"": @""};
+
+	[dict enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+		XCTAssertEqualObjects([key IDNAEncodedString], obj, @"%@ should encode to %@", key, obj);
+		// Second time around comes from the cache.
+		XCTAssertEqualObjects([key IDNAEncodedString], obj, @"%@ should encode to %@", key, obj);
+	}];
+}
+
+
+-(void)testIDNADecoding {
+	NSDictionary *dict = @{@"xn--bcher-kva.de": @"bücher.de",
+						   @"XN--bcher-kva.de": @"bücher.de",
+						   @"user@xn--bcher-kva.de": @"user@bücher.de",
+						   @"www.xn--d1abbgf6aiiy.xn--p1ai": @"www.президент.рф",
+						   @"example.com": @"example.com"};
+
+	[dict enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+		XCTAssertEqualObjects([key IDNADecodedString], obj, @"%@ should decode to %@", key, obj);
+		XCTAssertEqualObjects([key IDNADecodedString], obj, @"%@ should decode to %@", key, obj);
+	}];
+}
+
+
+-(void)testIDNAEncodingLongHost {
+	NSMutableString *host = [NSMutableString string];
+	for (int i = 0; i < 100; i++)
+		[host appendString:@"bücher."];
+	[host appendString:@"de"];
+
+	NSString *encoded = [host IDNAEncodedString];
+	XCTAssertEqual([[encoded componentsSeparatedByString:@"xn--bcher-kva."] count], (NSUInteger)101);
+	XCTAssertEqualObjects([encoded IDNADecodedString], host);
+}
+
+
+-(void)testEncodedURLString {
+	NSDictionary *dict = @{@"http://www.bücher.de/a b/ü?q=ö#frag": @"http://www.xn--bcher-kva.de/a%20b/%C3%BC?q=%C3%B6#frag",
+						   @"https://user:pw@bücher.de:8080/": @"https://user:pw@xn--bcher-kva.de:8080/",
+						   @"mailto:someone@bücher.de?subject=x": @"mailto:someone@xn--bcher-kva.de?subject=x",
+						   @"http://example.com/already%20escaped": @"http://example.com/already%20escaped",
+						   @"http://example.com/": @"http://example.com/"};
+
+	[dict enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+		XCTAssertEqualObjects([key encodedURLString], obj, @"%@ should encode to %@", key, obj);
+	}];
+}
+
+
+-(void)testEncodedURLStringPrecomposesWholeURL {
+	NSDictionary *dict = @{@"http://example.com/cafe\u0301?q=e\u0301": @"http://example.com/caf%C3%A9?q=%C3%A9",
+						   @"http://example.com/\uFB01le": @"http://example.com/file",
+						   @"http://bu\u0308cher.de/#cafe\u0301": @"http://xn--bcher-kva.de/#caf\u00E9"};
+
+	[dict enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+		XCTAssertEqualObjects([key encodedURLString], obj, @"%@ should encode to %@", key, obj);
+	}];
+}
+
+
+-(void)testDecodedURLString {
+	NSDictionary *dict = @{@"http://www.xn--bcher-kva.de/a%20b/%C3%BC?q=%C3%B6#frag": @"http://www.bücher.de/a b/ü?q=ö#frag",
+						   @"https://user:pw@xn--bcher-kva.de:8080/": @"https://user:pw@bücher.de:8080/",
+						   @"mailto:someone@xn--bcher-kva.de": @"mailto:someone@bücher.de",
+						   @"http://example.com/": @"http://example.com/"};
+
+	[dict enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL *stop) {
+		XCTAssertEqualObjects([key decodedURLString], obj, @"%@ should decode to %@", key, obj);
+	}];
+}
+
+
+-(void)testURLWithUnicodeString {
+	NSURL *url = [NSURL URLWithUnicodeString:@"http://bücher.de/ü"];
+	XCTAssertEqualObjects(url.host, @"xn--bcher-kva.de");
+	XCTAssertEqualObjects([url decodedURLString], @"http://bücher.de/ü");
+}
+
+
+-(void)testEncodedURLStringPerformance {
+	NSArray *urls = @[@"https://www.tipbit.com/about",
+					  @"http://www.bücher.de/kategorie/romane?seite=2",
+					  @"https://mail.google.com/mail/u/0/#inbox/14c5a3e2b9f8d7a6",
+					  @"mailto:someone@münchen.de"];
+	const NSUInteger count = 100000;
+
+	NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+	@autoreleasepool {
+		for (NSUInteger i = 0; i < count; i++)
+			[urls[i % urls.count] encodedURLString];
+	}
+	NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+	NSLog(@"encodedURLString x %lu: %0.6f sec.", (unsigned long)count, end - start);
+}
+
+
+/**
+ * Mail headers repeat the same few domains over and over, so the sample is drawn with replacement from a
+ * list of real domains, weighted toward the front of the list.
+ */
+static NSArray *sampleHosts(NSUInteger count) {
+	NSArray *domains = @[@"gmail.com", @"yahoo.com", @"outlook.com", @"tipbit.com", @"bücher.de",
+						 @"mail.google.com", @"münchen.de", @"президент.рф", @"例え.jp", @"mañana.com",
+						 @"icloud.com", @"hotmail.co.uk", @"straße.de", @"ñandú.com.ar", @"中国互联网络信息中心.中国",
+						 @"παράδειγμα.δοκιμή", @"köln.de", @"zürich.ch", @"aol.com", @"sub.domain.example.org"];
+	NSMutableArray *result = [NSMutableArray arrayWithCapacity:count];
+	for (NSUInteger i = 0; i < count; i++) {
+		uint32_t r = arc4random_uniform((uint32_t)domains.count);
+		r = arc4random_uniform(r + 1);
+		NSString *host = domains[r];
+		if (arc4random_uniform(8) == 0)
+			host = [NSString stringWithFormat:@"user%u@%@", arc4random_uniform(1000), host];
+		[result addObject:host];
+	}
+	return result;
+}
+
+
+/**
+ * The NSScanner-based implementation that IDNAEncodedString used before PunycodeCore, kept here for comparison.
+ */
+static NSString *legacyIDNAEncodedString(NSString *str) {
+	NSCharacterSet *nonAscii = [[NSCharacterSet characterSetWithRange:NSMakeRange(1, 127)] invertedSet];
+	NSMutableString *ret = [NSMutableString string];
+	NSScanner *s = [NSScanner scannerWithString:[str precomposedStringWithCompatibilityMapping]];
+	NSCharacterSet *dotAt = [NSCharacterSet characterSetWithCharactersInString:@".@"];
+	NSString *input = nil;
+
+	while (![s isAtEnd]) {
+		if ([s scanUpToCharactersFromSet:dotAt intoString:&input]) {
+			if ([input rangeOfCharacterFromSet:nonAscii].location != NSNotFound)
+				[ret appendFormat:@"xn--%@", [input punycodeEncodedString]];
+			else
+				[ret appendString:input];
+		}
+
+		if ([s scanCharactersFromSet:dotAt intoString:&input])
+			[ret appendString:input];
+	}
+
+	return ret;
+}
+
+
+-(void)testIDNAEncodingMatchesLegacy {
+	for (NSString *host in sampleHosts(1000))
+		XCTAssertEqualObjects([host IDNAEncodedString], legacyIDNAEncodedString(host));
+}
+
+
+-(void)testIDNAEncodingPerformance {
+	const NSUInteger count = 100000;
+	NSArray *hosts;
+	@autoreleasepool {
+		hosts = sampleHosts(count);
+	}
+
+	NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+	@autoreleasepool {
+		for (NSString *host in hosts)
+			legacyIDNAEncodedString(host);
+	}
+	NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+	@autoreleasepool {
+		for (NSString *host in hosts)
+			[host IDNAEncodedString];
+	}
+	NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+	NSTimeInterval baseline = mid - start;
+	NSTimeInterval result = end - mid;
+	NSLog(@"IDNAEncodedString x %lu: %0.6f sec, %0.6f ratio.", (unsigned long)count, result, result / baseline);
+}
+
+
+-(void)testIDNADecodingPerformance {
+	const NSUInteger count = 100000;
+	NSMutableArray *hosts = [NSMutableArray arrayWithCapacity:count];
+	@autoreleasepool {
+		for (NSString *host in sampleHosts(count))
+			[hosts addObject:[host IDNAEncodedString]];
+	}
+
+	NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+	@autoreleasepool {
+		for (NSString *host in hosts)
+			[host IDNADecodedString];
+	}
+	NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+	NSLog(@"IDNADecodedString x %lu: %0.6f sec.", (unsigned long)count, end - start);
+}
+
+
 @end
@@ -0,0 +1,122 @@
+//
+//  BinaryLog.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Lumberjack/Lumberjack.h>
+
+#import "LoggingMacros.h"
+
+
+/*
+ The BLog macros are drop-in replacements for NSLog, NSLogError, etc, for use on hot paths.
+
+ Instead of formatting the message at the call site, they record the timestamp, a pointer to a static description
+ of the call site, and the raw arguments in a ring buffer that belongs to the calling thread.  The messages are only
+ formatted when BinaryLog is flushed, at which point they are passed to Lumberjack (and so to the TTY, ASL, and file
+ loggers) exactly as if they had been logged with NSLog, or are written to a stream for an upload.
+
+ The ring buffers are single-producer, single-consumer, so the call site takes no locks.  If a thread logs faster
+ than BinaryLog is flushed and its ring fills up then its messages are dropped, and a warning saying how many is
+ logged on the next flush.
+
+ The arguments are captured according to the format string, which is parsed once per call site.  C strings (%s) are
+ copied into the ring.  Objects (%@) that conform to NSCopying are copied (which is just a retain for immutable
+ objects) and are described when the message is flushed; other objects are described at the call site.  Formats
+ that use anything more unusual (positional arguments, %C, %S, %s with a precision, or more than 16 arguments) are
+ formatted at the call site, as are messages with very long C strings.
+
+ BLogError flushes everything pending before it returns, the same as NSLogError, which is synchronous, so that an
+ error has reached the loggers before any crash that follows it.  A BLogError from a -description that is called
+ during a flush goes straight to Lumberjack, because that thread can't flush again until the outer flush is done.
+ Messages at the other levels are lost if the process dies before they are flushed.
+ */
+
+#define BLogError(__fmt, ...) BINARY_LOG_MAYBE(LOG_LEVEL_ERROR, LOG_FLAG_ERROR, _LoggingMacrosPrefix __fmt, ##__VA_ARGS__)
+#define BLogWarn(__fmt, ...)  BINARY_LOG_MAYBE(LOG_LEVEL_WARN,  LOG_FLAG_WARN,  _LoggingMacrosPrefix __fmt, ##__VA_ARGS__)
+#define BLogInfo(__fmt, ...)  BINARY_LOG_MAYBE(LOG_LEVEL_INFO,  LOG_FLAG_INFO,  _LoggingMacrosPrefix __fmt, ##__VA_ARGS__)
+#define BLogUser(__fmt, ...)  BINARY_LOG_MAYBE(LOG_LEVEL_USER,  LOG_FLAG_USER,  _LoggingMacrosPrefix __fmt, ##__VA_ARGS__)
+#define BLog(__fmt, ...)      BINARY_LOG_MAYBE(LOG_LEVEL_INFO,  LOG_FLAG_INFO,  _LoggingMacrosPrefix __fmt, ##__VA_ARGS__)
+
+#if DEBUG
+#define BDLog(__fmt, ...) BINARY_LOG_MAYBE(LOG_LEVEL_DEBUG, LOG_FLAG_DEBUG, _LoggingMacrosPrefix __fmt, ##__VA_ARGS__)
+#else
+#define BDLog(...)
+#endif
+
+// The dead call to BinaryLogCheckFormat gives the same -Wformat checking as NSLog.  This matters more here than it
+// does for NSLog, because the arguments are captured according to the format, so a mismatch is undefined behavior.
+#define BINARY_LOG_MAYBE(__lvl, __flg, __fmt, ...) \
+    do { \
+        if (0) { \
+            BinaryLogCheckFormat(__fmt, ##__VA_ARGS__); \
+        } \
+        static BinaryLogCallSite __binaryLogCallSite = { __fmt, __FILE__, __FUNCTION__, __LINE__, __lvl, __flg, NULL }; \
+        BinaryLogWrite(&__binaryLogCallSite, ##__VA_ARGS__); \
+    } while (0)
+
+
+/**
+ * The static description of a BLog call site.  There is one of these per call site, so that the format, function,
+ * and line number are stored once and not per message.  Use the BLog macros rather than using this directly.
+ */
+typedef struct {
+    __unsafe_unretained NSString * format;
+    const char * file;
+    const char * function;
+    int line;
+    int level;
+    int flag;
+    // Private to BinaryLog.  The parsed format, built by the first call to BinaryLogWrite.
+    void * volatile parsed;
+} BinaryLogCallSite;
+
+extern void BinaryLogWrite(BinaryLogCallSite * site, ...);
+
+static inline void BinaryLogCheckFormat(NSString * format, ...) __attribute__((format(__NSString__, 1, 2)));
+static inline void BinaryLogCheckFormat(NSString * format, ...) {
+}
+
+
+@interface BinaryLog : NSObject
+
+/**
+ * Format all pending messages and pass them to Lumberjack, in timestamp order across threads.  This blocks until
+ * the loggers have received them.
+ *
+ * This also happens automatically every flushInterval, and whenever a thread's ring is more than half full.
+ */
++(void)flush;
+
+/**
+ * Format all pending messages with the given formatter and write them to the given stream, one per line, in
+ * timestamp order across threads.  They are not passed to Lumberjack.  Use this to write a log for an upload
+ * without going through the loggers.
+ *
+ * The stream must already be open.  On failure, the message that could not be written is lost and any later
+ * ones remain pending.
+ *
+ * @param formatter The formatter to use; nil means a LogFormatter.
+ * @return YES on success, NO on failure.
+ */
++(BOOL)flushToStream:(NSOutputStream *)stream formatter:(id<DDLogFormatter>)formatter error:(NSError * __autoreleasing *)error;
+
+/**
+ * The interval between automatic flushes, in seconds.  0 means that there are no timed flushes (though a ring
+ * that is more than half full will still be flushed).  Defaults to 1 second.
+ */
++(NSTimeInterval)flushInterval;
++(void)setFlushInterval:(NSTimeInterval)interval;
+
+/**
+ * The size in bytes of each thread's ring buffer.  This is rounded up to a power of two, and is at least 16 KiB.
+ * A change only applies to threads that log for the first time afterwards.  Defaults to 64 KiB.
+ */
++(NSUInteger)ringCapacity;
++(void)setRingCapacity:(NSUInteger)capacity;
+
+@end
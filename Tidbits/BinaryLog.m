@@ -0,0 +1,1133 @@
+//
+//  BinaryLog.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#import <libkern/OSAtomic.h>
+
+#import "LogFormatter.h"
+
+#import "BinaryLog.h"
+
+
+#define DEFAULT_RING_CAPACITY 65536
+#define MIN_RING_CAPACITY 16384
+#define DEFAULT_FLUSH_INTERVAL 1.0
+
+// The maximum number of arguments (including * widths and precisions) that we capture.  This must be <= 32,
+// because Record.objectSlots is a bitmask.
+#define MAX_ARGS 16
+
+// C strings longer than this are not copied into the ring; the message is formatted at the call site instead.
+// MAX_ARGS * MAX_INLINE_STRING must be well under MIN_RING_CAPACITY / 2.
+#define MAX_INLINE_STRING 256
+
+#define MAX_SPEC_LENGTH 16
+
+
+typedef enum {
+    ArgInt,
+    ArgLong,
+    ArgLongLong,
+    ArgSize,
+    ArgIntMax,
+    ArgPtrDiff,
+    ArgDouble,
+    ArgPointer,
+    ArgCString,
+    ArgObject,
+} ArgKind;
+
+
+typedef struct {
+    // The literal text before this conversion, with any %% already collapsed.  Retained.  NULL if empty.
+    CFStringRef prefix;
+    // The conversion as a C format, e.g. "%-8.3lu".  Unused for ArgObject.
+    char spec[MAX_SPEC_LENGTH];
+    ArgKind kind;
+    // The number of * width and precision arguments that come before the value.
+    uint8_t starCount;
+} Conversion;
+
+
+typedef struct {
+    // YES if the format uses something that we don't handle, in which case every message is formatted at the
+    // call site.
+    BOOL eager;
+    NSUInteger argCount;
+    ArgKind argKinds[MAX_ARGS];
+    // The literal text after the last conversion.  Retained.  NULL if empty.
+    CFStringRef suffix;
+    NSUInteger conversionCount;
+    Conversion conversions[];
+} ParsedFormat;
+
+
+static ParsedFormat eagerFormat = { .eager = YES };
+
+
+typedef enum {
+    // This record is just filler up to the end of the ring, because the next record didn't fit there.
+    // Only the size and flags fields are valid.
+    RecordPadding = 1,
+    // slots[0] holds the message, already formatted.
+    RecordPreformatted = 2,
+} RecordFlags;
+
+
+/**
+ * One message in the ring.  This is followed by slotCount argument slots, and then by the bytes of any C string
+ * arguments, each NUL-terminated.  The whole thing is padded to a multiple of 8 bytes.
+ */
+typedef struct {
+    uint32_t size;
+    uint16_t flags;
+    uint16_t slotCount;
+    // Bit i is set if slots[i] holds a retained object, which must be released once the record is consumed.
+    uint32_t objectSlots;
+    uint32_t reserved;
+    CFAbsoluteTime timestamp;
+    union {
+        BinaryLogCallSite * site;
+        uint64_t sitePadding;
+    };
+    // Integers are sign-extended, doubles are stored bitwise, C strings are the offset of their bytes from the
+    // start of the record (0 for NULL), and objects are retained pointers.
+    uint64_t slots[];
+} Record;
+
+
+typedef struct Ring {
+    // The next ring in the rings list.  Guarded by ringsLock.
+    struct Ring * next;
+    uint8_t * buf;
+    uint32_t capacity;
+    // head and tail are byte counts that run freely and wrap at 2^32; capacity is a power of two so that
+    // head - tail is always the number of bytes in use.
+    // head is only written by the owning thread, and tail is only written by the flusher (under flushLock).
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    // The number of messages dropped because the ring was full and not yet reported.
+    volatile int32_t dropped;
+    // Set when the owning thread exits.  The flusher frees the ring once it has drained it.
+    volatile int32_t abandoned;
+    mach_port_t machThreadID;
+} Ring;
+
+
+static dispatch_once_t initOnce;
+static pthread_key_t ringKey;
+
+// Guards rings, ringCapacity, and flushInterval.  It is never held while formatting.
+static pthread_mutex_t ringsLock = PTHREAD_MUTEX_INITIALIZER;
+static Ring * rings;
+static uint32_t ringCapacity = DEFAULT_RING_CAPACITY;
+static NSTimeInterval flushInterval = DEFAULT_FLUSH_INTERVAL;
+
+// Held by whoever is consuming from the rings.
+static pthread_mutex_t flushLock = PTHREAD_MUTEX_INITIALIZER;
+// The thread that holds flushLock, or NULL.  Only ever set to the current thread, so any thread can compare it
+// with itself without a lock.
+static pthread_t volatile flushingThread;
+static dispatch_queue_t flushQueue;
+static dispatch_source_t flushTimer;
+static volatile int32_t flushScheduled;
+
+
+static void ensureInitialized(void);
+static Ring * currentRing(void);
+static ParsedFormat * parsedFormatForCallSite(BinaryLogCallSite * site);
+static void writeEager(Ring * ring, BinaryLogCallSite * site, CFAbsoluteTime timestamp, va_list args);
+static void logToLumberjack(BinaryLogCallSite * site, CFAbsoluteTime timestamp, va_list siteArgs);
+static BOOL isFlushingOnCurrentThread(void);
+static void * reserve(Ring * ring, uint32_t size);
+static void commit(Ring * ring, uint32_t size);
+static void scheduleFlush(void);
+static BOOL drain(BOOL (^handler)(DDLogMessage * msg));
+static void drainToLumberjack(void);
+
+
+static void writeRecord(BinaryLogCallSite * site, CFAbsoluteTime timestamp, va_list siteArgs);
+
+
+void BinaryLogWrite(BinaryLogCallSite * site, ...) {
+    CFAbsoluteTime timestamp = CFAbsoluteTimeGetCurrent();
+    ensureInitialized();
+
+    // NSLogError is synchronous, so that an error is with the loggers (and on disk) before any crash that follows
+    // it.  Do the same here.  If this thread is already flushing (this is from a -description, say) then it can't
+    // flush again, so the error goes straight to Lumberjack instead.
+    BOOL isError = ((site->flag & LOG_FLAG_ERROR) != 0);
+    BOOL isNested = (isError && isFlushingOnCurrentThread());
+
+    va_list args;
+    va_start(args, site);
+    if (isNested) {
+        logToLumberjack(site, timestamp, args);
+    }
+    else {
+        writeRecord(site, timestamp, args);
+    }
+    va_end(args);
+
+    if (isError) {
+        if (!isNested) {
+            drainToLumberjack();
+        }
+        [DDLog flushLog];
+    }
+}
+
+
+static void writeRecord(BinaryLogCallSite * site, CFAbsoluteTime timestamp, va_list siteArgs) {
+    Ring * ring = currentRing();
+    if (ring == NULL) {
+        logToLumberjack(site, timestamp, siteArgs);
+        return;
+    }
+    ParsedFormat * parsed = parsedFormatForCallSite(site);
+
+    va_list args;
+    va_copy(args, siteArgs);
+
+    if (parsed->eager) {
+        writeEager(ring, site, timestamp, args);
+        va_end(args);
+        return;
+    }
+
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+
+    // Pull all the arguments off the va_list first, so that we know how big the record is before we retain or
+    // copy anything.
+    uint64_t raw[MAX_ARGS];
+    uint32_t stringLengths[MAX_ARGS];
+    NSUInteger argCount = parsed->argCount;
+    uint32_t size = (uint32_t)(sizeof(Record) + argCount * sizeof(uint64_t));
+    for (NSUInteger i = 0; i < argCount; i++) {
+        switch (parsed->argKinds[i]) {
+            case ArgInt:
+                raw[i] = (uint64_t)(int64_t)va_arg(args, int);
+                break;
+            case ArgLong:
+                raw[i] = (uint64_t)(int64_t)va_arg(args, long);
+                break;
+            case ArgLongLong:
+                raw[i] = (uint64_t)va_arg(args, long long);
+                break;
+            case ArgSize:
+                raw[i] = (uint64_t)va_arg(args, size_t);
+                break;
+            case ArgIntMax:
+                raw[i] = (uint64_t)va_arg(args, intmax_t);
+                break;
+            case ArgPtrDiff:
+                raw[i] = (uint64_t)(int64_t)va_arg(args, ptrdiff_t);
+                break;
+            case ArgDouble: {
+                double d = va_arg(args, double);
+                memcpy(&raw[i], &d, sizeof(d));
+                break;
+            }
+            case ArgPointer:
+            case ArgObject:
+                raw[i] = (uintptr_t)va_arg(args, void *);
+                break;
+            case ArgCString: {
+                const char * s = va_arg(args, const char *);
+                raw[i] = (uintptr_t)s;
+                if (s != NULL) {
+                    size_t len = strlen(s);
+                    if (len > MAX_INLINE_STRING) {
+                        va_end(args);
+                        writeEager(ring, site, timestamp, argsCopy);
+                        va_end(argsCopy);
+                        return;
+                    }
+                    stringLengths[i] = (uint32_t)len;
+                    size += (uint32_t)len + 1;
+                }
+                break;
+            }
+        }
+    }
+    va_end(args);
+    va_end(argsCopy);
+
+    // Copy or describe the objects before reserving, because that runs arbitrary code, and a BLog from there would
+    // be given the same space in the ring as this record.
+    uint32_t objectSlots = 0;
+    for (NSUInteger i = 0; i < argCount; i++) {
+        if (parsed->argKinds[i] != ArgObject || raw[i] == 0) {
+            continue;
+        }
+        __unsafe_unretained id obj = (__bridge id)(void *)(uintptr_t)raw[i];
+        id captured = ([obj conformsToProtocol:@protocol(NSCopying)] ? [obj copy] : [obj description]);
+        raw[i] = (uintptr_t)CFBridgingRetain(captured);
+        objectSlots |= (1u << i);
+    }
+
+    size = (size + 7) & ~7u;
+    Record * record = reserve(ring, size);
+    if (record == NULL) {
+        for (NSUInteger i = 0; i < argCount; i++) {
+            if (objectSlots & (1u << i)) {
+                CFRelease((CFTypeRef)(uintptr_t)raw[i]);
+            }
+        }
+        return;
+    }
+
+    record->size = size;
+    record->flags = 0;
+    record->slotCount = (uint16_t)argCount;
+    record->objectSlots = objectSlots;
+    record->timestamp = timestamp;
+    record->site = site;
+
+    uint32_t stringOffset = (uint32_t)(sizeof(Record) + argCount * sizeof(uint64_t));
+    for (NSUInteger i = 0; i < argCount; i++) {
+        switch (parsed->argKinds[i]) {
+            case ArgCString:
+                if (raw[i] == 0) {
+                    record->slots[i] = 0;
+                }
+                else {
+                    memcpy((uint8_t *)record + stringOffset, (const char *)(uintptr_t)raw[i], stringLengths[i] + 1);
+                    record->slots[i] = stringOffset;
+                    stringOffset += stringLengths[i] + 1;
+                }
+                break;
+
+            default:
+                record->slots[i] = raw[i];
+                break;
+        }
+    }
+
+    commit(ring, size);
+}
+
+
+static void writeEager(Ring * ring, BinaryLogCallSite * site, CFAbsoluteTime timestamp, va_list args) {
+    // As in writeRecord, this must come before reserve, because it calls -description.
+    NSString * message = [[NSString alloc] initWithFormat:site->format arguments:args];
+
+    uint32_t size = (uint32_t)(sizeof(Record) + sizeof(uint64_t));
+    Record * record = reserve(ring, size);
+    if (record == NULL) {
+        return;
+    }
+
+    record->size = size;
+    record->flags = RecordPreformatted;
+    record->slotCount = 1;
+    record->objectSlots = 1;
+    record->timestamp = timestamp;
+    record->site = site;
+    record->slots[0] = (uintptr_t)CFBridgingRetain(message);
+
+    commit(ring, size);
+}
+
+
+/**
+ * Format the message now and pass it straight to Lumberjack, for when the ring can't be used.
+ */
+static void logToLumberjack(BinaryLogCallSite * site, CFAbsoluteTime timestamp, va_list siteArgs) {
+    va_list args;
+    va_copy(args, siteArgs);
+    NSString * logMsg = [[NSString alloc] initWithFormat:site->format arguments:args];
+    va_end(args);
+
+    DDLogMessage * msg = [[DDLogMessage alloc] initWithLogMsg:logMsg level:site->level flag:site->flag context:0 file:site->file function:site->function line:site->line tag:nil options:0];
+    msg->timestamp = [NSDate dateWithTimeIntervalSinceReferenceDate:timestamp];
+    [DDLog log:YES message:msg];
+}
+
+
+#pragma mark Ring buffers
+
+
+static void ringDestructor(void * value) {
+    Ring * ring = value;
+    OSMemoryBarrier();
+    ring->abandoned = 1;
+    scheduleFlush();
+}
+
+
+/**
+ * @return The calling thread's ring, creating it if necessary, or NULL if it couldn't be allocated.
+ */
+static Ring * currentRing(void) {
+    Ring * ring = pthread_getspecific(ringKey);
+    if (ring != NULL) {
+        return ring;
+    }
+
+    ring = calloc(1, sizeof(Ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->machThreadID = pthread_mach_thread_np(pthread_self());
+
+    pthread_mutex_lock(&ringsLock);
+    ring->capacity = ringCapacity;
+    pthread_mutex_unlock(&ringsLock);
+
+    ring->buf = malloc(ring->capacity);
+    if (ring->buf == NULL) {
+        free(ring);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&ringsLock);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&ringsLock);
+
+    pthread_setspecific(ringKey, ring);
+    return ring;
+}
+
+
+/**
+ * Find room for a record of the given size in the given ring, which must belong to the calling thread.
+ *
+ * @return A pointer to the space, or NULL if the ring is full, in which case the message has been counted as
+ * dropped.
+ */
+static void * reserve(Ring * ring, uint32_t size) {
+    uint32_t tail = ring->tail;
+    OSMemoryBarrier();
+    uint32_t head = ring->head;
+    uint32_t offset = head & (ring->capacity - 1);
+    uint32_t contiguous = ring->capacity - offset;
+    uint32_t needed = (size <= contiguous ? size : size + contiguous);
+
+    if (head - tail + needed > ring->capacity) {
+        OSAtomicIncrement32(&ring->dropped);
+        scheduleFlush();
+        return NULL;
+    }
+
+    if (size > contiguous) {
+        Record * padding = (Record *)(ring->buf + offset);
+        padding->size = contiguous;
+        padding->flags = RecordPadding;
+        OSMemoryBarrier();
+        ring->head = head + contiguous;
+        offset = 0;
+    }
+    return ring->buf + offset;
+}
+
+
+static void commit(Ring * ring, uint32_t size) {
+    uint32_t head = ring->head;
+    OSMemoryBarrier();
+    ring->head = head + size;
+
+    if ((head + size - ring->tail) * 2 > ring->capacity) {
+        scheduleFlush();
+    }
+}
+
+
+#pragma mark Format parsing
+
+
+static CFStringRef createString(const unichar * chars, NSUInteger length) {
+    return (length == 0 ? NULL : CFStringCreateWithCharacters(NULL, chars, (CFIndex)length));
+}
+
+
+static BOOL appendSpecChar(Conversion * conversion, NSUInteger * specLength, unichar c) {
+    if (*specLength >= MAX_SPEC_LENGTH - 1) {
+        return NO;
+    }
+    conversion->spec[(*specLength)++] = (char)c;
+    return YES;
+}
+
+
+static BOOL isDigit(unichar c) {
+    return c >= '0' && c <= '9';
+}
+
+
+/**
+ * Parse the conversion starting just after the % at chars[*i], advancing *i past it.
+ *
+ * @return NO if this is a conversion that we don't handle.
+ */
+static BOOL parseConversion(const unichar * chars, NSUInteger length, NSUInteger * i, Conversion * conversion) {
+    NSUInteger specLength = 0;
+    appendSpecChar(conversion, &specLength, '%');
+    conversion->starCount = 0;
+
+    NSUInteger j = *i;
+    while (j < length && (chars[j] == '-' || chars[j] == '+' || chars[j] == ' ' || chars[j] == '#' || chars[j] == '0' || chars[j] == '\'')) {
+        if (!appendSpecChar(conversion, &specLength, chars[j++])) {
+            return NO;
+        }
+    }
+
+    if (j < length && chars[j] == '*') {
+        appendSpecChar(conversion, &specLength, chars[j++]);
+        conversion->starCount++;
+        if (j < length && isDigit(chars[j])) {
+            // "%*1$d".
+            return NO;
+        }
+    }
+    else {
+        while (j < length && isDigit(chars[j])) {
+            if (!appendSpecChar(conversion, &specLength, chars[j++])) {
+                return NO;
+            }
+        }
+        if (j < length && chars[j] == '$') {
+            // Positional argument.
+            return NO;
+        }
+    }
+
+    BOOL hasPrecision = NO;
+    if (j < length && chars[j] == '.') {
+        hasPrecision = YES;
+        if (!appendSpecChar(conversion, &specLength, chars[j++])) {
+            return NO;
+        }
+        if (j < length && chars[j] == '*') {
+            if (!appendSpecChar(conversion, &specLength, chars[j++])) {
+                return NO;
+            }
+            conversion->starCount++;
+            if (j < length && isDigit(chars[j])) {
+                return NO;
+            }
+        }
+        else {
+            while (j < length && isDigit(chars[j])) {
+                if (!appendSpecChar(conversion, &specLength, chars[j++])) {
+                    return NO;
+                }
+            }
+        }
+    }
+
+    BOOL isPlain = (specLength == 1);
+
+    ArgKind intKind = ArgInt;
+    BOOL hasModifier = NO;
+    BOOL isLongDouble = NO;
+    if (j < length) {
+        unichar c = chars[j];
+        if (c == 'h') {
+            hasModifier = YES;
+            j++;
+            if (!appendSpecChar(conversion, &specLength, 'h')) {
+                return NO;
+            }
+            if (j < length && chars[j] == 'h') {
+                j++;
+                if (!appendSpecChar(conversion, &specLength, 'h')) {
+                    return NO;
+                }
+            }
+        }
+        else if (c == 'l') {
+            hasModifier = YES;
+            intKind = ArgLong;
+            j++;
+            if (!appendSpecChar(conversion, &specLength, 'l')) {
+                return NO;
+            }
+            if (j < length && chars[j] == 'l') {
+                intKind = ArgLongLong;
+                j++;
+                if (!appendSpecChar(conversion, &specLength, 'l')) {
+                    return NO;
+                }
+            }
+        }
+        else if (c == 'q') {
+            hasModifier = YES;
+            intKind = ArgLongLong;
+            j++;
+            if (!appendSpecChar(conversion, &specLength, 'l') || !appendSpecChar(conversion, &specLength, 'l')) {
+                return NO;
+            }
+        }
+        else if (c == 'j' || c == 'z' || c == 't') {
+            hasModifier = YES;
+            intKind = (c == 'j' ? ArgIntMax : c == 'z' ? ArgSize : ArgPtrDiff);
+            j++;
+            if (!appendSpecChar(conversion, &specLength, c)) {
+                return NO;
+            }
+        }
+        else if (c == 'L') {
+            isLongDouble = YES;
+            j++;
+        }
+    }
+
+    if (j >= length || isLongDouble) {
+        return NO;
+    }
+
+    unichar c = chars[j++];
+    switch (c) {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            conversion->kind = intKind;
+            break;
+
+        case 'c':
+            if (hasModifier) {
+                return NO;
+            }
+            conversion->kind = ArgInt;
+            break;
+
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (hasModifier && intKind != ArgLong) {
+                return NO;
+            }
+            conversion->kind = ArgDouble;
+            break;
+
+        case 's':
+            // With a precision, the string need not be NUL-terminated, so we can't copy it.
+            if (hasModifier || hasPrecision) {
+                return NO;
+            }
+            conversion->kind = ArgCString;
+            break;
+
+        case 'p':
+            if (hasModifier) {
+                return NO;
+            }
+            conversion->kind = ArgPointer;
+            break;
+
+        case '@':
+            if (!isPlain || hasModifier) {
+                return NO;
+            }
+            conversion->kind = ArgObject;
+            break;
+
+        default:
+            // %C, %S, %n, the obsolete %D, %U, %O, and anything invalid.
+            return NO;
+    }
+
+    if (!appendSpecChar(conversion, &specLength, c)) {
+        return NO;
+    }
+    conversion->spec[specLength] = '\0';
+    *i = j;
+    return YES;
+}
+
+
+static void freeParsedFormat(ParsedFormat * parsed) {
+    if (parsed == &eagerFormat) {
+        return;
+    }
+    for (NSUInteger i = 0; i < parsed->conversionCount; i++) {
+        if (parsed->conversions[i].prefix != NULL) {
+            CFRelease(parsed->conversions[i].prefix);
+        }
+    }
+    if (parsed->suffix != NULL) {
+        CFRelease(parsed->suffix);
+    }
+    free(parsed);
+}
+
+
+static ParsedFormat * parseFormat(NSString * format) {
+    NSUInteger length = format.length;
+    unichar * chars = malloc((length + 1) * sizeof(unichar));
+    unichar * literal = malloc((length + 1) * sizeof(unichar));
+    [format getCharacters:chars range:NSMakeRange(0, length)];
+
+    // Every conversion is at least two characters.
+    ParsedFormat * result = calloc(1, sizeof(ParsedFormat) + (length / 2 + 1) * sizeof(Conversion));
+    BOOL eager = NO;
+    NSUInteger literalLength = 0;
+    NSUInteger i = 0;
+    while (i < length) {
+        unichar c = chars[i++];
+        if (c != '%') {
+            literal[literalLength++] = c;
+            continue;
+        }
+        if (i < length && chars[i] == '%') {
+            literal[literalLength++] = '%';
+            i++;
+            continue;
+        }
+
+        Conversion * conversion = &result->conversions[result->conversionCount];
+        if (!parseConversion(chars, length, &i, conversion) ||
+            result->argCount + conversion->starCount + 1 > MAX_ARGS) {
+            eager = YES;
+            break;
+        }
+        for (NSUInteger s = 0; s < conversion->starCount; s++) {
+            result->argKinds[result->argCount++] = ArgInt;
+        }
+        result->argKinds[result->argCount++] = conversion->kind;
+        conversion->prefix = createString(literal, literalLength);
+        literalLength = 0;
+        result->conversionCount++;
+    }
+    if (!eager) {
+        result->suffix = createString(literal, literalLength);
+    }
+
+    free(chars);
+    free(literal);
+
+    if (eager) {
+        freeParsedFormat(result);
+        return &eagerFormat;
+    }
+    return result;
+}
+
+
+static ParsedFormat * parsedFormatForCallSite(BinaryLogCallSite * site) {
+    ParsedFormat * parsed = site->parsed;
+    if (parsed != NULL) {
+        return parsed;
+    }
+
+    parsed = parseFormat(site->format);
+    if (!OSAtomicCompareAndSwapPtrBarrier(NULL, parsed, &site->parsed)) {
+        // Another thread got there first.
+        freeParsedFormat(parsed);
+        parsed = site->parsed;
+    }
+    return parsed;
+}
+
+
+#pragma mark Formatting
+
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wformat-nonliteral"
+
+#define FORMAT_WITH_STARS(__value) \
+    (conversion->starCount == 0 ? snprintf(buf, size, conversion->spec, __value) : \
+     conversion->starCount == 1 ? snprintf(buf, size, conversion->spec, stars[0], __value) : \
+     snprintf(buf, size, conversion->spec, stars[0], stars[1], __value))
+
+static int formatScalar(char * buf, size_t size, const Conversion * conversion, const int * stars, uint64_t value, const Record * record) {
+    switch (conversion->kind) {
+        case ArgInt:
+            return FORMAT_WITH_STARS((int)value);
+        case ArgLong:
+            return FORMAT_WITH_STARS((long)value);
+        case ArgLongLong:
+            return FORMAT_WITH_STARS((long long)value);
+        case ArgSize:
+            return FORMAT_WITH_STARS((size_t)value);
+        case ArgIntMax:
+            return FORMAT_WITH_STARS((intmax_t)value);
+        case ArgPtrDiff:
+            return FORMAT_WITH_STARS((ptrdiff_t)value);
+        case ArgDouble: {
+            double d;
+            memcpy(&d, &value, sizeof(d));
+            return FORMAT_WITH_STARS(d);
+        }
+        case ArgPointer:
+            return FORMAT_WITH_STARS((void *)(uintptr_t)value);
+        case ArgCString:
+            return FORMAT_WITH_STARS(value == 0 ? "(null)" : (const char *)record + value);
+        case ArgObject:
+            break;
+    }
+    return 0;
+}
+
+#undef FORMAT_WITH_STARS
+
+#pragma clang diagnostic pop
+
+
+static NSString * messageFromRecord(const Record * record) {
+    if (record->flags & RecordPreformatted) {
+        return (__bridge NSString *)(void *)(uintptr_t)record->slots[0];
+    }
+
+    const ParsedFormat * parsed = record->site->parsed;
+    NSMutableString * result = [NSMutableString string];
+    CFMutableStringRef cfResult = (__bridge CFMutableStringRef)result;
+    NSUInteger slot = 0;
+    for (NSUInteger i = 0; i < parsed->conversionCount; i++) {
+        const Conversion * conversion = &parsed->conversions[i];
+        if (conversion->prefix != NULL) {
+            CFStringAppend(cfResult, conversion->prefix);
+        }
+
+        int stars[2];
+        for (NSUInteger s = 0; s < conversion->starCount; s++) {
+            stars[s] = (int)record->slots[slot++];
+        }
+        uint64_t value = record->slots[slot++];
+
+        if (conversion->kind == ArgObject) {
+            id obj = (__bridge id)(void *)(uintptr_t)value;
+            [result appendString:(obj == nil ? @"(null)" : [obj description])];
+            continue;
+        }
+
+        char buf[128];
+        int n = formatScalar(buf, sizeof(buf), conversion, stars, value, record);
+        if (n <= 0) {
+            continue;
+        }
+        if ((size_t)n < sizeof(buf)) {
+            CFStringAppendCString(cfResult, buf, CFStringGetSystemEncoding());
+        }
+        else {
+            char * bigBuf = malloc((size_t)n + 1);
+            formatScalar(bigBuf, (size_t)n + 1, conversion, stars, value, record);
+            CFStringAppendCString(cfResult, bigBuf, CFStringGetSystemEncoding());
+            free(bigBuf);
+        }
+    }
+    if (parsed->suffix != NULL) {
+        CFStringAppend(cfResult, parsed->suffix);
+    }
+    return result;
+}
+
+
+static void releaseRecordObjects(const Record * record) {
+    uint32_t objectSlots = record->objectSlots;
+    for (uint16_t i = 0; i < record->slotCount && objectSlots != 0; i++, objectSlots >>= 1) {
+        if ((objectSlots & 1) && record->slots[i] != 0) {
+            CFRelease((CFTypeRef)(uintptr_t)record->slots[i]);
+        }
+    }
+}
+
+
+#pragma mark Flushing
+
+
+/**
+ * @return The next record in the given ring at or after *cursor and before end, skipping any padding, or NULL
+ * if there isn't one.  *cursor is advanced past the padding.
+ */
+static const Record * peekRecord(const Ring * ring, uint32_t * cursor, uint32_t end) {
+    while (*cursor != end) {
+        const Record * record = (const Record *)(ring->buf + (*cursor & (ring->capacity - 1)));
+        if (!(record->flags & RecordPadding)) {
+            return record;
+        }
+        *cursor += record->size;
+    }
+    return NULL;
+}
+
+
+static DDLogMessage * logMessageFromRecord(const Record * record, mach_port_t machThreadID) {
+    BinaryLogCallSite * site = record->site;
+    DDLogMessage * msg = [[DDLogMessage alloc] initWithLogMsg:messageFromRecord(record) level:site->level flag:site->flag context:0 file:site->file function:site->function line:site->line tag:nil options:0];
+    msg->timestamp = [NSDate dateWithTimeIntervalSinceReferenceDate:record->timestamp];
+    msg->machThreadID = machThreadID;
+    return msg;
+}
+
+
+static BOOL isFlushingOnCurrentThread(void) {
+    pthread_t thread = flushingThread;
+    return thread != NULL && pthread_equal(thread, pthread_self());
+}
+
+
+/**
+ * Consume every pending record from every ring, oldest first, passing each to the handler as a DDLogMessage.
+ * If the handler returns NO then stop, leaving the later records pending.
+ *
+ * Formatting a record calls -description, which can log.  If that reaches here (through BinaryLog.flush, say)
+ * then this does nothing and returns YES, because flushLock is already held by this thread.  Anything logged
+ * meanwhile stays pending for the next flush.
+ *
+ * @return NO if the handler returned NO.
+ */
+static BOOL drain(BOOL (^handler)(DDLogMessage * msg)) {
+    if (isFlushingOnCurrentThread()) {
+        return YES;
+    }
+
+    pthread_mutex_lock(&flushLock);
+    flushingThread = pthread_self();
+
+    // Only the flusher ever removes rings, so this snapshot stays valid until we unlock flushLock.
+    pthread_mutex_lock(&ringsLock);
+    NSUInteger ringCount = 0;
+    for (Ring * ring = rings; ring != NULL; ring = ring->next) {
+        ringCount++;
+    }
+    Ring ** snapshot = malloc((ringCount + 1) * sizeof(Ring *));
+    NSUInteger r = 0;
+    for (Ring * ring = rings; ring != NULL; ring = ring->next) {
+        snapshot[r++] = ring;
+    }
+    pthread_mutex_unlock(&ringsLock);
+
+    uint32_t * cursors = malloc((ringCount + 1) * sizeof(uint32_t));
+    uint32_t * ends = malloc((ringCount + 1) * sizeof(uint32_t));
+    BOOL * finished = malloc((ringCount + 1) * sizeof(BOOL));
+    for (r = 0; r < ringCount; r++) {
+        Ring * ring = snapshot[r];
+        // If the owner has gone then we have seen its last head.
+        finished[r] = (ring->abandoned != 0);
+        OSMemoryBarrier();
+        ends[r] = ring->head;
+        OSMemoryBarrier();
+        cursors[r] = ring->tail;
+    }
+
+    BOOL ok = YES;
+    while (ok) {
+        // Merge by timestamp.  There are only as many rings as there are threads that have logged, so a linear
+        // scan is fine.
+        NSUInteger best = NSNotFound;
+        const Record * bestRecord = NULL;
+        for (r = 0; r < ringCount; r++) {
+            const Record * record = peekRecord(snapshot[r], &cursors[r], ends[r]);
+            if (record != NULL && (bestRecord == NULL || record->timestamp < bestRecord->timestamp)) {
+                best = r;
+                bestRecord = record;
+            }
+        }
+        if (bestRecord == NULL) {
+            break;
+        }
+
+        @autoreleasepool {
+            ok = handler(logMessageFromRecord(bestRecord, snapshot[best]->machThreadID));
+        }
+
+        releaseRecordObjects(bestRecord);
+        cursors[best] += bestRecord->size;
+        OSMemoryBarrier();
+        snapshot[best]->tail = cursors[best];
+    }
+
+    // This gives back any padding that we skipped after the last record of each ring.
+    OSMemoryBarrier();
+    for (r = 0; r < ringCount; r++) {
+        snapshot[r]->tail = cursors[r];
+    }
+
+    for (r = 0; r < ringCount && ok; r++) {
+        Ring * ring = snapshot[r];
+        int32_t dropped = ring->dropped;
+        if (dropped == 0) {
+            continue;
+        }
+        OSAtomicAdd32(-dropped, &ring->dropped);
+        @autoreleasepool {
+            NSString * logMsg = [NSString stringWithFormat:@"BinaryLog dropped %d messages from thread %x because its ring was full.", dropped, ring->machThreadID];
+            DDLogMessage * msg = [[DDLogMessage alloc] initWithLogMsg:logMsg level:LOG_LEVEL_WARN flag:LOG_FLAG_WARN context:0 file:__FILE__ function:__FUNCTION__ line:__LINE__ tag:nil options:0];
+            ok = handler(msg);
+        }
+    }
+
+    pthread_mutex_lock(&ringsLock);
+    for (r = 0; r < ringCount; r++) {
+        Ring * ring = snapshot[r];
+        if (!finished[r] || cursors[r] != ends[r] || ring->dropped != 0) {
+            continue;
+        }
+        Ring ** link = &rings;
+        while (*link != ring) {
+            link = &(*link)->next;
+        }
+        *link = ring->next;
+        free(ring->buf);
+        free(ring);
+    }
+    pthread_mutex_unlock(&ringsLock);
+
+    free(finished);
+    free(ends);
+    free(cursors);
+    free(snapshot);
+
+    flushingThread = NULL;
+    pthread_mutex_unlock(&flushLock);
+    return ok;
+}
+
+
+static void drainToLumberjack(void) {
+    drain(^BOOL(DDLogMessage * msg) {
+        [DDLog log:YES message:msg];
+        return YES;
+    });
+}
+
+
+static void flushToLumberjack(void * context) {
+    flushScheduled = 0;
+    OSMemoryBarrier();
+    drainToLumberjack();
+}
+
+
+static void scheduleFlush(void) {
+    if (OSAtomicCompareAndSwap32Barrier(0, 1, &flushScheduled)) {
+        dispatch_async_f(flushQueue, NULL, flushToLumberjack);
+    }
+}
+
+
+static void setFlushTimer(NSTimeInterval interval) {
+    if (interval <= 0.0) {
+        dispatch_source_set_timer(flushTimer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+        return;
+    }
+    uint64_t nsec = (uint64_t)(interval * NSEC_PER_SEC);
+    dispatch_source_set_timer(flushTimer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)nsec), nsec, nsec / 10);
+}
+
+
+static void ensureInitialized(void) {
+    dispatch_once(&initOnce, ^{
+        pthread_key_create(&ringKey, ringDestructor);
+
+        flushQueue = dispatch_queue_create("BinaryLog", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(flushQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+
+        flushTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, flushQueue);
+        dispatch_source_set_event_handler_f(flushTimer, flushToLumberjack);
+        pthread_mutex_lock(&ringsLock);
+        setFlushTimer(flushInterval);
+        pthread_mutex_unlock(&ringsLock);
+        dispatch_resume(flushTimer);
+    });
+}
+
+
+@implementation BinaryLog
+
+
++(void)flush {
+    ensureInitialized();
+    drainToLumberjack();
+    [DDLog flushLog];
+}
+
+
++(BOOL)flushToStream:(NSOutputStream *)stream formatter:(id<DDLogFormatter>)formatter error:(NSError * __autoreleasing *)error {
+    ensureInitialized();
+    if (formatter == nil) {
+        formatter = [[LogFormatter alloc] init];
+    }
+
+    __block NSError * err = nil;
+    BOOL ok = drain(^BOOL(DDLogMessage * msg) {
+        NSString * line = [formatter formatLogMessage:msg];
+        if (line == nil) {
+            return YES;
+        }
+        NSData * data = [[line stringByAppendingString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding];
+        const uint8_t * bytes = data.bytes;
+        NSUInteger length = data.length;
+        NSUInteger offset = 0;
+        while (offset < length) {
+            NSInteger n = [stream write:bytes + offset maxLength:length - offset];
+            if (n <= 0) {
+                err = stream.streamError;
+                if (err == nil) {
+                    err = [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil];
+                }
+                return NO;
+            }
+            offset += (NSUInteger)n;
+        }
+        return YES;
+    });
+
+    if (!ok && error != NULL) {
+        *error = err;
+    }
+    return ok;
+}
+
+
++(NSTimeInterval)flushInterval {
+    pthread_mutex_lock(&ringsLock);
+    NSTimeInterval result = flushInterval;
+    pthread_mutex_unlock(&ringsLock);
+    return result;
+}
+
+
++(void)setFlushInterval:(NSTimeInterval)interval {
+    ensureInitialized();
+    pthread_mutex_lock(&ringsLock);
+    flushInterval = interval;
+    setFlushTimer(interval);
+    pthread_mutex_unlock(&ringsLock);
+}
+
+
++(NSUInteger)ringCapacity {
+    pthread_mutex_lock(&ringsLock);
+    NSUInteger result = ringCapacity;
+    pthread_mutex_unlock(&ringsLock);
+    return result;
+}
+
+
++(void)setRingCapacity:(NSUInteger)capacity {
+    uint32_t rounded = MIN_RING_CAPACITY;
+    while (rounded < capacity && rounded < (1u << 30)) {
+        rounded <<= 1;
+    }
+    pthread_mutex_lock(&ringsLock);
+    ringCapacity = rounded;
+    pthread_mutex_unlock(&ringsLock);
+}
+
+
+@end
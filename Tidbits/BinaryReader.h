@@ -0,0 +1,90 @@
+//
+//  BinaryReader.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/31/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * A cursor for reading the encoding written by BinaryWriter, from an NSData (including a memory-mapped file) or
+ * from an NSInputStream.
+ *
+ * Every read is bounds-checked.  Rather than checking each field, callers read a whole record and then check
+ * error: the first failure sets error, and from then on every read returns 0, NO, or nil.  error is an
+ * NSPOSIXErrorDomain error with code EIO if the input ended early, or EILSEQ if a VarUInt or a string was
+ * malformed, or the stream's own streamError if the stream failed.
+ *
+ * This class is not thread-safe.
+ */
+@interface BinaryReader : NSObject
+
+/**
+ * The first error encountered, or nil if every read so far has succeeded.
+ */
+@property (nonatomic, readonly) NSError * error;
+
+/**
+ * The number of bytes consumed so far.
+ */
+@property (nonatomic, readonly) unsigned long long offset;
+
+/**
+ * YES if there is nothing more to read.  For a stream, this may block to find out.
+ */
+@property (nonatomic, readonly) BOOL atEnd;
+
+-(instancetype)initWithData:(NSData *)data __attribute__((nonnull));
+
+/**
+ * Read from stream, which must already be open, with a buffer of the given size.  Large bulk reads bypass the
+ * buffer.
+ */
+-(instancetype)initWithInputStream:(NSInputStream *)stream bufferSize:(NSUInteger)bufferSize __attribute__((nonnull));
+
+/**
+ * Map the file at path into memory (where the filesystem allows) and read from that.
+ *
+ * @return nil on failure, in which case *error is set (if error is not NULL).
+ */
++(instancetype)readerWithContentsOfMappedFile:(NSString *)path error:(NSError * __autoreleasing *)error __attribute__((nonnull(1)));
+
+-(uint8_t)readUInt8;
+-(BOOL)readBool;
+-(uint16_t)readUInt16LE;
+-(uint16_t)readUInt16BE;
+-(uint32_t)readUInt32LE;
+-(uint32_t)readUInt32BE;
+-(uint64_t)readUInt64LE;
+-(uint64_t)readUInt64BE;
+-(float)readFloat;
+-(double)readDouble;
+-(uint64_t)readVarUInt;
+-(int64_t)readVarInt;
+
+/**
+ * Read exactly length bytes into dest.
+ *
+ * @return NO if there were not enough bytes, in which case error is set and the contents of dest are undefined.
+ */
+-(BOOL)readBytes:(void *)dest length:(NSUInteger)length;
+
+/**
+ * Read length bytes and discard them.
+ */
+-(BOOL)skipBytes:(NSUInteger)length;
+
+/**
+ * Read a blob written by -[BinaryWriter writeBlob:].
+ */
+-(NSData *)readBlob;
+
+/**
+ * Read a string written by -[BinaryWriter writeString:].
+ */
+-(NSString *)readString;
+
+@end
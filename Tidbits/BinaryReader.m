@@ -0,0 +1,453 @@
+//
+//  BinaryReader.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/31/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "BinaryWriter.h"
+
+#import "BinaryReader.h"
+
+
+#define MIN_BUFFER_SIZE 64
+
+// The longest VarUInt: ceil(64 / 7).
+#define MAX_VARINT_LENGTH 10
+
+// Blobs and strings longer than this are read from a stream in chunks of this size, so that a corrupt length
+// doesn't make us allocate a huge buffer up front.
+#define LARGE_READ_CHUNK 65536
+
+
+@implementation BinaryReader
+{
+    // Exactly one of these is set.
+    NSData * data;
+    NSInputStream * stream;
+
+    // For a stream, the buffer that cur and end point into.  For data, NULL.
+    uint8_t * buf;
+    NSUInteger bufSize;
+
+    const uint8_t * start;
+    const uint8_t * cur;
+    const uint8_t * end;
+
+    // The stream offset of start.
+    unsigned long long base;
+
+    BOOL streamAtEnd;
+}
+
+
+-(instancetype)initWithData:(NSData *)data_ {
+    self = [super init];
+    if (self) {
+        data = data_;
+        start = cur = data.bytes;
+        end = cur + data.length;
+    }
+    return self;
+}
+
+
+-(instancetype)initWithInputStream:(NSInputStream *)stream_ bufferSize:(NSUInteger)bufferSize {
+    self = [super init];
+    if (self) {
+        stream = stream_;
+        bufSize = MAX(bufferSize, MIN_BUFFER_SIZE);
+        buf = malloc(bufSize);
+        if (buf == NULL) {
+            [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)bufSize];
+        }
+        start = cur = end = buf;
+    }
+    return self;
+}
+
+
++(instancetype)readerWithContentsOfMappedFile:(NSString *)path error:(NSError * __autoreleasing *)error {
+    NSData * data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:error];
+    if (data == nil) {
+        return nil;
+    }
+    return [[BinaryReader alloc] initWithData:data];
+}
+
+
+-(void)dealloc {
+    free(buf);
+}
+
+
+-(unsigned long long)offset {
+    return base + (unsigned long long)(cur - start);
+}
+
+
+-(BOOL)atEnd {
+    if (_error != nil) {
+        return YES;
+    }
+    return cur == end && ![self fill:1];
+}
+
+
+#pragma mark - Buffer management
+
+
+-(void)failWithCode:(int)code {
+    if (_error == nil) {
+        _error = [NSError errorWithDomain:NSPOSIXErrorDomain code:code userInfo:nil];
+    }
+    cur = end;
+}
+
+
+-(void)failWithStreamError {
+    if (_error == nil) {
+        NSError * err = stream.streamError;
+        _error = (err != nil ? err : [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil]);
+    }
+    cur = end;
+}
+
+
+/**
+ * Move what's left of the buffer to the front, and read from the stream until there are at least n bytes
+ * available (n must not be greater than bufSize) or the stream ends.
+ *
+ * @return YES if there are now at least n bytes available.  Does not set error if not.
+ */
+-(BOOL)fill:(NSUInteger)n {
+    if ((NSUInteger)(end - cur) >= n) {
+        return YES;
+    }
+    if (stream == nil || streamAtEnd || _error != nil) {
+        return NO;
+    }
+    NSParameterAssert(n <= bufSize);
+
+    NSUInteger remaining = (NSUInteger)(end - cur);
+    base += (unsigned long long)(cur - start);
+    memmove(buf, cur, remaining);
+    start = cur = buf;
+    end = buf + remaining;
+
+    while ((NSUInteger)(end - cur) < n) {
+        NSInteger got = [stream read:buf + (end - buf) maxLength:bufSize - (NSUInteger)(end - buf)];
+        if (got < 0) {
+            [self failWithStreamError];
+            return NO;
+        }
+        if (got == 0) {
+            streamAtEnd = YES;
+            return NO;
+        }
+        end += got;
+    }
+    return YES;
+}
+
+
+/**
+ * @return A pointer to the next n bytes, consuming them, or NULL with error set if there are not enough.
+ */
+static const uint8_t * take(BinaryReader * self, NSUInteger n) {
+    if ((NSUInteger)(self->end - self->cur) < n && ![self fill:n]) {
+        [self failWithCode:EIO];
+        return NULL;
+    }
+    const uint8_t * result = self->cur;
+    self->cur += n;
+    return result;
+}
+
+
+#pragma mark - Reading
+
+
+-(uint8_t)readUInt8 {
+    const uint8_t * p = take(self, 1);
+    return (p == NULL ? 0 : *p);
+}
+
+
+-(BOOL)readBool {
+    return [self readUInt8] != 0;
+}
+
+
+-(uint16_t)readUInt16LE {
+    uint16_t v;
+    const uint8_t * p = take(self, sizeof(v));
+    if (p == NULL) {
+        return 0;
+    }
+    memcpy(&v, p, sizeof(v));
+    return CFSwapInt16LittleToHost(v);
+}
+
+
+-(uint16_t)readUInt16BE {
+    uint16_t v;
+    const uint8_t * p = take(self, sizeof(v));
+    if (p == NULL) {
+        return 0;
+    }
+    memcpy(&v, p, sizeof(v));
+    return CFSwapInt16BigToHost(v);
+}
+
+
+-(uint32_t)readUInt32LE {
+    uint32_t v;
+    const uint8_t * p = take(self, sizeof(v));
+    if (p == NULL) {
+        return 0;
+    }
+    memcpy(&v, p, sizeof(v));
+    return CFSwapInt32LittleToHost(v);
+}
+
+
+-(uint32_t)readUInt32BE {
+    uint32_t v;
+    const uint8_t * p = take(self, sizeof(v));
+    if (p == NULL) {
+        return 0;
+    }
+    memcpy(&v, p, sizeof(v));
+    return CFSwapInt32BigToHost(v);
+}
+
+
+-(uint64_t)readUInt64LE {
+    uint64_t v;
+    const uint8_t * p = take(self, sizeof(v));
+    if (p == NULL) {
+        return 0;
+    }
+    memcpy(&v, p, sizeof(v));
+    return CFSwapInt64LittleToHost(v);
+}
+
+
+-(uint64_t)readUInt64BE {
+    uint64_t v;
+    const uint8_t * p = take(self, sizeof(v));
+    if (p == NULL) {
+        return 0;
+    }
+    memcpy(&v, p, sizeof(v));
+    return CFSwapInt64BigToHost(v);
+}
+
+
+-(float)readFloat {
+    uint32_t bits = [self readUInt32LE];
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+
+-(double)readDouble {
+    uint64_t bits = [self readUInt64LE];
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+
+-(uint64_t)readVarUInt {
+    // Make sure that the longest possible VarUInt is in the buffer if we can, so that it is never split across
+    // a refill.
+    if ((NSUInteger)(end - cur) < MAX_VARINT_LENGTH) {
+        [self fill:MAX_VARINT_LENGTH];
+    }
+
+    uint64_t result = 0;
+    unsigned shift = 0;
+    const uint8_t * p = cur;
+    while (p < end) {
+        uint8_t b = *p++;
+        if (shift == 63 && b > 1) {
+            // The tenth byte can only hold the top bit.
+            [self failWithCode:EILSEQ];
+            return 0;
+        }
+        result |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            cur = p;
+            return result;
+        }
+        shift += 7;
+    }
+    [self failWithCode:EIO];
+    return 0;
+}
+
+
+-(int64_t)readVarInt {
+    return BinaryZigZagDecode([self readVarUInt]);
+}
+
+
+-(BOOL)readBytes:(void *)dest length:(NSUInteger)length {
+    if (_error != nil) {
+        return NO;
+    }
+
+    NSUInteger available = (NSUInteger)(end - cur);
+    if (available >= length) {
+        memcpy(dest, cur, length);
+        cur += length;
+        return YES;
+    }
+    if (stream == nil) {
+        [self failWithCode:EIO];
+        return NO;
+    }
+
+    // Take what's in the buffer, and then read the rest straight from the stream into dest.
+    memcpy(dest, cur, available);
+    cur += available;
+    uint8_t * d = (uint8_t *)dest + available;
+    NSUInteger needed = length - available;
+    while (needed > 0) {
+        if (streamAtEnd) {
+            [self failWithCode:EIO];
+            return NO;
+        }
+        NSInteger got = [stream read:d maxLength:needed];
+        if (got < 0) {
+            [self failWithStreamError];
+            return NO;
+        }
+        if (got == 0) {
+            streamAtEnd = YES;
+            continue;
+        }
+        d += got;
+        needed -= (NSUInteger)got;
+        base += (unsigned long long)got;
+    }
+    return YES;
+}
+
+
+-(BOOL)skipBytes:(NSUInteger)length {
+    if (_error != nil) {
+        return NO;
+    }
+    NSUInteger available = (NSUInteger)(end - cur);
+    if (available >= length) {
+        cur += length;
+        return YES;
+    }
+    if (stream == nil) {
+        [self failWithCode:EIO];
+        return NO;
+    }
+
+    cur += available;
+    length -= available;
+    while (length > 0) {
+        NSUInteger n = MIN(length, bufSize);
+        if (![self fill:n]) {
+            [self failWithCode:EIO];
+            return NO;
+        }
+        cur += n;
+        length -= n;
+    }
+    return YES;
+}
+
+
+/**
+ * Read a VarUInt length and check it against what could possibly be available.
+ *
+ * @return NO with error set if the length is bad.
+ */
+-(BOOL)readLength:(NSUInteger *)length {
+    uint64_t len = [self readVarUInt];
+    if (_error != nil) {
+        return NO;
+    }
+    if (len > NSUIntegerMax || (stream == nil && len > (uint64_t)(end - cur))) {
+        [self failWithCode:EIO];
+        return NO;
+    }
+    *length = (NSUInteger)len;
+    return YES;
+}
+
+
+/**
+ * Read length bytes from the stream into a new NSData, growing it as the bytes arrive.
+ */
+-(NSData *)readLargeData:(NSUInteger)length {
+    NSMutableData * result = [NSMutableData data];
+    while (length > 0) {
+        NSUInteger n = MIN(length, LARGE_READ_CHUNK);
+        NSUInteger oldLength = result.length;
+        result.length = oldLength + n;
+        if (![self readBytes:(uint8_t *)result.mutableBytes + oldLength length:n]) {
+            return nil;
+        }
+        length -= n;
+    }
+    return result;
+}
+
+
+-(NSData *)readBlob {
+    NSUInteger len;
+    if (![self readLength:&len]) {
+        return nil;
+    }
+    if (len <= (NSUInteger)(end - cur) || len <= bufSize) {
+        const uint8_t * p = take(self, len);
+        return (p == NULL ? nil : [NSData dataWithBytes:p length:len]);
+    }
+    return [self readLargeData:len];
+}
+
+
+-(NSString *)readString {
+    NSUInteger len;
+    if (![self readLength:&len]) {
+        return nil;
+    }
+    if (len == 0) {
+        return @"";
+    }
+
+    NSString * result;
+    if (len <= (NSUInteger)(end - cur) || len <= bufSize) {
+        const uint8_t * p = take(self, len);
+        if (p == NULL) {
+            return nil;
+        }
+        result = [[NSString alloc] initWithBytes:p length:len encoding:NSUTF8StringEncoding];
+    }
+    else {
+        NSData * bytes = [self readLargeData:len];
+        if (bytes == nil) {
+            return nil;
+        }
+        result = [[NSString alloc] initWithData:bytes encoding:NSUTF8StringEncoding];
+    }
+
+    if (result == nil) {
+        [self failWithCode:EILSEQ];
+    }
+    return result;
+}
+
+
+@end
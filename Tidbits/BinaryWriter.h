@@ -0,0 +1,102 @@
+//
+//  BinaryWriter.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/31/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * Writes a compact binary encoding into a reusable buffer.  Read it back with BinaryReader.
+ *
+ * Encodings:
+ * - VarUInt: unsigned LEB128, 1-10 bytes, 7 bits per byte, least significant group first.
+ * - VarInt: zig-zag encoded (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) and then written as a VarUInt, so that small
+ *   negative numbers are small too.
+ * - UInt16/32/64 LE and BE: fixed width, explicit byte order, regardless of host.
+ * - Float and Double: IEEE 754, little-endian.
+ * - Blob and String: VarUInt length followed by the bytes (UTF-8 for String).
+ *
+ * Unlike NSMutableData+AppendByte, the fixed-width integers have a defined byte order, so files written on one
+ * architecture can be read on another.
+ *
+ * This class is not thread-safe.
+ */
+@interface BinaryWriter : NSObject
+
+@property (nonatomic, readonly) NSUInteger length;
+
+/**
+ * The bytes written so far.  This pointer is invalidated by any subsequent write.  May be NULL if length is 0.
+ */
+@property (nonatomic, readonly) const uint8_t * bytes;
+
+-(instancetype)init;
+-(instancetype)initWithCapacity:(NSUInteger)capacity;
+
+-(void)writeUInt8:(uint8_t)v;
+-(void)writeBool:(BOOL)v;
+-(void)writeUInt16LE:(uint16_t)v;
+-(void)writeUInt16BE:(uint16_t)v;
+-(void)writeUInt32LE:(uint32_t)v;
+-(void)writeUInt32BE:(uint32_t)v;
+-(void)writeUInt64LE:(uint64_t)v;
+-(void)writeUInt64BE:(uint64_t)v;
+-(void)writeFloat:(float)v;
+-(void)writeDouble:(double)v;
+-(void)writeVarUInt:(uint64_t)v;
+-(void)writeVarInt:(int64_t)v;
+
+/**
+ * Write raw bytes, with no length prefix.
+ */
+-(void)writeBytes:(const void *)bytes length:(NSUInteger)length;
+
+/**
+ * Write a VarUInt length and then the bytes.  nil is written the same as empty.
+ */
+-(void)writeBlob:(NSData *)data;
+
+/**
+ * Write a VarUInt byte length and then the string as UTF-8.  nil is written the same as empty.
+ */
+-(void)writeString:(NSString *)s;
+
+/**
+ * Discard everything written so far, but keep the buffer for reuse.
+ */
+-(void)reset;
+
+/**
+ * @return A copy of the bytes written so far.  This writer is left unchanged.
+ */
+-(NSData *)data;
+
+/**
+ * Hand the buffer over to a new NSData without copying, and leave this writer empty.
+ */
+-(NSData *)takeData;
+
+/**
+ * Write everything written so far to stream, which must already be open, and then reset.
+ *
+ * @return NO on failure, in which case *error is set (if error is not NULL), and this writer is left unchanged.
+ */
+-(BOOL)flushToStream:(NSOutputStream *)stream error:(NSError * __autoreleasing *)error __attribute__((nonnull(1)));
+
+@end
+
+
+/**
+ * Zig-zag encoding, as used by VarInt.  Exposed for callers that pack their own fields.
+ */
+static inline uint64_t BinaryZigZagEncode(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t BinaryZigZagDecode(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
@@ -0,0 +1,241 @@
+//
+//  BinaryWriter.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/31/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "BinaryWriter.h"
+
+
+#define MIN_CAPACITY 64
+
+// The longest VarUInt: ceil(64 / 7).
+#define MAX_VARINT_LENGTH 10
+
+
+@implementation BinaryWriter
+{
+    uint8_t * buf;
+    NSUInteger capacity;
+}
+
+
+-(instancetype)init {
+    return [self initWithCapacity:0];
+}
+
+
+-(instancetype)initWithCapacity:(NSUInteger)initialCapacity {
+    self = [super init];
+    if (self) {
+        if (initialCapacity > 0) {
+            [self reserve:initialCapacity];
+        }
+    }
+    return self;
+}
+
+
+-(void)dealloc {
+    free(buf);
+}
+
+
+-(const uint8_t *)bytes {
+    return buf;
+}
+
+
+/**
+ * @return A pointer to the tail of the buffer, with space for at least n bytes.
+ */
+-(uint8_t *)reserve:(NSUInteger)n {
+    NSUInteger needed = _length + n;
+    if (needed > capacity) {
+        NSUInteger newCapacity = MAX(MAX(needed, 2 * capacity), MIN_CAPACITY);
+        uint8_t * newBuf = realloc(buf, newCapacity);
+        if (newBuf == NULL) {
+            [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)newCapacity];
+        }
+        buf = newBuf;
+        capacity = newCapacity;
+    }
+    return buf + _length;
+}
+
+
+-(void)writeUInt8:(uint8_t)v {
+    *[self reserve:1] = v;
+    _length++;
+}
+
+
+-(void)writeBool:(BOOL)v {
+    [self writeUInt8:(v ? 1 : 0)];
+}
+
+
+-(void)writeUInt16LE:(uint16_t)v {
+    v = CFSwapInt16HostToLittle(v);
+    [self writeBytes:&v length:sizeof(v)];
+}
+
+
+-(void)writeUInt16BE:(uint16_t)v {
+    v = CFSwapInt16HostToBig(v);
+    [self writeBytes:&v length:sizeof(v)];
+}
+
+
+-(void)writeUInt32LE:(uint32_t)v {
+    v = CFSwapInt32HostToLittle(v);
+    [self writeBytes:&v length:sizeof(v)];
+}
+
+
+-(void)writeUInt32BE:(uint32_t)v {
+    v = CFSwapInt32HostToBig(v);
+    [self writeBytes:&v length:sizeof(v)];
+}
+
+
+-(void)writeUInt64LE:(uint64_t)v {
+    v = CFSwapInt64HostToLittle(v);
+    [self writeBytes:&v length:sizeof(v)];
+}
+
+
+-(void)writeUInt64BE:(uint64_t)v {
+    v = CFSwapInt64HostToBig(v);
+    [self writeBytes:&v length:sizeof(v)];
+}
+
+
+-(void)writeFloat:(float)v {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    [self writeUInt32LE:bits];
+}
+
+
+-(void)writeDouble:(double)v {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    [self writeUInt64LE:bits];
+}
+
+
+-(void)writeVarUInt:(uint64_t)v {
+    uint8_t * p = [self reserve:MAX_VARINT_LENGTH];
+    uint8_t * start = p;
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    _length += (NSUInteger)(p - start);
+}
+
+
+-(void)writeVarInt:(int64_t)v {
+    [self writeVarUInt:BinaryZigZagEncode(v)];
+}
+
+
+-(void)writeBytes:(const void *)bytes length:(NSUInteger)length {
+    if (length == 0) {
+        return;
+    }
+    memcpy([self reserve:length], bytes, length);
+    _length += length;
+}
+
+
+-(void)writeBlob:(NSData *)data {
+    NSUInteger len = data.length;
+    [self writeVarUInt:len];
+    [self writeBytes:data.bytes length:len];
+}
+
+
+-(void)writeString:(NSString *)s {
+    CFStringRef cf = (__bridge CFStringRef)s;
+    CFIndex len = (s == nil ? 0 : CFStringGetLength(cf));
+    if (len == 0) {
+        [self writeVarUInt:0];
+        return;
+    }
+
+    // If the string is stored as ASCII then we can copy it straight in.
+    const char * ascii = CFStringGetCStringPtr(cf, kCFStringEncodingUTF8);
+    if (ascii != NULL) {
+        [self writeVarUInt:(uint64_t)len];
+        [self writeBytes:ascii length:(NSUInteger)len];
+        return;
+    }
+
+    // Otherwise, transcode straight into the buffer after a maximum-width length prefix, and then move the bytes
+    // back if the actual length needed a shorter prefix.
+    CFIndex maxBytes = 3 * len;
+    uint8_t * p = [self reserve:MAX_VARINT_LENGTH + (NSUInteger)maxBytes];
+    CFIndex used = 0;
+    CFStringGetBytes(cf, CFRangeMake(0, len), kCFStringEncodingUTF8, '?', false, p + MAX_VARINT_LENGTH, maxBytes, &used);
+
+    uint8_t prefix[MAX_VARINT_LENGTH];
+    NSUInteger prefixLength = 0;
+    uint64_t v = (uint64_t)used;
+    while (v >= 0x80) {
+        prefix[prefixLength++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    prefix[prefixLength++] = (uint8_t)v;
+
+    memmove(p + prefixLength, p + MAX_VARINT_LENGTH, (size_t)used);
+    memcpy(p, prefix, prefixLength);
+    _length += prefixLength + (NSUInteger)used;
+}
+
+
+-(void)reset {
+    _length = 0;
+}
+
+
+-(NSData *)data {
+    return [NSData dataWithBytes:buf length:_length];
+}
+
+
+-(NSData *)takeData {
+    if (_length == 0) {
+        return [NSData data];
+    }
+    NSData * result = [NSData dataWithBytesNoCopy:buf length:_length freeWhenDone:YES];
+    buf = NULL;
+    capacity = 0;
+    _length = 0;
+    return result;
+}
+
+
+-(BOOL)flushToStream:(NSOutputStream *)stream error:(NSError * __autoreleasing *)error {
+    NSUInteger offset = 0;
+    while (offset < _length) {
+        NSInteger n = [stream write:buf + offset maxLength:_length - offset];
+        if (n <= 0) {
+            if (error != NULL) {
+                NSError * err = stream.streamError;
+                *error = (err != nil ? err : [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil]);
+            }
+            return NO;
+        }
+        offset += (NSUInteger)n;
+    }
+    _length = 0;
+    return YES;
+}
+
+
+@end
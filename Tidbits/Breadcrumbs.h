@@ -19,8 +19,11 @@ typedef enum { Pop=0, Push, Track } TrackMethod;
 @optional
 
 /**
- * @param trail An NSString array.  This is not yours to own or mutate.  If you need it beyond the lifetime of this call, then copy it.
- * @discussion This call is executed inline with the call to Breadcrumbs.track and under the internal lock inside Breadcrumbs -- be quick!
+ * @param trail An NSString array, the same as Breadcrumbs.trail.
+ * @discussion This call is executed inline with the call to Breadcrumbs.track, though not under any lock.
+ * The trail is only materialized if the delegate implements this method, and then it is built on every call to
+ * Breadcrumbs.track, so if you only need the trail occasionally (e.g. when reporting a crash) then call
+ * Breadcrumbs.trail at that point instead.
  */
 -(void)breadcrumbsSaveTrail:(NSArray*)trail;
 
@@ -39,6 +42,32 @@ typedef enum { Pop=0, Push, Track } TrackMethod;
 @end
 
 
+/**
+ * One entry in the breadcrumb trail: a tag, and the number of times in a row that it was tracked.
+ * The description is "<tag>" if count is 1, otherwise "<tag>*<count>".
+ */
+@interface BreadcrumbsEntry : NSObject
+
+@property (nonatomic, readonly) NSString * tag;
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ * The time that this tag was most recently tracked, to the nearest 1/100 second.
+ */
+@property (nonatomic, readonly) NSDate * date;
+
+@end
+
+
+/**
+ * The trail is a fixed-size lock-free ring of (tag, repeat count, timestamp) entries, where each tag is interned
+ * into a small integer id the first time that it is seen.  Tracking a tag that has been seen before does not
+ * allocate or take a lock, and a repeat of the last tag just bumps its count.  The trail is only turned back into
+ * strings when someone asks for it, through Breadcrumbs.trail or breadcrumbsSaveTrail:.
+ *
+ * The tag table holds up to 3072 distinct tags.  Beyond that, a new tag is kept as a string in its entry instead,
+ * so the trail is still right, but tracking it allocates and takes a lock.
+ */
 @interface Breadcrumbs : NSObject
 
 /**
@@ -67,15 +96,39 @@ typedef enum { Pop=0, Push, Track } TrackMethod;
 +(void)track:(NSString*)tag;
 +(void)track:(NSString*)tag with:(NSDictionary*)props;
 
+/**
+ * @return The trail, oldest first, as an NSString array in the form given by BreadcrumbsEntry.description.
+ * This is safe to call from any thread.
+ */
++(NSArray*)trail;
+
+/**
+ * @return The trail, oldest first, as a BreadcrumbsEntry array.  This is safe to call from any thread.
+ */
++(NSArray*)trailEntries;
+
+/**
+ * Whether each breadcrumb is also written with NSLog.  Defaults to YES.  Turning it off
+ * saves the cost of formatting and logging each breadcrumb; the trail is still kept either way.
+ */
++(void)setLogsToConsole:(BOOL)logsToConsole;
+
 /**
  * May be nil.  Is accessed with no locking, since it is intended to be set at start-of-day.
  */
 @property (nonatomic, strong) NSObject<BreadcrumbsDelegate>* delegate;
 
+/**
+ * Is accessed with no locking, since it is intended to be set at start-of-day.
+ */
+@property (nonatomic) BOOL logsToConsole;
+
 
 -(void)push:(NSString*)tag;
 -(void)pop:(NSString*)tag;
 -(void)track:(NSString*)tag method:(TrackMethod)method;
 -(void)track:(NSString*)tag with:(NSDictionary*)props;
+-(NSArray*)trail;
+-(NSArray*)trailEntries;
 
 @end
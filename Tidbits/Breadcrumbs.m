@@ -6,8 +6,13 @@
 //  Copyright (c) 2013 Tipbit, Inc. All rights reserved.
 //
 
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+#import <sched.h>
+
 #import "LoggingMacros.h"
 #import "NSString+Misc.h"
+#import "StringPool.h"
 #import "TBAsserts.h"
 
 #import "Breadcrumbs.h"
@@ -15,16 +20,87 @@
 
 #define MAX_CRUMBS 30
 
+// The tag table is open-addressed, so keep it at most 3/4 full.
+#define TAG_CAPACITY 4096
+#define TAG_LIMIT 3072
+#define TAG_OVERFLOW TAG_CAPACITY
+#define TAG_OVERFLOW_NAME @"breadcrumbs-too-many-tags"
 
-@interface Breadcrumbs ()
+#define CRUMB_BUSY 0x80000000u
+#define CRUMB_MAX_COUNT 0x7FFFFFFFu
 
 
-/**
- * NSString array.
- * The trail left by the user's path through the code.
- * Accessed by any thread via @synchronized on this object.
- */
-@property (nonatomic, strong, readonly) NSMutableArray* breadCrumbs;
+typedef struct {
+    // Retained, and never released, so that a tag id is valid for the life of the process.  NULL if this slot
+    // is empty.
+    CFStringRef volatile string;
+    // StringPoolHashString(string) | 1, or 0 if it has not been written yet.
+    volatile uint32_t hash;
+    // The tag id of "<" + string, plus 1, or 0 if it has not been needed yet.  Accessed only on main thread.
+    uint32_t popTag;
+} TagEntry;
+
+
+typedef struct {
+    // (seq << 32) | count, where seq is the 1-based position of this crumb in the trail, or 0 if this slot has
+    // never been used.  The owner of the slot sets CRUMB_BUSY in the count while it writes tag and time.
+    volatile int64_t state;
+    volatile uint32_t tag;
+    // Centiseconds since crumbEpoch.
+    volatile uint32_t time;
+    // If tag is TAG_OVERFLOW, the tag itself, retained, otherwise NULL.  Written by the owner of the slot, and
+    // read by anyone else, under overflowLock, so that a reader can retain it before the next owner releases it.
+    CFStringRef overflow;
+} Crumb;
+
+
+typedef struct {
+    // Crumb n (0-based) lives at crumbs[n % MAX_CRUMBS].
+    Crumb crumbs[MAX_CRUMBS];
+    // The number of crumbs ever appended.
+    volatile int64_t count;
+} CrumbRing;
+
+
+@interface BreadcrumbsEntry ()
+
+-(instancetype)initWithTag:(NSString *)tag count:(NSUInteger)count date:(NSDate *)date;
+
+@end
+
+
+@implementation BreadcrumbsEntry
+
+
+-(instancetype)initWithTag:(NSString *)tag count:(NSUInteger)count date:(NSDate *)date {
+    self = [super init];
+    if (self) {
+        _tag = tag;
+        _count = count;
+        _date = date;
+    }
+    return self;
+}
+
+
+-(NSString *)description {
+    return (self.count == 1 ? self.tag : [NSString stringWithFormat:@"%@*%lu", self.tag, (unsigned long)self.count]);
+}
+
+
+@end
+
+
+@interface Breadcrumbs () {
+    /**
+     * The trail left by the user's path through the code.
+     * Accessed by any thread, lock-free.
+     */
+    CrumbRing ring;
+
+    BOOL delegateSavesTrail;
+    BOOL delegateTracks;
+}
 
 
 /**
@@ -41,6 +117,282 @@
 static Breadcrumbs* instance = nil;
 static NSDictionary* customProps = nil;
 
+static TagEntry tags[TAG_CAPACITY];
+static volatile int32_t tagCount = 0;
+static CFAbsoluteTime crumbEpoch;
+
+// Guards Crumb.overflow.  This is only taken once the tag table is full.
+static pthread_mutex_t overflowLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+#pragma mark - Tag table
+
+
+/**
+ * @return The id for the given tag, adding it to the table if this is the first time that we've seen it.
+ * Returns TAG_OVERFLOW if the table is full, in which case the crumb holds the string itself.
+ *
+ * Entries are never removed, so a lookup only has to worry about a concurrent insert, and only a miss allocates.
+ */
+static uint32_t tagId(NSString * tag) {
+    CFStringRef s = (__bridge CFStringRef)tag;
+    uint32_t hash = StringPoolHashString(tag) | 1;
+    CFStringRef mine = NULL;
+    uint32_t result = TAG_OVERFLOW;
+
+    for (uint32_t probe = 0; probe < TAG_CAPACITY; probe++) {
+        uint32_t i = (hash + probe) & (TAG_CAPACITY - 1);
+        TagEntry * entry = &tags[i];
+        CFStringRef existing = entry->string;
+        if (existing == NULL) {
+            if (tagCount >= TAG_LIMIT) {
+                break;
+            }
+            if (mine == NULL) {
+                // Tags repeat constantly, so keep just one copy of each.
+                mine = CFBridgingRetain([[StringPool sharedPool] intern:tag]);
+            }
+            if (OSAtomicCompareAndSwapPtrBarrier(NULL, (void *)mine, (void * volatile *)&entry->string)) {
+                entry->hash = hash;
+                OSAtomicIncrement32(&tagCount);
+                return i;
+            }
+            // Someone else took this slot first.  It might even be for the same tag.
+            existing = entry->string;
+        }
+
+        uint32_t h = entry->hash;
+        if (h != 0 && h != hash) {
+            continue;
+        }
+        if (existing == s || CFEqual(existing, s)) {
+            result = i;
+            break;
+        }
+    }
+
+    if (mine != NULL) {
+        CFRelease(mine);
+    }
+    return result;
+}
+
+
+static NSString * tagName(uint32_t tag) {
+    return (tag == TAG_OVERFLOW ? TAG_OVERFLOW_NAME : (__bridge NSString *)tags[tag].string);
+}
+
+
+/**
+ * @return The id for "<" + the given tag.  Must be called on the main thread.
+ */
+static uint32_t popTagId(uint32_t tag) {
+    if (tag == TAG_OVERFLOW) {
+        return TAG_OVERFLOW;
+    }
+    TagEntry * entry = &tags[tag];
+    if (entry->popTag == 0) {
+        entry->popTag = tagId([@"<" stringByAppendingString:tagName(tag)]) + 1;
+    }
+    return entry->popTag - 1;
+}
+
+
+#pragma mark - Crumb ring
+
+
+static inline int64_t makeState(uint32_t seq, uint32_t count) {
+    return (int64_t)(((uint64_t)seq << 32) | count);
+}
+
+
+static inline uint32_t stateSeq(int64_t state) {
+    return (uint32_t)((uint64_t)state >> 32);
+}
+
+
+static inline uint32_t stateCount(int64_t state) {
+    return (uint32_t)state;
+}
+
+
+/**
+ * Clear CRUMB_BUSY and set the count.  Only the owner of a busy crumb may change its state, so this cannot
+ * fail; it is a CAS rather than a store so that it is a single atomic write on 32-bit devices too.
+ */
+static void publishCrumb(Crumb * crumb, uint32_t seq, uint32_t count) {
+    OSAtomicCompareAndSwap64Barrier(makeState(seq, CRUMB_BUSY), makeState(seq, count), &crumb->state);
+}
+
+
+/**
+ * Set the overflow string of a crumb that the caller owns, releasing the old one.
+ */
+static void setCrumbOverflow(Crumb * crumb, NSString * overflow) {
+    if (crumb->overflow == NULL && overflow == nil) {
+        return;
+    }
+
+    CFStringRef mine = (overflow == nil ? NULL : CFBridgingRetain([overflow copy]));
+    pthread_mutex_lock(&overflowLock);
+    CFStringRef old = crumb->overflow;
+    crumb->overflow = mine;
+    pthread_mutex_unlock(&overflowLock);
+    if (old != NULL) {
+        CFRelease(old);
+    }
+}
+
+
+/**
+ * @param overflow The tag, if tag is TAG_OVERFLOW.  Ignored otherwise.
+ */
+static void appendCrumb(CrumbRing * ring, uint32_t tag, NSString * overflow, uint32_t time) {
+    int64_t n = OSAtomicIncrement64Barrier(&ring->count) - 1;
+    uint32_t seq = (uint32_t)(n + 1);
+    Crumb * crumb = &ring->crumbs[n % MAX_CRUMBS];
+
+    while (true) {
+        int64_t old = crumb->state;
+        if ((int32_t)(stateSeq(old) - seq) > 0) {
+            // We were lapped before we got here, so this crumb has already fallen off the end of the trail.
+            return;
+        }
+        if (stateCount(old) & CRUMB_BUSY) {
+            // The previous owner of this slot is still writing it.
+            sched_yield();
+            continue;
+        }
+        if (OSAtomicCompareAndSwap64Barrier(old, makeState(seq, CRUMB_BUSY), &crumb->state)) {
+            break;
+        }
+    }
+
+    crumb->tag = tag;
+    crumb->time = time;
+    setCrumbOverflow(crumb, (tag == TAG_OVERFLOW ? overflow : nil));
+    publishCrumb(crumb, seq, 1);
+}
+
+
+/**
+ * Bump the count on the last crumb if it has the given tag, otherwise append a new one.
+ *
+ * @param overflow The tag, if tag is TAG_OVERFLOW.  Ignored otherwise.
+ * @return The count on the crumb that was written.
+ */
+static uint32_t trackCrumb(CrumbRing * ring, uint32_t tag, NSString * overflow, uint32_t time) {
+    while (true) {
+        int64_t n = ring->count;
+        if (n == 0) {
+            break;
+        }
+
+        Crumb * crumb = &ring->crumbs[(n - 1) % MAX_CRUMBS];
+        uint32_t seq = (uint32_t)n;
+        int64_t old = crumb->state;
+        uint32_t count = stateCount(old);
+        if (stateSeq(old) != seq || (count & CRUMB_BUSY)) {
+            if ((int32_t)(stateSeq(old) - seq) < 0 || (count & CRUMB_BUSY)) {
+                // The last crumb is still being written.
+                sched_yield();
+            }
+            continue;
+        }
+
+        OSMemoryBarrier();
+        if (crumb->tag != tag || count == CRUMB_MAX_COUNT) {
+            break;
+        }
+        if (!OSAtomicCompareAndSwap64Barrier(old, makeState(seq, CRUMB_BUSY), &crumb->state)) {
+            continue;
+        }
+        // Every overflowing tag has the same id, so compare the strings too.  That's only safe once we own the crumb.
+        if (tag == TAG_OVERFLOW && !CFEqual(crumb->overflow, (__bridge CFStringRef)overflow)) {
+            publishCrumb(crumb, seq, count);
+            break;
+        }
+        crumb->time = time;
+        publishCrumb(crumb, seq, count + 1);
+        return count + 1;
+    }
+
+    appendCrumb(ring, tag, overflow, time);
+    return 1;
+}
+
+
+/**
+ * Copy the crumbs that are currently in the trail into result, oldest first.  A crumb that has been claimed but
+ * not yet written is skipped.  Each result's overflow string is retained; snapshotTagName releases it.
+ *
+ * @param result Must have room for MAX_CRUMBS entries.
+ * @return The number of crumbs copied.
+ */
+static NSUInteger snapshotCrumbs(CrumbRing * ring, Crumb * result) {
+    int64_t n = ring->count;
+    int64_t first = (n > MAX_CRUMBS ? n - MAX_CRUMBS : 0);
+    NSUInteger count = 0;
+
+    for (int64_t i = first; i < n; i++) {
+        Crumb * crumb = &ring->crumbs[i % MAX_CRUMBS];
+        uint32_t seq = (uint32_t)(i + 1);
+        while (true) {
+            int64_t state = crumb->state;
+            if (stateSeq(state) != seq) {
+                // Either not written yet, or already overwritten.
+                break;
+            }
+            if (stateCount(state) & CRUMB_BUSY) {
+                sched_yield();
+                continue;
+            }
+            OSMemoryBarrier();
+            uint32_t tag = crumb->tag;
+            uint32_t time = crumb->time;
+            CFStringRef overflow = NULL;
+            if (tag == TAG_OVERFLOW) {
+                pthread_mutex_lock(&overflowLock);
+                overflow = crumb->overflow;
+                if (overflow != NULL) {
+                    CFRetain(overflow);
+                }
+                pthread_mutex_unlock(&overflowLock);
+            }
+            OSMemoryBarrier();
+            if (crumb->state != state) {
+                if (overflow != NULL) {
+                    CFRelease(overflow);
+                }
+                continue;
+            }
+            result[count].state = state;
+            result[count].tag = tag;
+            result[count].time = time;
+            result[count].overflow = overflow;
+            count++;
+            break;
+        }
+    }
+    return count;
+}
+
+
+/**
+ * @return The tag of a crumb from snapshotCrumbs, releasing its overflow string.
+ */
+static NSString * snapshotTagName(Crumb * crumb) {
+    if (crumb->tag != TAG_OVERFLOW) {
+        return tagName(crumb->tag);
+    }
+    NSString * result = CFBridgingRelease(crumb->overflow);
+    crumb->overflow = NULL;
+    return (result == nil ? TAG_OVERFLOW_NAME : result);
+}
+
+
+#pragma mark -
+
 
 @implementation Breadcrumbs
 
@@ -49,8 +401,9 @@ static NSDictionary* customProps = nil;
     if (self != [Breadcrumbs class]) {
         return;
     }
+    crumbEpoch = CFAbsoluteTimeGetCurrent();
     instance = [[Breadcrumbs alloc] init];
-    
+
     // Populate dictionary of known custom properties
     // Used in DEBUG to check event properties
     // See Confluence for definition of custom properties
@@ -72,6 +425,11 @@ static NSDictionary* customProps = nil;
 }
 
 
++(void)setLogsToConsole:(BOOL)logsToConsole {
+    instance.logsToConsole = logsToConsole;
+}
+
+
 +(void)push:(NSString*)tag {
     [instance push:tag];
 
@@ -90,16 +448,43 @@ static NSDictionary* customProps = nil;
     [instance track:tag with:props];
 }
 
+
++(NSArray*)trail {
+    return [instance trail];
+}
+
+
++(NSArray*)trailEntries {
+    return [instance trailEntries];
+}
+
+
 -(instancetype)init {
     self = [super init];
     if (self) {
-        _breadCrumbs = [NSMutableArray array];
         _crumbStack = [NSMutableArray array];
+        _logsToConsole = YES;
     }
     return self;
 }
 
 
+-(void)dealloc {
+    for (NSUInteger i = 0; i < MAX_CRUMBS; i++) {
+        if (ring.crumbs[i].overflow != NULL) {
+            CFRelease(ring.crumbs[i].overflow);
+        }
+    }
+}
+
+
+-(void)setDelegate:(NSObject<BreadcrumbsDelegate> *)delegate {
+    _delegate = delegate;
+    delegateSavesTrail = [delegate respondsToSelector:@selector(breadcrumbsSaveTrail:)];
+    delegateTracks = [delegate respondsToSelector:@selector(breadcrumbsTrack:method:)];
+}
+
+
 -(void)push:(NSString*)tag {
     AssertOnMainThread();
     [self.crumbStack addObject:tag];
@@ -110,11 +495,11 @@ static NSDictionary* customProps = nil;
 -(void)pop:(NSString*)tag {
     AssertOnMainThread();
     if (self.crumbStack.count) {
-        NSUInteger index = [self.crumbStack indexOfObjectWithOptions:NSEnumerationReverse passingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
+        NSUInteger index = (tag == nil ? self.crumbStack.count - 1 : [self.crumbStack indexOfObjectWithOptions:NSEnumerationReverse passingTest:^BOOL(id obj, NSUInteger idx, BOOL *stop) {
             return [tag isEqualToString:(NSString *) obj];
-        }];
-        
-        if (tag != nil && index == NSNotFound) {
+        }]);
+
+        if (index == NSNotFound) {
             NSString * popMismatchTag = [NSString stringWithFormat:@"pop-mismatch-%@-%@", tag, [self.crumbStack lastObject]];
 #if DEBUG
             TBAssertRaise(@"%@", popMismatchTag);
@@ -123,9 +508,10 @@ static NSDictionary* customProps = nil;
 #endif
         }
         else {
-            NSString *popTag = [NSString stringWithFormat:@"<%@", [self.crumbStack objectAtIndex:index]];
+            NSString * popped = [self.crumbStack objectAtIndex:index];
+            uint32_t popTag = popTagId(tagId(popped));
             [self.crumbStack removeObjectAtIndex:index];
-            [self track:popTag method:Pop];
+            [self trackTagId:popTag overflow:(popTag == TAG_OVERFLOW ? [@"<" stringByAppendingString:popped] : nil) method:Pop];
         }
     }
     else {
@@ -139,38 +525,44 @@ static NSDictionary* customProps = nil;
 }
 
 
--(void)track:(NSString*)tag method:(TrackMethod)meth{
-    NSObject<BreadcrumbsDelegate>* mydelegate = self.delegate;
+-(void)track:(NSString*)tag method:(TrackMethod)meth {
+    [self trackTagId:tagId(tag) overflow:tag method:meth];
+}
+
 
-    @synchronized(self.breadCrumbs) {
-        NSArray* bits = lastCrumbBits(self.breadCrumbs);
-        if ((bits.count == 1 || bits.count == 2) && [bits[0] isEqualToString:tag]) {
-            int count = bits.count == 2 ? [bits[1] intValue] : 1;
-            NSString* new_multiple = [NSString stringWithFormat:@"%@*%d", bits[0], count + 1];
-            NSLog(@"%@", new_multiple);
-            [self.breadCrumbs removeLastObject];
-            [self.breadCrumbs addObject:new_multiple];
+/**
+ * @param overflow The tag, if tag is TAG_OVERFLOW.  Ignored otherwise.
+ */
+-(void)trackTagId:(uint32_t)tag overflow:(NSString *)overflow method:(TrackMethod)meth {
+    uint32_t now = (uint32_t)((CFAbsoluteTimeGetCurrent() - crumbEpoch) * 100.0);
+    uint32_t count = trackCrumb(&ring, tag, overflow, now);
+
+    NSString * tagStr = (tag == TAG_OVERFLOW ? overflow : tagName(tag));
+    if (self.logsToConsole) {
+        if (count == 1) {
+            NSLog(@"%@", tagStr);
         }
         else {
-            NSLog(@"%@", tag);
-            [self.breadCrumbs addObject:tag];
-            if (self.breadCrumbs.count == MAX_CRUMBS)
-                [self.breadCrumbs removeObjectAtIndex:0];
+            NSLog(@"%@*%u", tagStr, count);
         }
+    }
 
-        if ([mydelegate respondsToSelector:@selector(breadcrumbsSaveTrail:)]) {
-            [mydelegate breadcrumbsSaveTrail:self.breadCrumbs];
-        }
+    NSObject<BreadcrumbsDelegate>* mydelegate = self.delegate;
+
+    if (delegateSavesTrail) {
+        [mydelegate breadcrumbsSaveTrail:[self trail]];
     }
 
-    if ([mydelegate respondsToSelector:@selector(breadcrumbsTrack:method:)]) {
-        [mydelegate breadcrumbsTrack:tag method:meth];
+    if (delegateTracks) {
+        [mydelegate breadcrumbsTrack:tagStr method:meth];
     }
 }
 
 
 -(void)track:(NSString*)tag with:(NSDictionary*)props {
-    NSLog(@"%@ %@", tag, [[props description] stringByFoldingWhitespace]);
+    if (self.logsToConsole) {
+        NSLog(@"%@ %@", tag, [[props description] stringByFoldingWhitespace]);
+    }
 
     NSObject<BreadcrumbsDelegate>* mydelegate = self.delegate;
 
@@ -181,20 +573,35 @@ static NSDictionary* customProps = nil;
             TBAssertRaise(@"Bad event property: %@", prop);
     }
 #endif
-    
+
     if ([mydelegate respondsToSelector:@selector(breadcrumbsTrack:with:)]) {
         [mydelegate breadcrumbsTrack:tag with:props];
     }
 }
 
 
-// Assumes that it is already locked under @synchronized (crumbs).
-static NSArray* lastCrumbBits(NSArray* crumbs) {
-    if (crumbs.count == 0) {
-        return nil;
+-(NSArray*)trail {
+    Crumb crumbs[MAX_CRUMBS];
+    NSUInteger n = snapshotCrumbs(&ring, crumbs);
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:n];
+    for (NSUInteger i = 0; i < n; i++) {
+        NSString * tag = snapshotTagName(&crumbs[i]);
+        uint32_t count = stateCount(crumbs[i].state);
+        [result addObject:(count == 1 ? tag : [NSString stringWithFormat:@"%@*%u", tag, count])];
+    }
+    return result;
+}
+
+
+-(NSArray*)trailEntries {
+    Crumb crumbs[MAX_CRUMBS];
+    NSUInteger n = snapshotCrumbs(&ring, crumbs);
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:n];
+    for (NSUInteger i = 0; i < n; i++) {
+        NSDate * date = [NSDate dateWithTimeIntervalSinceReferenceDate:crumbEpoch + crumbs[i].time / 100.0];
+        [result addObject:[[BreadcrumbsEntry alloc] initWithTag:snapshotTagName(&crumbs[i]) count:stateCount(crumbs[i].state) date:date]];
     }
-    NSString* lastCrumb = crumbs[crumbs.count - 1];
-    return [lastCrumb componentsSeparatedByString:@"*"];
+    return result;
 }
 
 
@@ -0,0 +1,103 @@
+//
+//  CivilTime.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/8/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/*
+ * Calendar arithmetic in the proleptic Gregorian calendar, and tables of a timezone's UTC offsets, so that day
+ * boundaries and local times can be computed without going through NSCalendar or localtime_r (both of which are
+ * slow and take locks).
+ *
+ * Times here are whole seconds since 1970-01-01 00:00:00, either UTC or local wall-clock time.  Days are days since
+ * 1970-01-01.  The date algorithms are from http://howardhinnant.github.io/date_algorithms.html.
+ */
+
+
+/**
+ * @return The number of days from 1970-01-01 to the given date.  day may be outside the month, in which case it
+ * rolls over into the neighboring months.
+ */
+extern int64_t CivilTimeDaysFromDate(int year, int month, int day);
+
+/**
+ * Converts days since 1970-01-01 into a year, a month (1-12), and a day of the month (1-31).
+ */
+extern void CivilTimeDateFromDays(int64_t days, int * year, int * month, int * day);
+
+/**
+ * @return The day of the week of the given day, from 0 for Sunday to 6 for Saturday.
+ */
+extern int CivilTimeWeekdayFromDays(int64_t days);
+
+/**
+ * @return seconds / 86400, rounded down.
+ */
+extern int64_t CivilTimeDaysFromSeconds(int64_t seconds);
+
+
+/**
+ * The UTC offsets of one timezone, found once using NSTimeZone and then read without locks.
+ *
+ * A table covers times from CIVIL_TIME_TABLE_START to CIVIL_TIME_TABLE_END.  Outside that, lookups fail, and the
+ * caller should fall back to NSTimeZone or NSCalendar.
+ */
+typedef struct CivilTimeZoneTable CivilTimeZoneTable;
+
+#define CIVIL_TIME_TABLE_START 0LL              // 1970-01-01
+#define CIVIL_TIME_TABLE_END   2145916800LL     // 2038-01-01
+
+extern CivilTimeZoneTable * CivilTimeZoneTableCreate(NSTimeZone * tz) __attribute__((nonnull(1)));
+extern void CivilTimeZoneTableFree(CivilTimeZoneTable * table);
+
+/**
+ * @return The table for the system timezone.  This is built the first time that it is needed, and then cached
+ * until the system timezone changes.  Cached tables are never freed, so they can be used from any thread.
+ *
+ * This may return NULL if the system timezone changes while the table is being built.  The lookup functions below
+ * accept a NULL table, and fail.
+ */
+extern const CivilTimeZoneTable * CivilTimeZoneTableForSystemTimeZone(void);
+
+/**
+ * @return CivilTimeZoneTableForSystemTimeZone() if tz is the system timezone, or NULL otherwise.
+ */
+extern const CivilTimeZoneTable * CivilTimeZoneTableForTimeZone(NSTimeZone * tz);
+
+/**
+ * @return A table for UTC.
+ */
+extern const CivilTimeZoneTable * CivilTimeZoneTableForUTC(void);
+
+/**
+ * Drop the cached table for the system timezone.  This happens automatically on
+ * NSSystemTimeZoneDidChangeNotification.
+ */
+extern void CivilTimeZoneTableInvalidateSystemTimeZone(void);
+
+/**
+ * Sets *local to the local time at the given UTC time.
+ *
+ * @return NO if utc is outside the table.
+ */
+extern BOOL CivilTimeZoneTableLocalFromUTC(const CivilTimeZoneTable * table, int64_t utc, int64_t * local);
+
+/**
+ * Sets *utc to the UTC time of the given local time.
+ *
+ * @return NO if local is outside the table, or if it is skipped or repeated by a transition (so it doesn't map to
+ * exactly one UTC time).  Callers should ask NSCalendar in that case, so that they get its rules.
+ */
+extern BOOL CivilTimeZoneTableUTCFromLocal(const CivilTimeZoneTable * table, int64_t local, int64_t * utc);
+
+/**
+ * Sets *utc to the given date in whole seconds since 1970, rounded down.
+ *
+ * @return NO if date is nil or outside CIVIL_TIME_TABLE_START to CIVIL_TIME_TABLE_END.
+ */
+extern BOOL CivilTimeSecondsFromDate(NSDate * date, int64_t * utc);
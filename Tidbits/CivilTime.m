@@ -0,0 +1,273 @@
+//
+//  CivilTime.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/8/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <libkern/OSAtomic.h>
+
+#import "CivilTime.h"
+
+
+#define DAY_IN_SECONDS 86400
+
+
+struct CivilTimeZoneTable {
+    CFTypeRef timeZone;     // Retained.
+    NSUInteger count;       // The number of transitions.
+    int64_t * times;        // The UTC time of each transition, ascending.
+    int32_t * offsets;      // count + 1 offsets: offsets[i] is in effect before times[i], and offsets[count] after the last one.
+};
+
+
+int64_t CivilTimeDaysFromDate(int year, int month, int day) {
+    year -= (month <= 2);
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+
+void CivilTimeDateFromDays(int64_t days, int * year, int * month, int * day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned doe = (unsigned)(days - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    *day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    *month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *year = (int)((int64_t)yoe + era * 400 + (*month <= 2));
+}
+
+
+int CivilTimeWeekdayFromDays(int64_t days) {
+    // 1970-01-01 was a Thursday.
+    int result = (int)((days + 4) % 7);
+    return (result < 0 ? result + 7 : result);
+}
+
+
+int64_t CivilTimeDaysFromSeconds(int64_t seconds) {
+    return (seconds >= 0 ? seconds : seconds - (DAY_IN_SECONDS - 1)) / DAY_IN_SECONDS;
+}
+
+
+BOOL CivilTimeSecondsFromDate(NSDate * date, int64_t * utc) {
+    if (date == nil) {
+        return NO;
+    }
+    NSTimeInterval t = floor([date timeIntervalSince1970]);
+    if (!(t >= CIVIL_TIME_TABLE_START && t < CIVIL_TIME_TABLE_END)) {
+        return NO;
+    }
+    *utc = (int64_t)t;
+    return YES;
+}
+
+
+#pragma mark - Timezone tables
+
+
+static int32_t offsetAt(NSTimeZone * tz, int64_t t) {
+    return (int32_t)[tz secondsFromGMTForDate:[NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)t]];
+}
+
+
+CivilTimeZoneTable * CivilTimeZoneTableCreate(NSTimeZone * tz) {
+    NSMutableData * times = [NSMutableData data];
+    NSMutableData * offsets = [NSMutableData data];
+
+    int64_t t = CIVIL_TIME_TABLE_START;
+    int32_t offset = offsetAt(tz, t);
+    [offsets appendBytes:&offset length:sizeof(offset)];
+    while (t < CIVIL_TIME_TABLE_END) {
+        NSDate * nextDate = [tz nextDaylightSavingTimeTransitionAfterDate:[NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)t]];
+        int64_t next = (nextDate == nil ? CIVIL_TIME_TABLE_END : MIN(CIVIL_TIME_TABLE_END, (int64_t)ceil(nextDate.timeIntervalSince1970)));
+
+        // nextDaylightSavingTimeTransitionAfterDate only tells us about DST, so look for any other change in the
+        // offset before next (e.g. a change of standard time), and bisect to find it if there is one.
+        if (offsetAt(tz, next - 1) != offset) {
+            int64_t lo = t;
+            int64_t hi = next - 1;
+            while (hi - lo > 1) {
+                int64_t mid = lo + (hi - lo) / 2;
+                if (offsetAt(tz, mid) == offset) {
+                    lo = mid;
+                }
+                else {
+                    hi = mid;
+                }
+            }
+            next = hi;
+        }
+        if (next >= CIVIL_TIME_TABLE_END) {
+            break;
+        }
+
+        int32_t nextOffset = offsetAt(tz, next);
+        if (nextOffset != offset) {
+            [times appendBytes:&next length:sizeof(next)];
+            [offsets appendBytes:&nextOffset length:sizeof(nextOffset)];
+            offset = nextOffset;
+        }
+        t = next;
+    }
+
+    NSUInteger count = times.length / sizeof(int64_t);
+    size_t size = sizeof(CivilTimeZoneTable) + times.length + offsets.length;
+    CivilTimeZoneTable * table = malloc(size);
+    if (table == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)size];
+    }
+    table->timeZone = CFBridgingRetain(tz);
+    table->count = count;
+    table->times = (int64_t *)(table + 1);
+    table->offsets = (int32_t *)(table->times + count);
+    memcpy(table->times, times.bytes, times.length);
+    memcpy(table->offsets, offsets.bytes, offsets.length);
+    return table;
+}
+
+
+void CivilTimeZoneTableFree(CivilTimeZoneTable * table) {
+    if (table == NULL) {
+        return;
+    }
+    CFRelease(table->timeZone);
+    free(table);
+}
+
+
+/**
+ * @return The index of the first transition after t, or table->count if there is none.  This is also the index
+ * of the offset in effect at t.
+ */
+static NSUInteger periodOf(const CivilTimeZoneTable * table, int64_t t) {
+    NSUInteger lo = 0;
+    NSUInteger hi = table->count;
+    while (lo < hi) {
+        NSUInteger mid = lo + (hi - lo) / 2;
+        if (table->times[mid] <= t) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+BOOL CivilTimeZoneTableLocalFromUTC(const CivilTimeZoneTable * table, int64_t utc, int64_t * local) {
+    if (table == NULL || utc < CIVIL_TIME_TABLE_START || utc >= CIVIL_TIME_TABLE_END) {
+        return NO;
+    }
+    *local = utc + table->offsets[periodOf(table, utc)];
+    return YES;
+}
+
+
+BOOL CivilTimeZoneTableUTCFromLocal(const CivilTimeZoneTable * table, int64_t local, int64_t * utc) {
+    if (table == NULL || local < CIVIL_TIME_TABLE_START - DAY_IN_SECONDS || local >= CIVIL_TIME_TABLE_END + DAY_IN_SECONDS) {
+        return NO;
+    }
+
+    // The answer is in the period around local - offset, or one of its neighbors.  Check each of those, and make
+    // sure that exactly one of them fits.
+    NSUInteger guess = periodOf(table, local - table->offsets[periodOf(table, local)]);
+    NSUInteger first = (guess > 0 ? guess - 1 : 0);
+    NSUInteger last = MIN(guess + 1, table->count);
+    BOOL found = NO;
+    int64_t result = 0;
+    for (NSUInteger i = first; i <= last; i++) {
+        int64_t u = local - table->offsets[i];
+        if ((i == 0 || u >= table->times[i - 1]) && (i == table->count || u < table->times[i])) {
+            if (found) {
+                // Repeated.
+                return NO;
+            }
+            found = YES;
+            result = u;
+        }
+    }
+    if (!found || result < CIVIL_TIME_TABLE_START || result >= CIVIL_TIME_TABLE_END) {
+        // Skipped, or out of range.
+        return NO;
+    }
+    *utc = result;
+    return YES;
+}
+
+
+#pragma mark - Cached tables
+
+
+/**
+ * Readers don't take a lock, so they may still be using a table after it has been replaced.  For that reason,
+ * tables that have been published here are never freed.  This means leaking a table each time the system timezone
+ * changes, which is rare, and a table is only a couple of KB.
+ */
+static CivilTimeZoneTable * volatile systemTable = NULL;
+
+
+static const CivilTimeZoneTable * installSystemTable(NSTimeZone * tz) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        [[NSNotificationCenter defaultCenter] addObserverForName:NSSystemTimeZoneDidChangeNotification object:nil queue:nil usingBlock:^(__unused NSNotification * note) {
+            CivilTimeZoneTableInvalidateSystemTimeZone();
+        }];
+    });
+
+    CivilTimeZoneTable * table = CivilTimeZoneTableCreate(tz);
+    CivilTimeZoneTable * old = systemTable;
+    if (!OSAtomicCompareAndSwapPtrBarrier(old, table, (void * volatile *)&systemTable)) {
+        // Someone else changed it at the same time.  Let them win.
+        CivilTimeZoneTableFree(table);
+        return NULL;
+    }
+    return table;
+}
+
+
+void CivilTimeZoneTableInvalidateSystemTimeZone() {
+    CivilTimeZoneTable * old;
+    do {
+        old = systemTable;
+    } while (!OSAtomicCompareAndSwapPtrBarrier(old, NULL, (void * volatile *)&systemTable));
+}
+
+
+const CivilTimeZoneTable * CivilTimeZoneTableForSystemTimeZone() {
+    const CivilTimeZoneTable * table = systemTable;
+    return (table != NULL ? table : installSystemTable([NSTimeZone systemTimeZone]));
+}
+
+
+const CivilTimeZoneTable * CivilTimeZoneTableForTimeZone(NSTimeZone * tz) {
+    if (tz == nil) {
+        return NULL;
+    }
+    const CivilTimeZoneTable * table = systemTable;
+    if (table != NULL && table->timeZone == (__bridge CFTypeRef)tz) {
+        return table;
+    }
+    // Either there's no table yet, or the system timezone has changed and we haven't heard about it yet, or tz is
+    // some other timezone.
+    NSTimeZone * systemTimeZone = [NSTimeZone systemTimeZone];
+    return (tz == systemTimeZone ? installSystemTable(systemTimeZone) : NULL);
+}
+
+
+const CivilTimeZoneTable * CivilTimeZoneTableForUTC() {
+    static CivilTimeZoneTable * table;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        table = CivilTimeZoneTableCreate([NSTimeZone timeZoneForSecondsFromGMT:0]);
+    });
+    return table;
+}
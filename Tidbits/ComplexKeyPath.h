@@ -0,0 +1,52 @@
+//
+//  ComplexKeyPath.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/3/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * A compiled form of the key paths accepted by -[NSObject valueForComplexKeyPath:] (MTJSONUtils), such as
+ * @"messages[first].from.email" or @"items[3].price".
+ *
+ * The path is split into key and subscript steps once, so evaluating it doesn't parse anything or create any
+ * strings.  Dictionaries are read with objectForKey:, and everything else goes through valueForKey:, so the result
+ * is the same as valueForKeyPath: on each dotted section.  A key beginning with '@' (a collection operator) is passed
+ * to valueForKeyPath: along with the rest of its section.
+ *
+ * Subscripts are [n], [first], or [last].  A subscript that is out of range, or that is applied to anything other
+ * than an NSArray, or that lands on NSNull, gives nil.
+ *
+ * Unlike the original MTJSONUtils parser, a subscript with no key before it (@"[0]" or @"a[0][1]") applies to the
+ * current object, rather than giving nil, and a path with an unclosed '[' gives nil.
+ *
+ * Instances are immutable and thread-safe.
+ */
+@interface ComplexKeyPath : NSObject
+
+@property (nonatomic, readonly) NSString * string;
+
+/**
+ * @return The compiled path for the given string, from a shared cache of recently used paths.
+ */
++(instancetype)keyPathWithString:(NSString *)string __attribute__((nonnull));
+
+-(instancetype)initWithString:(NSString *)string __attribute__((nonnull));
+
+-(id)valueForObject:(id)obj;
+
+/**
+ * Evaluate several paths against each of the given objects, in one pass over the objects.  Where a path shares
+ * leading steps with the path before it in keyPaths, those steps are only evaluated once per object, so put paths
+ * with a common prefix next to each other.
+ *
+ * @param keyPaths NSStrings or ComplexKeyPaths.
+ * @return One NSArray per key path, each with one value per object, with NSNull where the value was nil.
+ */
++(NSArray *)valuesForKeyPaths:(NSArray *)keyPaths ofObjects:(NSArray *)objects;
+
+@end
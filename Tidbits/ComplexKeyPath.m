@@ -0,0 +1,296 @@
+//
+//  ComplexKeyPath.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/3/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "LRUCache.h"
+
+#import "ComplexKeyPath.h"
+
+
+#define CACHE_COUNT_LIMIT 256
+
+// valuesForKeyPaths:ofObjects: shares at most this many leading steps between paths.
+#define MAX_SHARED_STEPS 16
+
+
+typedef NS_ENUM(uint8_t, StepKind) {
+    // valueForKey: (or objectForKey: on a dictionary).
+    StepKey,
+    // valueForKeyPath:, for collection operators.
+    StepKeyPath,
+    // [n] or [first].
+    StepIndex,
+    // [last].
+    StepLast,
+};
+
+
+typedef struct {
+    StepKind kind;
+    // Owned by the keys array.
+    __unsafe_unretained NSString * key;
+    NSUInteger index;
+} Step;
+
+
+@implementation ComplexKeyPath
+{
+    Step * steps;
+    NSUInteger stepCount;
+    // Keeps the strings in steps alive.
+    NSMutableArray * keys;
+    BOOL invalid;
+}
+
+
++(instancetype)keyPathWithString:(NSString *)string {
+    NSParameterAssert(string);
+
+    static LRUCache * cache;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[LRUCache alloc] initWithCountLimit:CACHE_COUNT_LIMIT];
+    });
+
+    ComplexKeyPath * result = [cache objectForKey:string];
+    if (result == nil) {
+        result = [[ComplexKeyPath alloc] initWithString:string];
+        [cache setObject:result forKey:string];
+    }
+    return result;
+}
+
+
+-(instancetype)initWithString:(NSString *)string {
+    NSParameterAssert(string);
+
+    self = [super init];
+    if (self) {
+        _string = [string copy];
+        keys = [NSMutableArray array];
+        [self compile];
+    }
+    return self;
+}
+
+
+-(void)dealloc {
+    free(steps);
+}
+
+
+-(NSString *)description {
+    return [NSString stringWithFormat:@"<ComplexKeyPath %@>", _string];
+}
+
+
+#pragma mark - Compilation
+
+
+-(void)compile {
+    NSString * s = _string;
+    NSUInteger len = s.length;
+
+    // Every step uses at least one character, apart from the first key.
+    steps = malloc((len + 1) * sizeof(Step));
+    if (steps == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %lu steps", (unsigned long)len + 1];
+    }
+
+    NSUInteger sectionStart = 0;
+    NSUInteger i = 0;
+    while (i < len) {
+        if ([s characterAtIndex:i] != '[') {
+            i++;
+            continue;
+        }
+
+        [self compileSection:NSMakeRange(sectionStart, i - sectionStart)];
+
+        NSRange close = [s rangeOfString:@"]" options:NSLiteralSearch range:NSMakeRange(i + 1, len - i - 1)];
+        if (close.location == NSNotFound) {
+            invalid = YES;
+            return;
+        }
+        NSString * subscript = [s substringWithRange:NSMakeRange(i + 1, close.location - i - 1)];
+        Step * step = &steps[stepCount++];
+        if ([subscript isEqualToString:@"last"]) {
+            step->kind = StepLast;
+        }
+        else {
+            step->kind = StepIndex;
+            // "first" is 0, and so is anything else that isn't a number, as with intValue in MTJSONUtils.  Negative
+            // numbers become huge, so are always out of range.
+            step->index = ([subscript isEqualToString:@"first"] ? 0 : (NSUInteger)(NSInteger)[subscript intValue]);
+        }
+
+        i = close.location + 1;
+        sectionStart = i;
+    }
+    [self compileSection:NSMakeRange(sectionStart, len - sectionStart)];
+}
+
+
+/**
+ * Compile the text between subscripts, which MTJSONUtils trims and passes to valueForKeyPath:.
+ */
+-(void)compileSection:(NSRange)range {
+    static NSCharacterSet * trimSet;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        trimSet = [NSCharacterSet characterSetWithCharactersInString:@". \n"];
+    });
+
+    NSString * section = [[_string substringWithRange:range] stringByTrimmingCharactersInSet:trimSet];
+    if (section.length == 0) {
+        return;
+    }
+
+    NSArray * components = [section componentsSeparatedByString:@"."];
+    NSUInteger count = components.count;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString * key = components[i];
+        Step * step = &steps[stepCount++];
+        if ([key hasPrefix:@"@"]) {
+            // A collection operator consumes the rest of the path, so leave that to valueForKeyPath:.
+            step->kind = StepKeyPath;
+            key = [[components subarrayWithRange:NSMakeRange(i, count - i)] componentsJoinedByString:@"."];
+            [keys addObject:key];
+            step->key = key;
+            return;
+        }
+        step->kind = StepKey;
+        [keys addObject:key];
+        step->key = key;
+    }
+}
+
+
+#pragma mark - Evaluation
+
+
+static inline id applyStep(const Step * step, id obj) {
+    if (obj == nil) {
+        return nil;
+    }
+
+    switch (step->kind) {
+        case StepKey:
+            return ([obj isKindOfClass:[NSDictionary class]] ?
+                    [(NSDictionary *)obj objectForKey:step->key] :
+                    [obj valueForKey:step->key]);
+
+        case StepKeyPath:
+            return [obj valueForKeyPath:step->key];
+
+        case StepIndex:
+        case StepLast: {
+            if (![obj isKindOfClass:[NSArray class]]) {
+                return nil;
+            }
+            NSArray * arr = obj;
+            NSUInteger count = arr.count;
+            if (count == 0) {
+                return nil;
+            }
+            NSUInteger index = (step->kind == StepLast ? count - 1 : step->index);
+            if (index >= count) {
+                return nil;
+            }
+            id result = arr[index];
+            return (result == [NSNull null] ? nil : result);
+        }
+    }
+}
+
+
+-(id)valueForObject:(id)obj {
+    if (invalid) {
+        return nil;
+    }
+    for (NSUInteger i = 0; i < stepCount && obj != nil; i++) {
+        obj = applyStep(&steps[i], obj);
+    }
+    return obj;
+}
+
+
+static BOOL stepsEqual(const Step * a, const Step * b) {
+    if (a->kind != b->kind) {
+        return NO;
+    }
+    switch (a->kind) {
+        case StepKey:
+        case StepKeyPath:
+            return [a->key isEqualToString:b->key];
+        case StepIndex:
+            return a->index == b->index;
+        case StepLast:
+            return YES;
+    }
+}
+
+
++(NSArray *)valuesForKeyPaths:(NSArray *)keyPaths ofObjects:(NSArray *)objects {
+    NSUInteger pathCount = keyPaths.count;
+    NSUInteger objectCount = objects.count;
+
+    NSMutableArray * compiled = [NSMutableArray arrayWithCapacity:pathCount];
+    NSMutableArray * columns = [NSMutableArray arrayWithCapacity:pathCount];
+    for (id path in keyPaths) {
+        [compiled addObject:([path isKindOfClass:[ComplexKeyPath class]] ? path : [ComplexKeyPath keyPathWithString:path])];
+        [columns addObject:[NSMutableArray arrayWithCapacity:objectCount]];
+    }
+
+    // shared[j] is the number of leading steps that path j has in common with path j - 1.
+    NSUInteger * shared = calloc(MAX(pathCount, 1), sizeof(NSUInteger));
+    if (shared == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %lu entries", (unsigned long)pathCount];
+    }
+    for (NSUInteger j = 1; j < pathCount; j++) {
+        ComplexKeyPath * prev = compiled[j - 1];
+        ComplexKeyPath * cur = compiled[j];
+        if (prev->invalid || cur->invalid) {
+            continue;
+        }
+        NSUInteger limit = MIN(MIN(prev->stepCount, cur->stepCount), MAX_SHARED_STEPS);
+        NSUInteger n = 0;
+        while (n < limit && stepsEqual(&prev->steps[n], &cur->steps[n])) {
+            n++;
+        }
+        shared[j] = n;
+    }
+
+    NSNull * null = [NSNull null];
+    for (id obj in objects) {
+        // intermediates[k] is the value after the first k steps of the most recent path.
+        __strong id intermediates[MAX_SHARED_STEPS + 1];
+        intermediates[0] = obj;
+
+        for (NSUInteger j = 0; j < pathCount; j++) {
+            ComplexKeyPath * path = compiled[j];
+            id value = nil;
+            if (!path->invalid) {
+                NSUInteger start = shared[j];
+                value = intermediates[start];
+                for (NSUInteger k = start; k < path->stepCount; k++) {
+                    value = applyStep(&path->steps[k], value);
+                    if (k + 1 <= MAX_SHARED_STEPS) {
+                        intermediates[k + 1] = value;
+                    }
+                }
+            }
+            [columns[j] addObject:(value == nil ? null : value)];
+        }
+    }
+
+    free(shared);
+    return columns;
+}
+
+
+@end
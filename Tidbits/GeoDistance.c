@@ -0,0 +1,292 @@
+//
+//  GeoDistance.c
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#include "GeoDistance.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#define HAVE_DISPATCH 1
+#endif
+
+
+#define DEG_TO_RAD (M_PI / 180.0)
+#define RAD_TO_DEG (180.0 / M_PI)
+
+// WGS-84.
+#define WGS84_A 6378137.0
+#define WGS84_F (1.0 / 298.257223563)
+#define WGS84_B (WGS84_A * (1.0 - WGS84_F))
+
+#define VINCENTY_MAX_ITERATIONS 200
+#define VINCENTY_TOLERANCE 1e-12
+
+// Destinations are processed in blocks of this many, so that the staging arrays stay in L1.  Must be even.
+#define BLOCK_SIZE 64
+
+// Concurrent batches are split into chunks of this many destinations, and are only split at all if there are at
+// least two chunks.  Below that, dispatch costs more than it saves.
+#define CONCURRENT_CHUNK_SIZE 2048
+
+
+typedef double v2f64 __attribute__((vector_size(16)));
+
+
+/**
+ * Everything about the origin that doesn't depend on the destination.
+ */
+typedef struct {
+    double latitude;        // Radians.
+    double longitude;       // Radians.
+    double sinLatitude;
+    double cosLatitude;
+    double sinU;            // Reduced latitude, for Vincenty.
+    double cosU;
+} Origin;
+
+
+static void makeOrigin(double latitude, double longitude, Origin * origin) {
+    origin->latitude = latitude * DEG_TO_RAD;
+    origin->longitude = longitude * DEG_TO_RAD;
+    origin->sinLatitude = sin(origin->latitude);
+    origin->cosLatitude = cos(origin->latitude);
+
+    double tanU = (1.0 - WGS84_F) * tan(origin->latitude);
+    origin->cosU = 1.0 / sqrt(1.0 + tanU * tanU);
+    origin->sinU = tanU * origin->cosU;
+}
+
+
+static inline v2f64 splat(double d) {
+    v2f64 v = { d, d };
+    return v;
+}
+
+
+static inline double normalizeBearing(double radians) {
+    double degrees = radians * RAD_TO_DEG;
+    return (degrees < 0.0 ? degrees + 360.0 : degrees);
+}
+
+
+/**
+ * The haversine formula, with the bearing from the same terms.  The half-angle sines and cosines of the longitude
+ * difference give the full-angle ones by the double-angle formulae, so each destination needs three sin/cos pairs,
+ * two square roots, and two atan2s.
+ */
+static void haversineRange(const Origin * origin, const double * latitudes, const double * longitudes, size_t count,
+                           double * distances, double * bearings) {
+    double sinLat2[BLOCK_SIZE];
+    double cosLat2[BLOCK_SIZE];
+    double sinHalfDLat[BLOCK_SIZE];
+    double sinHalfDLon[BLOCK_SIZE];
+    double cosHalfDLon[BLOCK_SIZE];
+    double a[BLOCK_SIZE];
+    double y[BLOCK_SIZE];
+    double x[BLOCK_SIZE];
+
+    const v2f64 sinLat1 = splat(origin->sinLatitude);
+    const v2f64 cosLat1 = splat(origin->cosLatitude);
+    const v2f64 one = splat(1.0);
+    const v2f64 two = splat(2.0);
+
+    for (size_t start = 0; start < count; start += BLOCK_SIZE) {
+        size_t n = (count - start < BLOCK_SIZE ? count - start : BLOCK_SIZE);
+
+        for (size_t i = 0; i < n; i++) {
+            double lat2 = latitudes[start + i] * DEG_TO_RAD;
+            double halfDLon = (longitudes[start + i] * DEG_TO_RAD - origin->longitude) * 0.5;
+            sinLat2[i] = sin(lat2);
+            cosLat2[i] = cos(lat2);
+            sinHalfDLat[i] = sin((lat2 - origin->latitude) * 0.5);
+            sinHalfDLon[i] = sin(halfDLon);
+            cosHalfDLon[i] = cos(halfDLon);
+        }
+        if (n % 2 != 0) {
+            sinLat2[n] = cosLat2[n] = sinHalfDLat[n] = sinHalfDLon[n] = cosHalfDLon[n] = 0.0;
+        }
+
+        for (size_t i = 0; i < n; i += 2) {
+            v2f64 sl2, cl2, shdlat, shdlon, chdlon;
+            memcpy(&sl2, sinLat2 + i, sizeof(v2f64));
+            memcpy(&cl2, cosLat2 + i, sizeof(v2f64));
+            memcpy(&shdlat, sinHalfDLat + i, sizeof(v2f64));
+            memcpy(&shdlon, sinHalfDLon + i, sizeof(v2f64));
+            memcpy(&chdlon, cosHalfDLon + i, sizeof(v2f64));
+
+            v2f64 sinDLon = two * shdlon * chdlon;
+            v2f64 cosDLon = one - two * shdlon * shdlon;
+            v2f64 va = shdlat * shdlat + cosLat1 * cl2 * shdlon * shdlon;
+            v2f64 vy = sinDLon * cl2;
+            v2f64 vx = cosLat1 * sl2 - sinLat1 * cl2 * cosDLon;
+
+            memcpy(a + i, &va, sizeof(v2f64));
+            memcpy(y + i, &vy, sizeof(v2f64));
+            memcpy(x + i, &vx, sizeof(v2f64));
+        }
+
+        if (distances != NULL) {
+            for (size_t i = 0; i < n; i++) {
+                // Rounding can take a hair outside [0, 1] for antipodal points.
+                double ai = fmin(fmax(a[i], 0.0), 1.0);
+                distances[start + i] = 2.0 * GEO_EARTH_MEAN_RADIUS * atan2(sqrt(ai), sqrt(1.0 - ai));
+            }
+        }
+        if (bearings != NULL) {
+            for (size_t i = 0; i < n; i++) {
+                // For coincident points x may be a rounding error either side of 0, which would give 0 or 180.
+                bearings[start + i] = (a[i] == 0.0 ? 0.0 : normalizeBearing(atan2(y[i], x[i])));
+            }
+        }
+    }
+}
+
+
+/**
+ * Vincenty's inverse formula (Survey Review XXIII, 176, 1975).  The iteration count depends on the destination, so
+ * this is not vectorized.
+ */
+static void vincenty(const Origin * origin, double latitude, double longitude, double * distance, double * bearing) {
+    double L = remainder(longitude * DEG_TO_RAD - origin->longitude, 2.0 * M_PI);
+    double tanU2 = (1.0 - WGS84_F) * tan(latitude * DEG_TO_RAD);
+    double cosU2 = 1.0 / sqrt(1.0 + tanU2 * tanU2);
+    double sinU2 = tanU2 * cosU2;
+    double sinU1 = origin->sinU;
+    double cosU1 = origin->cosU;
+
+    double lambda = L;
+    double sinLambda, cosLambda, sinSigma, cosSigma, sigma, cosSqAlpha, cos2SigmaM;
+    int iterations = 0;
+    for (;;) {
+        sinLambda = sin(lambda);
+        cosLambda = cos(lambda);
+        double t1 = cosU2 * sinLambda;
+        double t2 = cosU1 * sinU2 - sinU1 * cosU2 * cosLambda;
+        sinSigma = sqrt(t1 * t1 + t2 * t2);
+        if (sinSigma == 0.0) {
+            *distance = 0.0;
+            *bearing = 0.0;
+            return;
+        }
+        cosSigma = sinU1 * sinU2 + cosU1 * cosU2 * cosLambda;
+        sigma = atan2(sinSigma, cosSigma);
+        double sinAlpha = cosU1 * cosU2 * sinLambda / sinSigma;
+        cosSqAlpha = 1.0 - sinAlpha * sinAlpha;
+        // cosSqAlpha is 0 on the equator.
+        cos2SigmaM = (cosSqAlpha != 0.0 ? cosSigma - 2.0 * sinU1 * sinU2 / cosSqAlpha : 0.0);
+        double C = WGS84_F / 16.0 * cosSqAlpha * (4.0 + WGS84_F * (4.0 - 3.0 * cosSqAlpha));
+        double lambdaPrev = lambda;
+        lambda = L + (1.0 - C) * WGS84_F * sinAlpha *
+                     (sigma + C * sinSigma * (cos2SigmaM + C * cosSigma * (-1.0 + 2.0 * cos2SigmaM * cos2SigmaM)));
+
+        if (fabs(lambda - lambdaPrev) <= VINCENTY_TOLERANCE) {
+            break;
+        }
+        if (++iterations >= VINCENTY_MAX_ITERATIONS || fabs(lambda) > M_PI) {
+            *distance = NAN;
+            *bearing = NAN;
+            return;
+        }
+    }
+
+    double uSq = cosSqAlpha * (WGS84_A * WGS84_A - WGS84_B * WGS84_B) / (WGS84_B * WGS84_B);
+    double A = 1.0 + uSq / 16384.0 * (4096.0 + uSq * (-768.0 + uSq * (320.0 - 175.0 * uSq)));
+    double B = uSq / 1024.0 * (256.0 + uSq * (-128.0 + uSq * (74.0 - 47.0 * uSq)));
+    double deltaSigma = B * sinSigma * (cos2SigmaM + B / 4.0 * (cosSigma * (-1.0 + 2.0 * cos2SigmaM * cos2SigmaM) -
+                                                                 B / 6.0 * cos2SigmaM * (-3.0 + 4.0 * sinSigma * sinSigma) *
+                                                                 (-3.0 + 4.0 * cos2SigmaM * cos2SigmaM)));
+
+    *distance = WGS84_B * A * (sigma - deltaSigma);
+    *bearing = normalizeBearing(atan2(cosU2 * sinLambda, cosU1 * sinU2 - sinU1 * cosU2 * cosLambda));
+}
+
+
+static void vincentyRange(const Origin * origin, const double * latitudes, const double * longitudes, size_t count,
+                          double * distances, double * bearings) {
+    for (size_t i = 0; i < count; i++) {
+        double distance, bearing;
+        vincenty(origin, latitudes[i], longitudes[i], &distance, &bearing);
+        if (distances != NULL) {
+            distances[i] = distance;
+        }
+        if (bearings != NULL) {
+            bearings[i] = bearing;
+        }
+    }
+}
+
+
+static void computeRange(GeoDistanceMethod method, const Origin * origin, const double * latitudes,
+                         const double * longitudes, size_t count, double * distances, double * bearings) {
+    if (method == GeoDistanceVincenty) {
+        vincentyRange(origin, latitudes, longitudes, count, distances, bearings);
+    }
+    else {
+        haversineRange(origin, latitudes, longitudes, count, distances, bearings);
+    }
+}
+
+
+#if HAVE_DISPATCH
+
+typedef struct {
+    GeoDistanceMethod method;
+    const Origin * origin;
+    const double * latitudes;
+    const double * longitudes;
+    size_t count;
+    double * distances;
+    double * bearings;
+} Batch;
+
+
+static void computeChunk(void * context, size_t chunk) {
+    const Batch * batch = context;
+    size_t start = chunk * CONCURRENT_CHUNK_SIZE;
+    size_t n = (batch->count - start < CONCURRENT_CHUNK_SIZE ? batch->count - start : CONCURRENT_CHUNK_SIZE);
+    computeRange(batch->method, batch->origin, batch->latitudes + start, batch->longitudes + start, n,
+                 batch->distances == NULL ? NULL : batch->distances + start,
+                 batch->bearings == NULL ? NULL : batch->bearings + start);
+}
+
+#endif
+
+
+void GeoDistancesAndBearings(GeoDistanceMethod method, double originLatitude, double originLongitude,
+                             const double * latitudes, const double * longitudes, size_t count,
+                             double * distances, double * bearings, bool concurrent) {
+    if (count == 0 || (distances == NULL && bearings == NULL)) {
+        return;
+    }
+
+    Origin origin;
+    makeOrigin(originLatitude, originLongitude, &origin);
+
+#if HAVE_DISPATCH
+    if (concurrent && count >= 2 * CONCURRENT_CHUNK_SIZE) {
+        Batch batch = { method, &origin, latitudes, longitudes, count, distances, bearings };
+        size_t chunks = (count + CONCURRENT_CHUNK_SIZE - 1) / CONCURRENT_CHUNK_SIZE;
+        dispatch_apply_f(chunks, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &batch, computeChunk);
+        return;
+    }
+#else
+    (void)concurrent;
+#endif
+
+    computeRange(method, &origin, latitudes, longitudes, count, distances, bearings);
+}
+
+
+void GeoDistanceAndBearing(GeoDistanceMethod method, double originLatitude, double originLongitude,
+                           double latitude, double longitude, double * distance, double * bearing) {
+    GeoDistancesAndBearings(method, originLatitude, originLongitude, &latitude, &longitude, 1, distance, bearing,
+                            false);
+}
@@ -0,0 +1,64 @@
+//
+//  GeoDistance.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#ifndef Tidbits_GeoDistance_h
+#define Tidbits_GeoDistance_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/**
+ * The mean radius of the Earth (IUGG), in meters, which is the sphere used by GeoDistanceHaversine.
+ */
+#define GEO_EARTH_MEAN_RADIUS 6371008.8
+
+
+typedef enum {
+    /**
+     * Great-circle distance on a sphere of radius GEO_EARTH_MEAN_RADIUS.  This is within 0.5% of the true
+     * distance, and is much faster than GeoDistanceVincenty.
+     */
+    GeoDistanceHaversine = 0,
+
+    /**
+     * Vincenty's inverse formula on the WGS-84 ellipsoid, which is accurate to well under a millimeter.  For nearly
+     * antipodal points the iteration may not converge, in which case the distance and bearing are NAN.
+     */
+    GeoDistanceVincenty,
+} GeoDistanceMethod;
+
+
+/**
+ * Computes the distance (in meters) and initial bearing (in degrees clockwise from true north, in [0, 360)) from
+ * the origin to each of count destinations.  All coordinates are in degrees.
+ *
+ * The destinations are given as separate latitude and longitude arrays, and the results are written to
+ * distances[i] and bearings[i].  Either of distances or bearings may be NULL if those results are not needed.
+ * Coincident points have distance and bearing 0.
+ *
+ * The trigonometry of the origin is computed once for the whole batch, and GeoDistanceHaversine does its
+ * arithmetic two destinations at a time with vector instructions.
+ *
+ * If concurrent is true and the batch is large (thousands of destinations) then it is split across the global
+ * concurrent dispatch queue, and this call blocks until all are done.  Otherwise (including on platforms without
+ * libdispatch) it runs on the calling thread.  The results are the same either way.
+ *
+ * This does not allocate, and is thread-safe.
+ */
+void GeoDistancesAndBearings(GeoDistanceMethod method, double originLatitude, double originLongitude,
+                             const double * latitudes, const double * longitudes, size_t count,
+                             double * distances, double * bearings, bool concurrent);
+
+/**
+ * As GeoDistancesAndBearings, for a single pair of points.  Either of distance or bearing may be NULL.
+ */
+void GeoDistanceAndBearing(GeoDistanceMethod method, double originLatitude, double originLongitude,
+                           double latitude, double longitude, double * distance, double * bearing);
+
+#endif
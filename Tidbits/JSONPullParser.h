@@ -0,0 +1,143 @@
+//
+//  JSONPullParser.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/1/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+@class StringPool;
+
+
+typedef NS_ENUM(NSInteger, JSONPullToken) {
+    JSONPullTokenError = -1,
+    JSONPullTokenEnd = 0,
+    JSONPullTokenObjectStart,
+    JSONPullTokenObjectEnd,
+    JSONPullTokenArrayStart,
+    JSONPullTokenArrayEnd,
+    JSONPullTokenKey,
+    JSONPullTokenString,
+    JSONPullTokenNumber,
+    JSONPullTokenTrue,
+    JSONPullTokenFalse,
+    JSONPullTokenNull,
+};
+
+
+/**
+ * Decode the JSON escapes in the raw text of a string (the bytes between the quotes) into out, which must have room
+ * for length bytes.  Decoding never makes the text longer: \uXXXX is 6 bytes for at most 3, and a surrogate pair is
+ * 12 for 4.  Unpaired surrogates become U+FFFD.
+ *
+ * @return The decoded length, or NSNotFound if there is a malformed escape.
+ */
+NSUInteger JSONUnescapeString(const uint8_t * bytes, NSUInteger length, uint8_t * out);
+
+
+/**
+ * A pull parser for JSON, reading from an NSData (including a memory-mapped file) or incrementally from an
+ * NSInputStream.
+ *
+ * Call next repeatedly to get the tokens in document order.  Nothing is built unless you ask for it: the text
+ * of a key, string, or number is available through valueBytes / valueLength, which point straight into the input
+ * (or, for strings containing escapes, into a scratch buffer), and are only valid until the next call to next.
+ * When you reach a value that you do want, call objectValue to build just that subtree as Foundation objects, or
+ * skipValue to move past it.
+ *
+ * The grammar is RFC 7159, with any value allowed at the top level.  Escapes inside strings are only checked when
+ * the string is decoded, so a malformed escape inside a skipped subtree goes unnoticed.  Errors are in
+ * NSCocoaErrorDomain with code NSPropertyListReadCorruptError, the same as NSJSONSerialization.
+ *
+ * This class is not thread-safe.
+ */
+@interface JSONPullParser : NSObject
+
+/**
+ * The first error encountered, or nil.  Once set, next always returns JSONPullTokenError.
+ */
+@property (nonatomic, readonly) NSError * error;
+
+/**
+ * The token returned by the last call to next.
+ */
+@property (nonatomic, readonly) JSONPullToken token;
+
+/**
+ * The number of objects and arrays that currently enclose the parser.  This is incremented by ObjectStart and
+ * ArrayStart, and decremented by ObjectEnd and ArrayEnd.
+ */
+@property (nonatomic, readonly) NSUInteger depth;
+
+/**
+ * The byte offset in the input of the current token's text.
+ */
+@property (nonatomic, readonly) unsigned long long offset;
+
+/**
+ * If set, objectValue interns every object key in this pool straight from the parser's buffer, so a key that is
+ * already in the pool costs no allocation.  Defaults to nil.
+ */
+@property (nonatomic, strong) StringPool * keyPool;
+
+-(instancetype)initWithData:(NSData *)data __attribute__((nonnull));
+
+/**
+ * Parse from stream, which must already be open.  The buffer grows if a single token is larger than bufferSize.
+ */
+-(instancetype)initWithInputStream:(NSInputStream *)stream bufferSize:(NSUInteger)bufferSize __attribute__((nonnull));
+
+-(JSONPullToken)next;
+
+/**
+ * For a key or a string, the UTF-8 bytes of the decoded text.  For a number, the text of the number as it
+ * appeared in the input.  Otherwise NULL.
+ *
+ * This points into the parser's buffers and is only valid until the next call to next.  It returns NULL and
+ * sets error if the string contains a malformed escape.
+ */
+@property (nonatomic, readonly) const uint8_t * valueBytes;
+@property (nonatomic, readonly) NSUInteger valueLength;
+
+/**
+ * @return YES if the current key or string is exactly s (which is UTF-8).  Cheaper than comparing stringValue.
+ */
+-(BOOL)valueIsEqualToCString:(const char *)s __attribute__((nonnull));
+
+/**
+ * @return The current key or string as a new NSString, or nil if it is not valid UTF-8 (in which case error is set).
+ */
+-(NSString *)stringValue;
+
+/**
+ * @return The current number as an NSNumber.  Integers that fit in a long long are integral NSNumbers; everything
+ * else is a double.
+ */
+-(NSNumber *)numberValue;
+-(long long)longLongValue;
+-(double)doubleValue;
+
+/**
+ * Build the value at the current token as Foundation objects, the same as NSJSONSerialization would.  If the
+ * current token is ObjectStart or ArrayStart, this consumes tokens up to and including the matching end, so that
+ * the next call to next continues after the subtree.
+ *
+ * Containers are returned as the NSMutableDictionary and NSMutableArray instances they were built in, rather than
+ * as immutable copies.  Treat them as immutable.
+ *
+ * @return The value, or nil on error or if the current token does not start a value.
+ */
+-(id)objectValue;
+
+/**
+ * Move past the value at the current token without building anything.  Like objectValue, if the current token is
+ * ObjectStart or ArrayStart then everything up to the matching end is consumed.
+ *
+ * @return NO on error.
+ */
+-(BOOL)skipValue;
+
+@end
@@ -0,0 +1,827 @@
+//
+//  JSONPullParser.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/1/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "StringPool.h"
+
+#import "JSONPullParser.h"
+
+
+#define MIN_BUFFER_SIZE 256
+#define MAX_DEPTH 512
+
+// Longer than any number we'll convert by hand; the rest go through strtod.
+#define NUMBER_BUFFER_SIZE 64
+
+
+typedef NS_ENUM(uint8_t, ParserState) {
+    // Expecting a value (at the top level, after a colon, or after a comma in an array).
+    StateValue,
+    // Just after '['.
+    StateValueOrEnd,
+    // Just after '{'.
+    StateKeyOrEnd,
+    // After a comma in an object.
+    StateKey,
+    // After a key.
+    StateColon,
+    // After a value inside a container.
+    StateCommaOrEnd,
+    // After the top-level value.
+    StateDone,
+};
+
+
+@implementation JSONPullParser
+{
+    // Exactly one of these is set.
+    NSData * data;
+    NSInputStream * stream;
+
+    // The input.  For data, this is data.bytes, and len is the whole thing.  For a stream, this is buf, which we
+    // own, and we compact and refill it as we go.
+    const uint8_t * bytes;
+    uint8_t * buf;
+    NSUInteger cap;
+    NSUInteger len;
+    NSUInteger pos;
+    BOOL eof;
+
+    // The stream offset of bytes[0].
+    unsigned long long base;
+
+    // The current token's text is bytes[tokStart, tokStart + tokLen).  Everything from tokStart onwards is kept
+    // when the buffer is compacted.
+    NSUInteger tokStart;
+    NSUInteger tokLen;
+    BOOL tokEscaped;
+
+    // Decoded text of the current string if it contains escapes.
+    uint8_t * scratch;
+    NSUInteger scratchCap;
+    NSUInteger scratchLen;
+    BOOL decoded;
+
+    // 'o' or 'a' for each enclosing container.
+    uint8_t * stack;
+    NSUInteger stackCap;
+
+    ParserState state;
+}
+
+
+-(instancetype)initWithData:(NSData *)data_ {
+    self = [super init];
+    if (self) {
+        data = data_;
+        bytes = data.bytes;
+        len = data.length;
+        eof = YES;
+    }
+    return self;
+}
+
+
+-(instancetype)initWithInputStream:(NSInputStream *)stream_ bufferSize:(NSUInteger)bufferSize {
+    self = [super init];
+    if (self) {
+        stream = stream_;
+        cap = MAX(bufferSize, MIN_BUFFER_SIZE);
+        buf = malloc(cap);
+        if (buf == NULL) {
+            [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)cap];
+        }
+        bytes = buf;
+    }
+    return self;
+}
+
+
+-(void)dealloc {
+    free(buf);
+    free(scratch);
+    free(stack);
+}
+
+
+-(unsigned long long)offset {
+    return base + tokStart;
+}
+
+
+#pragma mark - Input
+
+
+/**
+ * Read more from the stream, first discarding everything before tokStart, and growing the buffer if the current
+ * token fills it.
+ *
+ * @return NO at the end of the input or on error.
+ */
+static BOOL refill(JSONPullParser * self) {
+    if (self->stream == nil || self->eof || self->_error != nil) {
+        return NO;
+    }
+
+    NSUInteger keep = self->tokStart;
+    if (keep > 0) {
+        memmove(self->buf, self->buf + keep, self->len - keep);
+        self->len -= keep;
+        self->pos -= keep;
+        self->tokStart = 0;
+        self->base += keep;
+    }
+    if (self->len == self->cap) {
+        NSUInteger newCap = 2 * self->cap;
+        uint8_t * newBuf = realloc(self->buf, newCap);
+        if (newBuf == NULL) {
+            [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)newCap];
+        }
+        self->buf = newBuf;
+        self->bytes = newBuf;
+        self->cap = newCap;
+    }
+
+    NSInteger n = [self->stream read:self->buf + self->len maxLength:self->cap - self->len];
+    if (n < 0) {
+        NSError * err = self->stream.streamError;
+        self->_error = (err != nil ? err : [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil]);
+        return NO;
+    }
+    if (n == 0) {
+        self->eof = YES;
+        return NO;
+    }
+    self->len += (NSUInteger)n;
+    return YES;
+}
+
+
+/**
+ * @return The next byte without consuming it, or -1 at the end of the input.
+ */
+static inline int peekByte(JSONPullParser * self) {
+    if (self->pos < self->len || refill(self)) {
+        return self->bytes[self->pos];
+    }
+    return -1;
+}
+
+
+static int skipWhitespace(JSONPullParser * self) {
+    while (YES) {
+        int c = peekByte(self);
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            return c;
+        }
+        self->pos++;
+        self->tokStart = self->pos;
+    }
+}
+
+
+static JSONPullToken fail(JSONPullParser * self, NSString * message) {
+    if (self->_error == nil) {
+        NSString * desc = [NSString stringWithFormat:@"%@ around character %llu.", message, self->base + self->pos];
+        self->_error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSPropertyListReadCorruptError userInfo:@{NSDebugDescriptionErrorKey: desc}];
+    }
+    self->_token = JSONPullTokenError;
+    return JSONPullTokenError;
+}
+
+
+#pragma mark - Tokens
+
+
+-(JSONPullToken)next {
+    if (_error != nil) {
+        _token = JSONPullTokenError;
+        return _token;
+    }
+
+    tokStart = pos;
+    tokLen = 0;
+    tokEscaped = NO;
+    decoded = NO;
+
+    while (YES) {
+        int c = skipWhitespace(self);
+        if (_error != nil) {
+            return fail(self, nil);
+        }
+
+        switch (state) {
+            case StateDone:
+                if (c == -1) {
+                    _token = JSONPullTokenEnd;
+                    return _token;
+                }
+                return fail(self, @"Garbage at end");
+
+            case StateColon:
+                if (c != ':') {
+                    return fail(self, @"No ':' after key");
+                }
+                pos++;
+                state = StateValue;
+                continue;
+
+            case StateCommaOrEnd:
+                if (c == ',') {
+                    pos++;
+                    state = (stack[_depth - 1] == 'o' ? StateKey : StateValue);
+                    continue;
+                }
+                if (c == '}' && stack[_depth - 1] == 'o') {
+                    return popContainer(self, JSONPullTokenObjectEnd);
+                }
+                if (c == ']' && stack[_depth - 1] == 'a') {
+                    return popContainer(self, JSONPullTokenArrayEnd);
+                }
+                return fail(self, @"Badly formed container");
+
+            case StateKeyOrEnd:
+                if (c == '}') {
+                    return popContainer(self, JSONPullTokenObjectEnd);
+                }
+                // Fall through.
+            case StateKey:
+                if (c != '"') {
+                    return fail(self, @"No string key for value in object");
+                }
+                if (!scanString(self)) {
+                    return JSONPullTokenError;
+                }
+                state = StateColon;
+                _token = JSONPullTokenKey;
+                return _token;
+
+            case StateValueOrEnd:
+                if (c == ']') {
+                    return popContainer(self, JSONPullTokenArrayEnd);
+                }
+                // Fall through.
+            case StateValue:
+                return scanValue(self, c);
+        }
+    }
+}
+
+
+static JSONPullToken pushContainer(JSONPullParser * self, uint8_t kind, JSONPullToken token, ParserState newState) {
+    if (self->_depth == MAX_DEPTH) {
+        return fail(self, @"Too many nested containers");
+    }
+    if (self->_depth == self->stackCap) {
+        NSUInteger newCap = MAX(2 * self->stackCap, 16);
+        uint8_t * newStack = realloc(self->stack, newCap);
+        if (newStack == NULL) {
+            [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)newCap];
+        }
+        self->stack = newStack;
+        self->stackCap = newCap;
+    }
+    self->stack[self->_depth++] = kind;
+    self->pos++;
+    self->state = newState;
+    self->_token = token;
+    return token;
+}
+
+
+static JSONPullToken popContainer(JSONPullParser * self, JSONPullToken token) {
+    self->pos++;
+    self->_depth--;
+    self->state = (self->_depth == 0 ? StateDone : StateCommaOrEnd);
+    self->_token = token;
+    return token;
+}
+
+
+static JSONPullToken scalarToken(JSONPullParser * self, JSONPullToken token) {
+    self->state = (self->_depth == 0 ? StateDone : StateCommaOrEnd);
+    self->_token = token;
+    return token;
+}
+
+
+/**
+ * Scan the string starting at the opening quote at pos.  Leaves tokStart / tokLen covering the raw text between
+ * the quotes, and tokEscaped set if there are any escapes in it.
+ */
+static BOOL scanString(JSONPullParser * self) {
+    self->pos++;
+    self->tokStart = self->pos;
+    while (YES) {
+        if (self->pos == self->len && !refill(self)) {
+            fail(self, @"Unterminated string");
+            return NO;
+        }
+        uint8_t c = self->bytes[self->pos];
+        if (c == '"') {
+            self->tokLen = self->pos - self->tokStart;
+            self->pos++;
+            return YES;
+        }
+        if (c == '\\') {
+            self->tokEscaped = YES;
+            self->pos++;
+            if (self->pos == self->len && !refill(self)) {
+                fail(self, @"Unterminated string");
+                return NO;
+            }
+        }
+        else if (c < 0x20) {
+            fail(self, @"Unescaped control character");
+            return NO;
+        }
+        self->pos++;
+    }
+}
+
+
+static BOOL isDigit(uint8_t c) {
+    return c >= '0' && c <= '9';
+}
+
+
+static JSONPullToken scanNumber(JSONPullParser * self) {
+    self->tokStart = self->pos;
+    while (YES) {
+        if (self->pos == self->len && !refill(self)) {
+            break;
+        }
+        uint8_t c = self->bytes[self->pos];
+        if (!(isDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')) {
+            break;
+        }
+        self->pos++;
+    }
+    if (self->_error != nil) {
+        return fail(self, nil);
+    }
+
+    const uint8_t * p = self->bytes + self->tokStart;
+    const uint8_t * end = self->bytes + self->pos;
+    self->tokLen = self->pos - self->tokStart;
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (p < end && *p == '-') {
+        p++;
+    }
+    if (p == end || !isDigit(*p)) {
+        return fail(self, @"Invalid number");
+    }
+    if (*p == '0') {
+        p++;
+    }
+    else {
+        while (p < end && isDigit(*p)) {
+            p++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (p == end || !isDigit(*p)) {
+            return fail(self, @"Invalid number");
+        }
+        while (p < end && isDigit(*p)) {
+            p++;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (p == end || !isDigit(*p)) {
+            return fail(self, @"Invalid number");
+        }
+        while (p < end && isDigit(*p)) {
+            p++;
+        }
+    }
+    if (p != end) {
+        return fail(self, @"Invalid number");
+    }
+
+    return scalarToken(self, JSONPullTokenNumber);
+}
+
+
+static JSONPullToken scanLiteral(JSONPullParser * self, const char * literal, NSUInteger n, JSONPullToken token) {
+    self->tokStart = self->pos;
+    while (self->len - self->pos < n) {
+        if (!refill(self)) {
+            break;
+        }
+    }
+    if (self->len - self->pos < n || memcmp(self->bytes + self->pos, literal, n) != 0) {
+        return fail(self, @"Invalid value");
+    }
+    self->pos += n;
+    return scalarToken(self, token);
+}
+
+
+
+static JSONPullToken scanValue(JSONPullParser * self, int c) {
+    switch (c) {
+        case '{':
+            return pushContainer(self, 'o', JSONPullTokenObjectStart, StateKeyOrEnd);
+        case '[':
+            return pushContainer(self, 'a', JSONPullTokenArrayStart, StateValueOrEnd);
+        case '"':
+            if (!scanString(self)) {
+                return JSONPullTokenError;
+            }
+            return scalarToken(self, JSONPullTokenString);
+        case 't':
+            return scanLiteral(self, "true", 4, JSONPullTokenTrue);
+        case 'f':
+            return scanLiteral(self, "false", 5, JSONPullTokenFalse);
+        case 'n':
+            return scanLiteral(self, "null", 4, JSONPullTokenNull);
+        case -1:
+            return fail(self, @"Unexpected end of file while parsing value");
+        default:
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                return scanNumber(self);
+            }
+            return fail(self, @"Invalid value");
+    }
+}
+
+#pragma mark - Values
+
+
+-(const uint8_t *)valueBytes {
+    switch (_token) {
+        case JSONPullTokenKey:
+        case JSONPullTokenString:
+            if (tokEscaped) {
+                return (decodeEscapes(self) ? scratch : NULL);
+            }
+            return bytes + tokStart;
+        case JSONPullTokenNumber:
+            return bytes + tokStart;
+        default:
+            return NULL;
+    }
+}
+
+
+-(NSUInteger)valueLength {
+    switch (_token) {
+        case JSONPullTokenKey:
+        case JSONPullTokenString:
+            if (tokEscaped) {
+                return (decodeEscapes(self) ? scratchLen : 0);
+            }
+            return tokLen;
+        case JSONPullTokenNumber:
+            return tokLen;
+        default:
+            return 0;
+    }
+}
+
+
+static inline void scratchReserve(JSONPullParser * self, NSUInteger n) {
+    if (n > self->scratchCap) {
+        NSUInteger newCap = MAX(n, 2 * self->scratchCap);
+        uint8_t * newScratch = realloc(self->scratch, newCap);
+        if (newScratch == NULL) {
+            [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)newCap];
+        }
+        self->scratch = newScratch;
+        self->scratchCap = newCap;
+    }
+}
+
+
+static int hexValue(uint8_t c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+
+/**
+ * @return The code unit from the four hex digits at p, or -1 if they aren't hex.
+ */
+static long readHex4(const uint8_t * p) {
+    long result = 0;
+    for (int i = 0; i < 4; i++) {
+        int h = hexValue(p[i]);
+        if (h < 0) {
+            return -1;
+        }
+        result = (result << 4) | h;
+    }
+    return result;
+}
+
+
+static NSUInteger encodeUTF8(uint32_t cp, uint8_t * out) {
+    if (cp < 0x80) {
+        out[0] = (uint8_t)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (uint8_t)(0xc0 | (cp >> 6));
+        out[1] = (uint8_t)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (uint8_t)(0xe0 | (cp >> 12));
+        out[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (uint8_t)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (uint8_t)(0xf0 | (cp >> 18));
+    out[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (uint8_t)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+
+NSUInteger JSONUnescapeString(const uint8_t * bytes, NSUInteger length, uint8_t * out) {
+    const uint8_t * p = bytes;
+    const uint8_t * end = p + length;
+    uint8_t * o = out;
+    while (p < end) {
+        uint8_t c = *p++;
+        if (c != '\\') {
+            *o++ = c;
+            continue;
+        }
+        if (p == end) {
+            return NSNotFound;
+        }
+        c = *p++;
+        switch (c) {
+            case '"': *o++ = '"'; break;
+            case '\\': *o++ = '\\'; break;
+            case '/': *o++ = '/'; break;
+            case 'b': *o++ = '\b'; break;
+            case 'f': *o++ = '\f'; break;
+            case 'n': *o++ = '\n'; break;
+            case 'r': *o++ = '\r'; break;
+            case 't': *o++ = '\t'; break;
+            case 'u': {
+                long u = (end - p >= 4 ? readHex4(p) : -1);
+                if (u < 0) {
+                    return NSNotFound;
+                }
+                p += 4;
+                uint32_t cp = (uint32_t)u;
+                if (cp >= 0xd800 && cp < 0xdc00) {
+                    long lo = (end - p >= 6 && p[0] == '\\' && p[1] == 'u' ? readHex4(p + 2) : -1);
+                    if (lo >= 0xdc00 && lo < 0xe000) {
+                        cp = 0x10000 + ((cp - 0xd800) << 10) + (uint32_t)(lo - 0xdc00);
+                        p += 6;
+                    }
+                    else {
+                        cp = 0xfffd;
+                    }
+                }
+                else if (cp >= 0xdc00 && cp < 0xe000) {
+                    cp = 0xfffd;
+                }
+                o += encodeUTF8(cp, o);
+                break;
+            }
+            default:
+                return NSNotFound;
+        }
+    }
+    return (NSUInteger)(o - out);
+}
+
+
+/**
+ * Decode the current string into scratch, if we haven't already.
+ *
+ * @return NO, with error set, if there is a malformed escape.
+ */
+static BOOL decodeEscapes(JSONPullParser * self) {
+    if (self->decoded) {
+        return YES;
+    }
+    if (self->_error != nil) {
+        return NO;
+    }
+
+    scratchReserve(self, self->tokLen);
+    NSUInteger n = JSONUnescapeString(self->bytes + self->tokStart, self->tokLen, self->scratch);
+    if (n == NSNotFound) {
+        fail(self, @"Invalid escape sequence");
+        return NO;
+    }
+    self->scratchLen = n;
+    self->decoded = YES;
+    return YES;
+}
+
+
+-(BOOL)valueIsEqualToCString:(const char *)s {
+    if (_token != JSONPullTokenKey && _token != JSONPullTokenString) {
+        return NO;
+    }
+    const uint8_t * v = self.valueBytes;
+    NSUInteger n = self.valueLength;
+    return v != NULL && strlen(s) == n && memcmp(v, s, n) == 0;
+}
+
+
+-(NSString *)stringValue {
+    if (_token != JSONPullTokenKey && _token != JSONPullTokenString) {
+        return nil;
+    }
+    const uint8_t * v = self.valueBytes;
+    if (v == NULL) {
+        return nil;
+    }
+    NSUInteger n = self.valueLength;
+    if (n == 0) {
+        return @"";
+    }
+    NSString * result = [[NSString alloc] initWithBytes:v length:n encoding:NSUTF8StringEncoding];
+    if (result == nil) {
+        fail(self, @"Invalid UTF-8 in string");
+    }
+    return result;
+}
+
+
+static NSString * internedKey(JSONPullParser * self) {
+    const char * v = (const char *)self.valueBytes;
+    if (v == NULL) {
+        return nil;
+    }
+    NSUInteger n = self.valueLength;
+    NSString * result = [self->_keyPool internUTF8:v length:n hash:StringPoolHashUTF8(v, n)];
+    if (result == nil) {
+        fail(self, @"Invalid UTF-8 in string");
+    }
+    return result;
+}
+
+
+/**
+ * @return YES if the current number is an integer that fits in a long long, with the value in *result.
+ */
+static BOOL parseInteger(JSONPullParser * self, long long * result) {
+    const uint8_t * p = self->bytes + self->tokStart;
+    const uint8_t * end = p + self->tokLen;
+    BOOL negative = (*p == '-');
+    if (negative) {
+        p++;
+    }
+    // 18 digits always fit.
+    if (end - p > 18) {
+        return NO;
+    }
+    long long v = 0;
+    while (p < end) {
+        if (!isDigit(*p)) {
+            return NO;
+        }
+        v = v * 10 + (*p++ - '0');
+    }
+    *result = (negative ? -v : v);
+    return YES;
+}
+
+
+static double parseDouble(JSONPullParser * self) {
+    char tmp[NUMBER_BUFFER_SIZE];
+    char * s = (self->tokLen < sizeof(tmp) ? tmp : malloc(self->tokLen + 1));
+    if (s == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)self->tokLen + 1];
+    }
+    memcpy(s, self->bytes + self->tokStart, self->tokLen);
+    s[self->tokLen] = '\0';
+    double result = strtod(s, NULL);
+    if (s != tmp) {
+        free(s);
+    }
+    return result;
+}
+
+
+-(NSNumber *)numberValue {
+    if (_token != JSONPullTokenNumber) {
+        return nil;
+    }
+    long long i;
+    if (parseInteger(self, &i)) {
+        return @(i);
+    }
+    return @(parseDouble(self));
+}
+
+
+-(long long)longLongValue {
+    if (_token != JSONPullTokenNumber) {
+        return 0;
+    }
+    long long i;
+    return (parseInteger(self, &i) ? i : (long long)parseDouble(self));
+}
+
+
+-(double)doubleValue {
+    if (_token != JSONPullTokenNumber) {
+        return 0.0;
+    }
+    long long i;
+    return (parseInteger(self, &i) ? (double)i : parseDouble(self));
+}
+
+
+-(id)objectValue {
+    switch (_token) {
+        case JSONPullTokenObjectStart: {
+            NSMutableDictionary * result = [NSMutableDictionary dictionary];
+            while (YES) {
+                JSONPullToken t = [self next];
+                if (t == JSONPullTokenObjectEnd) {
+                    return result;
+                }
+                if (t != JSONPullTokenKey) {
+                    return nil;
+                }
+                NSString * key = (_keyPool == nil ? [self stringValue] : internedKey(self));
+                if (key == nil || [self next] == JSONPullTokenError) {
+                    return nil;
+                }
+                id val = [self objectValue];
+                if (val == nil) {
+                    return nil;
+                }
+                result[key] = val;
+            }
+        }
+
+        case JSONPullTokenArrayStart: {
+            NSMutableArray * result = [NSMutableArray array];
+            while (YES) {
+                JSONPullToken t = [self next];
+                if (t == JSONPullTokenArrayEnd) {
+                    return result;
+                }
+                id val = [self objectValue];
+                if (val == nil) {
+                    return nil;
+                }
+                [result addObject:val];
+            }
+        }
+
+        case JSONPullTokenString:
+            return [self stringValue];
+        case JSONPullTokenNumber:
+            return [self numberValue];
+        case JSONPullTokenTrue:
+            return @YES;
+        case JSONPullTokenFalse:
+            return @NO;
+        case JSONPullTokenNull:
+            return [NSNull null];
+
+        default:
+            return nil;
+    }
+}
+
+
+-(BOOL)skipValue {
+    if (_token == JSONPullTokenObjectStart || _token == JSONPullTokenArrayStart) {
+        NSUInteger target = _depth - 1;
+        while (_depth > target) {
+            if ([self next] == JSONPullTokenError) {
+                return NO;
+            }
+        }
+        return YES;
+    }
+    return (_token == JSONPullTokenString || _token == JSONPullTokenNumber ||
+            _token == JSONPullTokenTrue || _token == JSONPullTokenFalse || _token == JSONPullTokenNull);
+}
+
+
+@end
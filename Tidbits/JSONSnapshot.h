@@ -0,0 +1,83 @@
+//
+//  JSONSnapshot.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/6/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * A compact binary form of a JSON document, for bundled resources that we would otherwise parse on every launch.
+ *
+ * Snapshots are made at build time by json-snapshot.py (at the top of this repo), or at runtime by
+ * snapshotDataWithJSONData:error:, which produce identical output.  The file is designed to be memory-mapped and
+ * read in place: loading one only checks the header, and the result is an NSDictionary or NSArray proxy that reads
+ * values out of the file as you access them.  Object lookups go through a hash table stored in the snapshot, so
+ * objectForKey: is O(1), and arrays are O(1) by index.  Every distinct string is stored once, in a string table, and
+ * dictionary keys are interned using [StringPool sharedPool].
+ *
+ * A snapshot records the length and a hash of the JSON that it was made from, so that a stale snapshot can be
+ * detected and ignored.
+ *
+ * The format, all little-endian:
+ *
+ *   Header: "TBJS", uint32 version, uint64 source length, uint64 source hash (JSONSnapshotSourceHash), uint32 root
+ *   value, uint32 string table offset.
+ *
+ *   A value is a uint32 with the kind in the top 3 bits and a payload in the rest:
+ *     0 null / false / true (payload 0, 1, 2); 1 an integer in the payload (29-bit signed); 2 an int64 and 3 a
+ *     double, with the payload the offset / 4 of the 8-byte number.  As with -[JSONPullParser numberValue], a
+ *     number is an integer if it is an optional minus sign and up to 18 digits, and a double otherwise; 4 a string, with the payload its index in the
+ *     string table; 5 an array and 6 an object, with the payload the offset / 4 of their node.
+ *
+ *   Array node: uint32 count, then count values.
+ *
+ *   Object node: uint32 count, uint32 table size (a power of two at least twice count, or 0 if count is 0), then
+ *   the hash table (table size uint32s, each the member index + 1, or 0 if empty, probed linearly from the key's
+ *   StringPool hash), then count uint32 key string indexes, then count values.  Members are in document order.  If
+ *   a key is repeated, the member stays where the key first appeared but has the last value, which is what
+ *   -[JSONPullParser objectValue] gives.
+ *
+ *   String table: uint32 count, then count uint32 offsets, each pointing at a uint32 byte length, the uint32
+ *   StringPoolHashString of the string, and the UTF-8 bytes, NUL-terminated and padded to a multiple of 4.
+ *
+ * The results are immutable and thread-safe, and keep the snapshot data alive.
+ */
+@interface JSONSnapshot : NSObject
+
+/**
+ * @return An NSDictionary or NSArray backed by the snapshot at snapshotPath, or the scalar value if that is what the
+ * document holds.  If sourcePath is not nil, the snapshot is checked against the JSON there first (which costs a
+ * pass over that file, but no parsing).  Returns nil if the snapshot is missing, stale, or invalid, in which case
+ * *error is set (if error is not NULL).
+ */
++(id)JSONObjectWithContentsOfFile:(NSString *)snapshotPath sourcePath:(NSString *)sourcePath error:(NSError * __autoreleasing *)error __attribute__((nonnull(1)));
+
+/**
+ * @return As above, but only checking that the snapshot was made from sourceLength bytes of JSON.  This is for
+ * bundled resources, which can't change after the build that snapshotted them, so it's only a sanity check.
+ */
++(id)JSONObjectWithContentsOfFile:(NSString *)snapshotPath sourceLength:(unsigned long long)sourceLength error:(NSError * __autoreleasing *)error __attribute__((nonnull(1)));
+
+/**
+ * @return As above, for a snapshot already in memory, without a staleness check.
+ */
++(id)JSONObjectWithSnapshotData:(NSData *)data error:(NSError * __autoreleasing *)error __attribute__((nonnull(1)));
+
+/**
+ * @return A snapshot of the given JSON, or nil if it is not valid JSON, in which case *error is set (if error is
+ * not NULL).
+ */
++(NSData *)snapshotDataWithJSONData:(NSData *)data error:(NSError * __autoreleasing *)error __attribute__((nonnull(1)));
+
+@end
+
+
+/**
+ * The hash of the source JSON recorded in a snapshot: FNV-1a over the input as 64-bit little-endian words, followed
+ * by any remaining bytes one at a time.
+ */
+extern uint64_t JSONSnapshotSourceHash(const uint8_t * bytes, NSUInteger length);
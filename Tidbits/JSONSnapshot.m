@@ -0,0 +1,769 @@
+//
+//  JSONSnapshot.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/6/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "JSONPullParser.h"
+#import "StringPool.h"
+
+#import "JSONSnapshot.h"
+
+
+#define SNAPSHOT_MAGIC "TBJS"
+#define SNAPSHOT_VERSION 1
+#define HEADER_SIZE 32
+
+#define REF_KIND(ref) ((ref) >> 29)
+#define REF_PAYLOAD(ref) ((ref) & 0x1fffffff)
+#define MAKE_REF(kind, payload) (((uint32_t)(kind) << 29) | (uint32_t)(payload))
+#define SMALL_INT_MIN (-(1 << 28))
+#define SMALL_INT_MAX ((1 << 28) - 1)
+
+// Keys up to this length are compared as UTF-8 without building any strings.
+#define KEY_BUFFER_SIZE 256
+
+#define FNV64_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV64_PRIME 0x100000001b3ULL
+
+
+typedef NS_ENUM(uint32_t, RefKind) {
+    RefLiteral = 0,
+    RefInt = 1,
+    RefInt64 = 2,
+    RefDouble = 3,
+    RefString = 4,
+    RefArray = 5,
+    RefObject = 6,
+};
+
+
+typedef NS_ENUM(uint32_t, RefLiteralValue) {
+    RefLiteralNull = 0,
+    RefLiteralFalse = 1,
+    RefLiteralTrue = 2,
+};
+
+
+/**
+ * The mapped snapshot, shared by all the proxies for one document.
+ */
+@interface JSONSnapshotDocument : NSObject
+{
+@public
+    NSData * data;
+    const uint8_t * bytes;
+    NSUInteger length;
+    const uint32_t * stringOffsets;
+    uint32_t stringCount;
+}
+@end
+
+
+@interface JSONSnapshotDictionary : NSDictionary
+-(instancetype)initWithDocument:(JSONSnapshotDocument *)document node:(const uint32_t *)node;
+@end
+
+
+@interface JSONSnapshotArray : NSArray
+-(instancetype)initWithDocument:(JSONSnapshotDocument *)document node:(const uint32_t *)node;
+@end
+
+
+/**
+ * Builds a snapshot from the tokens of a JSONPullParser, in document order, so that the output is the same as
+ * json-snapshot.py's.
+ */
+@interface JSONSnapshotBuilder : NSObject
+-(NSData *)buildWithJSONData:(NSData *)json error:(NSError * __autoreleasing *)error;
+@end
+
+
+uint64_t JSONSnapshotSourceHash(const uint8_t * bytes, NSUInteger length) {
+    uint64_t hash = FNV64_OFFSET_BASIS;
+    NSUInteger i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ CFSwapInt64LittleToHost(word)) * FNV64_PRIME;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ bytes[i]) * FNV64_PRIME;
+    }
+    return hash;
+}
+
+
+static NSError * corruptError(NSString * message) {
+    return [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{NSDebugDescriptionErrorKey: message}];
+}
+
+
+#pragma mark - Reading
+
+
+/**
+ * @return The node at the given payload, if there are at least words uint32s there, or NULL.
+ */
+static const uint32_t * nodeAt(JSONSnapshotDocument * doc, uint32_t payload, NSUInteger words) {
+    NSUInteger offset = (NSUInteger)payload * 4;
+    if (offset < HEADER_SIZE || offset > doc->length || (doc->length - offset) / 4 < words) {
+        return NULL;
+    }
+    return (const uint32_t *)(doc->bytes + offset);
+}
+
+
+/**
+ * @return The string table entry at index, or NULL if it is out of bounds.
+ */
+static const uint8_t * stringAt(JSONSnapshotDocument * doc, uint32_t index, uint32_t * len, uint32_t * hash) {
+    if (index >= doc->stringCount) {
+        return NULL;
+    }
+    NSUInteger offset = CFSwapInt32LittleToHost(doc->stringOffsets[index]);
+    if (offset > doc->length || doc->length - offset < 8) {
+        return NULL;
+    }
+    const uint32_t * entry = (const uint32_t *)(doc->bytes + offset);
+    *len = CFSwapInt32LittleToHost(entry[0]);
+    *hash = CFSwapInt32LittleToHost(entry[1]);
+    if (doc->length - offset - 8 < *len) {
+        return NULL;
+    }
+    return doc->bytes + offset + 8;
+}
+
+
+static NSString * stringForIndex(JSONSnapshotDocument * doc, uint32_t index) {
+    uint32_t len, hash;
+    const uint8_t * p = stringAt(doc, index, &len, &hash);
+    if (p == NULL) {
+        return nil;
+    }
+    return (len == 0 ? @"" : [[NSString alloc] initWithBytes:p length:len encoding:NSUTF8StringEncoding]);
+}
+
+
+static NSString * keyForIndex(JSONSnapshotDocument * doc, uint32_t index) {
+    uint32_t len, hash;
+    const uint8_t * p = stringAt(doc, index, &len, &hash);
+    if (p == NULL) {
+        return nil;
+    }
+    return [[StringPool sharedPool] internUTF8:(const char *)p length:len hash:hash];
+}
+
+
+/**
+ * @param limit Containers are written after their contents, so any array or object must be before this (the node
+ * that holds ref, or the string table for the root).  This stops a corrupt snapshot from making a cycle.
+ */
+static id valueForRef(JSONSnapshotDocument * doc, uint32_t ref, uint32_t limit) {
+    uint32_t payload = REF_PAYLOAD(ref);
+    id result = nil;
+    switch ((RefKind)REF_KIND(ref)) {
+        case RefLiteral:
+            result = (payload == RefLiteralTrue ? @YES : payload == RefLiteralFalse ? @NO : nil);
+            break;
+
+        case RefInt:
+            // Sign-extend from 29 bits.
+            result = @((int32_t)(ref << 3) >> 3);
+            break;
+
+        case RefInt64:
+        case RefDouble: {
+            const uint32_t * node = nodeAt(doc, payload, 2);
+            if (node != NULL) {
+                uint64_t bits = CFSwapInt64LittleToHost((uint64_t)node[0] | ((uint64_t)node[1] << 32));
+                if (REF_KIND(ref) == RefInt64) {
+                    result = @((int64_t)bits);
+                }
+                else {
+                    double d;
+                    memcpy(&d, &bits, sizeof(d));
+                    result = @(d);
+                }
+            }
+            break;
+        }
+
+        case RefString:
+            result = stringForIndex(doc, payload);
+            break;
+
+        case RefArray: {
+            const uint32_t * node = (payload < limit ? nodeAt(doc, payload, 1) : NULL);
+            if (node != NULL && nodeAt(doc, payload, 1 + (NSUInteger)node[0]) != NULL) {
+                result = [[JSONSnapshotArray alloc] initWithDocument:doc node:node];
+            }
+            break;
+        }
+
+        case RefObject: {
+            const uint32_t * node = (payload < limit ? nodeAt(doc, payload, 2) : NULL);
+            if (node != NULL && nodeAt(doc, payload, 2 + (NSUInteger)node[1] + 2 * (NSUInteger)node[0]) != NULL) {
+                result = [[JSONSnapshotDictionary alloc] initWithDocument:doc node:node];
+            }
+            break;
+        }
+    }
+    // Null, and anything corrupt.
+    return (result == nil ? [NSNull null] : result);
+}
+
+
+@implementation JSONSnapshot
+
+
++(id)JSONObjectWithContentsOfFile:(NSString *)snapshotPath sourcePath:(NSString *)sourcePath error:(NSError * __autoreleasing *)error {
+    NSParameterAssert(snapshotPath);
+
+    NSData * data = [NSData dataWithContentsOfFile:snapshotPath options:NSDataReadingMappedIfSafe error:error];
+    if (data == nil) {
+        return nil;
+    }
+
+    if (sourcePath != nil) {
+        NSData * source = [NSData dataWithContentsOfFile:sourcePath options:NSDataReadingMappedIfSafe error:error];
+        if (source == nil) {
+            return nil;
+        }
+        uint64_t sourceHash = JSONSnapshotSourceHash(source.bytes, source.length);
+        if (!checkSource(data, source.length, &sourceHash, error)) {
+            return nil;
+        }
+    }
+
+    return [JSONSnapshot JSONObjectWithSnapshotData:data error:error];
+}
+
+
++(id)JSONObjectWithContentsOfFile:(NSString *)snapshotPath sourceLength:(unsigned long long)sourceLength error:(NSError * __autoreleasing *)error {
+    NSParameterAssert(snapshotPath);
+
+    NSData * data = [NSData dataWithContentsOfFile:snapshotPath options:NSDataReadingMappedIfSafe error:error];
+    if (data == nil || !checkSource(data, sourceLength, NULL, error)) {
+        return nil;
+    }
+    return [JSONSnapshot JSONObjectWithSnapshotData:data error:error];
+}
+
+
+/**
+ * @param sourceHash NULL to check only the length.
+ * @return YES if the snapshot's header records the given source length and hash.
+ */
+static BOOL checkSource(NSData * data, unsigned long long sourceLength, const uint64_t * sourceHash, NSError * __autoreleasing * error) {
+    if (data.length < HEADER_SIZE) {
+        if (error != NULL) {
+            *error = corruptError(@"Snapshot is truncated");
+        }
+        return NO;
+    }
+    uint64_t header[3];
+    memcpy(header, data.bytes, sizeof(header));
+    if (CFSwapInt64LittleToHost(header[1]) != sourceLength ||
+        (sourceHash != NULL && CFSwapInt64LittleToHost(header[2]) != *sourceHash)) {
+        if (error != NULL) {
+            *error = corruptError(@"Snapshot is stale");
+        }
+        return NO;
+    }
+    return YES;
+}
+
+
++(id)JSONObjectWithSnapshotData:(NSData *)data error:(NSError * __autoreleasing *)error {
+    NSParameterAssert(data);
+
+    // We read the file in place as uint32s and uint64s.  Mapped files and malloc'd buffers are always aligned, but
+    // subdata might not be.
+    if (((uintptr_t)data.bytes & 7) != 0) {
+        data = [NSData dataWithBytes:data.bytes length:data.length];
+    }
+    else {
+        data = [data copy];
+    }
+
+    const uint8_t * bytes = data.bytes;
+    NSUInteger length = data.length;
+    if (length < HEADER_SIZE || memcmp(bytes, SNAPSHOT_MAGIC, 4) != 0) {
+        if (error != NULL) {
+            *error = corruptError(@"Not a snapshot");
+        }
+        return nil;
+    }
+
+    const uint32_t * header = (const uint32_t *)bytes;
+    uint32_t version = CFSwapInt32LittleToHost(header[1]);
+    uint32_t root = CFSwapInt32LittleToHost(header[6]);
+    NSUInteger stringTableOffset = CFSwapInt32LittleToHost(header[7]);
+    if (version != SNAPSHOT_VERSION) {
+        if (error != NULL) {
+            *error = corruptError([NSString stringWithFormat:@"Unsupported snapshot version %u", version]);
+        }
+        return nil;
+    }
+    if (stringTableOffset % 4 != 0 || stringTableOffset < HEADER_SIZE || stringTableOffset > length - 4 ||
+        (length - stringTableOffset - 4) / 4 < CFSwapInt32LittleToHost(*(const uint32_t *)(bytes + stringTableOffset))) {
+        if (error != NULL) {
+            *error = corruptError(@"Snapshot string table is out of bounds");
+        }
+        return nil;
+    }
+
+    JSONSnapshotDocument * doc = [[JSONSnapshotDocument alloc] init];
+    doc->data = data;
+    doc->bytes = bytes;
+    doc->length = length;
+    doc->stringCount = CFSwapInt32LittleToHost(*(const uint32_t *)(bytes + stringTableOffset));
+    doc->stringOffsets = (const uint32_t *)(bytes + stringTableOffset + 4);
+    return valueForRef(doc, root, (uint32_t)(stringTableOffset / 4));
+}
+
+
++(NSData *)snapshotDataWithJSONData:(NSData *)data error:(NSError * __autoreleasing *)error {
+    NSParameterAssert(data);
+
+    return [[[JSONSnapshotBuilder alloc] init] buildWithJSONData:data error:error];
+}
+
+
+@end
+
+
+#pragma mark - Proxies
+
+
+@implementation JSONSnapshotDocument
+@end
+
+
+@implementation JSONSnapshotDictionary
+{
+    JSONSnapshotDocument * doc;
+    // Our own node, as a payload.  See valueForRef.
+    uint32_t limit;
+    NSUInteger count;
+    NSUInteger tableSize;
+    const uint32_t * table;
+    const uint32_t * keys;
+    const uint32_t * values;
+}
+
+
+-(instancetype)initWithDocument:(JSONSnapshotDocument *)document node:(const uint32_t *)node {
+    self = [super init];
+    if (self) {
+        doc = document;
+        limit = (uint32_t)(((const uint8_t *)node - doc->bytes) / 4);
+        count = CFSwapInt32LittleToHost(node[0]);
+        tableSize = CFSwapInt32LittleToHost(node[1]);
+        table = node + 2;
+        keys = table + tableSize;
+        values = keys + count;
+    }
+    return self;
+}
+
+
+-(id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+
+-(NSUInteger)count {
+    return count;
+}
+
+
+-(id)objectForKey:(id)aKey {
+    if (tableSize == 0 || ![aKey isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+
+    NSString * key = aKey;
+    uint8_t buf[KEY_BUFFER_SIZE];
+    CFIndex keyLen = 0;
+    CFRange range = CFRangeMake(0, (CFIndex)key.length);
+    BOOL haveBytes = (CFStringGetBytes((__bridge CFStringRef)key, range, kCFStringEncodingUTF8, 0, false, buf, sizeof(buf), &keyLen) == range.length);
+    uint32_t hash = StringPoolHashString(key);
+
+    NSUInteger mask = tableSize - 1;
+    NSUInteger i = hash & mask;
+    // The table is never more than half full, but don't trust that.
+    for (NSUInteger probes = 0; probes < tableSize; probes++, i = (i + 1) & mask) {
+        uint32_t slot = CFSwapInt32LittleToHost(table[i]);
+        if (slot == 0 || slot > count) {
+            return nil;
+        }
+        uint32_t member = slot - 1;
+        uint32_t entryLen, entryHash;
+        const uint8_t * entry = stringAt(doc, CFSwapInt32LittleToHost(keys[member]), &entryLen, &entryHash);
+        if (entry == NULL || entryHash != hash) {
+            continue;
+        }
+        if (haveBytes ? (entryLen == (uint32_t)keyLen && memcmp(entry, buf, entryLen) == 0) :
+                        [keyForIndex(doc, CFSwapInt32LittleToHost(keys[member])) isEqualToString:key]) {
+            return valueForRef(doc, CFSwapInt32LittleToHost(values[member]), limit);
+        }
+    }
+    return nil;
+}
+
+
+-(NSArray *)allKeys {
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString * key = keyForIndex(doc, CFSwapInt32LittleToHost(keys[i]));
+        if (key != nil) {
+            [result addObject:key];
+        }
+    }
+    return result;
+}
+
+
+-(NSEnumerator *)keyEnumerator {
+    return [[self allKeys] objectEnumerator];
+}
+
+
+/**
+ * The default implementation calls objectForKey: for every key, which would hash each key again.
+ */
+-(void)enumerateKeysAndObjectsWithOptions:(NSEnumerationOptions)opts usingBlock:(void (^)(id key, id obj, BOOL * stop))block {
+    BOOL stop = NO;
+    for (NSUInteger i = 0; i < count && !stop; i++) {
+        @autoreleasepool {
+            NSString * key = keyForIndex(doc, CFSwapInt32LittleToHost(keys[i]));
+            if (key != nil) {
+                block(key, valueForRef(doc, CFSwapInt32LittleToHost(values[i]), limit), &stop);
+            }
+        }
+    }
+}
+
+
+-(void)enumerateKeysAndObjectsUsingBlock:(void (^)(id key, id obj, BOOL * stop))block {
+    [self enumerateKeysAndObjectsWithOptions:0 usingBlock:block];
+}
+
+
+@end
+
+
+@implementation JSONSnapshotArray
+{
+    JSONSnapshotDocument * doc;
+    // Our own node, as a payload.  See valueForRef.
+    uint32_t limit;
+    NSUInteger count;
+    const uint32_t * values;
+}
+
+
+-(instancetype)initWithDocument:(JSONSnapshotDocument *)document node:(const uint32_t *)node {
+    self = [super init];
+    if (self) {
+        doc = document;
+        limit = (uint32_t)(((const uint8_t *)node - doc->bytes) / 4);
+        count = CFSwapInt32LittleToHost(node[0]);
+        values = node + 1;
+    }
+    return self;
+}
+
+
+-(id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+
+-(NSUInteger)count {
+    return count;
+}
+
+
+-(id)objectAtIndex:(NSUInteger)index {
+    if (index >= count) {
+        [NSException raise:NSRangeException format:@"Index %lu beyond bounds [0 .. %ld]", (unsigned long)index, (long)count - 1];
+    }
+    return valueForRef(doc, CFSwapInt32LittleToHost(values[index]), limit);
+}
+
+
+@end
+
+
+#pragma mark - Writing
+
+
+@implementation JSONSnapshotBuilder
+{
+    JSONPullParser * parser;
+    NSMutableData * out;
+
+    // NSString -> NSNumber index in strings.
+    NSMutableDictionary * stringIndexes;
+    NSMutableArray * strings;
+}
+
+
+-(NSData *)buildWithJSONData:(NSData *)json error:(NSError * __autoreleasing *)error {
+    parser = [[JSONPullParser alloc] initWithData:json];
+    out = [NSMutableData dataWithLength:HEADER_SIZE];
+    stringIndexes = [NSMutableDictionary dictionary];
+    strings = [NSMutableArray array];
+
+    JSONPullToken token = [parser next];
+    uint32_t root = [self writeValue:token];
+    if (parser.error == nil && token > JSONPullTokenEnd) {
+        // This sets parser.error if there is anything after the value.
+        [parser next];
+    }
+    if (parser.error != nil || token <= JSONPullTokenEnd) {
+        if (error != NULL) {
+            *error = (parser.error != nil ? parser.error : corruptError(@"No JSON value"));
+        }
+        return nil;
+    }
+
+    uint32_t stringTableOffset = [self writeStringTable];
+
+    uint8_t header[HEADER_SIZE];
+    memcpy(header, SNAPSHOT_MAGIC, 4);
+    uint32_t version = CFSwapInt32HostToLittle(SNAPSHOT_VERSION);
+    uint64_t sourceLength = CFSwapInt64HostToLittle(json.length);
+    uint64_t sourceHash = CFSwapInt64HostToLittle(JSONSnapshotSourceHash(json.bytes, json.length));
+    root = CFSwapInt32HostToLittle(root);
+    stringTableOffset = CFSwapInt32HostToLittle(stringTableOffset);
+    memcpy(header + 4, &version, 4);
+    memcpy(header + 8, &sourceLength, 8);
+    memcpy(header + 16, &sourceHash, 8);
+    memcpy(header + 24, &root, 4);
+    memcpy(header + 28, &stringTableOffset, 4);
+    [out replaceBytesInRange:NSMakeRange(0, HEADER_SIZE) withBytes:header];
+
+    return out;
+}
+
+
+-(void)appendUInt32:(uint32_t)v {
+    v = CFSwapInt32HostToLittle(v);
+    [out appendBytes:&v length:sizeof(v)];
+}
+
+
+-(void)alignTo:(NSUInteger)alignment {
+    NSUInteger pad = (alignment - out.length % alignment) % alignment;
+    [out increaseLengthBy:pad];
+}
+
+
+-(uint32_t)internString:(NSString *)s {
+    NSNumber * index = stringIndexes[s];
+    if (index == nil) {
+        index = @(strings.count);
+        stringIndexes[s] = index;
+        [strings addObject:s];
+    }
+    return (uint32_t)index.unsignedIntegerValue;
+}
+
+
+-(uint32_t)writeEightBytes:(uint64_t)bits kind:(RefKind)kind {
+    [self alignTo:8];
+    uint32_t offset = (uint32_t)out.length;
+    bits = CFSwapInt64HostToLittle(bits);
+    [out appendBytes:&bits length:sizeof(bits)];
+    return MAKE_REF(kind, offset / 4);
+}
+
+
+/**
+ * The same rules as -[JSONPullParser numberValue]: an optional minus sign and up to 18 digits is an integer, and
+ * everything else is a double.  json-snapshot.py does the same.
+ */
+-(uint32_t)writeNumber {
+    const char * text = (const char *)parser.valueBytes;
+    NSUInteger len = parser.valueLength;
+    char tmp[64];
+    char * s = (len < sizeof(tmp) ? tmp : malloc(len + 1));
+    if (s == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)len + 1];
+    }
+    memcpy(s, text, len);
+    s[len] = '\0';
+
+    uint32_t result;
+    NSUInteger digits = (s[0] == '-' ? len - 1 : len);
+    if (digits <= 18 && strpbrk(s, ".eE") == NULL) {
+        long long i = strtoll(s, NULL, 10);
+        result = (i >= SMALL_INT_MIN && i <= SMALL_INT_MAX ?
+                  MAKE_REF(RefInt, (uint32_t)i & 0x1fffffff) :
+                  [self writeEightBytes:(uint64_t)i kind:RefInt64]);
+    }
+    else {
+        double d = strtod(s, NULL);
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        result = [self writeEightBytes:bits kind:RefDouble];
+    }
+
+    if (s != tmp) {
+        free(s);
+    }
+    return result;
+}
+
+
+/**
+ * Write the value starting at token, and any nodes that it needs.  Containers are written after their contents.
+ *
+ * @return The value, or 0 with parser.error set.
+ */
+-(uint32_t)writeValue:(JSONPullToken)token {
+    switch (token) {
+        case JSONPullTokenNull:
+            return MAKE_REF(RefLiteral, RefLiteralNull);
+        case JSONPullTokenFalse:
+            return MAKE_REF(RefLiteral, RefLiteralFalse);
+        case JSONPullTokenTrue:
+            return MAKE_REF(RefLiteral, RefLiteralTrue);
+        case JSONPullTokenNumber:
+            return [self writeNumber];
+        case JSONPullTokenString: {
+            NSString * s = parser.stringValue;
+            return (s == nil ? 0 : MAKE_REF(RefString, [self internString:s]));
+        }
+        case JSONPullTokenArrayStart:
+            return [self writeArray];
+        case JSONPullTokenObjectStart:
+            return [self writeObject];
+        default:
+            return 0;
+    }
+}
+
+
+-(uint32_t)writeArray {
+    NSMutableData * refs = [NSMutableData data];
+    JSONPullToken token;
+    while ((token = [parser next]) != JSONPullTokenArrayEnd) {
+        uint32_t ref = [self writeValue:token];
+        if (parser.error != nil || token <= JSONPullTokenEnd) {
+            return 0;
+        }
+        ref = CFSwapInt32HostToLittle(ref);
+        [refs appendBytes:&ref length:sizeof(ref)];
+    }
+
+    [self alignTo:4];
+    uint32_t offset = (uint32_t)out.length;
+    [self appendUInt32:(uint32_t)(refs.length / 4)];
+    [out appendData:refs];
+    return MAKE_REF(RefArray, offset / 4);
+}
+
+
+-(uint32_t)writeObject {
+    NSMutableData * keyIndexes = [NSMutableData data];
+    NSMutableData * refs = [NSMutableData data];
+    NSMutableArray * hashes = [NSMutableArray array];
+    // NSString -> NSNumber member index.
+    NSMutableDictionary * members = [NSMutableDictionary dictionary];
+    JSONPullToken token;
+    while ((token = [parser next]) == JSONPullTokenKey) {
+        NSString * key = parser.stringValue;
+        if (key == nil) {
+            return 0;
+        }
+        uint32_t keyIndex = [self internString:key];
+        token = [parser next];
+        uint32_t ref = [self writeValue:token];
+        if (parser.error != nil || token <= JSONPullTokenEnd) {
+            return 0;
+        }
+        ref = CFSwapInt32HostToLittle(ref);
+
+        // A repeated key keeps its first position but takes the last value, like -[JSONPullParser objectValue].
+        NSNumber * member = members[key];
+        if (member != nil) {
+            [refs replaceBytesInRange:NSMakeRange(member.unsignedIntegerValue * sizeof(ref), sizeof(ref)) withBytes:&ref];
+            continue;
+        }
+        members[key] = @(hashes.count);
+
+        keyIndex = CFSwapInt32HostToLittle(keyIndex);
+        [keyIndexes appendBytes:&keyIndex length:sizeof(keyIndex)];
+        [refs appendBytes:&ref length:sizeof(ref)];
+        [hashes addObject:@(StringPoolHashString(key))];
+    }
+    if (token != JSONPullTokenObjectEnd) {
+        return 0;
+    }
+
+    uint32_t count = (uint32_t)hashes.count;
+    uint32_t tableSize = 0;
+    if (count > 0) {
+        tableSize = 1;
+        while (tableSize < 2 * count) {
+            tableSize <<= 1;
+        }
+    }
+    uint32_t * table = calloc(MAX(tableSize, 1), sizeof(uint32_t));
+    if (table == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %u entries", tableSize];
+    }
+    for (uint32_t m = 0; m < count; m++) {
+        uint32_t i = (uint32_t)[hashes[m] unsignedIntValue] & (tableSize - 1);
+        while (table[i] != 0) {
+            i = (i + 1) & (tableSize - 1);
+        }
+        table[i] = CFSwapInt32HostToLittle(m + 1);
+    }
+
+    [self alignTo:4];
+    uint32_t offset = (uint32_t)out.length;
+    [self appendUInt32:count];
+    [self appendUInt32:tableSize];
+    [out appendBytes:table length:tableSize * sizeof(uint32_t)];
+    [out appendData:keyIndexes];
+    [out appendData:refs];
+    free(table);
+    return MAKE_REF(RefObject, offset / 4);
+}
+
+
+/**
+ * @return The offset of the table.
+ */
+-(uint32_t)writeStringTable {
+    [self alignTo:4];
+    uint32_t tableOffset = (uint32_t)out.length;
+    uint32_t count = (uint32_t)strings.count;
+    [self appendUInt32:count];
+
+    NSUInteger offsetsStart = out.length;
+    [out increaseLengthBy:count * sizeof(uint32_t)];
+    for (uint32_t i = 0; i < count; i++) {
+        NSString * s = strings[i];
+        NSData * utf8 = [s dataUsingEncoding:NSUTF8StringEncoding];
+        uint32_t entryOffset = CFSwapInt32HostToLittle((uint32_t)out.length);
+        [out replaceBytesInRange:NSMakeRange(offsetsStart + i * sizeof(uint32_t), sizeof(uint32_t)) withBytes:&entryOffset];
+        [self appendUInt32:(uint32_t)utf8.length];
+        [self appendUInt32:StringPoolHashString(s)];
+        [out appendData:utf8];
+        [out increaseLengthBy:1];
+        [self alignTo:4];
+    }
+    return tableOffset;
+}
+
+
+@end
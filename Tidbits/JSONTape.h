@@ -0,0 +1,43 @@
+//
+//  JSONTape.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/4/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * A lazy JSON parser, for when you only read a few fields out of a large document.
+ *
+ * Parsing is in two passes, as in simdjson.  The first classifies the input 64 bytes at a time using vector
+ * compares (SSE2 or NEON, with a scalar fallback) and records the offset of every structural character outside of
+ * strings.  The second walks those offsets, checks the grammar, and writes a compact tape: one or two 64-bit words
+ * per value, where strings and numbers are just ranges of the input, and every object and array records where it
+ * ends, so that skipping it is O(1).
+ *
+ * The result is an NSDictionary or NSArray backed by the tape.  Nothing is decoded until you read it: each call to
+ * objectForKey: or objectAtIndex: builds just the value that you asked for (nested objects and arrays are more
+ * tape-backed proxies), and strings stay as ranges of the input until then.  Lookups in small objects compare the
+ * UTF-8 key against the input without building any strings; larger objects build a key index on the first lookup.
+ * Values are not cached, so reading the same field twice decodes it twice, and you get equal but not identical
+ * objects.
+ *
+ * The grammar is RFC 7159, with any value allowed at the top level, and errors are in NSCocoaErrorDomain with code
+ * NSPropertyListReadCorruptError, the same as NSJSONSerialization.  Strings are not checked up front: a malformed
+ * escape gives the raw text of the string, and invalid UTF-8 is read as ISO Latin 1.  Duplicate keys are not
+ * merged, and objectForKey: gives the first.
+ *
+ * The results are immutable and thread-safe, and keep the input data alive.
+ */
+@interface JSONTape : NSObject
+
+/**
+ * @return An NSDictionary or NSArray backed by a tape over data, or the scalar value if that is what the document
+ * holds, or nil on failure, in which case *error is set (if error is not NULL).
+ */
++(id)JSONObjectWithData:(NSData *)data error:(NSError * __autoreleasing *)error __attribute__((nonnull(1)));
+
+@end
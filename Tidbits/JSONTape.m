@@ -0,0 +1,890 @@
+//
+//  JSONTape.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/4/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#if defined(__SSE2__)
+#import <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#import <arm_neon.h>
+#endif
+
+#import "JSONPullParser.h"
+
+#import "JSONTape.h"
+
+
+#define MAX_DEPTH 512
+
+// Tape indexes are 32 bits, and there are at most two tape words per input byte.
+#define MAX_INPUT_LENGTH (UINT32_MAX / 2)
+
+// Objects with more members than this get a key index on the first lookup.  Smaller ones are searched in place.
+#define LINEAR_SEARCH_LIMIT 16
+
+// Keys up to this length are compared as UTF-8 without building any strings.
+#define KEY_BUFFER_SIZE 256
+
+// Longer than any string or number we'll decode on the stack.
+#define STRING_BUFFER_SIZE 256
+#define NUMBER_BUFFER_SIZE 64
+
+
+/*
+ * Each tape word is a type in the top byte and a payload in the rest.
+ *
+ * '{' and '[': the tape index of the matching '}' or ']' in the low 32 bits, and the member count above that
+ *              (saturating at TAPE_COUNT_MAX, in which case the members are counted when needed).
+ * '}' and ']': the tape index of the matching '{' or '['.
+ * '"':         the input offset of the string's first byte after the quote.  The next word is its length, with
+ *              TAPE_ESCAPED set if it contains a backslash.
+ * '0':         a number: the input offset, and then the length in the next word.
+ * 't', 'f', 'n': true, false, null.
+ */
+#define TAPE_TYPE(w) ((uint8_t)((w) >> 56))
+#define TAPE_PAYLOAD(w) ((w) & 0x00ffffffffffffffULL)
+#define TAPE_WORD(type, payload) (((uint64_t)(type) << 56) | (uint64_t)(payload))
+#define TAPE_END(w) ((NSUInteger)(uint32_t)(w))
+#define TAPE_COUNT(w) ((NSUInteger)(((w) >> 32) & TAPE_COUNT_MAX))
+#define TAPE_COUNT_MAX 0xffffff
+#define TAPE_ESCAPED (1ULL << 63)
+#define TAPE_NUMBER '0'
+
+
+typedef NS_ENUM(uint8_t, ParserState) {
+    // Expecting a value (at the top level, after a colon, or after a comma in an array).
+    StateValue,
+    // Just after '['.
+    StateValueOrEnd,
+    // Just after '{'.
+    StateKeyOrEnd,
+    // After a comma in an object.
+    StateKey,
+    // After a key.
+    StateColon,
+    // After a value inside a container.
+    StateCommaOrEnd,
+    // After the top-level value.
+    StateDone,
+};
+
+
+/**
+ * The input and its tape, shared by all the proxies for one document.
+ */
+@interface JSONTapeDocument : NSObject
+{
+@public
+    NSData * data;
+    const uint8_t * bytes;
+    uint64_t * tape;
+}
+@end
+
+
+@interface JSONTapeDictionary : NSDictionary
+-(instancetype)initWithDocument:(JSONTapeDocument *)doc index:(NSUInteger)index;
+@end
+
+
+@interface JSONTapeArray : NSArray
+-(instancetype)initWithDocument:(JSONTapeDocument *)doc index:(NSUInteger)index;
+@end
+
+
+#pragma mark - Stage 1: structural index
+
+
+typedef uint8_t v16u8 __attribute__((vector_size(16)));
+
+
+static inline v16u8 splat(uint8_t c) {
+    v16u8 v;
+    memset(&v, c, sizeof(v));
+    return v;
+}
+
+
+/**
+ * @return One bit per lane of v, which must be all zeros or all ones in each lane.
+ */
+static inline uint64_t movemask(v16u8 v) {
+#if defined(__SSE2__)
+    return (uint64_t)(uint16_t)_mm_movemask_epi8((__m128i)v);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t bits = vandq_u8((uint8x16_t)v, vld1q_u8(weights));
+    return (uint64_t)vaddv_u8(vget_low_u8(bits)) | ((uint64_t)vaddv_u8(vget_high_u8(bits)) << 8);
+#else
+    uint64_t result = 0;
+    for (int i = 0; i < 16; i++) {
+        result |= (uint64_t)(v[i] & 1) << i;
+    }
+    return result;
+#endif
+}
+
+
+typedef struct {
+    uint64_t quote;
+    uint64_t backslash;
+    // { } [ ] : ,
+    uint64_t op;
+    uint64_t whitespace;
+} BlockMasks;
+
+
+static inline void classify16(const uint8_t * p, unsigned shift, BlockMasks * m) {
+    v16u8 v;
+    memcpy(&v, p, sizeof(v));
+
+    // '[' and ']' are '{' and '}' without the 0x20 bit, and nothing else is.
+    v16u8 folded = v | splat(0x20);
+    v16u8 op = ((v16u8)(folded == splat('{')) | (v16u8)(folded == splat('}')) |
+                (v16u8)(v == splat(':')) | (v16u8)(v == splat(',')));
+    v16u8 ws = ((v16u8)(v == splat(' ')) | (v16u8)(v == splat('\t')) |
+                (v16u8)(v == splat('\n')) | (v16u8)(v == splat('\r')));
+
+    m->quote |= movemask((v16u8)(v == splat('"'))) << shift;
+    m->backslash |= movemask((v16u8)(v == splat('\\'))) << shift;
+    m->op |= movemask(op) << shift;
+    m->whitespace |= movemask(ws) << shift;
+}
+
+
+/**
+ * @return The characters that are escaped by the given backslashes.  *carry says whether the first character in
+ * the block is escaped by a backslash at the end of the previous one, and is updated for the next block.
+ */
+static uint64_t findEscaped(uint64_t backslash, BOOL * carry) {
+    uint64_t escaped = 0;
+    if (*carry) {
+        escaped = 1;
+        backslash &= ~1ULL;
+    }
+    *carry = NO;
+    while (backslash != 0) {
+        int i = __builtin_ctzll(backslash);
+        if (i == 63) {
+            *carry = YES;
+            break;
+        }
+        uint64_t next = 2ULL << i;
+        escaped |= next;
+        backslash &= ~((1ULL << i) | next);
+    }
+    return escaped;
+}
+
+
+/**
+ * @return A mask with every bit set from each quote up to (but not including) the next one.
+ */
+static inline uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+
+/**
+ * Stage 1: write to indices the offset of every quote, every { } [ ] : , outside of a string, and the first
+ * character of every other run of characters outside of a string (that is, the start of each number and literal,
+ * and of any garbage, for stage 2 to reject).
+ *
+ * @param indices Must have room for len entries.
+ * @return The number of indices, or NSNotFound if the input ends inside a string.
+ */
+static NSUInteger findStructurals(const uint8_t * bytes, NSUInteger len, uint32_t * indices) {
+    NSUInteger n = 0;
+    // All ones if the previous block ended inside a string.
+    uint64_t inStringCarry = 0;
+    // 1 if the previous block ended with a character that ends a run.  The start of the input counts.
+    uint64_t breakCarry = 1;
+    BOOL escapeCarry = NO;
+    uint8_t tail[64];
+
+    for (NSUInteger base = 0; base < len; base += 64) {
+        const uint8_t * p = bytes + base;
+        if (len - base < 64) {
+            // Pad with whitespace, which never produces an index.
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, p, len - base);
+            p = tail;
+        }
+
+        BlockMasks m = {0, 0, 0, 0};
+        classify16(p, 0, &m);
+        classify16(p + 16, 16, &m);
+        classify16(p + 32, 32, &m);
+        classify16(p + 48, 48, &m);
+
+        uint64_t escaped = ((m.backslash != 0 || escapeCarry) ? findEscaped(m.backslash, &escapeCarry) : 0);
+        uint64_t quote = m.quote & ~escaped;
+        // Set for each opening quote and the string's contents, but not its closing quote.
+        uint64_t inString = prefixXor(quote) ^ inStringCarry;
+        inStringCarry = (uint64_t)((int64_t)inString >> 63);
+
+        uint64_t breaks = m.op | m.whitespace | m.quote;
+        uint64_t runStarts = ~(breaks | inString) & ((breaks << 1) | breakCarry);
+        breakCarry = breaks >> 63;
+
+        uint64_t structurals = (m.op & ~inString) | quote | runStarts;
+        while (structurals != 0) {
+            indices[n++] = (uint32_t)(base + (NSUInteger)__builtin_ctzll(structurals));
+            structurals &= structurals - 1;
+        }
+    }
+
+    return (inStringCarry != 0 ? NSNotFound : n);
+}
+
+
+#pragma mark - Stage 2: tape
+
+
+typedef struct {
+    uint32_t start;
+    uint32_t count;
+    BOOL isObject;
+} Frame;
+
+
+static BOOL isDigit(uint8_t c) {
+    return c >= '0' && c <= '9';
+}
+
+
+/**
+ * @return YES if c ends a number or literal.
+ */
+static BOOL isDelimiter(uint8_t c) {
+    switch (c) {
+        case ' ': case '\t': case '\n': case '\r':
+        case '{': case '}': case '[': case ']': case ':': case ',':
+        case '"':
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+
+static BOOL matchLiteral(const uint8_t * bytes, NSUInteger len, NSUInteger pos, const char * literal) {
+    NSUInteger n = strlen(literal);
+    return (pos + n <= len && memcmp(bytes + pos, literal, n) == 0 && (pos + n == len || isDelimiter(bytes[pos + n])));
+}
+
+
+/**
+ * @return The length of the number at pos, or 0 if it's not valid.
+ */
+static NSUInteger scanNumber(const uint8_t * bytes, NSUInteger len, NSUInteger pos) {
+    NSUInteger e = pos;
+    while (e < len && !isDelimiter(bytes[e])) {
+        e++;
+    }
+    const uint8_t * p = bytes + pos;
+    const uint8_t * end = bytes + e;
+
+    // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    if (p < end && *p == '-') {
+        p++;
+    }
+    if (p == end || !isDigit(*p)) {
+        return 0;
+    }
+    if (*p == '0') {
+        p++;
+    }
+    else {
+        while (p < end && isDigit(*p)) {
+            p++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (p == end || !isDigit(*p)) {
+            return 0;
+        }
+        while (p < end && isDigit(*p)) {
+            p++;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (p == end || !isDigit(*p)) {
+            return 0;
+        }
+        while (p < end && isDigit(*p)) {
+            p++;
+        }
+    }
+    return (p == end ? e - pos : 0);
+}
+
+
+/**
+ * Append the string whose opening quote is at indices[*k].  Stage 1 guarantees that its closing quote is the next
+ * index.
+ */
+static void appendString(const uint8_t * bytes, const uint32_t * indices, NSUInteger * k, uint64_t * tape, NSUInteger * t) {
+    NSUInteger start = indices[*k] + 1;
+    NSUInteger end = indices[*k + 1];
+    BOOL escaped = (memchr(bytes + start, '\\', end - start) != NULL);
+    tape[(*t)++] = TAPE_WORD('"', start);
+    tape[(*t)++] = (uint64_t)(end - start) | (escaped ? TAPE_ESCAPED : 0);
+    *k += 2;
+}
+
+
+static void closeContainer(uint64_t * tape, NSUInteger * t, const Frame * frame) {
+    uint8_t type = (frame->isObject ? '}' : ']');
+    uint64_t count = MIN(frame->count, TAPE_COUNT_MAX);
+    tape[frame->start] = TAPE_WORD((frame->isObject ? '{' : '['), (count << 32) | (uint32_t)*t);
+    tape[(*t)++] = TAPE_WORD(type, frame->start);
+}
+
+
+/**
+ * Stage 2: check the grammar and write the tape.
+ *
+ * @param tape Must have room for 2 * n words.
+ * @return nil on success, with the number of tape words in *tapeLen, or an error message, with the input offset
+ * in *errorOffset.
+ */
+static NSString * buildTape(const uint8_t * bytes, NSUInteger len, const uint32_t * indices, NSUInteger n,
+                            uint64_t * tape, NSUInteger * tapeLen, NSUInteger * errorOffset) {
+    Frame stack[MAX_DEPTH];
+    NSUInteger depth = 0;
+    NSUInteger t = 0;
+    NSUInteger k = 0;
+    ParserState state = StateValue;
+
+    while (k < n) {
+        NSUInteger pos = indices[k];
+        uint8_t c = bytes[pos];
+        *errorOffset = pos;
+
+        if (state == StateKeyOrEnd || state == StateValueOrEnd) {
+            if (c == (state == StateKeyOrEnd ? '}' : ']')) {
+                closeContainer(tape, &t, &stack[--depth]);
+                k++;
+                state = (depth == 0 ? StateDone : StateCommaOrEnd);
+                continue;
+            }
+            state = (state == StateKeyOrEnd ? StateKey : StateValue);
+        }
+
+        switch (state) {
+            case StateKey:
+                if (c != '"') {
+                    return @"Expected a key";
+                }
+                appendString(bytes, indices, &k, tape, &t);
+                stack[depth - 1].count++;
+                state = StateColon;
+                break;
+
+            case StateColon:
+                if (c != ':') {
+                    return @"Expected ':'";
+                }
+                k++;
+                state = StateValue;
+                break;
+
+            case StateCommaOrEnd: {
+                Frame * frame = &stack[depth - 1];
+                if (c == ',') {
+                    k++;
+                    state = (frame->isObject ? StateKey : StateValue);
+                }
+                else if (c == (frame->isObject ? '}' : ']')) {
+                    closeContainer(tape, &t, frame);
+                    depth--;
+                    k++;
+                    state = (depth == 0 ? StateDone : StateCommaOrEnd);
+                }
+                else {
+                    return (frame->isObject ? @"Expected ',' or '}'" : @"Expected ',' or ']'");
+                }
+                break;
+            }
+
+            case StateValue:
+                if (depth > 0 && !stack[depth - 1].isObject) {
+                    stack[depth - 1].count++;
+                }
+                if (c == '{' || c == '[') {
+                    if (depth == MAX_DEPTH) {
+                        return @"Too deeply nested";
+                    }
+                    Frame * frame = &stack[depth++];
+                    frame->start = (uint32_t)t;
+                    frame->count = 0;
+                    frame->isObject = (c == '{');
+                    tape[t++] = TAPE_WORD(c, 0);
+                    k++;
+                    state = (c == '{' ? StateKeyOrEnd : StateValueOrEnd);
+                    break;
+                }
+
+                if (c == '"') {
+                    appendString(bytes, indices, &k, tape, &t);
+                }
+                else if (c == 't' || c == 'f' || c == 'n') {
+                    const char * literal = (c == 't' ? "true" : c == 'f' ? "false" : "null");
+                    if (!matchLiteral(bytes, len, pos, literal)) {
+                        return @"Invalid value";
+                    }
+                    tape[t++] = TAPE_WORD(c, 0);
+                    k++;
+                }
+                else {
+                    NSUInteger numLen = scanNumber(bytes, len, pos);
+                    if (numLen == 0) {
+                        return (c == '-' || isDigit(c) ? @"Invalid number" : @"Invalid value");
+                    }
+                    tape[t++] = TAPE_WORD(TAPE_NUMBER, pos);
+                    tape[t++] = numLen;
+                    k++;
+                }
+                state = (depth == 0 ? StateDone : StateCommaOrEnd);
+                break;
+
+            case StateDone:
+                return @"Garbage at end";
+
+            case StateKeyOrEnd:
+            case StateValueOrEnd:
+                // Handled above.
+                break;
+        }
+    }
+
+    if (state != StateDone) {
+        *errorOffset = len;
+        return @"Unexpected end of input";
+    }
+    *tapeLen = t;
+    return nil;
+}
+
+
+#pragma mark - Decoding
+
+
+/**
+ * @return The tape index just after the value at i.
+ */
+static inline NSUInteger nextIndex(const uint64_t * tape, NSUInteger i) {
+    uint64_t w = tape[i];
+    switch (TAPE_TYPE(w)) {
+        case '{':
+        case '[':
+            return TAPE_END(w) + 1;
+        case '"':
+        case TAPE_NUMBER:
+            return i + 2;
+        default:
+            return i + 1;
+    }
+}
+
+
+/**
+ * @return The number of members of the object or array at i.
+ */
+static NSUInteger countAtIndex(const uint64_t * tape, NSUInteger i) {
+    uint64_t w = tape[i];
+    NSUInteger count = TAPE_COUNT(w);
+    if (count < TAPE_COUNT_MAX) {
+        return count;
+    }
+    BOOL isObject = (TAPE_TYPE(w) == '{');
+    NSUInteger end = TAPE_END(w);
+    count = 0;
+    for (NSUInteger j = i + 1; j < end; j = nextIndex(tape, (isObject ? j + 2 : j))) {
+        count++;
+    }
+    return count;
+}
+
+
+static NSString * stringWithBytes(const uint8_t * p, NSUInteger n) {
+    NSString * result = [[NSString alloc] initWithBytes:p length:n encoding:NSUTF8StringEncoding];
+    return (result != nil ? result : [[NSString alloc] initWithBytes:p length:n encoding:NSISOLatin1StringEncoding]);
+}
+
+
+static NSString * stringAtIndex(JSONTapeDocument * doc, NSUInteger i) {
+    const uint8_t * p = doc->bytes + TAPE_PAYLOAD(doc->tape[i]);
+    uint64_t w = doc->tape[i + 1];
+    NSUInteger n = (NSUInteger)(w & ~TAPE_ESCAPED);
+    if (n == 0) {
+        return @"";
+    }
+    if ((w & TAPE_ESCAPED) == 0) {
+        return stringWithBytes(p, n);
+    }
+
+    uint8_t tmp[STRING_BUFFER_SIZE];
+    uint8_t * buf = (n <= sizeof(tmp) ? tmp : malloc(n));
+    if (buf == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)n];
+    }
+    NSUInteger decodedLen = JSONUnescapeString(p, n, buf);
+    NSString * result = (decodedLen == NSNotFound ? stringWithBytes(p, n) : stringWithBytes(buf, decodedLen));
+    if (buf != tmp) {
+        free(buf);
+    }
+    return result;
+}
+
+
+/**
+ * @return YES if the key at tape index i is exactly the UTF-8 in key.
+ */
+static BOOL keyEquals(JSONTapeDocument * doc, NSUInteger i, const uint8_t * key, NSUInteger keyLen) {
+    const uint8_t * p = doc->bytes + TAPE_PAYLOAD(doc->tape[i]);
+    uint64_t w = doc->tape[i + 1];
+    NSUInteger n = (NSUInteger)(w & ~TAPE_ESCAPED);
+    if ((w & TAPE_ESCAPED) == 0) {
+        return (n == keyLen && memcmp(p, key, n) == 0);
+    }
+    // Unescaping never makes the text longer, and a key that long won't fit in our buffer.
+    if (n < keyLen || n > STRING_BUFFER_SIZE) {
+        return (n >= keyLen && [stringAtIndex(doc, i) isEqualToString:stringWithBytes(key, keyLen)]);
+    }
+    uint8_t buf[STRING_BUFFER_SIZE];
+    NSUInteger decodedLen = JSONUnescapeString(p, n, buf);
+    if (decodedLen == NSNotFound) {
+        return (n == keyLen && memcmp(p, key, n) == 0);
+    }
+    return (decodedLen == keyLen && memcmp(buf, key, keyLen) == 0);
+}
+
+
+static NSNumber * numberAtIndex(JSONTapeDocument * doc, NSUInteger i) {
+    const uint8_t * p = doc->bytes + TAPE_PAYLOAD(doc->tape[i]);
+    NSUInteger n = (NSUInteger)doc->tape[i + 1];
+
+    // Integers of up to 18 digits always fit in a long long.
+    const uint8_t * q = p;
+    const uint8_t * end = p + n;
+    BOOL negative = (*q == '-');
+    if (negative) {
+        q++;
+    }
+    if (end - q <= 18) {
+        long long v = 0;
+        while (q < end && isDigit(*q)) {
+            v = v * 10 + (*q++ - '0');
+        }
+        if (q == end) {
+            return @(negative ? -v : v);
+        }
+    }
+
+    char tmp[NUMBER_BUFFER_SIZE];
+    char * s = (n < sizeof(tmp) ? tmp : malloc(n + 1));
+    if (s == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)n + 1];
+    }
+    memcpy(s, p, n);
+    s[n] = '\0';
+    double d = strtod(s, NULL);
+    if (s != tmp) {
+        free(s);
+    }
+    return @(d);
+}
+
+
+static id valueAtIndex(JSONTapeDocument * doc, NSUInteger i) {
+    switch (TAPE_TYPE(doc->tape[i])) {
+        case '{':
+            return [[JSONTapeDictionary alloc] initWithDocument:doc index:i];
+        case '[':
+            return [[JSONTapeArray alloc] initWithDocument:doc index:i];
+        case '"':
+            return stringAtIndex(doc, i);
+        case TAPE_NUMBER:
+            return numberAtIndex(doc, i);
+        case 't':
+            return @YES;
+        case 'f':
+            return @NO;
+        default:
+            return [NSNull null];
+    }
+}
+
+
+#pragma mark - JSONTape
+
+
+@implementation JSONTape
+
+
+static NSError * makeError(NSString * message, NSUInteger offset) {
+    NSString * desc = [NSString stringWithFormat:@"%@ around character %lu.", message, (unsigned long)offset];
+    return [NSError errorWithDomain:NSCocoaErrorDomain code:NSPropertyListReadCorruptError userInfo:@{NSDebugDescriptionErrorKey: desc}];
+}
+
+
++(id)JSONObjectWithData:(NSData *)data error:(NSError * __autoreleasing *)error {
+    NSParameterAssert(data);
+
+    data = [data copy];
+    NSUInteger len = data.length;
+    if (len > MAX_INPUT_LENGTH) {
+        if (error != NULL) {
+            *error = makeError(@"Input too large", 0);
+        }
+        return nil;
+    }
+    const uint8_t * bytes = data.bytes;
+
+    uint32_t * indices = malloc(MAX(len, 1) * sizeof(uint32_t));
+    if (indices == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %lu indices", (unsigned long)len];
+    }
+    NSUInteger n = findStructurals(bytes, len, indices);
+    if (n == NSNotFound) {
+        free(indices);
+        if (error != NULL) {
+            *error = makeError(@"Unterminated string", len);
+        }
+        return nil;
+    }
+
+    uint64_t * tape = malloc(MAX(2 * n, 1) * sizeof(uint64_t));
+    if (tape == NULL) {
+        free(indices);
+        [NSException raise:NSMallocException format:@"Failed to allocate %lu tape words", (unsigned long)(2 * n)];
+    }
+    NSUInteger tapeLen = 0;
+    NSUInteger errorOffset = 0;
+    NSString * message = buildTape(bytes, len, indices, n, tape, &tapeLen, &errorOffset);
+    free(indices);
+    if (message != nil) {
+        free(tape);
+        if (error != NULL) {
+            *error = makeError(message, errorOffset);
+        }
+        return nil;
+    }
+
+    // Give back the slack: the tape is usually much shorter than the bound.
+    uint64_t * shrunk = realloc(tape, tapeLen * sizeof(uint64_t));
+    if (shrunk != NULL) {
+        tape = shrunk;
+    }
+
+    JSONTapeDocument * doc = [[JSONTapeDocument alloc] init];
+    doc->data = data;
+    doc->bytes = bytes;
+    doc->tape = tape;
+    return valueAtIndex(doc, 0);
+}
+
+
+@end
+
+
+#pragma mark - Proxies
+
+
+@implementation JSONTapeDocument
+
+
+-(void)dealloc {
+    free(tape);
+}
+
+
+@end
+
+
+@implementation JSONTapeDictionary
+{
+    JSONTapeDocument * doc;
+    NSUInteger start;
+    NSUInteger end;
+    NSUInteger count;
+
+    // Key -> NSNumber tape index of the value.  Built on the first lookup if count > LINEAR_SEARCH_LIMIT.  Guarded
+    // by @synchronized(self).
+    NSDictionary * keyIndex;
+}
+
+
+-(instancetype)initWithDocument:(JSONTapeDocument *)document index:(NSUInteger)index {
+    self = [super init];
+    if (self) {
+        doc = document;
+        start = index;
+        end = TAPE_END(doc->tape[index]);
+        count = countAtIndex(doc->tape, index);
+    }
+    return self;
+}
+
+
+-(id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+
+-(NSUInteger)count {
+    return count;
+}
+
+
+-(id)objectForKey:(id)aKey {
+    if (![aKey isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+
+    if (count > LINEAR_SEARCH_LIMIT) {
+        NSNumber * i;
+        @synchronized (self) {
+            if (keyIndex == nil) {
+                keyIndex = [self buildKeyIndex];
+            }
+            i = keyIndex[aKey];
+        }
+        return (i == nil ? nil : valueAtIndex(doc, i.unsignedIntegerValue));
+    }
+
+    NSString * key = aKey;
+    uint8_t buf[KEY_BUFFER_SIZE];
+    CFIndex keyLen = 0;
+    CFRange range = CFRangeMake(0, (CFIndex)key.length);
+    BOOL haveBytes = (CFStringGetBytes((__bridge CFStringRef)key, range, kCFStringEncodingUTF8, 0, false, buf, sizeof(buf), &keyLen) == range.length);
+
+    const uint64_t * tape = doc->tape;
+    for (NSUInteger i = start + 1; i < end; i = nextIndex(tape, i + 2)) {
+        if (haveBytes ? keyEquals(doc, i, buf, (NSUInteger)keyLen) : [stringAtIndex(doc, i) isEqualToString:key]) {
+            return valueAtIndex(doc, i + 2);
+        }
+    }
+    return nil;
+}
+
+
+-(NSDictionary *)buildKeyIndex {
+    NSMutableDictionary * result = [NSMutableDictionary dictionaryWithCapacity:count];
+    const uint64_t * tape = doc->tape;
+    for (NSUInteger i = start + 1; i < end; i = nextIndex(tape, i + 2)) {
+        NSString * key = stringAtIndex(doc, i);
+        if (result[key] == nil) {
+            result[key] = @(i + 2);
+        }
+    }
+    return result;
+}
+
+
+-(NSArray *)allKeys {
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:count];
+    const uint64_t * tape = doc->tape;
+    for (NSUInteger i = start + 1; i < end; i = nextIndex(tape, i + 2)) {
+        [result addObject:stringAtIndex(doc, i)];
+    }
+    return result;
+}
+
+
+-(NSEnumerator *)keyEnumerator {
+    return [[self allKeys] objectEnumerator];
+}
+
+
+/**
+ * The default implementation calls objectForKey: for every key, which would make this quadratic.
+ */
+-(void)enumerateKeysAndObjectsWithOptions:(NSEnumerationOptions)opts usingBlock:(void (^)(id key, id obj, BOOL * stop))block {
+    const uint64_t * tape = doc->tape;
+    BOOL stop = NO;
+    for (NSUInteger i = start + 1; i < end && !stop; i = nextIndex(tape, i + 2)) {
+        @autoreleasepool {
+            block(stringAtIndex(doc, i), valueAtIndex(doc, i + 2), &stop);
+        }
+    }
+}
+
+
+-(void)enumerateKeysAndObjectsUsingBlock:(void (^)(id key, id obj, BOOL * stop))block {
+    [self enumerateKeysAndObjectsWithOptions:0 usingBlock:block];
+}
+
+
+@end
+
+
+@implementation JSONTapeArray
+{
+    JSONTapeDocument * doc;
+    NSUInteger count;
+
+    // The tape index of each element.  This is just a walk over the tape; nothing is decoded.
+    uint32_t * elements;
+}
+
+
+-(instancetype)initWithDocument:(JSONTapeDocument *)document index:(NSUInteger)index {
+    self = [super init];
+    if (self) {
+        doc = document;
+        count = countAtIndex(doc->tape, index);
+        elements = malloc(MAX(count, 1) * sizeof(uint32_t));
+        if (elements == NULL) {
+            [NSException raise:NSMallocException format:@"Failed to allocate %lu entries", (unsigned long)count];
+        }
+        NSUInteger i = index + 1;
+        for (NSUInteger j = 0; j < count; j++) {
+            elements[j] = (uint32_t)i;
+            i = nextIndex(doc->tape, i);
+        }
+    }
+    return self;
+}
+
+
+-(void)dealloc {
+    free(elements);
+}
+
+
+-(id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+
+-(NSUInteger)count {
+    return count;
+}
+
+
+-(id)objectAtIndex:(NSUInteger)index {
+    if (index >= count) {
+        [NSException raise:NSRangeException format:@"Index %lu beyond bounds [0 .. %ld]", (unsigned long)index, (long)count - 1];
+    }
+    return valueAtIndex(doc, elements[index]);
+}
+
+
+@end
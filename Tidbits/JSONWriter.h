@@ -0,0 +1,61 @@
+//
+//  JSONWriter.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/2/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+typedef NS_OPTIONS(NSUInteger, JSONWriterOptions) {
+    /**
+     * Newlines and two-space indentation, with " : " between keys and values, in the same layout as
+     * NSJSONWritingPrettyPrinted.
+     */
+    JSONWriterPrettyPrinted = 1 << 0,
+
+    /**
+     * Write dictionary keys in the order given by -[NSString compare:].
+     */
+    JSONWriterSortedKeys = 1 << 1,
+};
+
+
+/**
+ * Writes JSON in a single pass over an object graph, straight into a UTF-8 buffer or an NSOutputStream.
+ *
+ * Everything is made safe as it is written, with the same coercions as -[NSObject objectWithJSONSafeObjects]
+ * (MTJSONUtils), so this is equivalent to [NSJSONSerialization dataWithJSONObject:[obj objectWithJSONSafeObjects] ...]
+ * but without the intermediate copy of the tree, NSData, and NSString:
+ *
+ * - NSString, NSNumber, and NSNull are written as-is.
+ * - NSDate is written as a "yyyy-MM-dd'T'HH:mm:ss'Z'" string in UTC (always in the Gregorian calendar, which
+ *   NSDateFormatter only does if the user hasn't chosen some other calendar).
+ * - NSSet is written as an array, except as a dictionary value, where MTJSONUtils uses its description.
+ * - Anything else is written as its description.
+ *
+ * Unlike NSJSONSerialization, a top-level value that is not a container is written rather than rejected, and
+ * dictionary keys that are not strings are written as their description.  Non-finite numbers are an error, and so
+ * is nesting deeper than 512 (which is most likely a cycle).  Errors are in NSCocoaErrorDomain with code
+ * NSFormattingError, or are the stream's streamError.
+ *
+ * Strings are escaped the same way as NSJSONSerialization, including "\/".
+ */
+@interface JSONWriter : NSObject
+
++(NSData *)dataWithJSONSafeObject:(id)obj options:(JSONWriterOptions)opt error:(NSError * __autoreleasing *)error;
+
++(NSString *)stringWithJSONSafeObject:(id)obj options:(JSONWriterOptions)opt error:(NSError * __autoreleasing *)error;
+
+/**
+ * Write to stream, which must already be open.  The output is written in chunks as it is generated, so the
+ * whole document is never held in memory.
+ *
+ * @return NO on failure, in which case *error is set (if error is not NULL), and a partial document may have been
+ * written.
+ */
++(BOOL)writeJSONSafeObject:(id)obj toStream:(NSOutputStream *)stream options:(JSONWriterOptions)opt error:(NSError * __autoreleasing *)error __attribute__((nonnull(2)));
+
+@end
@@ -0,0 +1,526 @@
+//
+//  JSONWriter.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/2/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "UTF8Builder.h"
+
+#import "JSONWriter.h"
+
+
+#define MAX_DEPTH 512
+
+// When writing to a stream, the buffer is flushed whenever it gets to this size.
+#define FLUSH_THRESHOLD 16384
+
+// Dictionaries up to this size have their keys and values fetched into arrays on the stack.
+#define STACK_DICT_COUNT 32
+
+
+/**
+ * 0 for bytes that are written as-is, otherwise the character to write after a backslash, or 'u' for \u00XX.
+ */
+static uint8_t escapes[256];
+
+
+@interface JSONWriter ()
+
+-(instancetype)initWithOptions:(JSONWriterOptions)opt stream:(NSOutputStream *)stream;
+
+@end
+
+
+@implementation JSONWriter
+{
+    UTF8Builder * b;
+    NSOutputStream * stream;
+    BOOL pretty;
+    BOOL sorted;
+    NSUInteger depth;
+    NSError * error;
+}
+
+
++(void)initialize {
+    if (self != [JSONWriter class]) {
+        return;
+    }
+    for (int c = 0; c < 0x20; c++) {
+        escapes[c] = 'u';
+    }
+    escapes['\b'] = 'b';
+    escapes['\f'] = 'f';
+    escapes['\n'] = 'n';
+    escapes['\r'] = 'r';
+    escapes['\t'] = 't';
+    escapes['"'] = '"';
+    escapes['\\'] = '\\';
+    escapes['/'] = '/';
+}
+
+
++(NSData *)dataWithJSONSafeObject:(id)obj options:(JSONWriterOptions)opt error:(NSError * __autoreleasing *)error {
+    JSONWriter * w = [[JSONWriter alloc] initWithOptions:opt stream:nil];
+    if (!writeTopLevel(w, obj)) {
+        if (error != NULL) {
+            *error = w->error;
+        }
+        return nil;
+    }
+    return [w->b data];
+}
+
+
++(NSString *)stringWithJSONSafeObject:(id)obj options:(JSONWriterOptions)opt error:(NSError * __autoreleasing *)error {
+    JSONWriter * w = [[JSONWriter alloc] initWithOptions:opt stream:nil];
+    if (!writeTopLevel(w, obj)) {
+        if (error != NULL) {
+            *error = w->error;
+        }
+        return nil;
+    }
+    return [w->b string];
+}
+
+
++(BOOL)writeJSONSafeObject:(id)obj toStream:(NSOutputStream *)stream options:(JSONWriterOptions)opt error:(NSError * __autoreleasing *)error {
+    NSParameterAssert(stream);
+
+    JSONWriter * w = [[JSONWriter alloc] initWithOptions:opt stream:stream];
+    if (!writeTopLevel(w, obj) || !flush(w)) {
+        if (error != NULL) {
+            *error = w->error;
+        }
+        return NO;
+    }
+    return YES;
+}
+
+
+-(instancetype)initWithOptions:(JSONWriterOptions)opt stream:(NSOutputStream *)stream_ {
+    self = [super init];
+    if (self) {
+        b = [[UTF8Builder alloc] initWithCapacity:(stream_ == nil ? 256 : FLUSH_THRESHOLD + 1024)];
+        stream = stream_;
+        pretty = ((opt & JSONWriterPrettyPrinted) != 0);
+        sorted = ((opt & JSONWriterSortedKeys) != 0);
+    }
+    return self;
+}
+
+
+#pragma mark - Output
+
+
+static BOOL fail(JSONWriter * self, NSString * message) {
+    if (self->error == nil) {
+        self->error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFormattingError userInfo:@{NSDebugDescriptionErrorKey: message}];
+    }
+    return NO;
+}
+
+
+static BOOL flush(JSONWriter * self) {
+    if (self->stream == nil) {
+        return YES;
+    }
+    UTF8Builder * b = self->b;
+    const uint8_t * bytes = b.bytes;
+    NSUInteger length = b.length;
+    NSUInteger offset = 0;
+    while (offset < length) {
+        NSInteger n = [self->stream write:bytes + offset maxLength:length - offset];
+        if (n <= 0) {
+            if (self->error == nil) {
+                NSError * err = self->stream.streamError;
+                self->error = (err != nil ? err : [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil]);
+            }
+            return NO;
+        }
+        offset += (NSUInteger)n;
+    }
+    [b truncateToLength:0];
+    return YES;
+}
+
+
+static inline BOOL maybeFlush(JSONWriter * self) {
+    return (self->stream == nil || self->b.length < FLUSH_THRESHOLD || flush(self));
+}
+
+
+static void writeNewlineAndIndent(JSONWriter * self) {
+    NSUInteger n = 2 * self->depth;
+    uint8_t * p = [self->b reserve:n + 1];
+    p[0] = '\n';
+    memset(p + 1, ' ', n);
+    [self->b didAppend:n + 1];
+}
+
+
+/**
+ * Write bytes as the body of a JSON string (without the quotes), escaping as needed.
+ */
+static void writeEscaped(UTF8Builder * b, const uint8_t * bytes, NSUInteger length) {
+    static const char hex[] = "0123456789abcdef";
+
+    NSUInteger runStart = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        uint8_t e = escapes[bytes[i]];
+        if (e == 0) {
+            continue;
+        }
+        [b appendBytes:bytes + runStart length:i - runStart];
+        if (e == 'u') {
+            uint8_t esc[6] = { '\\', 'u', '0', '0', (uint8_t)hex[bytes[i] >> 4], (uint8_t)hex[bytes[i] & 0xf] };
+            [b appendBytes:esc length:6];
+        }
+        else {
+            uint8_t esc[2] = { '\\', e };
+            [b appendBytes:esc length:2];
+        }
+        runStart = i + 1;
+    }
+    [b appendBytes:bytes + runStart length:length - runStart];
+}
+
+
+static void writeString(JSONWriter * self, NSString * s) {
+    UTF8Builder * b = self->b;
+    [b appendByte:'"'];
+
+    CFStringRef cf = (__bridge CFStringRef)s;
+    CFIndex len = CFStringGetLength(cf);
+    const char * ascii = CFStringGetCStringPtr(cf, kCFStringEncodingUTF8);
+    if (ascii != NULL) {
+        writeEscaped(b, (const uint8_t *)ascii, (NSUInteger)len);
+    }
+    else if (len > 0) {
+        // Transcode into a scratch area past the end of the buffer, and then escape from there into place.  The
+        // escaped text can be up to six times longer (\u00XX), so this can't be done in place.
+        CFIndex maxBytes = 3 * len;
+        NSUInteger at = b.length;
+        uint8_t * p = [b reserve:(NSUInteger)maxBytes];
+        CFIndex used = 0;
+        CFStringGetBytes(cf, CFRangeMake(0, len), kCFStringEncodingUTF8, '?', false, p, maxBytes, &used);
+        [b didAppend:(NSUInteger)used];
+
+        NSUInteger i = 0;
+        while (i < (NSUInteger)used && escapes[p[i]] == 0) {
+            i++;
+        }
+        if (i < (NSUInteger)used) {
+            // There's something to escape, so move the rest out of the way and write it back escaped.
+            NSUInteger restLength = (NSUInteger)used - i;
+            uint8_t * rest = malloc(restLength);
+            if (rest == NULL) {
+                [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)restLength];
+            }
+            memcpy(rest, p + i, restLength);
+            [b truncateToLength:at + i];
+            writeEscaped(b, rest, restLength);
+            free(rest);
+        }
+    }
+
+    [b appendByte:'"'];
+}
+
+
+static BOOL writeNumber(JSONWriter * self, NSNumber * n) {
+    UTF8Builder * b = self->b;
+    CFTypeRef cf = (__bridge CFTypeRef)n;
+    if (cf == kCFBooleanTrue) {
+        [b appendBytes:"true" length:4];
+        return YES;
+    }
+    if (cf == kCFBooleanFalse) {
+        [b appendBytes:"false" length:5];
+        return YES;
+    }
+    if ([n isKindOfClass:[NSDecimalNumber class]]) {
+        if (isnan(n.doubleValue)) {
+            return fail(self, @"Invalid number value (NaN) in JSON write");
+        }
+        [b appendString:[n stringValue]];
+        return YES;
+    }
+
+    switch (n.objCType[0]) {
+        case 'c':
+        case 's':
+        case 'i':
+        case 'l':
+        case 'q':
+            [b appendInteger:n.longLongValue];
+            return YES;
+
+        case 'C':
+        case 'S':
+        case 'I':
+        case 'L':
+        case 'Q':
+            [b appendUnsignedInteger:n.unsignedLongLongValue];
+            return YES;
+
+        case 'f': {
+            float f = n.floatValue;
+            if (!isfinite(f)) {
+                return fail(self, @"Invalid number value (non-finite) in JSON write");
+            }
+            // The shortest of %.7g and %.9g that gives back the same float, so that 0.1f is written as 0.1.
+            char tmp[32];
+            int len = snprintf(tmp, sizeof(tmp), "%.7g", (double)f);
+            if (strtof(tmp, NULL) != f) {
+                len = snprintf(tmp, sizeof(tmp), "%.9g", (double)f);
+            }
+            [b appendBytes:tmp length:(NSUInteger)len];
+            return YES;
+        }
+
+        default: {
+            double d = n.doubleValue;
+            if (!isfinite(d)) {
+                return fail(self, @"Invalid number value (non-finite) in JSON write");
+            }
+            [b appendDouble:d];
+            return YES;
+        }
+    }
+}
+
+
+static void writeDate(JSONWriter * self, NSDate * date) {
+    // "yyyy-MM-dd'T'HH:mm:ss'Z'", as MTJSONUtils does with NSDateFormatter.  That truncates fractional
+    // seconds (towards the past), hence floor.
+    time_t t = (time_t)floor(date.timeIntervalSince1970);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char tmp[32];
+    int len = snprintf(tmp, sizeof(tmp), "\"%04d-%02d-%02dT%02d:%02d:%02dZ\"", tm.tm_year + 1900, tm.tm_mon + 1,
+                       tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    [self->b appendBytes:tmp length:(NSUInteger)len];
+}
+
+
+#pragma mark - Values
+
+
+static BOOL writeArray(JSONWriter * self, id array);
+static BOOL writeDictionary(JSONWriter * self, NSDictionary * dict);
+
+
+/**
+ * The equivalent of -[NSObject safeObjectFromObject:].
+ */
+static BOOL writeScalar(JSONWriter * self, id obj) {
+    if ([obj isKindOfClass:[NSString class]]) {
+        writeString(self, obj);
+    }
+    else if ([obj isKindOfClass:[NSNumber class]]) {
+        return writeNumber(self, obj);
+    }
+    else if (obj == nil || obj == [NSNull null]) {
+        [self->b appendBytes:"null" length:4];
+    }
+    else if ([obj isKindOfClass:[NSDate class]]) {
+        writeDate(self, obj);
+    }
+    else {
+        NSString * desc = [obj description];
+        writeString(self, (desc == nil ? @"" : desc));
+    }
+    return YES;
+}
+
+
+static BOOL openContainer(JSONWriter * self, uint8_t c) {
+    if (self->depth == MAX_DEPTH) {
+        return fail(self, @"Too many nested containers in JSON write");
+    }
+    [self->b appendByte:c];
+    self->depth++;
+    return YES;
+}
+
+
+static void closeContainer(JSONWriter * self, uint8_t c, BOOL empty) {
+    self->depth--;
+    if (self->pretty && !empty) {
+        writeNewlineAndIndent(self);
+    }
+    [self->b appendByte:c];
+}
+
+
+static inline void writeSeparator(JSONWriter * self, BOOL first) {
+    if (!first) {
+        [self->b appendByte:','];
+    }
+    if (self->pretty) {
+        writeNewlineAndIndent(self);
+    }
+}
+
+
+/**
+ * The equivalent of -[NSObject objectWithJSONSafeObjects].
+ */
+static BOOL writeTopLevel(JSONWriter * self, id obj) {
+    if ([obj isKindOfClass:[NSDictionary class]]) {
+        return writeDictionary(self, obj);
+    }
+    else if ([obj isKindOfClass:[NSArray class]] || [obj isKindOfClass:[NSSet class]]) {
+        return writeArray(self, obj);
+    }
+    else {
+        return writeScalar(self, obj);
+    }
+}
+
+
+/**
+ * The equivalent of -[NSObject safeArrayFromArray:].  array may be an NSArray or an NSSet.
+ */
+static BOOL writeArray(JSONWriter * self, id array) {
+    if (!openContainer(self, '[')) {
+        return NO;
+    }
+    BOOL first = YES;
+    for (id obj in array) {
+        writeSeparator(self, first);
+        first = NO;
+
+        BOOL ok;
+        if ([obj isKindOfClass:[NSArray class]] || [obj isKindOfClass:[NSSet class]]) {
+            ok = writeArray(self, obj);
+        }
+        else if ([obj isKindOfClass:[NSDictionary class]]) {
+            ok = writeDictionary(self, obj);
+        }
+        else {
+            ok = writeScalar(self, obj);
+        }
+        if (!ok || !maybeFlush(self)) {
+            return NO;
+        }
+    }
+    closeContainer(self, ']', first);
+    return YES;
+}
+
+
+/**
+ * The equivalent of -[NSObject safeDictionaryFromDictionary:].
+ */
+static BOOL writeDictionaryValue(JSONWriter * self, id key, id obj) {
+    writeString(self, ([key isKindOfClass:[NSString class]] ? key : [key description]));
+    if (self->pretty) {
+        [self->b appendBytes:" : " length:3];
+    }
+    else {
+        [self->b appendByte:':'];
+    }
+
+    // Note that unlike arrays, MTJSONUtils doesn't treat an NSSet inside a dictionary as an array.
+    BOOL ok;
+    if ([obj isKindOfClass:[NSDictionary class]]) {
+        ok = writeDictionary(self, obj);
+    }
+    else if ([obj isKindOfClass:[NSArray class]]) {
+        ok = writeArray(self, obj);
+    }
+    else {
+        ok = writeScalar(self, obj);
+    }
+    return ok && maybeFlush(self);
+}
+
+
+/**
+ * Write the entries of a dictionary, without the braces.  keys and values are from CFDictionaryGetKeysAndValues.
+ */
+static BOOL writeDictionaryEntries(JSONWriter * self, const void ** keys, const void ** values, CFIndex count) {
+    if (!self->sorted || count < 2) {
+        for (CFIndex i = 0; i < count; i++) {
+            writeSeparator(self, i == 0);
+            if (!writeDictionaryValue(self, (__bridge id)keys[i], (__bridge id)values[i])) {
+                return NO;
+            }
+        }
+        return YES;
+    }
+
+    // Sort the key-value pairs together, comparing the keys as they will be written.
+    NSMutableArray * keyStrings = [NSMutableArray arrayWithCapacity:(NSUInteger)count];
+    for (CFIndex i = 0; i < count; i++) {
+        id key = (__bridge id)keys[i];
+        [keyStrings addObject:([key isKindOfClass:[NSString class]] ? key : [key description])];
+    }
+    CFIndex * order = malloc((size_t)count * sizeof(CFIndex));
+    if (order == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %ld entries", (long)count];
+    }
+
+    // compare: or a nested write may throw, so make sure that order is freed.
+    BOOL ok = YES;
+    @try {
+        for (CFIndex i = 0; i < count; i++) {
+            order[i] = i;
+        }
+        qsort_b(order, (size_t)count, sizeof(CFIndex), ^int(const void * a, const void * b) {
+            return (int)[keyStrings[(NSUInteger)*(const CFIndex *)a] compare:keyStrings[(NSUInteger)*(const CFIndex *)b]];
+        });
+        for (CFIndex i = 0; i < count && ok; i++) {
+            writeSeparator(self, i == 0);
+            ok = writeDictionaryValue(self, keyStrings[(NSUInteger)order[i]], (__bridge id)values[order[i]]);
+        }
+    }
+    @finally {
+        free(order);
+    }
+    return ok;
+}
+
+
+static BOOL writeDictionary(JSONWriter * self, NSDictionary * dict) {
+    if (!openContainer(self, '{')) {
+        return NO;
+    }
+
+    CFDictionaryRef cf = (__bridge CFDictionaryRef)dict;
+    CFIndex count = CFDictionaryGetCount(cf);
+    BOOL ok;
+    if (count <= STACK_DICT_COUNT) {
+        const void * keys[STACK_DICT_COUNT];
+        const void * values[STACK_DICT_COUNT];
+        CFDictionaryGetKeysAndValues(cf, keys, values);
+        ok = writeDictionaryEntries(self, keys, values, count);
+    }
+    else {
+        // Keys and values share one allocation.
+        const void ** keys = malloc((size_t)count * 2 * sizeof(void *));
+        if (keys == NULL) {
+            [NSException raise:NSMallocException format:@"Failed to allocate %ld entries", (long)count];
+        }
+        const void ** values = keys + count;
+        @try {
+            CFDictionaryGetKeysAndValues(cf, keys, values);
+            ok = writeDictionaryEntries(self, keys, values, count);
+        }
+        @finally {
+            free(keys);
+        }
+    }
+
+    if (ok) {
+        closeContainer(self, '}', count == 0);
+    }
+    return ok;
+}
+
+
+@end
@@ -0,0 +1,47 @@
+//
+//  LRUCache.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/24/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * A bounded, thread-safe key-value cache with least-recently-used eviction.
+ *
+ * Unlike NSCache, the eviction policy is deterministic: once countLimit entries are present, adding another
+ * evicts the one that was least recently read or written.  Keys are copied, as with NSDictionary.
+ */
+@interface LRUCache : NSObject
+
+/**
+ * @param countLimit The maximum number of entries to hold.  Must be greater than zero.
+ */
+-(instancetype)initWithCountLimit:(NSUInteger)countLimit;
+
+@property (nonatomic, readonly) NSUInteger countLimit;
+
+/**
+ * The number of entries currently in the cache.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ * @return The value for the given key, or nil if it is not in the cache.  A hit marks the entry as most recently used.
+ */
+-(id)objectForKey:(id<NSCopying>)key;
+
+/**
+ * Add or replace the value for the given key, and mark it as most recently used.  This may evict the least
+ * recently used entry.
+ */
+-(void)setObject:(id)obj forKey:(id<NSCopying>)key __attribute__((nonnull));
+
+-(void)removeObjectForKey:(id<NSCopying>)key;
+
+-(void)removeAllObjects;
+
+@end
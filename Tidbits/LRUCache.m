@@ -0,0 +1,199 @@
+//
+//  LRUCache.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/24/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "LRUCache.h"
+
+
+@interface LRUCacheNode : NSObject
+{
+@public
+    id key;
+    id value;
+
+    // The list is owned through next; prev is a back-pointer only.
+    LRUCacheNode * next;
+    __unsafe_unretained LRUCacheNode * prev;
+}
+@end
+
+
+@implementation LRUCacheNode
+@end
+
+
+@interface LRUCache ()
+
+/**
+ * Key -> LRUCacheNode.
+ * May only be accessed under @synchronized (self).
+ */
+@property (nonatomic, readonly) NSMutableDictionary * nodes;
+
+@end
+
+
+@implementation LRUCache
+{
+    // Most recently used.  May only be accessed under @synchronized (self).
+    LRUCacheNode * head;
+
+    // Least recently used.  May only be accessed under @synchronized (self).
+    __unsafe_unretained LRUCacheNode * tail;
+}
+
+
+-(instancetype)initWithCountLimit:(NSUInteger)countLimit {
+    NSParameterAssert(countLimit > 0);
+
+    self = [super init];
+    if (self) {
+        _countLimit = countLimit;
+        _nodes = [NSMutableDictionary dictionaryWithCapacity:countLimit];
+    }
+    return self;
+}
+
+
+-(NSUInteger)count {
+    @synchronized (self) {
+        return self.nodes.count;
+    }
+}
+
+
+-(id)objectForKey:(id<NSCopying>)key {
+    if (key == nil) {
+        return nil;
+    }
+
+    @synchronized (self) {
+        LRUCacheNode * node = self.nodes[key];
+        if (node == nil) {
+            return nil;
+        }
+        [self moveToHead:node];
+        return node->value;
+    }
+}
+
+
+-(void)setObject:(id)obj forKey:(id<NSCopying>)key __attribute__((nonnull)) {
+    NSParameterAssert(obj);
+    NSParameterAssert(key);
+
+    @synchronized (self) {
+        LRUCacheNode * node = self.nodes[key];
+        if (node != nil) {
+            node->value = obj;
+            [self moveToHead:node];
+            return;
+        }
+
+        if (self.nodes.count >= self.countLimit) {
+            LRUCacheNode * victim = tail;
+            [self unlink:victim];
+            [self.nodes removeObjectForKey:victim->key];
+        }
+
+        node = [[LRUCacheNode alloc] init];
+        node->key = [(id)key copy];
+        node->value = obj;
+        self.nodes[node->key] = node;
+        [self linkAtHead:node];
+    }
+}
+
+
+-(void)removeObjectForKey:(id<NSCopying>)key {
+    if (key == nil) {
+        return;
+    }
+
+    @synchronized (self) {
+        LRUCacheNode * node = self.nodes[key];
+        if (node != nil) {
+            [self unlink:node];
+            [self.nodes removeObjectForKey:key];
+        }
+    }
+}
+
+
+-(void)removeAllObjects {
+    @synchronized (self) {
+        [self clearList];
+        [self.nodes removeAllObjects];
+    }
+}
+
+
+-(void)dealloc {
+    [self clearList];
+}
+
+
+#pragma mark - List manipulation; all called under @synchronized (self)
+
+
+-(void)moveToHead:(LRUCacheNode *)node {
+    if (node == head) {
+        return;
+    }
+    [self unlink:node];
+    [self linkAtHead:node];
+}
+
+
+-(void)linkAtHead:(LRUCacheNode *)node {
+    node->prev = nil;
+    node->next = head;
+    if (head != nil) {
+        head->prev = node;
+    }
+    head = node;
+    if (tail == nil) {
+        tail = node;
+    }
+}
+
+
+/**
+ * Break the links iteratively, so that releasing a long list doesn't recurse once per node.
+ */
+-(void)clearList {
+    LRUCacheNode * node = head;
+    head = nil;
+    tail = nil;
+    while (node != nil) {
+        LRUCacheNode * next = node->next;
+        node->next = nil;
+        node = next;
+    }
+}
+
+
+-(void)unlink:(LRUCacheNode *)node {
+    LRUCacheNode * next = node->next;
+    if (node->prev != nil) {
+        node->prev->next = next;
+    }
+    else {
+        head = next;
+    }
+    if (next != nil) {
+        next->prev = node->prev;
+    }
+    else {
+        tail = node->prev;
+    }
+    node->next = nil;
+    node->prev = nil;
+}
+
+
+@end
@@ -0,0 +1,119 @@
+//
+//  LogFileWriter.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <Lumberjack/DDLog.h>
+
+
+typedef NS_ENUM(NSInteger, LogFileWriterOverflowPolicy) {
+    /**
+     * If the buffer is full, drop the message.
+     */
+    LogFileWriterOverflowDrop,
+
+    /**
+     * If the buffer is full, block until the writer thread has made room.  Messages logged on the main thread
+     * and error-level messages (which Lumberjack logs synchronously) are dropped instead, because their thread is
+     * waiting.  Note that when logging through DDLog, blocking holds up DDLog's queue, and so every other logger.
+     */
+    LogFileWriterOverflowBlock,
+};
+
+
+/**
+ * A Lumberjack logger that writes to a file in the background.
+ *
+ * -logMessage: formats the message and copies it into a preallocated buffer, and a dedicated writer thread
+ * writes the buffer to the file in large batches.  There are two buffers, so that logging can continue while a
+ * batch is being written.
+ *
+ * The file is <directory>/<baseName>.log.  When it grows past maximumFileSize or is older than rollingFrequency,
+ * it is renamed to <baseName>-<UTC timestamp>.log and a new one is started.  The renamed file is then compressed
+ * with FileCompressor on a low-priority queue, and the oldest archives beyond maximumNumberOfArchivedFiles are
+ * deleted.
+ *
+ * The writer thread keeps this instance alive until -close is called.
+ */
+@interface LogFileWriter : NSObject <DDLogger>
+
+/**
+ * Equivalent to initWithDirectory:directory baseName:baseName bufferSize:262144.
+ */
+-(instancetype)initWithDirectory:(NSString *)directory baseName:(NSString *)baseName;
+
+/**
+ * @param directory This will be created if necessary.
+ * @param bufferSize The size in bytes of each of the two buffers, which is at least 4096.  A single message
+ * longer than this is truncated.
+ */
+-(instancetype)initWithDirectory:(NSString *)directory baseName:(NSString *)baseName bufferSize:(NSUInteger)bufferSize;
+
+@property (nonatomic, readonly) NSString * directory;
+@property (nonatomic, readonly) NSString * currentFilePath;
+@property (nonatomic, readonly) NSUInteger bufferSize;
+
+/**
+ * Defaults to a LogFormatter.  If nil, the raw message is written.
+ */
+@property (atomic, strong) id<DDLogFormatter> logFormatter;
+
+/**
+ * The size in bytes after which the file is rotated, or 0 for no limit.  Defaults to 1 MiB.
+ */
+@property (atomic) unsigned long long maximumFileSize;
+
+/**
+ * The age in seconds after which the file is rotated, or 0 for no limit.  Defaults to 24 hours.
+ * This is checked when a batch is written, so an idle file is not rotated until something is logged.
+ */
+@property (atomic) NSTimeInterval rollingFrequency;
+
+/**
+ * The number of rotated files to keep, or 0 to keep them all.  Defaults to 5.
+ */
+@property (atomic) NSUInteger maximumNumberOfArchivedFiles;
+
+/**
+ * Whether rotated files are compressed.  Defaults to YES.
+ */
+@property (atomic) BOOL compressesArchivedFiles;
+
+/**
+ * Defaults to LogFileWriterOverflowDrop.
+ */
+@property (atomic) LogFileWriterOverflowPolicy overflowPolicy;
+
+/**
+ * The longest that the writer thread will wait to collect a batch before writing it, in seconds.  The batch is
+ * written sooner if a buffer becomes half full, or on -flush.  Defaults to 0.5.
+ */
+@property (atomic) NSTimeInterval writeInterval;
+
+/**
+ * The number of messages dropped because the buffer was full or because this writer was closed.
+ */
+@property (atomic, readonly) unsigned long long droppedMessageCount;
+
+/**
+ * The most recent error from opening, writing, or rotating the file, or nil if there hasn't been one.
+ * This can't be logged, because that would come back here.
+ */
+@property (atomic, readonly) NSError * lastError;
+
+/**
+ * Block until everything logged so far has been written to the file.  This is called by +[DDLog flushLog].
+ */
+-(void)flush;
+
+/**
+ * Write everything logged so far, close the file, and stop the writer thread.  Messages logged after this are
+ * dropped.
+ */
+-(void)close;
+
+@end
@@ -0,0 +1,443 @@
+//
+//  LogFileWriter.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#import "FileCompressor.h"
+#import "LogFormatter.h"
+#import "LoggingMacros.h"
+
+#import "LogFileWriter.h"
+
+
+#define DEFAULT_BUFFER_SIZE 262144
+#define MIN_BUFFER_SIZE 4096
+
+
+@interface LogFileWriter ()
+
+@property (atomic, readwrite) unsigned long long droppedMessageCount;
+@property (atomic, readwrite) NSError * lastError;
+
+@end
+
+
+@implementation LogFileWriter {
+    pthread_mutex_t lock;
+    // Signalled when there is something for the writer thread to do.
+    pthread_cond_t workCond;
+    // Signalled when the writer thread has taken the pending buffer or finished a batch.
+    pthread_cond_t doneCond;
+
+    // These are all guarded by lock.
+    // Filled by -logMessage: and swapped with writing by the writer thread.  Both are bufferSize bytes.
+    uint8_t * pending;
+    NSUInteger pendingLength;
+    CFAbsoluteTime pendingSince;
+    uint64_t flushRequested;
+    uint64_t flushCompleted;
+    // The number of threads in -logMessage: waiting for room.
+    NSUInteger blockedCount;
+    BOOL closing;
+    BOOL closed;
+
+    // These are only used by the writer thread.
+    uint8_t * writing;
+    int fd;
+    unsigned long long fileSize;
+    NSTimeInterval fileCreated;
+
+    dispatch_queue_t archiveQueue;
+}
+
+
+-(instancetype)initWithDirectory:(NSString *)directory baseName:(NSString *)baseName {
+    return [self initWithDirectory:directory baseName:baseName bufferSize:DEFAULT_BUFFER_SIZE];
+}
+
+
+-(instancetype)initWithDirectory:(NSString *)directory baseName:(NSString *)baseName bufferSize:(NSUInteger)bufferSize {
+    self = [super init];
+    if (self) {
+        _directory = directory;
+        _currentFilePath = [directory stringByAppendingPathComponent:[baseName stringByAppendingPathExtension:@"log"]];
+        _bufferSize = MAX(bufferSize, (NSUInteger)MIN_BUFFER_SIZE);
+        _logFormatter = [[LogFormatter alloc] init];
+        _maximumFileSize = 1024 * 1024;
+        _rollingFrequency = 24 * 60 * 60;
+        _maximumNumberOfArchivedFiles = 5;
+        _compressesArchivedFiles = YES;
+        _overflowPolicy = LogFileWriterOverflowDrop;
+        _writeInterval = 0.5;
+
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&workCond, NULL);
+        pthread_cond_init(&doneCond, NULL);
+        pending = malloc(_bufferSize);
+        writing = malloc(_bufferSize);
+        fd = -1;
+
+        archiveQueue = dispatch_queue_create("LogFileWriter.archive", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(archiveQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+
+        [[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+
+        NSThread * thread = [[NSThread alloc] initWithTarget:self selector:@selector(writerThreadMain) object:nil];
+        thread.name = @"LogFileWriter";
+        [thread start];
+    }
+    return self;
+}
+
+
+-(void)dealloc {
+    free(pending);
+    free(writing);
+    pthread_cond_destroy(&doneCond);
+    pthread_cond_destroy(&workCond);
+    pthread_mutex_destroy(&lock);
+}
+
+
+-(NSString *)loggerName {
+    return @"LogFileWriter";
+}
+
+
+#pragma mark Logging threads
+
+
+static mach_port_t mainThreadMachPort;
++(void)load {
+    // +load runs on the main thread while the image is being loaded.
+    assert(pthread_main_np());
+    mainThreadMachPort = pthread_mach_thread_np(pthread_self());
+}
+
+
+/**
+ * Whether the thread that logged msg is waiting on us, or mustn't be kept waiting, so we should drop rather than
+ * block if the buffer is full.  DDLog calls -logMessage: on its own queue, so this goes by the thread recorded
+ * in the message, not the current one.  Errors are logged synchronously (LOG_ASYNC_ERROR), so their thread is
+ * always waiting.
+ */
+static BOOL mustNotBlock(DDLogMessage * msg) {
+    return (msg->machThreadID == mainThreadMachPort || (msg->logFlag & (LOG_FLAG_ERROR | LOG_FLAG_FATAL)) != 0 || pthread_main_np());
+}
+
+
+-(void)logMessage:(DDLogMessage *)logMessage {
+    id<DDLogFormatter> formatter = self.logFormatter;
+    NSString * line = (formatter == nil ? logMessage->logMsg : [formatter formatLogMessage:logMessage]);
+    if (line == nil) {
+        return;
+    }
+
+    NSData * lossy = nil;
+    const char * utf8 = line.UTF8String;
+    size_t length;
+    if (utf8 != NULL) {
+        length = strlen(utf8);
+    }
+    else {
+        // The string has unpaired surrogates.
+        lossy = [line dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
+        utf8 = lossy.bytes;
+        length = lossy.length;
+    }
+    if (length >= _bufferSize) {
+        length = _bufferSize - 1;
+        // Don't split a UTF-8 sequence.
+        while (length > 0 && ((uint8_t)utf8[length] & 0xC0) == 0x80) {
+            length--;
+        }
+    }
+    NSUInteger needed = length + 1;
+    BOOL mayBlock = (self.overflowPolicy == LogFileWriterOverflowBlock && !mustNotBlock(logMessage));
+
+    pthread_mutex_lock(&lock);
+    while (closing || pendingLength + needed > _bufferSize) {
+        if (closing || !mayBlock) {
+            self.droppedMessageCount = self.droppedMessageCount + 1;
+            pthread_mutex_unlock(&lock);
+            return;
+        }
+        blockedCount++;
+        pthread_cond_signal(&workCond);
+        pthread_cond_wait(&doneCond, &lock);
+        blockedCount--;
+    }
+
+    if (pendingLength == 0) {
+        pendingSince = CFAbsoluteTimeGetCurrent();
+    }
+    BOOL wasEmpty = (pendingLength == 0);
+    memcpy(pending + pendingLength, utf8, length);
+    pending[pendingLength + length] = '\n';
+    pendingLength += needed;
+
+    // The writer needs to know when a batch starts, so that it can time it, and when a buffer is half full,
+    // so that it can write it early.  It doesn't need telling about anything in between.
+    if (wasEmpty || (pendingLength >= _bufferSize / 2 && pendingLength - needed < _bufferSize / 2)) {
+        pthread_cond_signal(&workCond);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+-(void)flush {
+    pthread_mutex_lock(&lock);
+    uint64_t target = ++flushRequested;
+    pthread_cond_signal(&workCond);
+    while (flushCompleted < target && !closed) {
+        pthread_cond_wait(&doneCond, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+-(void)close {
+    pthread_mutex_lock(&lock);
+    closing = YES;
+    pthread_cond_signal(&workCond);
+    while (!closed) {
+        pthread_cond_wait(&doneCond, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+#pragma mark Writer thread
+
+
+-(void)writerThreadMain {
+    @autoreleasepool {
+        [self openFile];
+    }
+
+    pthread_mutex_lock(&lock);
+    while (YES) {
+        while (pendingLength == 0 && flushCompleted == flushRequested && !closing) {
+            pthread_cond_wait(&workCond, &lock);
+        }
+
+        // Let the batch build up, unless we've been asked to write it now.
+        while (pendingLength < _bufferSize / 2 && flushCompleted == flushRequested && blockedCount == 0 && !closing) {
+            NSTimeInterval remaining = pendingSince + self.writeInterval - CFAbsoluteTimeGetCurrent();
+            if (remaining <= 0.0) {
+                break;
+            }
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            double deadline = (double)now.tv_sec + (double)now.tv_usec / 1e6 + remaining;
+            struct timespec ts;
+            ts.tv_sec = (time_t)deadline;
+            ts.tv_nsec = (long)((deadline - (double)ts.tv_sec) * 1e9);
+            pthread_cond_timedwait(&workCond, &lock, &ts);
+        }
+
+        uint8_t * batch = pending;
+        NSUInteger batchLength = pendingLength;
+        uint64_t flushTarget = flushRequested;
+        BOOL stop = closing;
+        pending = writing;
+        pendingLength = 0;
+        writing = batch;
+        pthread_cond_broadcast(&doneCond);
+        pthread_mutex_unlock(&lock);
+
+        if (batchLength > 0) {
+            @autoreleasepool {
+                [self writeBatch:batch length:batchLength];
+            }
+        }
+
+        pthread_mutex_lock(&lock);
+        flushCompleted = flushTarget;
+        pthread_cond_broadcast(&doneCond);
+        // -logMessage: refuses new messages once closing is set, so this batch was the last.
+        if (stop) {
+            break;
+        }
+    }
+
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    closed = YES;
+    pthread_cond_broadcast(&doneCond);
+    pthread_mutex_unlock(&lock);
+}
+
+
+-(void)openFile {
+    fd = open(self.currentFilePath.fileSystemRepresentation, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        self.lastError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{NSFilePathErrorKey: self.currentFilePath}];
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        fileSize = (unsigned long long)st.st_size;
+        fileCreated = (NSTimeInterval)st.st_birthtimespec.tv_sec - NSTimeIntervalSince1970;
+    }
+    else {
+        fileSize = 0;
+        fileCreated = [NSDate timeIntervalSinceReferenceDate];
+    }
+}
+
+
+-(void)writeBatch:(const uint8_t *)bytes length:(NSUInteger)length {
+    if (fd >= 0 && [self shouldRotateBeforeWriting:length]) {
+        [self rotate];
+    }
+    if (fd < 0) {
+        [self openFile];
+        if (fd < 0) {
+            return;
+        }
+    }
+
+    NSUInteger offset = 0;
+    while (offset < length) {
+        ssize_t n = write(fd, bytes + offset, length - offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            self.lastError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{NSFilePathErrorKey: self.currentFilePath}];
+            // Reopen next time, in case the file has been removed from under us.
+            close(fd);
+            fd = -1;
+            return;
+        }
+        offset += (NSUInteger)n;
+    }
+    fileSize += length;
+}
+
+
+-(BOOL)shouldRotateBeforeWriting:(NSUInteger)length {
+    if (fileSize == 0) {
+        return NO;
+    }
+    unsigned long long maximumFileSize = self.maximumFileSize;
+    if (maximumFileSize > 0 && fileSize + length > maximumFileSize) {
+        return YES;
+    }
+    NSTimeInterval rollingFrequency = self.rollingFrequency;
+    if (rollingFrequency > 0.0 && [NSDate timeIntervalSinceReferenceDate] - fileCreated >= rollingFrequency) {
+        return YES;
+    }
+    return NO;
+}
+
+
+-(void)rotate {
+    close(fd);
+    fd = -1;
+
+    NSString * archivePath = [self unusedArchivePath];
+    NSError * error = nil;
+    if (![[NSFileManager defaultManager] moveItemAtPath:self.currentFilePath toPath:archivePath error:&error]) {
+        self.lastError = error;
+        return;
+    }
+
+    BOOL compress = self.compressesArchivedFiles;
+    NSUInteger keep = self.maximumNumberOfArchivedFiles;
+    dispatch_async(archiveQueue, ^{
+        if (compress) {
+            [FileCompressor compressFile:archivePath removeSource:YES error:NULL];
+        }
+        [self pruneArchivesKeeping:keep];
+    });
+}
+
+
+-(NSString *)archivePrefix {
+    return [[self.currentFilePath.lastPathComponent stringByDeletingPathExtension] stringByAppendingString:@"-"];
+}
+
+
+-(NSString *)unusedArchivePath {
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    char timestamp[20];
+    strftime(timestamp, sizeof(timestamp), "%Y%m%dT%H%M%SZ", &tm);
+
+    NSFileManager * nsfm = [NSFileManager defaultManager];
+    NSString * stem = [self.directory stringByAppendingPathComponent:[NSString stringWithFormat:@"%@%s", self.archivePrefix, timestamp]];
+    NSString * path = [stem stringByAppendingPathExtension:@"log"];
+    for (NSUInteger i = 1; [nsfm fileExistsAtPath:path] || [nsfm fileExistsAtPath:[path stringByAppendingPathExtension:@"gz"]]; i++) {
+        path = [[stem stringByAppendingFormat:@"-%lu", (unsigned long)i] stringByAppendingPathExtension:@"log"];
+    }
+    return path;
+}
+
+
+/**
+ * Delete all but the newest keep archives (compressed or not).  Runs on archiveQueue.
+ */
+-(void)pruneArchivesKeeping:(NSUInteger)keep {
+    if (keep == 0) {
+        return;
+    }
+
+    NSFileManager * nsfm = [NSFileManager defaultManager];
+    NSString * prefix = self.archivePrefix;
+    NSMutableArray * archives = [NSMutableArray array];
+    NSMutableDictionary * dates = [NSMutableDictionary dictionary];
+    for (NSString * name in [nsfm contentsOfDirectoryAtPath:self.directory error:NULL]) {
+        if (![name hasPrefix:prefix] || !([name hasSuffix:@".log"] || [name hasSuffix:@".log.gz"])) {
+            continue;
+        }
+        NSString * path = [self.directory stringByAppendingPathComponent:name];
+        NSDate * date = [nsfm attributesOfItemAtPath:path error:NULL].fileModificationDate;
+        if (date == nil) {
+            continue;
+        }
+        [archives addObject:path];
+        dates[path] = date;
+    }
+    if (archives.count <= keep) {
+        return;
+    }
+
+    // Newest first.  Archives from the same second are told apart by their "-N" suffix, so on a tie the longer
+    // name and then the greater name is the newer.
+    [archives sortUsingComparator:^NSComparisonResult(NSString * a, NSString * b) {
+        NSComparisonResult result = [dates[b] compare:dates[a]];
+        if (result != NSOrderedSame) {
+            return result;
+        }
+        NSString * aStem = [a stringByReplacingOccurrencesOfString:@".gz" withString:@""];
+        NSString * bStem = [b stringByReplacingOccurrencesOfString:@".gz" withString:@""];
+        if (aStem.length != bStem.length) {
+            return (aStem.length < bStem.length ? NSOrderedDescending : NSOrderedAscending);
+        }
+        return [bStem compare:aStem];
+    }];
+    for (NSUInteger i = keep; i < archives.count; i++) {
+        [nsfm removeItemAtPath:archives[i] error:NULL];
+    }
+}
+
+
+@end
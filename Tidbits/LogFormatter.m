@@ -6,7 +6,9 @@
 //  Copyright (c) 2013 Tipbit, Inc. All rights reserved.
 //
 
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #import <Lumberjack/Lumberjack.h>
@@ -26,6 +28,32 @@
 // a nasty threading problem so it's off by default.
 #define INCLUDE_THREAD_ID_ON_TTY 0
 
+// "yyyy-MM-dd HH:mm:ss.SSS level" and "L HH:mm:ss.SSS", plus the terminators.
+#define TIME_LEVEL_LENGTH 30
+#define TIME_LEVEL_LENGTH_TTY 15
+
+
+/**
+ * The formatted whole-second part of a timestamp, so that consecutive log messages in the same second only
+ * need their milliseconds written.
+ */
+typedef struct {
+    BOOL valid;
+    time_t second;
+    // "yyyy-MM-dd HH:mm:ss." in UTC, or "HH:mm:ss." in local time.
+    char prefix[24];
+} TimestampPrefix;
+
+
+typedef struct {
+    TimestampPrefix utc;
+    TimestampPrefix local;
+} TimestampCache;
+
+
+static void formatTimeLevel(char * buf, NSTimeInterval ts, const char * level, BOOL useCache);
+static void formatTimeLevelTTY(char * buf, NSTimeInterval ts, char level, BOOL useCache);
+
 
 @implementation LogFormatter
 
@@ -73,14 +101,8 @@
 
 
 -(NSString *)formatLogMessage:(DDLogMessage *)logMessage {
-    char time_level_str[30];
-    struct tm tm;
-    NSTimeInterval ts = [logMessage->timestamp timeIntervalSince1970];
-    time_t ts_whole = (time_t)ts;
-    int ts_frac = (int)((ts - (double)ts_whole) * 1000.0);
-    gmtime_r(&ts_whole, &tm);
-    // Using snprintf for the fixed-length fields is 26-29% faster than putting it all in the stringWithFormat call.
-    snprintf(time_level_str, 30, "%4d-%02d-%02d %02d:%02d:%02d.%03d %5s", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ts_frac, logLevelToStr(logMessage->logLevel));
+    char time_level_str[TIME_LEVEL_LENGTH];
+    formatTimeLevel(time_level_str, [logMessage->timestamp timeIntervalSince1970], logLevelToStr(logMessage->logLevel), YES);
     return [NSString stringWithFormat:@"%s %s:%i | %@", time_level_str, logMessage->function, logMessage->lineNumber, logMessage->logMsg];
 }
 
@@ -111,17 +133,19 @@ static const char * logLevelToStr(int level) {
 }
 
 
+#if DEBUG || RELEASE_TESTING
+
+/**
+ * The same as formatLogMessage: but without the timestamp cache, for comparison.
+ */
 -(NSString *)formatLogMessageB:(DDLogMessage *)logMessage {
-    char time_level_str[30];
-    struct tm tm;
-    NSTimeInterval ts = [logMessage->timestamp timeIntervalSince1970];
-    time_t ts_whole = (time_t)ts;
-    int ts_frac = (int)((ts - (double)ts_whole) * 1000.0);
-    gmtime_r(&ts_whole, &tm);
-    snprintf(time_level_str, sizeof(time_level_str), "%4d-%02d-%02d %02d:%02d:%02d.%03d %5s", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ts_frac, logLevelToStr(logMessage->logLevel));
+    char time_level_str[TIME_LEVEL_LENGTH];
+    formatTimeLevel(time_level_str, [logMessage->timestamp timeIntervalSince1970], logLevelToStr(logMessage->logLevel), NO);
     return [NSString stringWithFormat:@"%s %s:%i | %@", time_level_str, logMessage->function, logMessage->lineNumber, logMessage->logMsg];
 }
 
+#endif
+
 
 @end
 
@@ -130,14 +154,8 @@ static const char * logLevelToStr(int level) {
 
 
 -(NSString *)formatLogMessage:(DDLogMessage *)logMessage {
-    char time_level_str[15];
-    struct tm tm;
-    NSTimeInterval ts = [logMessage->timestamp timeIntervalSince1970];
-    time_t ts_whole = (time_t)ts;
-    int ts_frac = (int)((ts - (double)ts_whole) * 1000.0);
-    localtime_r(&ts_whole, &tm);
-    // Using snprintf for the fixed-length fields is 26-29% faster than putting it all in the stringWithFormat call.
-    snprintf(time_level_str, sizeof(time_level_str), "%c %02d:%02d:%02d.%03d", logLevelToChar(logMessage->logLevel), tm.tm_hour, tm.tm_min, tm.tm_sec, ts_frac);
+    char time_level_str[TIME_LEVEL_LENGTH_TTY];
+    formatTimeLevelTTY(time_level_str, [logMessage->timestamp timeIntervalSince1970], logLevelToChar(logMessage->logLevel), YES);
     return [NSString stringWithFormat:@"%s"
 #if INCLUDE_THREAD_ID_ON_TTY
             " %-4x"
@@ -181,18 +199,21 @@ static char logLevelToChar(int level) {
 
 #if DEBUG || RELEASE_TESTING
 
+/**
+ * The same as formatLogMessage: but without the timestamp cache, for comparison.
+ */
 -(NSString *)formatLogMessageB:(DDLogMessage *)logMessage {
-    char time_level_str[15];
-    struct tm tm;
-    NSTimeInterval ts = [logMessage->timestamp timeIntervalSince1970];
-    time_t ts_whole = (time_t)ts;
-    int ts_frac = (int)((ts - (double)ts_whole) * 1000.0);
-    localtime_r(&ts_whole, &tm);
-    // Using snprintf for the fixed-length fields is 26-29% faster than putting it all in the stringWithFormat call.
-    snprintf(time_level_str, sizeof(time_level_str), "%c %02d:%02d:%02d.%03d", logLevelToChar(logMessage->logLevel), tm.tm_hour, tm.tm_min, tm.tm_sec, ts_frac);
-    return [NSString stringWithFormat:@"%s %-4x %s:%d | %@",
+    char time_level_str[TIME_LEVEL_LENGTH_TTY];
+    formatTimeLevelTTY(time_level_str, [logMessage->timestamp timeIntervalSince1970], logLevelToChar(logMessage->logLevel), NO);
+    return [NSString stringWithFormat:@"%s"
+#if INCLUDE_THREAD_ID_ON_TTY
+            " %-4x"
+#endif
+            " %s:%d | %@",
             time_level_str,
+#if INCLUDE_THREAD_ID_ON_TTY
             logMessage->machThreadID,
+#endif
             logMessage->function,
             logMessage->lineNumber,
             logMessage->logMsg];
@@ -202,3 +223,98 @@ static char logLevelToChar(int level) {
 
 
 @end
+
+
+static TimestampCache * currentTimestampCache(void) {
+    static pthread_key_t key;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&key, free);
+    });
+
+    TimestampCache * cache = pthread_getspecific(key);
+    if (cache == NULL) {
+        cache = calloc(1, sizeof(TimestampCache));
+        pthread_setspecific(key, cache);
+    }
+    return cache;
+}
+
+
+static void writeMilliseconds(char * buf, int ts_frac) {
+    buf[0] = (char)('0' + ts_frac / 100);
+    buf[1] = (char)('0' + ts_frac / 10 % 10);
+    buf[2] = (char)('0' + ts_frac % 10);
+}
+
+
+/**
+ * Write "yyyy-MM-dd HH:mm:ss.SSS level" (in UTC) into buf, which must have room for TIME_LEVEL_LENGTH chars.
+ *
+ * If useCache is YES then the date and time are cached per thread, so that only the milliseconds are formatted
+ * unless the second has changed since this thread's last call.
+ */
+static void formatTimeLevel(char * buf, NSTimeInterval ts, const char * level, BOOL useCache) {
+    time_t ts_whole = (time_t)ts;
+    int ts_frac = (int)((ts - (double)ts_whole) * 1000.0);
+    size_t levelLength = strlen(level);
+
+    if (useCache && ts_frac >= 0 && levelLength == 5) {
+        TimestampPrefix * prefix = &currentTimestampCache()->utc;
+        if (!prefix->valid || prefix->second != ts_whole) {
+            struct tm tm;
+            gmtime_r(&ts_whole, &tm);
+            int n = snprintf(prefix->prefix, sizeof(prefix->prefix), "%4d-%02d-%02d %02d:%02d:%02d.", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+            prefix->second = ts_whole;
+            // Years after 9999 don't fit in the fixed-width layout.
+            prefix->valid = (n == 20);
+        }
+        if (prefix->valid) {
+            memcpy(buf, prefix->prefix, 20);
+            writeMilliseconds(buf + 20, ts_frac);
+            buf[23] = ' ';
+            memcpy(buf + 24, level, 5);
+            buf[29] = '\0';
+            return;
+        }
+    }
+
+    struct tm tm;
+    gmtime_r(&ts_whole, &tm);
+    // Using snprintf for the fixed-length fields is 26-29% faster than putting it all in the stringWithFormat call.
+    snprintf(buf, TIME_LEVEL_LENGTH, "%4d-%02d-%02d %02d:%02d:%02d.%03d %5s", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ts_frac, level);
+}
+
+
+/**
+ * Write "L HH:mm:ss.SSS" (in local time) into buf, which must have room for TIME_LEVEL_LENGTH_TTY chars.
+ *
+ * useCache is as for formatTimeLevel.
+ */
+static void formatTimeLevelTTY(char * buf, NSTimeInterval ts, char level, BOOL useCache) {
+    time_t ts_whole = (time_t)ts;
+    int ts_frac = (int)((ts - (double)ts_whole) * 1000.0);
+
+    if (useCache && ts_frac >= 0) {
+        TimestampPrefix * prefix = &currentTimestampCache()->local;
+        if (!prefix->valid || prefix->second != ts_whole) {
+            struct tm tm;
+            localtime_r(&ts_whole, &tm);
+            int n = snprintf(prefix->prefix, sizeof(prefix->prefix), "%02d:%02d:%02d.", tm.tm_hour, tm.tm_min, tm.tm_sec);
+            prefix->second = ts_whole;
+            prefix->valid = (n == 9);
+        }
+        if (prefix->valid) {
+            buf[0] = level;
+            buf[1] = ' ';
+            memcpy(buf + 2, prefix->prefix, 9);
+            writeMilliseconds(buf + 11, ts_frac);
+            buf[14] = '\0';
+            return;
+        }
+    }
+
+    struct tm tm;
+    localtime_r(&ts_whole, &tm);
+    snprintf(buf, TIME_LEVEL_LENGTH_TTY, "%c %02d:%02d:%02d.%03d", level, tm.tm_hour, tm.tm_min, tm.tm_sec, ts_frac);
+}
@@ -8,6 +8,29 @@
 
 #import <Foundation/Foundation.h>
 
+
+/**
+ * The groups that a message list puts its rows into, newest first.  Each date is in exactly one bucket: the first
+ * one of these that it's in.  So DateBucketThisMonth is the part of this month that is before the last 7 days, and
+ * is empty during the first week of the month.
+ *
+ * The boundaries are the same as +startOfToday, +startOf7DaysAgo, etc.
+ */
+typedef NS_ENUM(uint8_t, DateBucket) {
+    DateBucketFuture = 0,       // Tomorrow or later.
+    DateBucketToday,
+    DateBucketYesterday,
+    DateBucketDayBefore,
+    DateBucketLast7Days,
+    DateBucketThisMonth,
+    DateBucketLast30Days,
+    DateBucketLast60Days,
+    DateBucketOlder,
+
+    DateBucketCount
+};
+
+
 @interface NSDate (Ext)
 
 +(NSDate*)year2038;
@@ -39,6 +62,16 @@
  */
 - (NSDate*) startOfDay;
 
+/**
+ * @return Midnight at the start of the first day of this date's month, in the system timezone.
+ */
+- (NSDate*) startOfMonth;
+
+/**
+ * @return Midnight at the start of the first day of the week after this date's week, in the system timezone.
+ */
+- (NSDate*) startOfNextWeek;
+
 /*!
  @abstract Now with minutes and seconds zeroed. Equivalent to [self thisDayAtHour:14 minute:0 second:0 tz:[NSTimeZone systemTimeZone] where the current time is >= 2pm < 3pm
  */
@@ -69,6 +102,32 @@
 +(NSDate*)startOfNextWeek;
 +(NSDate*)startOfThisMonth;
 
+-(DateBucket)dateBucket;
+
+/**
+ * Sets buckets[i] to the DateBucket of intervals[i] (which are since the reference date, as
+ * NSDate.timeIntervalSinceReferenceDate), for count intervals.  The boundaries are read once, so this is much faster
+ * than calling isToday etc. on each date.
+ *
+ * This and dateBucketRanges:ofSortedIntervals:count: are thread-safe.
+ */
++(void)dateBuckets:(DateBucket *)buckets ofIntervals:(const NSTimeInterval *)intervals count:(NSUInteger)count;
+
+/**
+ * Sets ranges[b] to the range of intervals that are in DateBucket b, for all DateBucketCount buckets.  Empty buckets
+ * have a range of length 0.
+ *
+ * intervals must be sorted, either newest first (in which case the ranges are in bucket order) or oldest first (in
+ * which case they are in reverse order).  This takes O(DateBucketCount * log(count)) time.
+ */
++(void)dateBucketRanges:(NSRange *)ranges ofSortedIntervals:(const NSTimeInterval *)intervals count:(NSUInteger)count;
+
+#if DEBUG || RELEASE_TESTING
+// Exposed for unit testing.  Sets thresholds[0 .. DateBucketCount - 2] to the start of each bucket, as
+// dateBuckets:ofIntervals:count: would use them at the given time in the given time zone.
++(void)dateBucketThresholds:(NSTimeInterval *)thresholds now:(NSDate *)now timeZone:(NSTimeZone *)tz;
+#endif
+
 +(NSTimeInterval)timeIntervalFromDays:(NSInteger)days;
 +(NSTimeInterval)timeIntervalFromHours:(NSInteger)hours;
 +(NSTimeInterval)timeIntervalFromMinutes:(NSInteger)minutes;
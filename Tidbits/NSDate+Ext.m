@@ -10,33 +10,188 @@
 #import <UIKit/UIApplication.h>
 #endif
 
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+
+#import "CivilTime.h"
 #import "NSDate+Ext.h"
 #import "NSDate+ISO8601.h"
 
 
 #define DAY_IN_SECONDS (60.0 * 60.0 * 24)
 
+#define FORMATTER_POOL_THREAD_KEY @"NSDate+Ext.DateFormatterPool"
+
+
+/**
+ * NSDateFormatter is expensive to create and configure, and the user*String methods are called for every table
+ * cell as it scrolls.  So they take their formatters from a pool instead, keyed by how each formatter is configured
+ * (style, format, or template).
+ *
+ * NSDateFormatter isn't safe to share between threads, so each thread has its own pool, kept in its thread
+ * dictionary.  Every pooled formatter uses the current locale and the system timezone, so rather than keying on
+ * those, all the pools are emptied when either changes, or on a significant time change: formatterPoolGeneration
+ * is incremented, and each pool checks it before use.
+ */
+@interface DateFormatterPool : NSObject
+
+-(NSDateFormatter *)formatterForKey:(NSString *)key configure:(void (^)(NSDateFormatter * formatter, NSLocale * locale))configure;
+
+@end
+
+
+static volatile int32_t formatterPoolGeneration = 0;
+
+
+@implementation DateFormatterPool {
+    int32_t generation;
+    NSMutableDictionary * formatters;
+}
+
+
++(DateFormatterPool *)poolForCurrentThread {
+    NSMutableDictionary * threadDictionary = [NSThread currentThread].threadDictionary;
+    DateFormatterPool * result = threadDictionary[FORMATTER_POOL_THREAD_KEY];
+    if (result == nil) {
+        result = [[DateFormatterPool alloc] init];
+        threadDictionary[FORMATTER_POOL_THREAD_KEY] = result;
+    }
+    return result;
+}
+
+
++(void)invalidateAll {
+    OSAtomicIncrement32Barrier(&formatterPoolGeneration);
+}
+
+
+-(instancetype)init {
+    self = [super init];
+    if (self) {
+        generation = formatterPoolGeneration;
+        formatters = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+
+-(NSDateFormatter *)formatterForKey:(NSString *)key configure:(void (^)(NSDateFormatter * formatter, NSLocale * locale))configure {
+    int32_t currentGeneration = formatterPoolGeneration;
+    if (generation != currentGeneration) {
+        [formatters removeAllObjects];
+        generation = currentGeneration;
+    }
+
+    NSDateFormatter * result = formatters[key];
+    if (result == nil) {
+        result = [[NSDateFormatter alloc] init];
+        NSLocale * locale = [NSLocale autoupdatingCurrentLocale];
+        result.locale = locale;
+        configure(result, locale);
+        formatters[key] = result;
+    }
+    return result;
+}
+
+
+@end
+
+
+static NSDateFormatter * pooledFormatter(NSString * key, void (^configure)(NSDateFormatter * formatter, NSLocale * locale)) {
+    return [[DateFormatterPool poolForCurrentThread] formatterForKey:key configure:configure];
+}
+
+
+static NSDateFormatter * shortDateFormatter() {
+    return pooledFormatter(@"dateStyle:short", ^(NSDateFormatter * formatter, __unused NSLocale * locale) {
+        formatter.dateStyle = NSDateFormatterShortStyle;
+    });
+}
+
+
+static NSDateFormatter * shortTimeFormatter() {
+    return pooledFormatter(@"timeStyle:short", ^(NSDateFormatter * formatter, __unused NSLocale * locale) {
+        formatter.timeStyle = NSDateFormatterShortStyle;
+    });
+}
+
+
+static NSDateFormatter * yearlessDateFormatter() {
+    return pooledFormatter(@"template:M d", ^(NSDateFormatter * formatter, __unused NSLocale * locale) {
+        formatter.dateFormat = [NSDateFormatter dateFormatFromTemplate:@"M d" options:0 locale:NSLocale.currentLocale];
+    });
+}
+
+
+static NSDateFormatter * dateAtTimeFormatter() {
+    return pooledFormatter(@"dateAtTime", ^(NSDateFormatter * formatter, NSLocale * locale) {
+        NSString * lang = [locale objectForKey:NSLocaleLanguageCode];
+        formatter.dateFormat = ([lang isEqualToString:@"en"] ? @"MMM d, yyyy 'at' h:mm a" :
+                                                              [NSDateFormatter dateFormatFromTemplate:@"yyyyMMMd jjm" options:0 locale:locale]);
+    });
+}
+
+
+static NSDateFormatter * dayOfWeekFormatter() {
+    return pooledFormatter(@"format:EEEE", ^(NSDateFormatter * formatter, __unused NSLocale * locale) {
+        formatter.dateFormat = @"EEEE";
+    });
+}
+
+
+/**
+ * The start of the day, month, and week, and thisDayAtHour:minute:second:tz:, are computed using CivilTime where
+ * possible, which is lock-free and much faster than NSCalendar.  That works for UTC and the system timezone, between
+ * 1970 and 2038, and for local times that aren't skipped or repeated by a DST transition.  Everything else falls
+ * back to NSCalendar.
+ */
+static NSDate * civilDateFromLocal(const CivilTimeZoneTable * table, int64_t local) {
+    int64_t utc;
+    return (CivilTimeZoneTableUTCFromLocal(table, local, &utc) ? [NSDate dateWithTimeIntervalSince1970:(NSTimeInterval)utc] : nil);
+}
+
+
+static BOOL civilLocalDay(NSDate * date, const CivilTimeZoneTable * table, int64_t * day) {
+    int64_t utc;
+    int64_t local;
+    if (table == NULL || !CivilTimeSecondsFromDate(date, &utc) || !CivilTimeZoneTableLocalFromUTC(table, utc, &local)) {
+        return NO;
+    }
+    *day = CivilTimeDaysFromSeconds(local);
+    return YES;
+}
+
+
+/**
+ * [NSCalendar firstWeekday] for the calendar that startOfNextWeek uses, or 0 if not cached yet.
+ */
+static NSUInteger cachedFirstWeekday = 0;
+
 
 @implementation NSDate (Ext)
 
 
 +(void)load {
     _year2038 = [NSDate dateWithTimeIntervalSince1970:(68.0 * 365 * 24 * 60 * 60)];
+    NSNotificationCenter * nc = [NSNotificationCenter defaultCenter];
 #if TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR
-    [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(significantTimeChange) name:UIApplicationSignificantTimeChangeNotification object:nil];
+    [nc addObserver:self selector:@selector(significantTimeChange) name:UIApplicationSignificantTimeChangeNotification object:nil];
 #endif
+    [nc addObserver:self selector:@selector(localeOrTimeZoneChange) name:NSCurrentLocaleDidChangeNotification object:nil];
+    [nc addObserver:self selector:@selector(localeOrTimeZoneChange) name:NSSystemTimeZoneDidChangeNotification object:nil];
+}
+
+
++(void)localeOrTimeZoneChange {
+    [DateFormatterPool invalidateAll];
+    cachedFirstWeekday = 0;
 }
 
 
 +(void)significantTimeChange {
-    cachedStartOfDayBefore = nil;
-    cachedStartOfToday = nil;
-    cachedStartOfYesterday = nil;
-    cachedStartOf7DaysAgo = nil;
-    cachedStartOf30DaysAgo = nil;
-    cachedStartOf60DaysAgo = nil;
-    cachedStartOfThisMonth = nil;
-    cachedThisYear = 0;
+    [DateFormatterPool invalidateAll];
+    CivilTimeZoneTableInvalidateSystemTimeZone();
+    invalidateDateBoundaries();
 }
 
 
@@ -47,28 +202,17 @@ static NSDate* _year2038 = nil;
 
 
 - (NSString *) dateAtTimeString {
-    NSDateFormatter * formatter = [[NSDateFormatter alloc] init];
-    NSLocale * locale = [NSLocale autoupdatingCurrentLocale];
-    NSString * lang = [locale objectForKey:NSLocaleLanguageCode];
-    formatter.dateFormat = ([lang isEqualToString:@"en"] ? @"MMM d, yyyy 'at' h:mm a" :
-                                                          [NSDateFormatter dateFormatFromTemplate:@"yyyyMMMd jjm" options:0 locale:locale]);
-    return [formatter stringFromDate:self];
+    return [dateAtTimeFormatter() stringFromDate:self];
 }
 
 
 -(NSString*)userShortDateString {
-    NSDateFormatter* formatter = [[NSDateFormatter alloc] init];
-    formatter.locale = [NSLocale autoupdatingCurrentLocale];
-    formatter.dateStyle = NSDateFormatterShortStyle;
-    return [formatter stringFromDate:self];
+    return [shortDateFormatter() stringFromDate:self];
 }
 
 
 -(NSString*)userYearlessDateString {
-    NSDateFormatter* formatter = [[NSDateFormatter alloc] init];
-    formatter.locale = [NSLocale autoupdatingCurrentLocale];
-    formatter.dateFormat = [NSDateFormatter dateFormatFromTemplate:@"M d" options:0 locale:NSLocale.currentLocale];
-    return [formatter stringFromDate:self];
+    return [yearlessDateFormatter() stringFromDate:self];
 }
 
 
@@ -78,10 +222,7 @@ static NSDate* _year2038 = nil;
 
 
 -(NSString*)userShortTimeString {
-    NSDateFormatter* formatter = [[NSDateFormatter alloc] init];
-    formatter.locale = [NSLocale autoupdatingCurrentLocale];
-    formatter.timeStyle = NSDateFormatterShortStyle;
-    NSString* result = [formatter stringFromDate:self];
+    NSString* result = [shortTimeFormatter() stringFromDate:self];
     return [result lowercaseString];
 }
 
@@ -92,28 +233,16 @@ static NSDate* _year2038 = nil;
 
 
 -(NSString*)userYearlessOrShortDateAndTimeString {
-    NSDateFormatter* formatter = [[NSDateFormatter alloc] init];
-    formatter.locale = [NSLocale autoupdatingCurrentLocale];
-    if (self.isThisYear)
-        formatter.dateFormat = [NSDateFormatter dateFormatFromTemplate:@"M d" options:0 locale:NSLocale.currentLocale];
-    else
-        formatter.dateStyle = NSDateFormatterShortStyle;
-    NSString* date = [formatter stringFromDate:self];
-    formatter.dateStyle = NSDateFormatterNoStyle;
-    formatter.timeStyle = NSDateFormatterShortStyle;
-    NSString* time = [formatter stringFromDate:self];
+    NSDateFormatter* dateFormatter = (self.isThisYear ? yearlessDateFormatter() : shortDateFormatter());
+    NSString* date = [dateFormatter stringFromDate:self];
+    NSString* time = [shortTimeFormatter() stringFromDate:self];
     return [[NSString stringWithFormat:@"%@ %@", date, time] lowercaseString];
 }
 
 
 -(NSString*)userShortDateAndTimeString {
-    NSDateFormatter* formatter = [[NSDateFormatter alloc] init];
-    formatter.locale = [NSLocale autoupdatingCurrentLocale];
-    formatter.dateStyle = NSDateFormatterShortStyle;
-    NSString* date = [formatter stringFromDate:self];
-    formatter.dateStyle = NSDateFormatterNoStyle;
-    formatter.timeStyle = NSDateFormatterShortStyle;
-    NSString* time = [formatter stringFromDate:self];
+    NSString* date = [shortDateFormatter() stringFromDate:self];
+    NSString* time = [shortTimeFormatter() stringFromDate:self];
     return [[NSString stringWithFormat:@"%@ %@", date, time] lowercaseString];
 }
 
@@ -151,6 +280,17 @@ static NSDate* _year2038 = nil;
 
 
 - (NSDate*) startOfMonth {
+    const CivilTimeZoneTable * table = CivilTimeZoneTableForSystemTimeZone();
+    int64_t day;
+    if (civilLocalDay(self, table, &day)) {
+        int y, m, d;
+        CivilTimeDateFromDays(day, &y, &m, &d);
+        NSDate * result = civilDateFromLocal(table, CivilTimeDaysFromDate(y, m, 1) * 86400);
+        if (result != nil) {
+            return result;
+        }
+    }
+
     NSCalendar *cal = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar];
     [cal setTimeZone:[NSTimeZone systemTimeZone]];
     NSDateComponents * comp = [cal components:(NSYearCalendarUnit | NSMonthCalendarUnit) fromDate:self];
@@ -162,6 +302,23 @@ static NSDate* _year2038 = nil;
 }
 
 - (NSDate*) startOfNextWeek {
+    const CivilTimeZoneTable * table = CivilTimeZoneTableForSystemTimeZone();
+    int64_t day;
+    if (civilLocalDay(self, table, &day) && civilDateFromLocal(table, day * 86400) != nil) {
+        NSUInteger firstWeekday = cachedFirstWeekday;
+        if (firstWeekday == 0) {
+            firstWeekday = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar].firstWeekday;
+            cachedFirstWeekday = firstWeekday;
+        }
+        // NSCalendar weekdays are 1 for Sunday to 7 for Saturday.
+        NSInteger weekday = CivilTimeWeekdayFromDays(day) + 1;
+        NSInteger weekdayOfDate = (weekday - (NSInteger)firstWeekday + 7) % 7 + 1;
+        NSDate * result = civilDateFromLocal(table, (day + 7 - (weekdayOfDate - 1)) * 86400);
+        if (result != nil) {
+            return result;
+        }
+    }
+
     NSCalendar *cal = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar];
     [cal setTimeZone:[NSTimeZone systemTimeZone]];
     NSInteger weekdayOfDate = [cal ordinalityOfUnit:NSWeekdayCalendarUnit inUnit:NSWeekCalendarUnit forDate:[self startOfDay]];
@@ -189,6 +346,17 @@ static NSDate* _year2038 = nil;
 
 
 - (NSDate*) thisDayAtHour:(NSInteger)hour minute:(NSInteger)minute second:(NSInteger)second tz:(NSTimeZone*)tz {
+    if (hour >= 0 && hour < 24 && minute >= 0 && minute < 60 && second >= 0 && second < 60) {
+        const CivilTimeZoneTable * table = (tz == nil ? CivilTimeZoneTableForUTC() : CivilTimeZoneTableForTimeZone(tz));
+        int64_t day;
+        if (civilLocalDay(self, table, &day)) {
+            NSDate * result = civilDateFromLocal(table, day * 86400 + hour * 3600 + minute * 60 + second);
+            if (result != nil) {
+                return result;
+            }
+        }
+    }
+
     NSCalendar *cal = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar];
     if (tz == nil)
         tz = [NSTimeZone timeZoneWithName:@"UTC"];
@@ -210,6 +378,12 @@ static NSDate* _year2038 = nil;
 }
 
 - (BOOL) isSameDayAs:(NSDate*)date {
+    const CivilTimeZoneTable * table = CivilTimeZoneTableForSystemTimeZone();
+    int64_t selfDay;
+    int64_t dateDay;
+    if (civilLocalDay(self, table, &selfDay) && civilLocalDay(date, table, &dateDay)) {
+        return selfDay == dateDay;
+    }
 
     NSCalendar *cal = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar];
     [cal setTimeZone:[NSTimeZone systemTimeZone]];
@@ -233,62 +407,207 @@ static NSDate* _year2038 = nil;
 }
 
 
-static NSDate* cachedStartOfToday = nil;
+/**
+ * The start of today, yesterday, etc., worked out once and then cached until significantTimeChange.  These are
+ * read from any thread (the batch bucketing methods are meant to be called off the main thread), so they're kept
+ * together in one struct, copied in and out under dateBoundariesLock.  dateBoundariesGeneration is bumped on each
+ * invalidation, so that boundaries computed before an invalidation don't get stored after it.
+ */
+typedef struct {
+    BOOL valid;
+    NSInteger thisYear;
+    NSTimeInterval startOfThisMonth;
+    NSTimeInterval thresholds[DateBucketCount - 1];   // Since the reference date, descending.  See dateBucketThresholds.
+} DateBoundaries;
+
+static DateBoundaries dateBoundaries = { NO, 0, 0, { 0 } };
+static pthread_mutex_t dateBoundariesLock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t dateBoundariesGeneration = 0;
+
+
+/**
+ * thresholds[i] is the start of bucket i, which is also the end of bucket i + 1 (buckets go newest first).  A time's
+ * bucket is therefore the number of thresholds that it is before.
+ *
+ * "This month" only covers the part of the month before the last 7 days, so if the month started within the last 7
+ * days then its threshold is the same as the one for 7 days ago and the bucket is empty.
+ *
+ * The start of the month is midnight local time, but "30 days ago" is 30 * 24 hours before the start of today.  On
+ * the 31st of a month with a DST change that gained an hour (e.g. 31 October in Europe), the month started an hour
+ * before 30 days ago, so the thresholds are clamped to keep them descending.  The bucketing methods all rely on that.
+ */
+static void dateBucketThresholds(NSTimeInterval * thresholds, NSDate * now, NSTimeZone * tz, NSTimeInterval month) {
+    NSDate * today = [now thisDayAtHour:0 minute:0 second:0 tz:tz];
+    NSTimeInterval t = today.timeIntervalSinceReferenceDate;
+    NSTimeInterval sevenDaysAgo = t - DAY_IN_SECONDS * 7;
+
+    thresholds[DateBucketFuture] = [[today dateByAddingTimeInterval:DAY_IN_SECONDS * 1.5] thisDayAtHour:0 minute:0 second:0 tz:tz].timeIntervalSinceReferenceDate;
+    thresholds[DateBucketToday] = t;
+    thresholds[DateBucketYesterday] = t - DAY_IN_SECONDS;
+    thresholds[DateBucketDayBefore] = t - DAY_IN_SECONDS * 2;
+    thresholds[DateBucketLast7Days] = sevenDaysAgo;
+    thresholds[DateBucketThisMonth] = month;
+    thresholds[DateBucketLast30Days] = t - DAY_IN_SECONDS * 30;
+    thresholds[DateBucketLast60Days] = t - DAY_IN_SECONDS * 60;
+
+    for (NSUInteger i = 1; i < DateBucketCount - 1; i++) {
+        thresholds[i] = MIN(thresholds[i], thresholds[i - 1]);
+    }
+}
+
+
+#if DEBUG || RELEASE_TESTING
+
++(void)dateBucketThresholds:(NSTimeInterval *)thresholds now:(NSDate *)now timeZone:(NSTimeZone *)tz {
+    NSCalendar * cal = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar];
+    cal.timeZone = tz;
+    NSDateComponents * comps = [cal components:NSYearCalendarUnit | NSMonthCalendarUnit fromDate:now];
+    NSTimeInterval month = [cal dateFromComponents:comps].timeIntervalSinceReferenceDate;
+    dateBucketThresholds(thresholds, now, tz, month);
+}
+
+#endif
+
+
+static DateBoundaries currentDateBoundaries() {
+    pthread_mutex_lock(&dateBoundariesLock);
+    DateBoundaries result = dateBoundaries;
+    uint32_t generation = dateBoundariesGeneration;
+    pthread_mutex_unlock(&dateBoundariesLock);
+    if (result.valid) {
+        return result;
+    }
+
+    // Computed outside the lock, because startOfDay and NSCalendar may be slow.
+    NSDate * now = [NSDate date];
+    result.valid = YES;
+    result.thisYear = [[NSCalendar currentCalendar] components:NSYearCalendarUnit fromDate:now].year;
+    result.startOfThisMonth = [now startOfMonth].timeIntervalSinceReferenceDate;
+    dateBucketThresholds(result.thresholds, now, [NSTimeZone systemTimeZone], result.startOfThisMonth);
+
+    pthread_mutex_lock(&dateBoundariesLock);
+    if (generation == dateBoundariesGeneration) {
+        dateBoundaries = result;
+    }
+    pthread_mutex_unlock(&dateBoundariesLock);
+    return result;
+}
+
+
+static void invalidateDateBoundaries() {
+    pthread_mutex_lock(&dateBoundariesLock);
+    dateBoundaries.valid = NO;
+    dateBoundariesGeneration++;
+    pthread_mutex_unlock(&dateBoundariesLock);
+}
+
+
+static NSDate * dateBoundary(DateBucket bucket) {
+    return [NSDate dateWithTimeIntervalSinceReferenceDate:currentDateBoundaries().thresholds[bucket]];
+}
+
+
 +(NSDate*) startOfToday {
-    if (cachedStartOfToday == nil)
-        cachedStartOfToday = [[NSDate date] startOfDay];
-    return cachedStartOfToday;
+    return dateBoundary(DateBucketToday);
 }
 
 
-static NSDate* cachedStartOfYesterday = nil;
 +(NSDate*) startOfYesterday {
-    if (cachedStartOfYesterday == nil)
-        cachedStartOfYesterday = [[NSDate startOfToday] dateByAddingTimeInterval:-DAY_IN_SECONDS];
-    return cachedStartOfYesterday;
+    return dateBoundary(DateBucketYesterday);
 }
 
 
-static NSDate* cachedStartOfDayBefore = nil;
 + (NSDate*) startOfDayBefore {
-    if (cachedStartOfDayBefore == nil)
-        cachedStartOfDayBefore = [[NSDate startOfToday] dateByAddingTimeInterval:-DAY_IN_SECONDS * 2];
-    return cachedStartOfDayBefore;
+    return dateBoundary(DateBucketDayBefore);
 }
 
 
-static NSDate* cachedStartOf7DaysAgo = nil;
 +(NSDate*)startOf7DaysAgo {
-    if (cachedStartOf7DaysAgo == nil)
-        cachedStartOf7DaysAgo = [[NSDate startOfToday] dateByAddingTimeInterval:-DAY_IN_SECONDS * 7];
-    return cachedStartOf7DaysAgo;
+    return dateBoundary(DateBucketLast7Days);
 }
 
 
-static NSDate* cachedStartOf30DaysAgo = nil;
 +(NSDate*)startOf30DaysAgo {
-    if (cachedStartOf30DaysAgo == nil)
-        cachedStartOf30DaysAgo = [[NSDate startOfToday] dateByAddingTimeInterval:-DAY_IN_SECONDS * 30];
-    return cachedStartOf30DaysAgo;
+    return dateBoundary(DateBucketLast30Days);
 }
 
 
-static NSDate* cachedStartOf60DaysAgo = nil;
 +(NSDate*)startOf60DaysAgo {
-    if (cachedStartOf60DaysAgo == nil)
-        cachedStartOf60DaysAgo = [[NSDate startOfToday] dateByAddingTimeInterval:-DAY_IN_SECONDS * 60];
-    return cachedStartOf60DaysAgo;
+    return dateBoundary(DateBucketLast60Days);
 }
 
 +(NSDate*) startOfNextWeek {
     return [[NSDate date] startOfNextWeek];
 }
 
-static NSDate* cachedStartOfThisMonth = nil;
 +(NSDate*) startOfThisMonth {
-    if (cachedStartOfThisMonth == nil)
-        cachedStartOfThisMonth = [[NSDate date] startOfMonth];
-    return cachedStartOfThisMonth;
+    return [NSDate dateWithTimeIntervalSinceReferenceDate:currentDateBoundaries().startOfThisMonth];
+}
+
+
+-(DateBucket)dateBucket {
+    NSTimeInterval t = self.timeIntervalSinceReferenceDate;
+    DateBucket result;
+    [NSDate dateBuckets:&result ofIntervals:&t count:1];
+    return result;
+}
+
+
++(void)dateBuckets:(DateBucket *)buckets ofIntervals:(const NSTimeInterval *)intervals count:(NSUInteger)count {
+    DateBoundaries boundaries = currentDateBoundaries();
+    const NSTimeInterval t0 = boundaries.thresholds[0];
+    const NSTimeInterval t1 = boundaries.thresholds[1];
+    const NSTimeInterval t2 = boundaries.thresholds[2];
+    const NSTimeInterval t3 = boundaries.thresholds[3];
+    const NSTimeInterval t4 = boundaries.thresholds[4];
+    const NSTimeInterval t5 = boundaries.thresholds[5];
+    const NSTimeInterval t6 = boundaries.thresholds[6];
+    const NSTimeInterval t7 = boundaries.thresholds[7];
+
+    // Branch-free, so that the compiler can vectorize it.
+    for (NSUInteger i = 0; i < count; i++) {
+        NSTimeInterval t = intervals[i];
+        buckets[i] = (DateBucket)((t < t0) + (t < t1) + (t < t2) + (t < t3) + (t < t4) + (t < t5) + (t < t6) + (t < t7));
+    }
+}
+
+
++(void)dateBucketRanges:(NSRange *)ranges ofSortedIntervals:(const NSTimeInterval *)intervals count:(NSUInteger)count {
+    DateBoundaries boundaries = currentDateBoundaries();
+    BOOL ascending = (count > 1 && intervals[0] < intervals[count - 1]);
+
+    // splits[i] is the index of the first interval on the far side of thresholds[i] from intervals[0].
+    NSUInteger splits[DateBucketCount - 1];
+    for (NSUInteger i = 0; i < DateBucketCount - 1; i++) {
+        NSTimeInterval threshold = boundaries.thresholds[i];
+        // The thresholds descend, so the splits are in order too, and each search can be bounded by the last.
+        NSUInteger lo = (i == 0 || ascending ? 0 : splits[i - 1]);
+        NSUInteger hi = (i == 0 || !ascending ? count : splits[i - 1]);
+        while (lo < hi) {
+            NSUInteger mid = lo + (hi - lo) / 2;
+            if (ascending ? intervals[mid] < threshold : intervals[mid] >= threshold) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        splits[i] = lo;
+    }
+
+    for (NSUInteger b = 0; b < DateBucketCount; b++) {
+        NSUInteger start;
+        NSUInteger end;
+        if (ascending) {
+            start = (b == DateBucketCount - 1 ? 0 : splits[b]);
+            end = (b == 0 ? count : splits[b - 1]);
+        }
+        else {
+            start = (b == 0 ? 0 : splits[b - 1]);
+            end = (b == DateBucketCount - 1 ? count : splits[b]);
+        }
+        ranges[b] = NSMakeRange(start, end - start);
+    }
 }
 
 
@@ -304,26 +623,15 @@ static NSDate* cachedStartOfThisMonth = nil;
     return [self isSameDayAs:[NSDate startOfDayBefore]];
 }
 
-static NSInteger cachedThisYear = 0;
 -(BOOL) isThisYear {
     NSCalendar * cal = [NSCalendar currentCalendar];
-
-    if (cachedThisYear == 0) {
-        NSDate *today = [NSDate date];
-        NSDateComponents *today_bits = [cal components:NSYearCalendarUnit fromDate:today];
-        cachedThisYear = today_bits.year;
-    }
-
     NSDateComponents *date_bits = [cal components:NSYearCalendarUnit fromDate:self];
-    return cachedThisYear == date_bits.year;
+    return currentDateBoundaries().thisYear == date_bits.year;
 }
 
 
 -(NSString*) dayOfWeek {
-    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
-    formatter.locale = [NSLocale autoupdatingCurrentLocale];
-    formatter.dateFormat = @"EEEE";
-    return [formatter stringFromDate:self];
+    return [dayOfWeekFormatter() stringFromDate:self];
 }
 
 +(NSTimeInterval)timeIntervalFromDays:(NSInteger)days
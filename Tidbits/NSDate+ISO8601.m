@@ -6,25 +6,23 @@
 //  Copyright (c) 2013 Tipbit, Inc. All rights reserved.
 //
 
+#import <pthread.h>
+
 #import "CBLParseDate.h"
+#import "CivilTime.h"
 
 #import "NSDate+ISO8601.h"
 
 
 @implementation NSDate (ISO8601)
 
-#define FORMAT_24 "%4d-%02d-%02dT%02d:%02d:%02d.%03dZ"
-#define FORMAT_23 "%4d-%02d-%02dT%02d:%02d:%02d.%03d"
-#define FORMAT_20 "%4d-%02d-%02dT%02d:%02d:%02dZ"
-#define FORMAT_19 "%4d-%02d-%02dT%02d:%02d:%02d"
-#define FORMAT_16 "%4d-%02d-%02dT%02d:%02d"
-
-
 static NSTimeInterval k1970ToReferenceDate;
+static int64_t k1970ToReferenceDateMsec;
 
 
 +(void)load {
     k1970ToReferenceDate = [[NSDate dateWithTimeIntervalSince1970:0.0] timeIntervalSinceReferenceDate];
+    k1970ToReferenceDateMsec = (int64_t)llround(k1970ToReferenceDate * 1000.0);
 }
 
 
@@ -35,9 +33,20 @@ static NSTimeInterval k1970ToReferenceDate;
     
 
 +(NSTimeInterval)timeIntervalSinceReferenceDateFromIso8601:(NSString*)s {
+    if (s == nil) {
+        return NAN;
+    }
+    const char * str = s.UTF8String;
+
+    // The 24 char form is exact to the msec already, so it doesn't need the truncation below.
+    int64_t msec;
+    if (CBLParseISO8601Date24(str, &msec) == 0) {
+        return (double)(msec - k1970ToReferenceDateMsec) / 1000.0;
+    }
+
     // Note that we truncate to 0.001 (i.e. msec) because CBLParseISO8601Date gives slightly different results compared
     // with NSDateFormatter, and since we know that our dates are always msec precision we can truncate that away.
-    return s == nil ? NAN : trunc(1000.0 * (CBLParseISO8601Date(s.UTF8String) + k1970ToReferenceDate)) / 1000.0;
+    return trunc(1000.0 * (CBLParseISO8601Date(str) + k1970ToReferenceDate)) / 1000.0;
 }
 
 
@@ -50,81 +59,240 @@ static NSTimeInterval k1970ToReferenceDate;
 }
 
 
+#pragma mark - Formatting engine
+
+/**
+ * The UTC forms are all prefixes of the 24 char form, so we always write that and then take as much as we need.
+ * Dates are converted using CivilTime.
+ *
+ * Consecutive calls are usually for the same day and often for the same second, so we keep the date and the
+ * date and time up to the seconds from the last call, and only the msecs need writing each time.  The instance
+ * methods use a cache per thread, so no locking is needed; the batch methods use their own cache on the stack.
+ */
+typedef struct {
+    int64_t day;        // Days since 1970 for date, or INT64_MIN if not set yet.
+    int64_t second;     // Seconds since 1970 for prefix, or INT64_MIN if not set yet.
+    char date[10];      // yyyy-MM-dd
+    char prefix[19];    // yyyy-MM-dd'T'HH:mm:ss
+} Iso8601Cache;
+
+#define ISO8601_CACHE_INIT { INT64_MIN, INT64_MIN, {0}, {0} }
+
+
+static Iso8601Cache * currentIso8601Cache(void) {
+    static pthread_key_t key;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        pthread_key_create(&key, free);
+    });
+
+    Iso8601Cache * cache = pthread_getspecific(key);
+    if (cache == NULL) {
+        cache = malloc(sizeof(Iso8601Cache));
+        if (cache != NULL) {
+            *cache = (Iso8601Cache)ISO8601_CACHE_INIT;
+            pthread_setspecific(key, cache);
+        }
+    }
+    return cache;
+}
+
+
+static const char kDigitPairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+
+static void writeDigits2(char * p, int v) {
+    memcpy(p, &kDigitPairs[2 * v], 2);
+}
+
+
+static void writeDigits3(char * p, int v) {
+    p[0] = (char)('0' + v / 100);
+    writeDigits2(p + 1, v % 100);
+}
+
+
+static void writeDigits4(char * p, int v) {
+    writeDigits2(p, v / 100);
+    writeDigits2(p + 2, v % 100);
+}
+
+
+/**
+ * Writes yyyy-MM-dd.  There is no room for years outside 0000-9999 so they are clamped.
+ */
+static void writeDate(char * p, int year, int month, int day) {
+    writeDigits4(p, year < 0 ? 0 : year > 9999 ? 9999 : year);
+    p[4] = '-';
+    writeDigits2(p + 5, month);
+    p[7] = '-';
+    writeDigits2(p + 8, day);
+}
+
+
+/**
+ * Writes HH:mm:ss.
+ */
+static void writeTime(char * p, int hour, int minute, int second) {
+    writeDigits2(p, hour);
+    p[2] = ':';
+    writeDigits2(p + 3, minute);
+    p[5] = ':';
+    writeDigits2(p + 6, second);
+}
+
+
+static void updateCache(Iso8601Cache * cache, int64_t second) {
+    int64_t day = (second >= 0 ? second : second - 86399) / 86400;
+    if (day != cache->day) {
+        int y, m, d;
+        CivilTimeDateFromDays(day, &y, &m, &d);
+        writeDate(cache->date, y, m, d);
+        cache->day = day;
+    }
+    int secOfDay = (int)(second - day * 86400);
+    memcpy(cache->prefix, cache->date, 10);
+    cache->prefix[10] = 'T';
+    writeTime(cache->prefix + 11, secOfDay / 3600, secOfDay / 60 % 60, secOfDay % 60);
+    cache->second = second;
+}
+
+
+/**
+ * Writes the 24 char form of ts (seconds since 1970) into buf, with no NUL.
+ */
+static void formatIso8601_24(NSTimeInterval ts, Iso8601Cache * cache, char * buf) {
+    int64_t second = (int64_t)floor(ts);
+    int msec = (int)((ts - (double)second) * 1000.0);
+    if (msec > 999) {
+        msec = 999;
+    }
+    if (second != cache->second) {
+        updateCache(cache, second);
+    }
+    memcpy(buf, cache->prefix, sizeof(cache->prefix));
+    buf[19] = '.';
+    writeDigits3(buf + 20, msec);
+    buf[23] = 'Z';
+}
+
+
+static NSString * utcStringOfLength(NSTimeInterval ts, NSUInteger length) {
+    char buf[ISO8601_24_LENGTH];
+    Iso8601Cache * cache = currentIso8601Cache();
+    Iso8601Cache fallback = ISO8601_CACHE_INIT;
+    formatIso8601_24(ts, (cache == NULL ? &fallback : cache), buf);
+    return [[NSString alloc] initWithBytes:buf length:length encoding:NSASCIIStringEncoding];
+}
+
+
+#pragma mark -
+
+
 -(NSString*) iso8601String {
-    // This implementation and the similar ones below are 10x faster than using NSDateFormatter.
-    struct tm tm;
-    gmtime_of_interval([self timeIntervalSince1970], &tm);
-    char buf[20];
-    snprintf(buf, sizeof(buf), FORMAT_19, tm.tm_year + 1900, tm.tm_mon + 1,
-             tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
-    return [NSString stringWithCString:buf encoding:NSASCIIStringEncoding];
+    // This implementation and the similar ones below are 10x faster than using NSDateFormatter, and the formatting
+    // engine below is several times faster again than the snprintf that we used to use.
+    return utcStringOfLength([self timeIntervalSince1970], 19);
 }
 
 
 -(NSString*) iso8601String_16 {
-    struct tm tm;
-    gmtime_of_interval([self timeIntervalSince1970], &tm);
-    char buf[17];
-    snprintf(buf, sizeof(buf), FORMAT_16, tm.tm_year + 1900, tm.tm_mon + 1,
-             tm.tm_mday, tm.tm_hour, tm.tm_min);
-    return [NSString stringWithCString:buf encoding:NSASCIIStringEncoding];
+    return utcStringOfLength([self timeIntervalSince1970], 16);
 }
 
 
 -(NSString*) iso8601String_23 {
-    struct tm tm;
-    int ts_frac = gmtime_and_msec_of_interval([self timeIntervalSince1970], &tm);
-    char buf[24];
-    snprintf(buf, sizeof(buf), FORMAT_23, tm.tm_year + 1900, tm.tm_mon + 1,
-             tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ts_frac);
-    return [NSString stringWithCString:buf encoding:NSASCIIStringEncoding];
+    return utcStringOfLength([self timeIntervalSince1970], 23);
 }
 
 
 -(NSString*) iso8601String_local_23 {
-    struct tm tm;
-    int ts_frac = localtime_and_msec_of_interval([self timeIntervalSince1970], &tm);
-    char buf[24];
-    snprintf(buf, sizeof(buf), FORMAT_23, tm.tm_year + 1900, tm.tm_mon + 1,
-             tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ts_frac);
-    return [NSString stringWithCString:buf encoding:NSASCIIStringEncoding];
+    NSTimeInterval ts = [self timeIntervalSince1970];
+    char buf[23];
+    int64_t utc;
+    int64_t local;
+    if (CivilTimeSecondsFromDate(self, &utc) &&
+        CivilTimeZoneTableLocalFromUTC(CivilTimeZoneTableForSystemTimeZone(), utc, &local)) {
+        // The common case, without localtime_r and the libc timezone lock.
+        int64_t day = CivilTimeDaysFromSeconds(local);
+        int secOfDay = (int)(local - day * 86400);
+        int y, m, d;
+        CivilTimeDateFromDays(day, &y, &m, &d);
+        writeDate(buf, y, m, d);
+        writeTime(buf + 11, secOfDay / 3600, secOfDay / 60 % 60, secOfDay % 60);
+        int msec = (int)((ts - (double)utc) * 1000.0);
+        writeDigits3(buf + 20, msec > 999 ? 999 : msec);
+    }
+    else {
+        struct tm tm;
+        int ts_frac = localtime_and_msec_of_interval(ts, &tm);
+        writeDate(buf, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+        writeTime(buf + 11, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        writeDigits3(buf + 20, ts_frac);
+    }
+    buf[10] = 'T';
+    buf[19] = '.';
+    return [[NSString alloc] initWithBytes:buf length:sizeof(buf) encoding:NSASCIIStringEncoding];
 }
 
 
 -(NSString*) iso8601String_24 {
-    struct tm tm;
-    int ts_frac = gmtime_and_msec_of_interval([self timeIntervalSince1970], &tm);
-    char buf[25];
-    snprintf(buf, sizeof(buf), FORMAT_24, tm.tm_year + 1900, tm.tm_mon + 1,
-             tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ts_frac);
-    return [NSString stringWithCString:buf encoding:NSASCIIStringEncoding];
+    return utcStringOfLength([self timeIntervalSince1970], ISO8601_24_LENGTH);
 }
 
 
-static void gmtime_of_interval(NSTimeInterval ts, struct tm * tm) {
-    time_t ts_whole = (time_t)ts;
-    gmtime_r(&ts_whole, tm);
++(void)iso8601Strings_24:(const NSTimeInterval *)intervals count:(NSUInteger)count buffer:(char *)buffer {
+    Iso8601Cache cache = ISO8601_CACHE_INIT;
+    for (NSUInteger i = 0; i < count; i++) {
+        formatIso8601_24(intervals[i] + k1970ToReferenceDate, &cache, buffer + i * ISO8601_24_LENGTH);
+    }
 }
 
 
-static int localtime_and_msec_of_interval(NSTimeInterval ts, struct tm * tm) {
-    time_t ts_whole = (time_t)ts;
-    localtime_r(&ts_whole, tm);
-    return (int)((ts - (double)ts_whole) * 1000.0);
++(NSArray *)iso8601Strings_24:(const NSTimeInterval *)intervals count:(NSUInteger)count {
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:count];
+    Iso8601Cache cache = ISO8601_CACHE_INIT;
+    char buf[ISO8601_24_LENGTH];
+    for (NSUInteger i = 0; i < count; i++) {
+        formatIso8601_24(intervals[i] + k1970ToReferenceDate, &cache, buf);
+        [result addObject:[[NSString alloc] initWithBytes:buf length:sizeof(buf) encoding:NSASCIIStringEncoding]];
+    }
+    return result;
 }
 
 
-static int gmtime_and_msec_of_interval(NSTimeInterval ts, struct tm * tm) {
-    time_t ts_whole = (time_t)ts;
-    gmtime_r(&ts_whole, tm);
-    return (int)((ts - (double)ts_whole) * 1000.0);
+static int localtime_and_msec_of_interval(NSTimeInterval ts, struct tm * tm) {
+    // floor rather than truncation so that times before 1970 don't get a negative msec.
+    time_t ts_whole = (time_t)floor(ts);
+    localtime_r(&ts_whole, tm);
+    int msec = (int)((ts - (double)ts_whole) * 1000.0);
+    return (msec > 999 ? 999 : msec);
 }
 
 
 #if DEBUG || RELEASE_TESTING
 
+#define FORMAT_24 "%4d-%02d-%02dT%02d:%02d:%02d.%03dZ"
+
+
+/**
+ * The implementation of iso8601String_24 before the formatting engine above, for comparison.
+ */
 -(NSString *)iso8601String_24_B {
-    return [self iso8601String_24];
+    struct tm tm;
+    NSTimeInterval ts = [self timeIntervalSince1970];
+    time_t ts_whole = (time_t)ts;
+    gmtime_r(&ts_whole, &tm);
+    int ts_frac = (int)((ts - (double)ts_whole) * 1000.0);
+    char buf[25];
+    snprintf(buf, sizeof(buf), FORMAT_24, tm.tm_year + 1900, tm.tm_mon + 1,
+             tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ts_frac);
+    return [NSString stringWithCString:buf encoding:NSASCIIStringEncoding];
 }
 
 #endif
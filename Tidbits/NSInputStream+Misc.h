@@ -24,6 +24,15 @@
  */
 -(NSInteger)readUint32:(uint32_t*)result;
 
+/**
+ * Read a VarUInt, as written by BinaryWriter.  This reads a byte at a time, so for anything more than the odd
+ * field, use BinaryReader, which buffers.
+ *
+ * @return The number of bytes read, 0 on EOF, or a negative number on failure (including a truncated or
+ * malformed VarUInt).
+ */
+-(NSInteger)readVarUInt:(uint64_t*)result;
+
 /**
  * @param length May be NSUIntegerMax, in which case no checks are performed.  Otherwise, this is used to check that the correct data were read.
  * @param error May be nil.
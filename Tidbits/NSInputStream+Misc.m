@@ -48,17 +48,38 @@
 }
 
 
+-(NSInteger)readVarUInt:(uint64_t*)result {
+    uint64_t v = 0;
+    for (NSInteger n = 0; n < 10; n++) {
+        u_int8_t b;
+        NSInteger i = [self read:&b maxLength:1];
+        if (i <= 0) {
+            return (n == 0 ? i : -1);
+        }
+        if (n == 9 && b > 1) {
+            return -1;
+        }
+        v |= (uint64_t)(b & 0x7f) << (7 * n);
+        if ((b & 0x80) == 0) {
+            *result = v;
+            return n + 1;
+        }
+    }
+    return -1;
+}
+
+
 static NSInteger readLen(NSInputStream* is, u_int8_t* dest, NSUInteger len) {
-    int n = 0;
+    NSUInteger n = 0;
     while (true) {
         NSInteger i = [is read:(dest + n) maxLength:len - n];
         if (i <= 0)
             return i;
 
-        n += i;
+        n += (NSUInteger)i;
 
-        if ((NSUInteger)n == len)
-            return n;
+        if (n == len)
+            return (NSInteger)n;
     }
 }
 
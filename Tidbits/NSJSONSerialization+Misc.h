@@ -11,11 +11,24 @@
 #import "StandardBlocks.h"
 
 
+@class JSONPullParser;
+
+
 @interface NSJSONSerialization (Misc)
 
 /**
- * Equivalent to [NSJSONSerialization JSONObjectWithStream:stream options:0 error:error],
- * where the stream is from opening resourceName.json from the given bundle.
+ * Parse resourceName.json from the given bundle.  Like [NSJSONSerialization JSONObjectWithStream:options:0 error:],
+ * the top level must be an object or an array.
+ *
+ * Bundled JSON tends to be kept for the lifetime of the app, so the dictionary keys in the result are interned
+ * using [StringPool sharedPool].  This is done as the file is parsed (see JSONPullParser.keyPool), so the tree is
+ * only built once.  Because of that, the containers in the result are the parser's NSMutableDictionary and
+ * NSMutableArray instances rather than immutable copies.  Treat them as immutable.
+ *
+ * If the bundle also has resourceName.jsonsnap (made by json-snapshot.py at build time), then the result is read
+ * lazily from that snapshot instead (see JSONSnapshot), and the JSON is never read.  The snapshot is only checked
+ * against the length of the JSON, since bundle resources can't change after the build; json-snapshot.py is what
+ * keeps them in step.  A snapshot gives the same values as parsing the JSON, but its containers are immutable.
  */
 +(id)JSONObjectFromBundle:(NSBundle *)bundle resourceName:(NSString *)resourceName error:(NSError * __autoreleasing *)error __attribute__((nonnull(1,2)));
 
@@ -28,6 +41,36 @@
  */
 +(void)JSONObjectFromBundleAsync:(NSBundle *)bundle resourceName:(NSString *)resourceName onSuccess:(IdBlock)onSuccess onFailure:(NSErrorBlock)onFailure __attribute__((nonnull(1,2,3)));
 
+/**
+ * Open resourceName.json from the given bundle for incremental parsing.  The file is memory-mapped where
+ * possible, and nothing is built until you ask for it (see JSONPullParser), so this is much cheaper than
+ * JSONObjectFromBundle when you only need part of a large file.
+ *
+ * @return nil on failure, in which case *error is set (if error is not NULL).
+ */
++(JSONPullParser *)JSONPullParserFromBundle:(NSBundle *)bundle resourceName:(NSString *)resourceName error:(NSError * __autoreleasing *)error __attribute__((nonnull(1,2)));
+
+/**
+ * Parse data with JSONTape, which returns an NSDictionary or NSArray that only decodes the parts of the document that
+ * you read.  This is much cheaper than NSJSONSerialization when you only need a few fields out of a large document.
+ *
+ * @return nil on failure, in which case *error is set (if error is not NULL).
+ */
++(id)lazyJSONObjectWithData:(NSData *)data error:(NSError * __autoreleasing *)error __attribute__((nonnull(1)));
+
+/**
+ * Equivalent to lazyJSONObjectWithData:error: on resourceName.json from the given bundle, memory-mapped where
+ * possible.
+ */
++(id)lazyJSONObjectFromBundle:(NSBundle *)bundle resourceName:(NSString *)resourceName error:(NSError * __autoreleasing *)error __attribute__((nonnull(1,2)));
+
+/**
+ * @return A copy of obj where every NSDictionary key has been replaced with the canonical instance from
+ * [StringPool sharedPool].  NSDictionary and NSArray instances are rebuilt; all other values are shared with obj.
+ * If you are parsing the JSON yourself, it is cheaper to set JSONPullParser.keyPool instead.
+ */
++(id)JSONObjectWithInternedKeys:(id)obj;
+
 /**
  * Equivalent to [NSJSONSerialization stringWithJSONObject:obj options:0 error:error].
  */
@@ -39,12 +82,20 @@
 +(NSString *)stringWithJSONObject:(id)obj options:(NSJSONWritingOptions)opt error:(NSError *__autoreleasing *)error;
 
 /**
- * Equivalent to [NSJSONSerialization stringWithJSONObject:[obj objectWithJSONSafeObjects] options:0 error:error].
+ * Equivalent to [NSJSONSerialization stringWithJSONObject:[obj objectWithJSONSafeObjects] options:0 error:error],
+ * but written in a single pass by JSONWriter, without the intermediate copy of obj.
+ *
+ * Note that this succeeds in two cases where that fails: a top-level value that is not an NSArray or NSDictionary
+ * is written as a bare JSON value, and dictionary keys that are not strings are written as their description.
  */
 +(NSString *)stringWithJSONObjectMadeSafe:(id)obj error:(NSError *__autoreleasing *)error;
 
 /**
- * Equivalent to [NSString stringWithUTF8Data:[NSJSONSerialization dataWithJSONObject:[obj objectWithJSONSafeObjects] options:opt error:error]].
+ * Equivalent to [NSString stringWithUTF8Data:[NSJSONSerialization dataWithJSONObject:[obj objectWithJSONSafeObjects] options:opt error:error]],
+ * but written in a single pass by JSONWriter, without the intermediate copy of obj, NSData, and NSString.
+ * The same differences as stringWithJSONObjectMadeSafe:error: apply.
+ *
+ * @param opt NSJSONWritingPrettyPrinted is the only option.
  */
 +(NSString *)stringWithJSONObjectMadeSafe:(id)obj options:(NSJSONWritingOptions)opt error:(NSError *__autoreleasing *)error;
 
@@ -7,8 +7,13 @@
 //
 
 #import "Dispatch.h"
-#import "NSObject+MTJSONUtils.h"
+#import "JSONPullParser.h"
+#import "JSONSnapshot.h"
+#import "JSONTape.h"
+#import "JSONWriter.h"
+#import "LoggingMacros.h"
 #import "NSString+Misc.h"
+#import "StringPool.h"
 #import "TBAsserts.h"
 
 #import "NSJSONSerialization+Misc.h"
@@ -29,11 +34,40 @@
         return nil;
     }
 
-    NSInputStream * stream = [NSInputStream inputStreamWithFileAtPath:path];
-    [stream open];
-    id result = [NSJSONSerialization JSONObjectWithStream:stream options:(NSJSONReadingOptions)0 error:error];
-    [stream close];
-    return  result;
+    // The bundle can't change after the build that made the snapshot, so checking the length is enough, and
+    // means that the JSON is never read.
+    NSString * snapshotPath = [bundle pathForResource:resourceName ofType:@"jsonsnap"];
+    if (snapshotPath != nil) {
+        NSError * err = nil;
+        unsigned long long sourceLength = [[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL].fileSize;
+        id result = [JSONSnapshot JSONObjectWithContentsOfFile:snapshotPath sourceLength:sourceLength error:&err];
+        if (result != nil) {
+            return result;
+        }
+        NSLogWarn(@"Ignoring snapshot %@: %@", snapshotPath, err);
+    }
+
+    NSData * data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:error];
+    return (data == nil ? nil : JSONObjectWithInternedKeysFromData(data, error));
+}
+
+
+/**
+ * Parse data with JSONPullParser, interning the keys as they are read rather than rebuilding the tree afterwards.
+ */
+static id JSONObjectWithInternedKeysFromData(NSData * data, NSError * __autoreleasing * error) {
+    JSONPullParser * parser = [[JSONPullParser alloc] initWithData:data];
+    parser.keyPool = [StringPool sharedPool];
+    JSONPullToken token = [parser next];
+    // NSJSONSerialization rejects top-level fragments without NSJSONReadingAllowFragments, so do the same.
+    id result = (token == JSONPullTokenObjectStart || token == JSONPullTokenArrayStart ? [parser objectValue] : nil);
+    if (result != nil && [parser next] != JSONPullTokenEnd) {
+        result = nil;
+    }
+    if (result == nil && error != NULL) {
+        *error = (parser.error ?: [NSError errorWithDomain:NSCocoaErrorDomain code:NSPropertyListReadCorruptError userInfo:nil]);
+    }
+    return result;
 }
 
 
@@ -64,6 +98,68 @@
 }
 
 
++(JSONPullParser *)JSONPullParserFromBundle:(NSBundle *)bundle resourceName:(NSString *)resourceName error:(NSError * __autoreleasing *)error __attribute__((nonnull(1,2))) {
+    NSData * data = mappedBundleResource(bundle, resourceName, error);
+    return (data == nil ? nil : [[JSONPullParser alloc] initWithData:data]);
+}
+
+
++(id)lazyJSONObjectWithData:(NSData *)data error:(NSError * __autoreleasing *)error __attribute__((nonnull(1))) {
+    return [JSONTape JSONObjectWithData:data error:error];
+}
+
+
++(id)lazyJSONObjectFromBundle:(NSBundle *)bundle resourceName:(NSString *)resourceName error:(NSError * __autoreleasing *)error __attribute__((nonnull(1,2))) {
+    NSData * data = mappedBundleResource(bundle, resourceName, error);
+    return (data == nil ? nil : [JSONTape JSONObjectWithData:data error:error]);
+}
+
+
+static NSData * mappedBundleResource(NSBundle * bundle, NSString * resourceName, NSError * __autoreleasing * error) {
+    NSCParameterAssert(bundle);
+    NSCParameterAssert(resourceName);
+
+    NSString * path = [bundle pathForResource:resourceName ofType:@"json"];
+    if (path == nil) {
+        if (error != NULL) {
+            *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileNoSuchFileError userInfo:nil];
+        }
+        return nil;
+    }
+    return [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:error];
+}
+
+
++(id)JSONObjectWithInternedKeys:(id)obj {
+    return internKeys(obj, [StringPool sharedPool]);
+}
+
+
+static id internKeys(id obj, StringPool * pool) {
+    if ([obj isKindOfClass:[NSDictionary class]]) {
+        NSDictionary * dict = obj;
+        NSMutableArray * keys = [NSMutableArray arrayWithCapacity:dict.count];
+        NSMutableArray * values = [NSMutableArray arrayWithCapacity:dict.count];
+        [dict enumerateKeysAndObjectsUsingBlock:^(id key, id val, __unused BOOL * stop) {
+            [keys addObject:([key isKindOfClass:[NSString class]] ? [pool intern:key] : key)];
+            [values addObject:internKeys(val, pool)];
+        }];
+        return [NSDictionary dictionaryWithObjects:values forKeys:keys];
+    }
+    else if ([obj isKindOfClass:[NSArray class]]) {
+        NSArray * arr = obj;
+        NSMutableArray * result = [NSMutableArray arrayWithCapacity:arr.count];
+        for (id val in arr) {
+            [result addObject:internKeys(val, pool)];
+        }
+        return [NSArray arrayWithArray:result];
+    }
+    else {
+        return obj;
+    }
+}
+
+
 +(NSString *)stringWithJSONObject:(id)obj error:(NSError *__autoreleasing *)error {
     return [NSJSONSerialization stringWithJSONObject:obj options:0 error:error];
 }
@@ -75,12 +171,13 @@
 
 
 +(NSString *)stringWithJSONObjectMadeSafe:(id)obj error:(NSError *__autoreleasing *)error {
-    return [NSJSONSerialization stringWithJSONObject:[obj objectWithJSONSafeObjects] options:0 error:error];
+    return [JSONWriter stringWithJSONSafeObject:obj options:0 error:error];
 }
 
 
 +(NSString *)stringWithJSONObjectMadeSafe:(id)obj options:(NSJSONWritingOptions)opt error:(NSError *__autoreleasing *)error {
-    return [NSString stringWithUTF8Data:[NSJSONSerialization dataWithJSONObject:[obj objectWithJSONSafeObjects] options:opt error:error]];
+    JSONWriterOptions writerOpt = ((opt & NSJSONWritingPrettyPrinted) != 0 ? JSONWriterPrettyPrinted : 0);
+    return [JSONWriter stringWithJSONSafeObject:obj options:writerOpt error:error];
 }
 
 
@@ -14,4 +14,11 @@
 -(void) appendUint16:(u_int16_t)i;
 -(void) appendUint32:(u_int32_t)i;
 
+/**
+ * Append v in the VarUInt / VarInt encodings used by BinaryWriter.  For anything more than the odd field, use
+ * BinaryWriter itself, which also has fixed byte-order integers, floats, and length-prefixed strings.
+ */
+-(void) appendVarUInt:(u_int64_t)v;
+-(void) appendVarInt:(int64_t)v;
+
 @end
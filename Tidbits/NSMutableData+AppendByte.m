@@ -6,6 +6,8 @@
 //  Copyright (c) 2013 Tipbit, Inc. All rights reserved.
 //
 
+#import "BinaryWriter.h"
+
 #import "NSMutableData+AppendByte.h"
 
 @implementation NSMutableData (AppendByte)
@@ -22,4 +24,19 @@
     [self appendBytes:&i length:4];
 }
 
+-(void) appendVarUInt:(u_int64_t)v {
+    u_int8_t buf[10];
+    NSUInteger n = 0;
+    while (v >= 0x80) {
+        buf[n++] = (u_int8_t)(v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (u_int8_t)v;
+    [self appendBytes:buf length:n];
+}
+
+-(void) appendVarInt:(int64_t)v {
+    [self appendVarUInt:BinaryZigZagEncode(v)];
+}
+
 @end
@@ -8,6 +8,10 @@
 
 #import <Foundation/Foundation.h>
 
+/**
+ * For anything more than the occasional append, use UTF8Builder instead, which can format directly into its
+ * buffer and hand it over to an NSData without copying.
+ */
 @interface NSMutableData (UTF8)
 
 -(void) appendUTF8:(NSString *)s;
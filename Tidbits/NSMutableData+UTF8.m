@@ -13,7 +13,19 @@
 @implementation NSMutableData (UTF8)
 
 -(void) appendUTF8:(NSString *)s {
-    [self appendData:[s dataUsingEncoding:NSUTF8StringEncoding]];
+    if (s == nil) {
+        return;
+    }
+
+    // Transcode straight into our own tail, rather than via an intermediate NSData.
+    // Three bytes per UTF-16 unit is the worst case.
+    CFStringRef cf = (__bridge CFStringRef)s;
+    CFIndex len = CFStringGetLength(cf);
+    NSUInteger oldLength = self.length;
+    [self increaseLengthBy:(NSUInteger)(3 * len)];
+    CFIndex used = 0;
+    CFStringGetBytes(cf, CFRangeMake(0, len), kCFStringEncodingUTF8, '?', false, (UInt8 *)self.mutableBytes + oldLength, 3 * len, &used);
+    self.length = oldLength + (NSUInteger)used;
 }
 
 -(void) appendUTF8Format:(NSString *)format, ... {
@@ -0,0 +1,430 @@
+//
+//  RFC2822Date.c
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/9/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#include "RFC2822Date.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+
+#define WORD_KEY(a, b, c) (((uint32_t)(a) << 16) | ((uint32_t)(b) << 8) | (uint32_t)(c))
+
+
+typedef struct {
+    const char * p;
+    const char * end;
+} Cursor;
+
+
+typedef struct {
+    uint32_t key;       // The first three letters, lowercased, as WORD_KEY.
+    int minutes;
+} Zone;
+
+
+/**
+ * RFC 5322 section 4.3 gives the first eight, the rest are ones that we see in the wild.  Ambiguous ones (IST, for
+ * example) are left out, and so are treated as unknown (i.e. UTC).
+ */
+static const Zone kZones[] = {
+    { WORD_KEY('g', 'm', 't'),    0 },
+    { WORD_KEY('u', 't', 'c'),    0 },
+    { WORD_KEY('e', 's', 't'), -300 },
+    { WORD_KEY('e', 'd', 't'), -240 },
+    { WORD_KEY('c', 's', 't'), -360 },
+    { WORD_KEY('c', 'd', 't'), -300 },
+    { WORD_KEY('m', 's', 't'), -420 },
+    { WORD_KEY('m', 'd', 't'), -360 },
+    { WORD_KEY('p', 's', 't'), -480 },
+    { WORD_KEY('p', 'd', 't'), -420 },
+    { WORD_KEY('w', 'e', 't'),    0 },
+    { WORD_KEY('b', 's', 't'),   60 },
+    { WORD_KEY('c', 'e', 't'),   60 },
+    { WORD_KEY('m', 'e', 't'),   60 },
+    { WORD_KEY('e', 'e', 't'),  120 },
+    { WORD_KEY('j', 's', 't'),  540 },
+    { WORD_KEY('h', 's', 't'), -600 },
+};
+
+/**
+ * Four-letter zones, keyed on the first three letters, with the fourth letter separately.
+ */
+static const struct {
+    uint32_t key;
+    char last;
+    int minutes;
+} kLongZones[] = {
+    { WORD_KEY('w', 'e', 's'), 't',   60 },
+    { WORD_KEY('c', 'e', 's'), 't',  120 },
+    { WORD_KEY('m', 'e', 's'), 't',  120 },
+    { WORD_KEY('e', 'e', 's'), 't',  180 },
+    { WORD_KEY('a', 'e', 's'), 't',  600 },
+    { WORD_KEY('a', 'e', 'd'), 't',  660 },
+    { WORD_KEY('a', 'k', 's'), 't', -540 },
+    { WORD_KEY('a', 'k', 'd'), 't', -480 },
+};
+
+static const uint32_t kMonths[12] = {
+    WORD_KEY('j', 'a', 'n'), WORD_KEY('f', 'e', 'b'), WORD_KEY('m', 'a', 'r'), WORD_KEY('a', 'p', 'r'),
+    WORD_KEY('m', 'a', 'y'), WORD_KEY('j', 'u', 'n'), WORD_KEY('j', 'u', 'l'), WORD_KEY('a', 'u', 'g'),
+    WORD_KEY('s', 'e', 'p'), WORD_KEY('o', 'c', 't'), WORD_KEY('n', 'o', 'v'), WORD_KEY('d', 'e', 'c'),
+};
+
+static const uint32_t kWeekdays[7] = {
+    WORD_KEY('s', 'u', 'n'), WORD_KEY('m', 'o', 'n'), WORD_KEY('t', 'u', 'e'), WORD_KEY('w', 'e', 'd'),
+    WORD_KEY('t', 'h', 'u'), WORD_KEY('f', 'r', 'i'), WORD_KEY('s', 'a', 't'),
+};
+
+
+static bool isDigit(char c) {
+    return (unsigned)(c - '0') < 10;
+}
+
+
+static bool isAlpha(char c) {
+    return (unsigned)((c | 0x20) - 'a') < 26;
+}
+
+
+/**
+ * Skips whitespace (including folding) and comments, which may be nested and may contain quoted-pairs.
+ */
+static void skipCFWS(Cursor * c) {
+    while (c->p < c->end) {
+        char ch = *c->p;
+        if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
+            c->p++;
+        }
+        else if (ch == '(') {
+            int depth = 0;
+            while (c->p < c->end) {
+                ch = *c->p++;
+                if (ch == '\\' && c->p < c->end) {
+                    c->p++;
+                }
+                else if (ch == '(') {
+                    depth++;
+                }
+                else if (ch == ')' && --depth == 0) {
+                    break;
+                }
+            }
+        }
+        else {
+            return;
+        }
+    }
+}
+
+
+/**
+ * Reads minDigits to maxDigits digits, which must not be followed by another digit.
+ *
+ * @return The number of digits read, or 0 if there weren't enough or there were too many.
+ */
+static int readNumber(Cursor * c, int minDigits, int maxDigits, int * out) {
+    int n = 0;
+    int val = 0;
+    while (c->p < c->end && isDigit(*c->p)) {
+        if (n == maxDigits) {
+            return 0;
+        }
+        val = val * 10 + (*c->p - '0');
+        c->p++;
+        n++;
+    }
+    if (n < minDigits) {
+        return 0;
+    }
+    *out = val;
+    return n;
+}
+
+
+/**
+ * Reads a word of letters.
+ *
+ * @return The first three letters as WORD_KEY (or 0 if the word is shorter than that), with the length of the word
+ * in *len and its fourth letter (lowercase) in *fourth, or 0 if it has only three.
+ */
+static uint32_t readWord(Cursor * c, int * len, char * fourth) {
+    uint32_t key = 0;
+    int n = 0;
+    *fourth = 0;
+    while (c->p < c->end && isAlpha(*c->p)) {
+        char ch = (char)(*c->p | 0x20);
+        if (n < 3) {
+            key = (key << 8) | (uint8_t)ch;
+        }
+        else if (n == 3) {
+            *fourth = ch;
+        }
+        c->p++;
+        n++;
+    }
+    *len = n;
+    return (n >= 3 ? key : 0);
+}
+
+
+static int indexOfKey(const uint32_t * keys, int count, uint32_t key) {
+    for (int i = 0; i < count; i++) {
+        if (keys[i] == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static int readMonth(Cursor * c) {
+    int len;
+    char fourth;
+    uint32_t key = readWord(c, &len, &fourth);
+    return indexOfKey(kMonths, 12, key) + 1;
+}
+
+
+/**
+ * hh:mm or hh:mm:ss.
+ */
+static bool readTime(Cursor * c, int * hour, int * minute, int * second) {
+    if (!readNumber(c, 1, 2, hour) || *hour > 23) {
+        return false;
+    }
+    if (c->p == c->end || *c->p != ':') {
+        return false;
+    }
+    c->p++;
+    if (!readNumber(c, 2, 2, minute) || *minute > 59) {
+        return false;
+    }
+    *second = 0;
+    if (c->p < c->end && *c->p == ':') {
+        c->p++;
+        // 60 is a leap second.
+        if (!readNumber(c, 2, 2, second) || *second > 60) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * +hhmm, +hh:mm, or +hh.
+ */
+static bool readNumericZone(Cursor * c, int * minutes) {
+    int sign = (*c->p == '-' ? -1 : 1);
+    c->p++;
+    int hh;
+    int mm = 0;
+    int n = readNumber(c, 2, 4, &hh);
+    if (n == 4) {
+        mm = hh % 100;
+        hh /= 100;
+    }
+    else if (n == 2) {
+        if (c->p < c->end && *c->p == ':') {
+            c->p++;
+            if (!readNumber(c, 2, 2, &mm)) {
+                return false;
+            }
+        }
+    }
+    else {
+        return false;
+    }
+    if (hh > 23 || mm > 59) {
+        return false;
+    }
+    *minutes = sign * (hh * 60 + mm);
+    return true;
+}
+
+
+/**
+ * The zone, if there is one.  *minutes is left alone if there isn't.
+ */
+static bool readZone(Cursor * c, int * minutes) {
+    if (c->p == c->end) {
+        return true;
+    }
+    char ch = *c->p;
+    if (ch == '+' || ch == '-') {
+        return readNumericZone(c, minutes);
+    }
+    if (!isAlpha(ch)) {
+        return false;
+    }
+
+    int len;
+    char fourth;
+    uint32_t key = readWord(c, &len, &fourth);
+    *minutes = 0;
+    if (len == 3) {
+        for (size_t i = 0; i < sizeof(kZones) / sizeof(kZones[0]); i++) {
+            if (kZones[i].key == key) {
+                *minutes = kZones[i].minutes;
+                break;
+            }
+        }
+    }
+    else if (len == 4) {
+        for (size_t i = 0; i < sizeof(kLongZones) / sizeof(kLongZones[0]); i++) {
+            if (kLongZones[i].key == key && kLongZones[i].last == fourth) {
+                *minutes = kLongZones[i].minutes;
+                break;
+            }
+        }
+    }
+    // Anything else (UT, Z, military zones, and names that we don't know) is UTC.
+
+    // GMT+hhmm and the like.
+    if (c->p < c->end && (*c->p == '+' || *c->p == '-')) {
+        return readNumericZone(c, minutes);
+    }
+    return true;
+}
+
+
+/**
+ * RFC 5322 section 4.3: two-digit years are 2000-2049 or 1950-1999, and three-digit years have 1900 added.
+ */
+static int fixYear(int year, int digits) {
+    return (digits == 2 ? (year < 50 ? year + 2000 : year + 1900) :
+            digits == 3 ? year + 1900 :
+            year);
+}
+
+
+static int daysInMonth(int year, int month) {
+    static const int kDays[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool leap = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
+    return (month == 2 && leap ? 29 : kDays[month - 1]);
+}
+
+
+static int64_t daysFromCivil(int year, int month, int day) {
+    year -= (month <= 2);
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yoe = year - era * 400;
+    int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + doe - 719468;
+}
+
+
+double RFC2822ParseDateWithLength(const char* dateStr, size_t length) {
+    Cursor c = { dateStr, dateStr + length };
+    int day, month, year, yearDigits, hour, minute, second;
+    int zone = 0;
+
+    skipCFWS(&c);
+    if (c.p == c.end) {
+        return NAN;
+    }
+
+    bool asctime = false;
+    if (isAlpha(*c.p)) {
+        // The day of the week, or in the asctime form possibly just the month.
+        Cursor start = c;
+        int len;
+        char fourth;
+        uint32_t key = readWord(&c, &len, &fourth);
+        if (indexOfKey(kWeekdays, 7, key) < 0) {
+            c = start;
+        }
+        else {
+            skipCFWS(&c);
+            if (c.p < c.end && *c.p == ',') {
+                c.p++;
+                skipCFWS(&c);
+            }
+        }
+        if (c.p < c.end && isAlpha(*c.p)) {
+            month = readMonth(&c);
+            if (month == 0) {
+                return NAN;
+            }
+            asctime = true;
+        }
+    }
+
+    if (asctime) {
+        // Mon DD hh:mm:ss YYYY [zone]
+        skipCFWS(&c);
+        if (!readNumber(&c, 1, 2, &day)) {
+            return NAN;
+        }
+        skipCFWS(&c);
+        if (!readTime(&c, &hour, &minute, &second)) {
+            return NAN;
+        }
+        skipCFWS(&c);
+        if (c.p < c.end && !isDigit(*c.p)) {
+            // Some write the zone before the year.
+            if (!readZone(&c, &zone)) {
+                return NAN;
+            }
+            skipCFWS(&c);
+        }
+        if (!(yearDigits = readNumber(&c, 2, 4, &year))) {
+            return NAN;
+        }
+    }
+    else {
+        // DD Mon YYYY hh:mm:ss [zone]
+        if (!readNumber(&c, 1, 2, &day)) {
+            return NAN;
+        }
+        skipCFWS(&c);
+        month = readMonth(&c);
+        if (month == 0) {
+            return NAN;
+        }
+        skipCFWS(&c);
+        if (!(yearDigits = readNumber(&c, 2, 4, &year))) {
+            return NAN;
+        }
+        skipCFWS(&c);
+        if (!readTime(&c, &hour, &minute, &second)) {
+            return NAN;
+        }
+    }
+
+    skipCFWS(&c);
+    if (!readZone(&c, &zone)) {
+        return NAN;
+    }
+    skipCFWS(&c);
+    if (c.p != c.end) {
+        return NAN;
+    }
+
+    year = fixYear(year, yearDigits);
+    if (day < 1 || day > daysInMonth(year, month)) {
+        return NAN;
+    }
+    int64_t t = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - zone * 60;
+    return (double)t;
+}
+
+
+double RFC2822ParseDate(const char* dateStr) {
+    return RFC2822ParseDateWithLength(dateStr, strlen(dateStr));
+}
+
+
+void RFC2822ParseDates(const char* const* dateStrs, size_t count, double* results) {
+    for (size_t i = 0; i < count; i++) {
+        results[i] = (dateStrs[i] == NULL ? NAN : RFC2822ParseDate(dateStrs[i]));
+    }
+}
@@ -0,0 +1,39 @@
+//
+//  RFC2822Date.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/9/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#ifndef Tidbits_RFC2822Date_h
+#define Tidbits_RFC2822Date_h
+
+#include <stddef.h>
+
+/**
+ * Parses the date in an email header (RFC 5322 section 3.3, and RFC 2822 before it), e.g.
+ * "Tue, 1 Jul 2014 10:52:37 +0200 (CEST)".  Returns a UNIX timestamp (number of seconds since 1/1/1970), or NAN if
+ * the string is not valid.  This does not allocate.
+ *
+ * Besides the standard form, this accepts the obsolete and malformed variants that are common in real mail:
+ * - the day of the week is optional, and is not checked against the date;
+ * - month and day names may be written in full, and in any case;
+ * - two-digit years (00-49 are 20xx, 50-99 are 19xx) and three-digit years (+1900);
+ * - seconds are optional, and the hour may be a single digit;
+ * - the zone may be +hhmm, +hh:mm, or +hh, the obsolete names (UT, GMT, EST, PDT etc.), a handful of other common
+ *   abbreviations (CET, CEST, BST, JST etc.), GMT+hhmm, or missing.  Military zones and unknown names are taken to
+ *   be UTC, as RFC 5322 says;
+ * - the asctime form, "Tue Jul  1 10:52:37 2014", optionally followed by a zone;
+ * - comments in parentheses, and folding whitespace, anywhere between the parts.
+ */
+double RFC2822ParseDate(const char* dateStr);
+
+/** As RFC2822ParseDate, for a string that is not NUL-terminated, e.g. a header value inside a larger buffer. */
+double RFC2822ParseDateWithLength(const char* dateStr, size_t length);
+
+/** Parses count C strings with RFC2822ParseDate, writing the results into the results array.
+    NULL entries give NAN. */
+void RFC2822ParseDates(const char* const* dateStrs, size_t count, double* results);
+
+#endif
@@ -0,0 +1,86 @@
+//
+//  StringPool.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/28/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * The hash used by StringPool.  This is FNV-1a over the UTF-16 code units of the string, so the same string
+ * gets the same hash whichever of these functions is used.  Parsers can compute this incrementally as they scan
+ * and then pass it to -[StringPool internUTF8:length:hash:].
+ *
+ * StringPoolHashUTF8 returns an arbitrary value if bytes is not valid UTF-8; the subsequent intern call will then
+ * return nil.
+ */
+extern uint32_t StringPoolHashUTF8(const char * bytes, NSUInteger length);
+extern uint32_t StringPoolHashCharacters(const unichar * chars, NSUInteger length);
+extern uint32_t StringPoolHashString(NSString * s);
+
+
+/**
+ * A thread-safe pool of canonical immutable strings, for identifiers that are seen over and over again, such as
+ * Breadcrumb tags, JSON keys, and TBUserDefaults setting keys.
+ *
+ * Every call to intern... with equal contents returns the same NSString instance, for as long as that string
+ * is in the pool, so callers may compare interned strings by pointer first.  If the pool has a countLimit, then
+ * strings may be evicted, after which a new instance will be returned; a pointer comparison must therefore only
+ * ever be used as a fast path in front of -isEqualToString:.
+ *
+ * The pool is split into shards by hash, each with its own lock, so that concurrent callers rarely contend.
+ * Eviction is approximately least-recently-used (the CLOCK algorithm), per shard.
+ */
+@interface StringPool : NSObject
+
+/**
+ * A pool shared by Tidbits, with a countLimit of 16384.
+ */
++(StringPool *)sharedPool;
+
+/**
+ * Equivalent to initWithCountLimit:0.
+ */
+-(instancetype)init;
+
+/**
+ * @param countLimit The maximum number of strings to hold, or 0 for no limit.
+ */
+-(instancetype)initWithCountLimit:(NSUInteger)countLimit;
+
+@property (nonatomic, readonly) NSUInteger countLimit;
+
+/**
+ * The number of strings in the pool right now.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ * The number of bytes used by the pool's hash tables, not including the strings themselves.
+ */
+@property (nonatomic, readonly) NSUInteger tableSize;
+
+/**
+ * @return The canonical instance equal to s, or nil if s is nil.  If s is immutable and not already in the pool,
+ * then s itself becomes the canonical instance.
+ */
+-(NSString *)intern:(NSString *)s;
+
+/**
+ * @param hash Must be StringPoolHashUTF8(bytes, length).
+ * @return The canonical instance for the given UTF-8 bytes, or nil if they are not valid UTF-8.
+ */
+-(NSString *)internUTF8:(const char *)bytes length:(NSUInteger)length hash:(uint32_t)hash;
+
+/**
+ * @param hash Must be StringPoolHashCharacters(chars, length).
+ * @return The canonical instance for the given characters.
+ */
+-(NSString *)internCharacters:(const unichar *)chars length:(NSUInteger)length hash:(uint32_t)hash;
+
+-(void)removeAllObjects;
+
+@end
@@ -0,0 +1,536 @@
+//
+//  StringPool.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/28/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <pthread.h>
+
+#import "StringPool.h"
+
+
+#define SHARD_BITS 4
+#define SHARD_COUNT (1 << SHARD_BITS)
+#define INITIAL_SHARD_CAPACITY 64
+#define SHARED_POOL_COUNT_LIMIT 16384
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+
+typedef struct {
+    // Retained.  NULL if this slot is empty.
+    CFStringRef string;
+    uint32_t hash;
+    // Set whenever this entry is used, and cleared as the clock hand passes over it.
+    uint32_t referenced;
+} PoolEntry;
+
+
+typedef struct {
+    pthread_mutex_t lock;
+    // Open addressing, linear probing.  capacity is a power of two, and 0 until the first insert.
+    PoolEntry * entries;
+    NSUInteger capacity;
+    NSUInteger count;
+    NSUInteger clockHand;
+} PoolShard;
+
+
+typedef enum {
+    MatchString,
+    MatchCharacters,
+    MatchUTF8,
+} MatchKind;
+
+
+static inline uint32_t fnvStep(uint32_t hash, unichar c) {
+    return (hash ^ c) * FNV_PRIME;
+}
+
+
+/**
+ * Decode the UTF-8 sequence at bytes[*i], advancing *i past it.
+ *
+ * @return The code point, or UINT32_MAX if the sequence is invalid.
+ */
+static inline uint32_t nextCodePoint(const uint8_t * bytes, NSUInteger length, NSUInteger * i) {
+    uint8_t b = bytes[(*i)++];
+    if (b < 0x80) {
+        return b;
+    }
+
+    NSUInteger extra;
+    uint32_t cp;
+    uint32_t min;
+    if ((b & 0xE0) == 0xC0) {
+        extra = 1;
+        cp = b & 0x1F;
+        min = 0x80;
+    }
+    else if ((b & 0xF0) == 0xE0) {
+        extra = 2;
+        cp = b & 0x0F;
+        min = 0x800;
+    }
+    else if ((b & 0xF8) == 0xF0) {
+        extra = 3;
+        cp = b & 0x07;
+        min = 0x10000;
+    }
+    else {
+        return UINT32_MAX;
+    }
+
+    if (*i + extra > length) {
+        return UINT32_MAX;
+    }
+    for (NSUInteger j = 0; j < extra; j++) {
+        uint8_t cont = bytes[(*i)++];
+        if ((cont & 0xC0) != 0x80) {
+            return UINT32_MAX;
+        }
+        cp = (cp << 6) | (cont & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        return UINT32_MAX;
+    }
+    return cp;
+}
+
+
+uint32_t StringPoolHashUTF8(const char * bytes, NSUInteger length) {
+    const uint8_t * b = (const uint8_t *)bytes;
+    uint32_t hash = FNV_OFFSET_BASIS;
+    NSUInteger i = 0;
+    while (i < length) {
+        if (b[i] < 0x80) {
+            hash = fnvStep(hash, b[i++]);
+            continue;
+        }
+        uint32_t cp = nextCodePoint(b, length, &i);
+        if (cp == UINT32_MAX) {
+            return hash;
+        }
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            hash = fnvStep(hash, (unichar)(0xD800 + (cp >> 10)));
+            hash = fnvStep(hash, (unichar)(0xDC00 + (cp & 0x3FF)));
+        }
+        else {
+            hash = fnvStep(hash, (unichar)cp);
+        }
+    }
+    return hash;
+}
+
+
+uint32_t StringPoolHashCharacters(const unichar * chars, NSUInteger length) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (NSUInteger i = 0; i < length; i++) {
+        hash = fnvStep(hash, chars[i]);
+    }
+    return hash;
+}
+
+
+uint32_t StringPoolHashString(NSString * s) {
+    CFStringRef cf = (__bridge CFStringRef)s;
+    CFIndex len = CFStringGetLength(cf);
+    CFStringInlineBuffer buf;
+    CFStringInitInlineBuffer(cf, &buf, CFRangeMake(0, len));
+
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (CFIndex i = 0; i < len; i++) {
+        hash = fnvStep(hash, CFStringGetCharacterFromInlineBuffer(&buf, i));
+    }
+    return hash;
+}
+
+
+static BOOL equalsCharacters(CFStringRef s, const unichar * chars, NSUInteger length) {
+    if ((NSUInteger)CFStringGetLength(s) != length) {
+        return NO;
+    }
+    const UniChar * ptr = CFStringGetCharactersPtr(s);
+    if (ptr != NULL) {
+        return 0 == memcmp(ptr, chars, length * sizeof(unichar));
+    }
+
+    CFStringInlineBuffer buf;
+    CFStringInitInlineBuffer(s, &buf, CFRangeMake(0, (CFIndex)length));
+    for (NSUInteger i = 0; i < length; i++) {
+        if (CFStringGetCharacterFromInlineBuffer(&buf, (CFIndex)i) != chars[i]) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+
+static BOOL equalsUTF8(CFStringRef s, const uint8_t * bytes, NSUInteger length) {
+    CFIndex slen = CFStringGetLength(s);
+
+    // A non-NULL pointer here means that s is stored as ASCII, so it's one byte per character.
+    const char * ptr = CFStringGetCStringPtr(s, kCFStringEncodingUTF8);
+    if (ptr != NULL) {
+        return (NSUInteger)slen == length && 0 == memcmp(ptr, bytes, length);
+    }
+
+    if ((NSUInteger)slen > length) {
+        return NO;
+    }
+
+    CFStringInlineBuffer buf;
+    CFStringInitInlineBuffer(s, &buf, CFRangeMake(0, slen));
+    CFIndex j = 0;
+    NSUInteger i = 0;
+    while (i < length) {
+        uint32_t cp = nextCodePoint(bytes, length, &i);
+        if (cp == UINT32_MAX) {
+            return NO;
+        }
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            if (j + 2 > slen ||
+                CFStringGetCharacterFromInlineBuffer(&buf, j) != 0xD800 + (cp >> 10) ||
+                CFStringGetCharacterFromInlineBuffer(&buf, j + 1) != 0xDC00 + (cp & 0x3FF)) {
+                return NO;
+            }
+            j += 2;
+        }
+        else {
+            if (j >= slen || CFStringGetCharacterFromInlineBuffer(&buf, j) != cp) {
+                return NO;
+            }
+            j++;
+        }
+    }
+    return j == slen;
+}
+
+
+static inline BOOL entryMatches(const PoolEntry * entry, uint32_t hash, MatchKind kind, const void * key, NSUInteger length) {
+    if (entry->hash != hash) {
+        return NO;
+    }
+    switch (kind) {
+        case MatchString:
+            return CFEqual(entry->string, (CFStringRef)key);
+        case MatchCharacters:
+            return equalsCharacters(entry->string, key, length);
+        case MatchUTF8:
+            return equalsUTF8(entry->string, key, length);
+    }
+    return NO;
+}
+
+
+/**
+ * Must be called under shard->lock.
+ *
+ * @return The matching string, retained, or NULL.
+ */
+static CFStringRef findEntry(PoolShard * shard, uint32_t hash, MatchKind kind, const void * key, NSUInteger length) {
+    if (shard->capacity == 0) {
+        return NULL;
+    }
+
+    NSUInteger mask = shard->capacity - 1;
+    for (NSUInteger i = hash & mask; shard->entries[i].string != NULL; i = (i + 1) & mask) {
+        PoolEntry * entry = &shard->entries[i];
+        if (entryMatches(entry, hash, kind, key, length)) {
+            entry->referenced = 1;
+            return CFRetain(entry->string);
+        }
+    }
+    return NULL;
+}
+
+
+static void putEntry(PoolEntry * entries, NSUInteger capacity, CFStringRef string, uint32_t hash, uint32_t referenced) {
+    NSUInteger mask = capacity - 1;
+    NSUInteger i = hash & mask;
+    while (entries[i].string != NULL) {
+        i = (i + 1) & mask;
+    }
+    entries[i].string = string;
+    entries[i].hash = hash;
+    entries[i].referenced = referenced;
+}
+
+
+/**
+ * Must be called under shard->lock.  Keeps the load factor at or below 3/4.
+ */
+static void growIfNeeded(PoolShard * shard) {
+    if (4 * (shard->count + 1) <= 3 * shard->capacity) {
+        return;
+    }
+
+    NSUInteger capacity = (shard->capacity == 0 ? INITIAL_SHARD_CAPACITY : 2 * shard->capacity);
+    PoolEntry * entries = calloc(capacity, sizeof(PoolEntry));
+    if (entries == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate StringPool shard"];
+    }
+    for (NSUInteger i = 0; i < shard->capacity; i++) {
+        PoolEntry * old = &shard->entries[i];
+        if (old->string != NULL) {
+            putEntry(entries, capacity, old->string, old->hash, old->referenced);
+        }
+    }
+
+    free(shard->entries);
+    shard->entries = entries;
+    shard->capacity = capacity;
+    shard->clockHand = 0;
+}
+
+
+/**
+ * Must be called under shard->lock.  Removes the entry at index i, shifting later entries in the same probe
+ * sequence back so that no tombstone is needed.
+ *
+ * @return The removed string, which the caller must release.
+ */
+static CFStringRef removeEntry(PoolShard * shard, NSUInteger i) {
+    PoolEntry * entries = shard->entries;
+    NSUInteger mask = shard->capacity - 1;
+    CFStringRef removed = entries[i].string;
+
+    NSUInteger j = i;
+    while (YES) {
+        j = (j + 1) & mask;
+        if (entries[j].string == NULL) {
+            break;
+        }
+        // k is where entries[j] would ideally be.  It can move back to i unless k lies cyclically in (i, j].
+        NSUInteger k = entries[j].hash & mask;
+        BOOL stays = (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        if (!stays) {
+            entries[i] = entries[j];
+            i = j;
+        }
+    }
+    entries[i].string = NULL;
+    entries[i].referenced = 0;
+    shard->count--;
+    return removed;
+}
+
+
+/**
+ * Must be called under shard->lock, with shard->count > 0.
+ *
+ * @return The evicted string, which the caller must release.
+ */
+static CFStringRef evictOne(PoolShard * shard) {
+    NSUInteger mask = shard->capacity - 1;
+    while (YES) {
+        NSUInteger i = shard->clockHand;
+        shard->clockHand = (i + 1) & mask;
+        PoolEntry * entry = &shard->entries[i];
+        if (entry->string == NULL) {
+            continue;
+        }
+        if (entry->referenced) {
+            entry->referenced = 0;
+            continue;
+        }
+        return removeEntry(shard, i);
+    }
+}
+
+
+@implementation StringPool
+{
+    PoolShard shards[SHARD_COUNT];
+
+    // 0 for unlimited.
+    NSUInteger shardCountLimit;
+}
+
+
++(StringPool *)sharedPool {
+    static StringPool * instance;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        instance = [[StringPool alloc] initWithCountLimit:SHARED_POOL_COUNT_LIMIT];
+    });
+    return instance;
+}
+
+
+-(instancetype)init {
+    return [self initWithCountLimit:0];
+}
+
+
+-(instancetype)initWithCountLimit:(NSUInteger)countLimit {
+    self = [super init];
+    if (self) {
+        _countLimit = countLimit;
+        shardCountLimit = (countLimit == 0 ? 0 : MAX(1, (countLimit + SHARD_COUNT - 1) / SHARD_COUNT));
+        for (NSUInteger i = 0; i < SHARD_COUNT; i++) {
+            pthread_mutex_init(&shards[i].lock, NULL);
+        }
+    }
+    return self;
+}
+
+
+-(void)dealloc {
+    for (NSUInteger i = 0; i < SHARD_COUNT; i++) {
+        [self clearShard:&shards[i]];
+        pthread_mutex_destroy(&shards[i].lock);
+    }
+}
+
+
+-(NSUInteger)count {
+    NSUInteger result = 0;
+    for (NSUInteger i = 0; i < SHARD_COUNT; i++) {
+        PoolShard * shard = &shards[i];
+        pthread_mutex_lock(&shard->lock);
+        result += shard->count;
+        pthread_mutex_unlock(&shard->lock);
+    }
+    return result;
+}
+
+
+-(NSUInteger)tableSize {
+    NSUInteger result = 0;
+    for (NSUInteger i = 0; i < SHARD_COUNT; i++) {
+        PoolShard * shard = &shards[i];
+        pthread_mutex_lock(&shard->lock);
+        result += shard->capacity * sizeof(PoolEntry);
+        pthread_mutex_unlock(&shard->lock);
+    }
+    return result;
+}
+
+
+-(NSString *)intern:(NSString *)s {
+    if (s == nil) {
+        return nil;
+    }
+
+    CFStringRef cf = (__bridge CFStringRef)s;
+    uint32_t hash = StringPoolHashString(s);
+    PoolShard * shard = [self shardForHash:hash];
+
+    pthread_mutex_lock(&shard->lock);
+    CFStringRef result = findEntry(shard, hash, MatchString, cf, 0);
+    pthread_mutex_unlock(&shard->lock);
+    if (result != NULL) {
+        return CFBridgingRelease(result);
+    }
+
+    // CFStringCreateCopy just retains s if it is already immutable.
+    return CFBridgingRelease([self insert:CFStringCreateCopy(NULL, cf) hash:hash shard:shard]);
+}
+
+
+-(NSString *)internUTF8:(const char *)bytes length:(NSUInteger)length hash:(uint32_t)hash {
+    PoolShard * shard = [self shardForHash:hash];
+
+    pthread_mutex_lock(&shard->lock);
+    CFStringRef result = findEntry(shard, hash, MatchUTF8, bytes, length);
+    pthread_mutex_unlock(&shard->lock);
+    if (result != NULL) {
+        return CFBridgingRelease(result);
+    }
+
+    CFStringRef candidate = CFStringCreateWithBytes(NULL, (const UInt8 *)bytes, (CFIndex)length, kCFStringEncodingUTF8, false);
+    if (candidate == NULL) {
+        return nil;
+    }
+    return CFBridgingRelease([self insert:candidate hash:hash shard:shard]);
+}
+
+
+-(NSString *)internCharacters:(const unichar *)chars length:(NSUInteger)length hash:(uint32_t)hash {
+    PoolShard * shard = [self shardForHash:hash];
+
+    pthread_mutex_lock(&shard->lock);
+    CFStringRef result = findEntry(shard, hash, MatchCharacters, chars, length);
+    pthread_mutex_unlock(&shard->lock);
+    if (result != NULL) {
+        return CFBridgingRelease(result);
+    }
+
+    CFStringRef candidate = CFStringCreateWithCharacters(NULL, chars, (CFIndex)length);
+    return CFBridgingRelease([self insert:candidate hash:hash shard:shard]);
+}
+
+
+-(void)removeAllObjects {
+    for (NSUInteger i = 0; i < SHARD_COUNT; i++) {
+        [self clearShard:&shards[i]];
+    }
+}
+
+
+-(PoolShard *)shardForHash:(uint32_t)hash {
+    // The low bits pick the slot within the shard, so use the high bits to pick the shard.
+    return &shards[hash >> (32 - SHARD_BITS)];
+}
+
+
+/**
+ * The candidate was created outside the lock, so another thread may have inserted an equal string in the meantime;
+ * if so, that one wins and candidate is released.
+ *
+ * @param candidate Retained; ownership passes to this method.
+ * @return The canonical string, retained.
+ */
+-(CFStringRef)insert:(CFStringRef)candidate hash:(uint32_t)hash shard:(PoolShard *)shard {
+    CFStringRef evicted = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+    CFStringRef result = findEntry(shard, hash, MatchString, candidate, 0);
+    if (result == NULL) {
+        if (shardCountLimit != 0 && shard->count >= shardCountLimit) {
+            evicted = evictOne(shard);
+        }
+        growIfNeeded(shard);
+        // New entries start unreferenced, so that a one-off is evicted ahead of anything that has been used twice.
+        putEntry(shard->entries, shard->capacity, candidate, hash, 0);
+        shard->count++;
+        result = CFRetain(candidate);
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (result != candidate) {
+        CFRelease(candidate);
+    }
+    if (evicted != NULL) {
+        CFRelease(evicted);
+    }
+    return result;
+}
+
+
+-(void)clearShard:(PoolShard *)shard {
+    pthread_mutex_lock(&shard->lock);
+    PoolEntry * entries = shard->entries;
+    NSUInteger capacity = shard->capacity;
+    shard->entries = NULL;
+    shard->capacity = 0;
+    shard->count = 0;
+    shard->clockHand = 0;
+    pthread_mutex_unlock(&shard->lock);
+
+    for (NSUInteger i = 0; i < capacity; i++) {
+        if (entries[i].string != NULL) {
+            CFRelease(entries[i].string);
+        }
+    }
+    free(entries);
+}
+
+
+@end
@@ -13,6 +13,7 @@
 #import "GTMNSString+URLArguments.h"
 #import "LoggingMacros.h"
 #import "NSDictionary+Map.h"
+#import "StringPool.h"
 
 #import "TBUserDefaults.h"
 
@@ -133,6 +134,7 @@ static NSString* preferencesDir;
 
 
 +(void)registerSetting:(NSString *)key type:(NSString *)type protection:(NSString *)protection defaultValue:(id)def __attribute__((nonnull)) {
+    key = [[StringPool sharedPool] intern:key];
     @synchronized (protectionsByKey) {
         typesByKey[key] = type;
         protectionsByKey[key] = protection;
@@ -468,7 +470,7 @@ static id valueFromString(NSString * value, NSString * type) {
             result = NO;
         }
         else {
-            settings[key] = value;
+            settings[[[StringPool sharedPool] intern:key]] = value;
             result = YES;
         }
     }
@@ -514,7 +516,7 @@ static id valueFromString(NSString * value, NSString * type) {
 
     NSFileManager* nsfm = [[NSFileManager alloc] init];
     if ([nsfm fileExistsAtPath:defPath]) {
-        NSMutableDictionary* settings = [NSMutableDictionary dictionaryWithContentsOfFile:defPath];
+        NSMutableDictionary* settings = internKeys([NSMutableDictionary dictionaryWithContentsOfFile:defPath]);
         if (settings == nil) {
             settings = [NSMutableDictionary dictionary];
         }
@@ -542,6 +544,23 @@ static id valueFromString(NSString * value, NSString * type) {
 }
 
 
+/**
+ * The plist gives us a fresh copy of every key, each time it's loaded.  Replace them with the interned ones, which
+ * are shared with the registered settings (and so with every other user's settings too).
+ */
+static NSMutableDictionary * internKeys(NSDictionary * dict) {
+    if (dict == nil) {
+        return nil;
+    }
+    StringPool * pool = [StringPool sharedPool];
+    NSMutableDictionary * result = [NSMutableDictionary dictionaryWithCapacity:dict.count];
+    [dict enumerateKeysAndObjectsUsingBlock:^(id key, id obj, __unused BOOL * stop) {
+        result[[key isKindOfClass:[NSString class]] ? [pool intern:key] : key] = obj;
+    }];
+    return result;
+}
+
+
 -(BOOL)savePlist:(NSString*)protection settings:(NSDictionary*)settings __attribute__((nonnull)) {
     NSParameterAssert(protection);
     NSParameterAssert(settings);
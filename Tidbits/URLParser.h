@@ -0,0 +1,77 @@
+//
+//  URLParser.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/26/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * The component ranges of a URI reference, as defined by RFC 3986:
+ *
+ *     scheme ":" [ "//" [ userinfo "@" ] host [ ":" port ] ] path [ "?" query ] [ "#" fragment ]
+ *
+ * The delimiters are not included in the ranges.  A component that is absent has location NSNotFound;
+ * one that is present but empty (e.g. the query in "http://a/b?") has its location set and length 0.
+ * path is always present, though it may be empty.  host is present if and only if the URL has an authority
+ * part.  For an IP-literal host, the brackets are included in the host range.
+ */
+typedef struct {
+    NSRange scheme;
+    NSRange userinfo;
+    NSRange host;
+    NSRange port;
+    NSRange path;
+    NSRange query;
+    NSRange fragment;
+} URLRanges;
+
+
+/**
+ * Parse the given URL string in a single pass, without allocating.
+ *
+ * This doesn't validate the URL.  Any string can be split into components per RFC 3986 Appendix B, and that's
+ * all this does.  If the string doesn't start with a valid scheme then it is treated as a relative reference.
+ *
+ * @return NO if url is nil, YES otherwise.
+ */
+extern BOOL parseURLRanges(NSString * url, URLRanges * ranges) __attribute__((nonnull(2)));
+
+
+/**
+ * @return The substring of url for the given range, or nil if range.location is NSNotFound.
+ */
+static inline NSString * URLComponent(NSString * url, NSRange range) {
+    return range.location == NSNotFound ? nil : [url substringWithRange:range];
+}
+
+
+/**
+ * @return YES if any character in the given range of url would need to be percent-encoded in a path or query,
+ * i.e. is non-ASCII, a control character, a space, or one of "<>\"{}|\\^`[]".  '%' is assumed to be an existing
+ * escape and is left alone.  Returns NO if range.location is NSNotFound.
+ */
+extern BOOL URLRangeNeedsPercentEncoding(NSString * url, NSRange range);
+
+/**
+ * @return YES if the given range of url contains a '%'.  Returns NO if range.location is NSNotFound.
+ */
+extern BOOL URLRangeHasPercentEscapes(NSString * url, NSRange range);
+
+/**
+ * @return YES if the given range of url contains a non-ASCII character.  Returns NO if range.location is NSNotFound.
+ */
+extern BOOL URLRangeHasNonASCII(NSString * url, NSRange range);
+
+/**
+ * Percent-encode the characters in the given range of url that need it (see URLRangeNeedsPercentEncoding),
+ * using UTF-8, and write the result to dest.
+ *
+ * @param dest Must have space for at least 9 * range.length characters, which is the worst case
+ * (a character above U+07FF becomes three %XX escapes).
+ * @return The number of characters written to dest.
+ */
+extern NSUInteger URLPercentEncodeRange(NSString * url, NSRange range, unichar * dest) __attribute__((nonnull(3)));
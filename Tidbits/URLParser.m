@@ -0,0 +1,261 @@
+//
+//  URLParser.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/26/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "URLParser.h"
+
+
+static const NSRange NotFound = { NSNotFound, 0 };
+
+
+/**
+ * 1 for each ASCII character that may appear unescaped in a path or query: RFC 3986 unreserved, sub-delims,
+ * ":", "@", "/", "?", plus "%" because we assume that it is already part of an escape.
+ */
+static const uint8_t urlSafe[128] = {
+    ['a' ... 'z'] = 1,
+    ['A' ... 'Z'] = 1,
+    ['0' ... '9'] = 1,
+    ['-'] = 1, ['.'] = 1, ['_'] = 1, ['~'] = 1,
+    ['!'] = 1, ['$'] = 1, ['&'] = 1, ['\''] = 1, ['('] = 1, [')'] = 1,
+    ['*'] = 1, ['+'] = 1, [','] = 1, [';'] = 1, ['='] = 1,
+    [':'] = 1, ['@'] = 1, ['/'] = 1, ['?'] = 1,
+    ['%'] = 1,
+};
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+
+static inline BOOL isAlpha(unichar c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+
+static inline BOOL isSchemeChar(unichar c) {
+    return isAlpha(c) || (c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.';
+}
+
+
+BOOL parseURLRanges(NSString * url, URLRanges * ranges) {
+    ranges->scheme = NotFound;
+    ranges->userinfo = NotFound;
+    ranges->host = NotFound;
+    ranges->port = NotFound;
+    ranges->path = NotFound;
+    ranges->query = NotFound;
+    ranges->fragment = NotFound;
+
+    if (url == nil) {
+        return NO;
+    }
+
+    CFIndex len = CFStringGetLength((__bridge CFStringRef)url);
+    CFStringInlineBuffer buf;
+    CFStringInitInlineBuffer((__bridge CFStringRef)url, &buf, CFRangeMake(0, len));
+
+    CFIndex pos = 0;
+
+    // scheme = ALPHA *( ALPHA / DIGIT / "+" / "-" / "." ), followed by ':'.
+    if (len > 0 && isAlpha(CFStringGetCharacterFromInlineBuffer(&buf, 0))) {
+        CFIndex i = 1;
+        unichar c = 0;
+        while (i < len && isSchemeChar(c = CFStringGetCharacterFromInlineBuffer(&buf, i))) {
+            i++;
+        }
+        if (i < len && c == ':') {
+            ranges->scheme = NSMakeRange(0, i);
+            pos = i + 1;
+        }
+    }
+
+    // authority = [ userinfo "@" ] host [ ":" port ], introduced by "//" and terminated by '/', '?', '#' or the end.
+    if (pos + 1 < len &&
+        CFStringGetCharacterFromInlineBuffer(&buf, pos) == '/' &&
+        CFStringGetCharacterFromInlineBuffer(&buf, pos + 1) == '/') {
+        pos += 2;
+        CFIndex hostStart = pos;
+        CFIndex colon = -1;
+        BOOL inBrackets = NO;
+        while (pos < len) {
+            unichar c = CFStringGetCharacterFromInlineBuffer(&buf, pos);
+            if (c == '/' || c == '?' || c == '#') {
+                break;
+            }
+            else if (c == '@') {
+                // Everything so far was userinfo.  An '@' inside userinfo isn't legal, so the last one wins.
+                ranges->userinfo = NSMakeRange(hostStart, pos - hostStart);
+                hostStart = pos + 1;
+                colon = -1;
+                inBrackets = NO;
+            }
+            else if (c == '[' && pos == hostStart) {
+                inBrackets = YES;
+            }
+            else if (c == ']') {
+                inBrackets = NO;
+            }
+            else if (c == ':' && colon == -1 && !inBrackets) {
+                colon = pos;
+            }
+            pos++;
+        }
+
+        if (colon == -1) {
+            ranges->host = NSMakeRange(hostStart, pos - hostStart);
+        }
+        else {
+            ranges->host = NSMakeRange(hostStart, colon - hostStart);
+            ranges->port = NSMakeRange(colon + 1, pos - colon - 1);
+        }
+    }
+
+    CFIndex pathStart = pos;
+    while (pos < len) {
+        unichar c = CFStringGetCharacterFromInlineBuffer(&buf, pos);
+        if (c == '?' || c == '#') {
+            break;
+        }
+        pos++;
+    }
+    ranges->path = NSMakeRange(pathStart, pos - pathStart);
+
+    if (pos < len && CFStringGetCharacterFromInlineBuffer(&buf, pos) == '?') {
+        pos++;
+        CFIndex queryStart = pos;
+        while (pos < len && CFStringGetCharacterFromInlineBuffer(&buf, pos) != '#') {
+            pos++;
+        }
+        ranges->query = NSMakeRange(queryStart, pos - queryStart);
+    }
+
+    if (pos < len) {
+        // Must be '#'.
+        ranges->fragment = NSMakeRange(pos + 1, len - pos - 1);
+    }
+
+    return YES;
+}
+
+
+typedef enum {
+    ScanForUnsafe,
+    ScanForPercent,
+    ScanForNonASCII,
+} ScanMode;
+
+
+static inline BOOL matches(ScanMode mode, unichar c) {
+    switch (mode) {
+        case ScanForUnsafe:
+            return c >= 128 || !urlSafe[c];
+        case ScanForPercent:
+            return c == '%';
+        case ScanForNonASCII:
+            return c >= 128;
+    }
+    return NO;
+}
+
+
+/**
+ * @return YES as soon as we find a character in the given range that matches the given mode.
+ */
+static BOOL anyCharInRange(NSString * url, NSRange range, ScanMode mode) {
+    if (range.location == NSNotFound || range.length == 0) {
+        return NO;
+    }
+
+    CFStringInlineBuffer buf;
+    CFStringInitInlineBuffer((__bridge CFStringRef)url, &buf, CFRangeMake(range.location, range.length));
+    for (CFIndex i = 0; i < (CFIndex)range.length; i++) {
+        if (matches(mode, CFStringGetCharacterFromInlineBuffer(&buf, i))) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+
+BOOL URLRangeNeedsPercentEncoding(NSString * url, NSRange range) {
+    return anyCharInRange(url, range, ScanForUnsafe);
+}
+
+
+BOOL URLRangeHasPercentEscapes(NSString * url, NSRange range) {
+    return anyCharInRange(url, range, ScanForPercent);
+}
+
+
+BOOL URLRangeHasNonASCII(NSString * url, NSRange range) {
+    return anyCharInRange(url, range, ScanForNonASCII);
+}
+
+
+static inline NSUInteger writeEscapedByte(unichar * dest, uint8_t b) {
+    dest[0] = '%';
+    dest[1] = hexDigits[b >> 4];
+    dest[2] = hexDigits[b & 0xF];
+    return 3;
+}
+
+
+NSUInteger URLPercentEncodeRange(NSString * url, NSRange range, unichar * dest) {
+    if (range.location == NSNotFound) {
+        return 0;
+    }
+
+    CFStringInlineBuffer buf;
+    CFStringInitInlineBuffer((__bridge CFStringRef)url, &buf, CFRangeMake(range.location, range.length));
+    CFIndex len = (CFIndex)range.length;
+
+    NSUInteger n = 0;
+    for (CFIndex i = 0; i < len; i++) {
+        unichar c = CFStringGetCharacterFromInlineBuffer(&buf, i);
+        if (c < 128) {
+            if (urlSafe[c]) {
+                dest[n++] = c;
+            }
+            else {
+                n += writeEscapedByte(dest + n, (uint8_t)c);
+            }
+            continue;
+        }
+
+        uint32_t cp = c;
+        if (CFStringIsSurrogateHighCharacter(c)) {
+            unichar c2 = (i + 1 < len ? CFStringGetCharacterFromInlineBuffer(&buf, i + 1) : 0);
+            if (CFStringIsSurrogateLowCharacter(c2)) {
+                cp = (uint32_t)CFStringGetLongCharacterForSurrogatePair(c, c2);
+                i++;
+            }
+            else {
+                cp = 0xFFFD;
+            }
+        }
+        else if (CFStringIsSurrogateLowCharacter(c)) {
+            cp = 0xFFFD;
+        }
+
+        if (cp < 0x800) {
+            n += writeEscapedByte(dest + n, (uint8_t)(0xC0 | (cp >> 6)));
+            n += writeEscapedByte(dest + n, (uint8_t)(0x80 | (cp & 0x3F)));
+        }
+        else if (cp < 0x10000) {
+            n += writeEscapedByte(dest + n, (uint8_t)(0xE0 | (cp >> 12)));
+            n += writeEscapedByte(dest + n, (uint8_t)(0x80 | ((cp >> 6) & 0x3F)));
+            n += writeEscapedByte(dest + n, (uint8_t)(0x80 | (cp & 0x3F)));
+        }
+        else {
+            n += writeEscapedByte(dest + n, (uint8_t)(0xF0 | (cp >> 18)));
+            n += writeEscapedByte(dest + n, (uint8_t)(0x80 | ((cp >> 12) & 0x3F)));
+            n += writeEscapedByte(dest + n, (uint8_t)(0x80 | ((cp >> 6) & 0x3F)));
+            n += writeEscapedByte(dest + n, (uint8_t)(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    return n;
+}
@@ -0,0 +1,96 @@
+//
+//  URLQueryString.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/27/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * Called once for each key=value argument in a query string.
+ *
+ * @param keyRange The range of the key in the query string, still escaped.
+ * @param valueRange The range of the value in the query string, still escaped, or location NSNotFound if the
+ * argument had no '='.
+ */
+typedef void (^URLQueryArgumentBlock)(NSRange keyRange, NSRange valueRange, BOOL * stop);
+
+
+/**
+ * Split query (of the form key1=value1&key2=value2&...&keyN=valueN) into arguments in a single pass, and call
+ * block for each one, in order.  Empty arguments (e.g. "a=1&&b=2") are skipped.  Nothing is unescaped or
+ * allocated; use URLQueryUnescapeRange on the ranges that you need.
+ */
+extern void enumerateURLQueryArguments(NSString * query, URLQueryArgumentBlock block);
+
+/**
+ * @return The given range of s, with '+' converted to space and percent escapes replaced, interpreting the
+ * escaped bytes as UTF-8.  This matches -[NSString gtm_stringByUnescapingFromURLArgument], and so returns nil if
+ * there is a malformed escape or the result is not valid UTF-8.  If there is nothing to unescape then this is
+ * just a substring.
+ */
+extern NSString * URLQueryUnescapeRange(NSString * s, NSRange range);
+
+/**
+ * @return s, with everything except RFC 3986 unreserved characters (ALPHA / DIGIT / "-" / "." / "_" / "~")
+ * percent-encoded as UTF-8.  This matches -[NSString gtm_stringByEscapingForURLArgument].
+ */
+extern NSString * URLQueryEscape(NSString * s);
+
+
+/**
+ * Builds a query string (or an application/x-www-form-urlencoded POST body) into a single growing UTF-8 buffer,
+ * escaping keys and values directly into the buffer using the same rules as URLQueryEscape.
+ *
+ * If initialized with an output stream, the buffer is written to the stream whenever it fills, so that large
+ * form bodies don't need to be held in memory.  The stream must already be open.
+ *
+ * This class is not thread-safe.
+ */
+@interface URLQueryStringBuilder : NSObject
+
+/**
+ * The error from the output stream, if a write has failed.  Once this is set, nothing more will be written.
+ */
+@property (nonatomic, readonly) NSError * streamError;
+
+/**
+ * The number of bytes appended so far, including any that have already been written to the output stream.
+ */
+@property (nonatomic, readonly) unsigned long long totalLength;
+
+-(instancetype)init;
+-(instancetype)initWithOutputStream:(NSOutputStream *)stream __attribute__((nonnull));
+
+/**
+ * Append "key=value", preceded by '&' if this is not the first argument.  value may be any object; its
+ * -description is used.
+ */
+-(void)appendKey:(NSString *)key value:(id)value __attribute__((nonnull));
+
+/**
+ * Append each key and value in dict, in the dictionary's enumeration order.
+ */
+-(void)appendDictionary:(NSDictionary *)dict __attribute__((nonnull));
+
+/**
+ * Write any buffered bytes to the output stream.  Does nothing if this builder has no output stream.
+ *
+ * @return NO if the write failed, in which case streamError is set.
+ */
+-(BOOL)flush;
+
+/**
+ * @return The query string built so far.  Only valid if this builder has no output stream.
+ */
+-(NSString *)string;
+
+/**
+ * @return The query string built so far, as ASCII bytes.  Only valid if this builder has no output stream.
+ */
+-(NSData *)data;
+
+@end
@@ -0,0 +1,398 @@
+//
+//  URLQueryString.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/27/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "URLQueryString.h"
+
+
+#define STACK_BUFFER_LENGTH 1024
+#define STREAM_FLUSH_THRESHOLD 16384
+
+
+/**
+ * 1 for each ASCII character that is left alone when escaping a query argument: the RFC 3986 unreserved set.
+ */
+static const uint8_t queryArgSafe[128] = {
+    ['a' ... 'z'] = 1,
+    ['A' ... 'Z'] = 1,
+    ['0' ... '9'] = 1,
+    ['-'] = 1, ['.'] = 1, ['_'] = 1, ['~'] = 1,
+};
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+
+typedef struct {
+    uint8_t * bytes;
+    NSUInteger length;
+    NSUInteger capacity;
+    // YES if bytes points at the caller's stack buffer, in which case it mustn't be realloc'd or freed.
+    BOOL onStack;
+} ByteBuffer;
+
+
+static void reserve(ByteBuffer * buf, NSUInteger extra) {
+    NSUInteger needed = buf->length + extra;
+    if (needed <= buf->capacity) {
+        return;
+    }
+
+    NSUInteger capacity = MAX(needed, 2 * buf->capacity);
+    uint8_t * bytes;
+    if (buf->onStack) {
+        bytes = malloc(capacity);
+        if (bytes != NULL) {
+            memcpy(bytes, buf->bytes, buf->length);
+        }
+    }
+    else {
+        bytes = realloc(buf->bytes, capacity);
+    }
+    if (bytes == NULL) {
+        [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)capacity];
+    }
+
+    buf->bytes = bytes;
+    buf->capacity = capacity;
+    buf->onStack = NO;
+}
+
+
+static void freeByteBuffer(ByteBuffer * buf) {
+    if (!buf->onStack) {
+        free(buf->bytes);
+    }
+}
+
+
+static inline void appendByte(ByteBuffer * buf, uint8_t b) {
+    reserve(buf, 1);
+    buf->bytes[buf->length++] = b;
+}
+
+
+static inline NSUInteger encodeUTF8(uint32_t cp, uint8_t * out) {
+    if (cp < 0x80) {
+        out[0] = (uint8_t)cp;
+        return 1;
+    }
+    else if (cp < 0x800) {
+        out[0] = (uint8_t)(0xC0 | (cp >> 6));
+        out[1] = (uint8_t)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    else if (cp < 0x10000) {
+        out[0] = (uint8_t)(0xE0 | (cp >> 12));
+        out[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (uint8_t)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    else {
+        out[0] = (uint8_t)(0xF0 | (cp >> 18));
+        out[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+        out[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        out[3] = (uint8_t)(0x80 | (cp & 0x3F));
+        return 4;
+    }
+}
+
+
+/**
+ * Read the code point at *i, advancing *i past a surrogate pair if necessary.  Unpaired surrogates become U+FFFD.
+ */
+static inline uint32_t codePointAt(CFStringInlineBuffer * inlineBuf, CFIndex * i, CFIndex len) {
+    unichar c = CFStringGetCharacterFromInlineBuffer(inlineBuf, *i);
+    if (CFStringIsSurrogateHighCharacter(c)) {
+        unichar c2 = (*i + 1 < len ? CFStringGetCharacterFromInlineBuffer(inlineBuf, *i + 1) : 0);
+        if (CFStringIsSurrogateLowCharacter(c2)) {
+            (*i)++;
+            return (uint32_t)CFStringGetLongCharacterForSurrogatePair(c, c2);
+        }
+        return 0xFFFD;
+    }
+    else if (CFStringIsSurrogateLowCharacter(c)) {
+        return 0xFFFD;
+    }
+    return c;
+}
+
+
+/**
+ * Escape s onto the end of buf.
+ *
+ * @return YES if any character needed escaping.
+ */
+static BOOL appendEscaped(ByteBuffer * buf, NSString * s) {
+    CFIndex len = CFStringGetLength((__bridge CFStringRef)s);
+    if (len == 0) {
+        return NO;
+    }
+
+    // Worst case is a BMP character above U+07FF: three UTF-8 bytes, each of which becomes %XX.
+    reserve(buf, 9 * (NSUInteger)len);
+
+    CFStringInlineBuffer inlineBuf;
+    CFStringInitInlineBuffer((__bridge CFStringRef)s, &inlineBuf, CFRangeMake(0, len));
+
+    uint8_t * p = buf->bytes + buf->length;
+    BOOL escaped = NO;
+    for (CFIndex i = 0; i < len; i++) {
+        unichar c = CFStringGetCharacterFromInlineBuffer(&inlineBuf, i);
+        if (c < 128 && queryArgSafe[c]) {
+            *p++ = (uint8_t)c;
+            continue;
+        }
+
+        escaped = YES;
+        uint8_t utf8[4];
+        NSUInteger n = encodeUTF8(codePointAt(&inlineBuf, &i, len), utf8);
+        for (NSUInteger j = 0; j < n; j++) {
+            *p++ = '%';
+            *p++ = hexDigits[utf8[j] >> 4];
+            *p++ = hexDigits[utf8[j] & 0xF];
+        }
+    }
+
+    buf->length = (NSUInteger)(p - buf->bytes);
+    return escaped;
+}
+
+
+NSString * URLQueryEscape(NSString * s) {
+    if (s == nil) {
+        return nil;
+    }
+
+    uint8_t stackBytes[STACK_BUFFER_LENGTH];
+    ByteBuffer buf = { stackBytes, 0, sizeof(stackBytes), YES };
+
+    NSString * result;
+    if (appendEscaped(&buf, s)) {
+        result = [[NSString alloc] initWithBytes:buf.bytes length:buf.length encoding:NSASCIIStringEncoding];
+    }
+    else {
+        result = [s copy];
+    }
+
+    freeByteBuffer(&buf);
+    return result;
+}
+
+
+static inline int hexValue(unichar c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    else {
+        return -1;
+    }
+}
+
+
+NSString * URLQueryUnescapeRange(NSString * s, NSRange range) {
+    CFIndex len = (CFIndex)range.length;
+    CFStringInlineBuffer inlineBuf;
+    CFStringInitInlineBuffer((__bridge CFStringRef)s, &inlineBuf, CFRangeMake((CFIndex)range.location, len));
+
+    CFIndex first = 0;
+    while (first < len) {
+        unichar c = CFStringGetCharacterFromInlineBuffer(&inlineBuf, first);
+        if (c == '%' || c == '+') {
+            break;
+        }
+        first++;
+    }
+    if (first == len) {
+        return [s substringWithRange:range];
+    }
+
+    uint8_t stackBytes[STACK_BUFFER_LENGTH];
+    ByteBuffer buf = { stackBytes, 0, sizeof(stackBytes), YES };
+    // Unescaping never expands, except that non-ASCII characters take up to three UTF-8 bytes per UTF-16 unit.
+    reserve(&buf, 3 * (NSUInteger)len);
+
+    uint8_t * p = buf.bytes;
+    BOOL malformed = NO;
+    for (CFIndex i = 0; i < len; i++) {
+        unichar c = CFStringGetCharacterFromInlineBuffer(&inlineBuf, i);
+        if (c == '+') {
+            *p++ = ' ';
+        }
+        else if (c == '%') {
+            int hi = (i + 2 < len ? hexValue(CFStringGetCharacterFromInlineBuffer(&inlineBuf, i + 1)) : -1);
+            int lo = (i + 2 < len ? hexValue(CFStringGetCharacterFromInlineBuffer(&inlineBuf, i + 2)) : -1);
+            if (hi < 0 || lo < 0) {
+                malformed = YES;
+                break;
+            }
+            *p++ = (uint8_t)((hi << 4) | lo);
+            i += 2;
+        }
+        else if (c < 0x80) {
+            *p++ = (uint8_t)c;
+        }
+        else {
+            p += encodeUTF8(codePointAt(&inlineBuf, &i, len), p);
+        }
+    }
+
+    NSString * result = nil;
+    if (!malformed) {
+        buf.length = (NSUInteger)(p - buf.bytes);
+        result = [[NSString alloc] initWithBytes:buf.bytes length:buf.length encoding:NSUTF8StringEncoding];
+    }
+
+    freeByteBuffer(&buf);
+    return result;
+}
+
+
+void enumerateURLQueryArguments(NSString * query, URLQueryArgumentBlock block) {
+    if (query == nil) {
+        return;
+    }
+
+    CFIndex len = CFStringGetLength((__bridge CFStringRef)query);
+    CFStringInlineBuffer inlineBuf;
+    CFStringInitInlineBuffer((__bridge CFStringRef)query, &inlineBuf, CFRangeMake(0, len));
+
+    CFIndex start = 0;
+    CFIndex equals = -1;
+    BOOL stop = NO;
+    for (CFIndex i = 0; i <= len && !stop; i++) {
+        unichar c = (i < len ? CFStringGetCharacterFromInlineBuffer(&inlineBuf, i) : '&');
+        if (c == '=' && equals == -1) {
+            equals = i;
+        }
+        else if (c == '&') {
+            if (i > start) {
+                if (equals == -1) {
+                    block(NSMakeRange((NSUInteger)start, (NSUInteger)(i - start)), NSMakeRange(NSNotFound, 0), &stop);
+                }
+                else {
+                    block(NSMakeRange((NSUInteger)start, (NSUInteger)(equals - start)),
+                          NSMakeRange((NSUInteger)equals + 1, (NSUInteger)(i - equals - 1)), &stop);
+                }
+            }
+            start = i + 1;
+            equals = -1;
+        }
+    }
+}
+
+
+@implementation URLQueryStringBuilder
+{
+    ByteBuffer buf;
+    NSOutputStream * stream;
+    unsigned long long flushedLength;
+    BOOL empty;
+}
+
+
+-(instancetype)init {
+    self = [super init];
+    if (self) {
+        empty = YES;
+    }
+    return self;
+}
+
+
+-(instancetype)initWithOutputStream:(NSOutputStream *)outputStream {
+    self = [self init];
+    if (self) {
+        stream = outputStream;
+    }
+    return self;
+}
+
+
+-(void)dealloc {
+    freeByteBuffer(&buf);
+}
+
+
+-(unsigned long long)totalLength {
+    return flushedLength + buf.length;
+}
+
+
+-(void)appendKey:(NSString *)key value:(id)value {
+    if (self.streamError != nil) {
+        return;
+    }
+
+    if (!empty) {
+        appendByte(&buf, '&');
+    }
+    empty = NO;
+
+    appendEscaped(&buf, key);
+    appendByte(&buf, '=');
+    appendEscaped(&buf, [value description]);
+
+    if (stream != nil && buf.length >= STREAM_FLUSH_THRESHOLD) {
+        [self flush];
+    }
+}
+
+
+-(void)appendDictionary:(NSDictionary *)dict {
+    [dict enumerateKeysAndObjectsUsingBlock:^(id key, id obj, __unused BOOL * stop) {
+        [self appendKey:[key description] value:obj];
+    }];
+}
+
+
+-(BOOL)flush {
+    if (stream == nil) {
+        return YES;
+    }
+    if (self.streamError != nil) {
+        return NO;
+    }
+
+    NSUInteger offset = 0;
+    while (offset < buf.length) {
+        NSInteger n = [stream write:buf.bytes + offset maxLength:buf.length - offset];
+        if (n <= 0) {
+            NSError * err = stream.streamError;
+            _streamError = (err != nil ? err : [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil]);
+            return NO;
+        }
+        offset += (NSUInteger)n;
+    }
+
+    flushedLength += buf.length;
+    buf.length = 0;
+    return YES;
+}
+
+
+-(NSString *)string {
+    NSAssert(stream == nil, @"string is not available when streaming");
+    if (buf.length == 0) {
+        return @"";
+    }
+    return [[NSString alloc] initWithBytes:buf.bytes length:buf.length encoding:NSASCIIStringEncoding];
+}
+
+
+-(NSData *)data {
+    NSAssert(stream == nil, @"data is not available when streaming");
+    return [NSData dataWithBytes:buf.bytes length:buf.length];
+}
+
+
+@end
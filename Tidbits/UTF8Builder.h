@@ -0,0 +1,103 @@
+//
+//  UTF8Builder.h
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/30/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+
+/**
+ * A growable UTF-8 byte buffer, for writers (JSON, logs, MIME) that build up output a piece at a time.
+ *
+ * Unlike NSMutableData+UTF8, nothing here goes through an intermediate NSString or NSData: printf-style
+ * formatting, integers, and floats are written directly into the tail of the buffer, and NSStrings are
+ * transcoded directly into it.  When you're done, -data hands the buffer over to an NSData without copying.
+ *
+ * This class is not thread-safe.
+ */
+@interface UTF8Builder : NSObject
+
+@property (nonatomic, readonly) NSUInteger length;
+
+/**
+ * The bytes written so far.  This pointer is invalidated by any subsequent append.  May be NULL if length is 0.
+ */
+@property (nonatomic, readonly) const uint8_t * bytes;
+
+-(instancetype)init;
+-(instancetype)initWithCapacity:(NSUInteger)capacity;
+
+-(void)appendByte:(uint8_t)b;
+-(void)appendBytes:(const void *)bytes length:(NSUInteger)length;
+-(void)appendCString:(const char *)s __attribute__((nonnull));
+
+/**
+ * Append s as UTF-8.  Unpaired surrogates are written as '?'.  Does nothing if s is nil.
+ */
+-(void)appendString:(NSString *)s;
+
+/**
+ * Append the result of printf-style formatting, written directly into the buffer.  This is C printf, so
+ * %@ is not supported; see appendStringWithFormat: for that.
+ */
+-(void)appendFormat:(const char *)format, ... __attribute__((format(printf, 2, 3)));
+-(void)appendFormat:(const char *)format arguments:(va_list)args __attribute__((format(printf, 2, 0)));
+
+/**
+ * Append the result of [NSString stringWithFormat:format, ...].  This still needs the intermediate NSString,
+ * but not the NSData.
+ */
+-(void)appendStringWithFormat:(NSString *)format, ... NS_FORMAT_FUNCTION(1, 2);
+
+/**
+ * Equivalent to appendFormat:"%lld", but using a digit-pair table rather than printf.
+ */
+-(void)appendInteger:(long long)i;
+
+/**
+ * Equivalent to appendFormat:"%llu", but using a digit-pair table rather than printf.
+ */
+-(void)appendUnsignedInteger:(unsigned long long)i;
+
+/**
+ * Append d in the shortest of %.15g or %.17g that round-trips, or as an integer if it is integral and
+ * exactly representable (which is by far the common case).  NaN and infinities are written as "nan", "inf", and
+ * "-inf".
+ */
+-(void)appendDouble:(double)d;
+
+/**
+ * Equivalent to appendFormat:"%.*f", fractionDigits, d, but computed with integer arithmetic when the scaled
+ * value is below 2^52.  The rounding is done on the exact value of d, so the result matches printf; values that
+ * are exactly halfway in binary (e.g. 0.125 with two digits) are passed to printf for its tie-breaking.
+ *
+ * @param fractionDigits Must be between 0 and 9.
+ */
+-(void)appendDouble:(double)d fractionDigits:(int)fractionDigits;
+
+/**
+ * Ensure that there is space for at least n more bytes, and return a pointer to the tail of the buffer.  Write
+ * into it, then call didAppend: with the number of bytes written.
+ */
+-(uint8_t *)reserve:(NSUInteger)n;
+-(void)didAppend:(NSUInteger)n;
+
+/**
+ * Discard everything after the first length bytes.  length must not be greater than the current length.
+ */
+-(void)truncateToLength:(NSUInteger)length;
+
+/**
+ * Hand the buffer over to a new NSData, without copying, and leave this builder empty.
+ */
+-(NSData *)data;
+
+/**
+ * @return A new string from the bytes written so far.  This builder is left unchanged.
+ */
+-(NSString *)string;
+
+@end
@@ -0,0 +1,343 @@
+//
+//  UTF8Builder.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/30/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "UTF8Builder.h"
+
+
+#define MIN_CAPACITY 64
+
+// Once the builder is handed over by -data, any slack beyond this is given back with realloc.
+#define MAX_HANDOFF_SLACK 4096
+
+
+static const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const double powersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+static const unsigned long long integerPowersOf10[] = { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL };
+
+
+/**
+ * Write the decimal digits of v backwards, ending just before end.
+ *
+ * @return The number of digits written.
+ */
+static inline NSUInteger formatUnsigned(unsigned long long v, char * end) {
+    char * p = end;
+    while (v >= 100) {
+        unsigned idx = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--p = digitPairs[idx + 1];
+        *--p = digitPairs[idx];
+    }
+    if (v >= 10) {
+        unsigned idx = (unsigned)v * 2;
+        *--p = digitPairs[idx + 1];
+        *--p = digitPairs[idx];
+    }
+    else {
+        *--p = (char)('0' + v);
+    }
+    return (NSUInteger)(end - p);
+}
+
+
+@implementation UTF8Builder
+{
+    uint8_t * buf;
+    NSUInteger capacity;
+}
+
+
+-(instancetype)init {
+    return [self initWithCapacity:0];
+}
+
+
+-(instancetype)initWithCapacity:(NSUInteger)initialCapacity {
+    self = [super init];
+    if (self) {
+        if (initialCapacity > 0) {
+            [self reserve:initialCapacity];
+        }
+    }
+    return self;
+}
+
+
+-(void)dealloc {
+    free(buf);
+}
+
+
+-(const uint8_t *)bytes {
+    return buf;
+}
+
+
+-(uint8_t *)reserve:(NSUInteger)n {
+    NSUInteger needed = _length + n;
+    if (needed > capacity) {
+        NSUInteger newCapacity = MAX(MAX(needed, 2 * capacity), MIN_CAPACITY);
+        uint8_t * newBuf = realloc(buf, newCapacity);
+        if (newBuf == NULL) {
+            [NSException raise:NSMallocException format:@"Failed to allocate %lu bytes", (unsigned long)newCapacity];
+        }
+        buf = newBuf;
+        capacity = newCapacity;
+    }
+    return buf + _length;
+}
+
+
+-(void)didAppend:(NSUInteger)n {
+    NSAssert(_length + n <= capacity, @"Appended past the reserved space");
+    _length += n;
+}
+
+
+-(void)truncateToLength:(NSUInteger)length {
+    NSParameterAssert(length <= _length);
+    _length = length;
+}
+
+
+-(void)appendByte:(uint8_t)b {
+    *[self reserve:1] = b;
+    _length++;
+}
+
+
+-(void)appendBytes:(const void *)bytes length:(NSUInteger)length {
+    if (length == 0) {
+        return;
+    }
+    memcpy([self reserve:length], bytes, length);
+    _length += length;
+}
+
+
+-(void)appendCString:(const char *)s {
+    [self appendBytes:s length:strlen(s)];
+}
+
+
+-(void)appendString:(NSString *)s {
+    if (s == nil) {
+        return;
+    }
+
+    CFStringRef cf = (__bridge CFStringRef)s;
+    CFIndex len = CFStringGetLength(cf);
+    if (len == 0) {
+        return;
+    }
+
+    // If the string is stored as ASCII then we get a pointer straight to it, and it's one byte per character.
+    const char * ascii = CFStringGetCStringPtr(cf, kCFStringEncodingUTF8);
+    if (ascii != NULL) {
+        [self appendBytes:ascii length:(NSUInteger)len];
+        return;
+    }
+
+    // Three bytes per UTF-16 unit is the worst case (a surrogate pair is two units and four bytes).
+    CFIndex maxBytes = 3 * len;
+    uint8_t * tail = [self reserve:(NSUInteger)maxBytes];
+    CFIndex used = 0;
+    CFStringGetBytes(cf, CFRangeMake(0, len), kCFStringEncodingUTF8, '?', false, tail, maxBytes, &used);
+    _length += (NSUInteger)used;
+}
+
+
+-(void)appendFormat:(const char *)format, ... {
+    va_list args;
+    va_start(args, format);
+    [self appendFormat:format arguments:args];
+    va_end(args);
+}
+
+
+-(void)appendFormat:(const char *)format arguments:(va_list)args {
+    va_list retryArgs;
+    va_copy(retryArgs, args);
+
+    // Try with whatever space we have (but at least enough for a typical field), and only if that was too
+    // small do we grow and format again.  vsnprintf needs room for the NUL too, though we don't keep it.
+    NSUInteger available = MAX(capacity - _length, MIN_CAPACITY);
+    char * tail = (char *)[self reserve:available];
+    int n = vsnprintf(tail, available, format, args);
+    if (n >= 0 && (NSUInteger)n >= available) {
+        tail = (char *)[self reserve:(NSUInteger)n + 1];
+        n = vsnprintf(tail, (NSUInteger)n + 1, format, retryArgs);
+    }
+    va_end(retryArgs);
+
+    if (n > 0) {
+        _length += (NSUInteger)n;
+    }
+}
+
+
+-(void)appendStringWithFormat:(NSString *)format, ... {
+    va_list args;
+    va_start(args, format);
+    NSString * s = [[NSString alloc] initWithFormat:format arguments:args];
+    va_end(args);
+    [self appendString:s];
+}
+
+
+-(void)appendUnsignedInteger:(unsigned long long)i {
+    char digits[20];
+    NSUInteger n = formatUnsigned(i, digits + sizeof(digits));
+    [self appendBytes:digits + sizeof(digits) - n length:n];
+}
+
+
+-(void)appendInteger:(long long)i {
+    char digits[21];
+    char * end = digits + sizeof(digits);
+    // Negate as unsigned so that LLONG_MIN works.
+    unsigned long long magnitude = (i < 0 ? 0ULL - (unsigned long long)i : (unsigned long long)i);
+    char * p = end - formatUnsigned(magnitude, end);
+    if (i < 0) {
+        *--p = '-';
+    }
+    [self appendBytes:p length:(NSUInteger)(end - p)];
+}
+
+
+-(void)appendDouble:(double)d {
+    if (isnan(d)) {
+        [self appendBytes:"nan" length:3];
+        return;
+    }
+    if (isinf(d)) {
+        if (d > 0) {
+            [self appendBytes:"inf" length:3];
+        }
+        else {
+            [self appendBytes:"-inf" length:4];
+        }
+        return;
+    }
+
+    // 2^53: every integer below this is exactly representable.
+    if (d == floor(d) && fabs(d) < 9007199254740992.0) {
+        if (d == 0 && signbit(d)) {
+            [self appendBytes:"-0" length:2];
+        }
+        else {
+            [self appendInteger:(long long)d];
+        }
+        return;
+    }
+
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), "%.15g", d);
+    if (strtod(tmp, NULL) != d) {
+        n = snprintf(tmp, sizeof(tmp), "%.17g", d);
+    }
+    [self appendBytes:tmp length:(NSUInteger)n];
+}
+
+
+-(void)appendDouble:(double)d fractionDigits:(int)fractionDigits {
+    NSParameterAssert(fractionDigits >= 0 && fractionDigits <= 9);
+
+    double scaled = fabs(d) * powersOf10[fractionDigits];
+    // Below 2^52 the rounding error in scaled is at most 0.25, so the rounding below can't be off by more than
+    // one.  This also catches NaN and infinities, since the comparison is false for NaN.
+    if (!(scaled < 4503599627370496.0)) {
+        [self appendFormat:"%.*f", fractionDigits, d];
+        return;
+    }
+
+    // powersOf10 are exact, so scaled + error is exactly |d| * 10^fractionDigits.  Round that, not scaled: e.g.
+    // 0.015 is really 0.01499999..., but 0.015 * 100 rounds to 1.5.
+    double error = fma(fabs(d), powersOf10[fractionDigits], -scaled);
+    double floored = floor(scaled);
+    double remainder = scaled - floored;
+    unsigned long long v = (unsigned long long)floored;
+    if (remainder >= 0.25) {
+        // Exact, since remainder is within a factor of two of 0.5.
+        double fromHalf = remainder - 0.5;
+        if (fromHalf == -error) {
+            // Exactly halfway.  Leave the tie-breaking to printf.
+            [self appendFormat:"%.*f", fractionDigits, d];
+            return;
+        }
+        if (fromHalf > -error) {
+            v++;
+        }
+    }
+    unsigned long long divisor = integerPowersOf10[fractionDigits];
+    unsigned long long whole = v / divisor;
+    unsigned long long frac = v % divisor;
+
+    // Sign, up to 20 integer digits, the point, and up to 9 fraction digits.
+    char tmp[32];
+    char * end = tmp + sizeof(tmp);
+    char * p = end;
+    if (fractionDigits > 0) {
+        for (int i = 0; i < fractionDigits; i++) {
+            *--p = (char)('0' + frac % 10);
+            frac /= 10;
+        }
+        *--p = '.';
+    }
+    p -= formatUnsigned(whole, p);
+    // printf writes "-0.00" for negative values that round to zero, so we do the same.
+    if (signbit(d)) {
+        *--p = '-';
+    }
+    [self appendBytes:p length:(NSUInteger)(end - p)];
+}
+
+
+-(NSData *)data {
+    if (_length == 0) {
+        free(buf);
+        buf = NULL;
+        capacity = 0;
+        return [NSData data];
+    }
+
+    if (capacity - _length > MAX_HANDOFF_SLACK) {
+        uint8_t * shrunk = realloc(buf, _length);
+        if (shrunk != NULL) {
+            buf = shrunk;
+        }
+    }
+
+    NSData * result = [NSData dataWithBytesNoCopy:buf length:_length freeWhenDone:YES];
+    buf = NULL;
+    capacity = 0;
+    _length = 0;
+    return result;
+}
+
+
+-(NSString *)string {
+    if (_length == 0) {
+        return @"";
+    }
+    return [[NSString alloc] initWithBytes:buf length:_length encoding:NSUTF8StringEncoding];
+}
+
+
+@end
@@ -0,0 +1,303 @@
+//
+//  BinaryCodecTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/31/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "BinaryReader.h"
+#import "BinaryWriter.h"
+#import "NSInputStream+Misc.h"
+#import "NSMutableData+AppendByte.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface BinaryCodecTests : TBTestCaseBase
+
+@end
+
+
+@implementation BinaryCodecTests
+
+
+-(void)testVarUIntEncoding {
+    BinaryWriter * w = [[BinaryWriter alloc] init];
+    [w writeVarUInt:0];
+    [w writeVarUInt:127];
+    [w writeVarUInt:300];
+    [w writeVarInt:-1];
+    [w writeVarInt:1];
+    const uint8_t expected[] = { 0x00, 0x7f, 0xac, 0x02, 0x01, 0x02 };
+    XCTAssertEqualObjects(w.data, [NSData dataWithBytes:expected length:sizeof(expected)]);
+
+    [w reset];
+    [w writeVarUInt:UINT64_MAX];
+    XCTAssertEqual(w.length, (NSUInteger)10);
+}
+
+
+-(void)testFixedEndian {
+    BinaryWriter * w = [[BinaryWriter alloc] init];
+    [w writeUInt16BE:0x0102];
+    [w writeUInt16LE:0x0102];
+    [w writeUInt32BE:0x01020304];
+    [w writeUInt32LE:0x01020304];
+    const uint8_t expected[] = { 1, 2, 2, 1, 1, 2, 3, 4, 4, 3, 2, 1 };
+    XCTAssertEqualObjects(w.data, [NSData dataWithBytes:expected length:sizeof(expected)]);
+}
+
+
+-(void)testRoundTrip {
+    NSData * blob = [@"blob" dataUsingEncoding:NSUTF8StringEncoding];
+
+    BinaryWriter * w = [[BinaryWriter alloc] init];
+    [w writeUInt8:0xfe];
+    [w writeBool:YES];
+    [w writeUInt16LE:0xbeef];
+    [w writeUInt16BE:0xbeef];
+    [w writeUInt32LE:0xdeadbeef];
+    [w writeUInt32BE:0xdeadbeef];
+    [w writeUInt64LE:0x0123456789abcdefULL];
+    [w writeUInt64BE:0x0123456789abcdefULL];
+    [w writeFloat:1.5f];
+    [w writeDouble:-0.1];
+    [w writeVarUInt:UINT64_MAX];
+    [w writeVarInt:INT64_MIN];
+    [w writeVarInt:-300];
+    [w writeBlob:blob];
+    [w writeBlob:nil];
+    [w writeString:@"plain"];
+    [w writeString:@"café \U0001F600"];
+    [w writeString:nil];
+
+    BinaryReader * r = [[BinaryReader alloc] initWithData:[w takeData]];
+    XCTAssertEqual([r readUInt8], (uint8_t)0xfe);
+    XCTAssertTrue([r readBool]);
+    XCTAssertEqual([r readUInt16LE], (uint16_t)0xbeef);
+    XCTAssertEqual([r readUInt16BE], (uint16_t)0xbeef);
+    XCTAssertEqual([r readUInt32LE], (uint32_t)0xdeadbeef);
+    XCTAssertEqual([r readUInt32BE], (uint32_t)0xdeadbeef);
+    XCTAssertEqual([r readUInt64LE], 0x0123456789abcdefULL);
+    XCTAssertEqual([r readUInt64BE], 0x0123456789abcdefULL);
+    XCTAssertEqual([r readFloat], 1.5f);
+    XCTAssertEqual([r readDouble], -0.1);
+    XCTAssertEqual([r readVarUInt], UINT64_MAX);
+    XCTAssertEqual([r readVarInt], INT64_MIN);
+    XCTAssertEqual([r readVarInt], (int64_t)-300);
+    XCTAssertEqualObjects([r readBlob], blob);
+    XCTAssertEqualObjects([r readBlob], [NSData data]);
+    XCTAssertEqualObjects([r readString], @"plain");
+    XCTAssertEqualObjects([r readString], @"café \U0001F600");
+    XCTAssertEqualObjects([r readString], @"");
+    XCTAssertTrue(r.atEnd);
+    XCTAssertNil(r.error);
+    XCTAssertEqual(w.length, (NSUInteger)0);
+}
+
+
+-(void)testTruncated {
+    BinaryWriter * w = [[BinaryWriter alloc] init];
+    [w writeUInt16LE:7];
+    [w writeString:@"truncated"];
+    NSData * data = [w.data subdataWithRange:NSMakeRange(0, w.length - 1)];
+
+    BinaryReader * r = [[BinaryReader alloc] initWithData:data];
+    XCTAssertEqual([r readUInt16LE], (uint16_t)7);
+    XCTAssertNil(r.error);
+    XCTAssertNil([r readString]);
+    XCTAssertEqualObjects(r.error.domain, NSPOSIXErrorDomain);
+    XCTAssertEqual(r.error.code, (NSInteger)EIO);
+
+    // Once failed, everything reads as zero.
+    XCTAssertEqual([r readUInt8], (uint8_t)0);
+    XCTAssertTrue(r.atEnd);
+}
+
+
+-(void)testMalformed {
+    const uint8_t tooLong[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f };
+    BinaryReader * r = [[BinaryReader alloc] initWithData:[NSData dataWithBytes:tooLong length:sizeof(tooLong)]];
+    XCTAssertEqual([r readVarUInt], (uint64_t)0);
+    XCTAssertEqual(r.error.code, (NSInteger)EILSEQ);
+
+    const uint8_t badUTF8[] = { 0x02, 0xc3, 0x28 };
+    r = [[BinaryReader alloc] initWithData:[NSData dataWithBytes:badUTF8 length:sizeof(badUTF8)]];
+    XCTAssertNil([r readString]);
+    XCTAssertEqual(r.error.code, (NSInteger)EILSEQ);
+
+    // A length longer than the data fails without trying to allocate it.
+    const uint8_t hugeLength[] = { 0xff, 0xff, 0xff, 0xff, 0x0f, 0x00 };
+    r = [[BinaryReader alloc] initWithData:[NSData dataWithBytes:hugeLength length:sizeof(hugeLength)]];
+    XCTAssertNil([r readBlob]);
+    XCTAssertEqual(r.error.code, (NSInteger)EIO);
+}
+
+
+-(void)testStream {
+    NSMutableData * big = [NSMutableData dataWithLength:100000];
+    for (NSUInteger i = 0; i < big.length; i++) {
+        ((uint8_t *)big.mutableBytes)[i] = (uint8_t)i;
+    }
+
+    BinaryWriter * w = [[BinaryWriter alloc] init];
+    for (uint32_t i = 0; i < 1000; i++) {
+        [w writeVarUInt:(uint64_t)i * 1000003];
+        [w writeUInt32BE:i];
+    }
+    [w writeBlob:big];
+    [w writeString:@"end"];
+    NSData * data = w.data;
+
+    // The minimum buffer, so that fields and VarUInts straddle refills, and the blob bypasses the buffer.
+    NSInputStream * is = [NSInputStream inputStreamWithData:data];
+    [is open];
+    BinaryReader * r = [[BinaryReader alloc] initWithInputStream:is bufferSize:1];
+    for (uint32_t i = 0; i < 1000; i++) {
+        XCTAssertEqual([r readVarUInt], (uint64_t)i * 1000003);
+        XCTAssertEqual([r readUInt32BE], i);
+    }
+    XCTAssertEqualObjects([r readBlob], big);
+    XCTAssertEqualObjects([r readString], @"end");
+    XCTAssertTrue(r.atEnd);
+    XCTAssertNil(r.error);
+    XCTAssertEqual(r.offset, (unsigned long long)data.length);
+    [is close];
+}
+
+
+-(void)testMappedFile {
+    NSString * path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"BinaryCodecTests.bin"];
+    BinaryWriter * w = [[BinaryWriter alloc] init];
+    [w writeString:@"mapped"];
+    [w writeDouble:M_PI];
+
+    NSOutputStream * os = [NSOutputStream outputStreamToFileAtPath:path append:NO];
+    [os open];
+    NSError * error = nil;
+    XCTAssertTrue([w flushToStream:os error:&error]);
+    [os close];
+    XCTAssertEqual(w.length, (NSUInteger)0);
+
+    BinaryReader * r = [BinaryReader readerWithContentsOfMappedFile:path error:&error];
+    XCTAssertNotNil(r);
+    XCTAssertEqualObjects([r readString], @"mapped");
+    XCTAssertEqual([r readDouble], M_PI);
+    XCTAssertTrue(r.atEnd);
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+    XCTAssertNil([BinaryReader readerWithContentsOfMappedFile:path error:&error]);
+    XCTAssertNotNil(error);
+}
+
+
+-(void)testCategories {
+    NSMutableData * data = [NSMutableData data];
+    [data appendVarUInt:300];
+    [data appendVarInt:-2];
+
+    BinaryReader * r = [[BinaryReader alloc] initWithData:data];
+    XCTAssertEqual([r readVarUInt], (uint64_t)300);
+    XCTAssertEqual([r readVarInt], (int64_t)-2);
+
+    NSInputStream * is = [NSInputStream inputStreamWithData:data];
+    [is open];
+    uint64_t v;
+    XCTAssertEqual([is readVarUInt:&v], (NSInteger)2);
+    XCTAssertEqual(v, (uint64_t)300);
+    XCTAssertEqual([is readVarUInt:&v], (NSInteger)1);
+    XCTAssertEqual(v, (uint64_t)3);
+    XCTAssertEqual([is readVarUInt:&v], (NSInteger)0);
+    [is close];
+}
+
+
+#pragma mark - Performance
+
+
+static NSArray * makeRecords(NSUInteger count) {
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [result addObject:@{@"id": @(i * 7919),
+                            @"subject": [NSString stringWithFormat:@"Re: meeting notes %lu", (unsigned long)i],
+                            @"from": @"someone@example.com",
+                            @"date": @(449000000.0 + i * 60.5),
+                            @"unread": @(i % 3 == 0)}];
+    }
+    return result;
+}
+
+
+static NSData * encodeRecords(NSArray * records, BinaryWriter * w) {
+    [w reset];
+    [w writeVarUInt:records.count];
+    for (NSDictionary * rec in records) {
+        [w writeVarUInt:[rec[@"id"] unsignedLongLongValue]];
+        [w writeString:rec[@"subject"]];
+        [w writeString:rec[@"from"]];
+        [w writeDouble:[rec[@"date"] doubleValue]];
+        [w writeBool:[rec[@"unread"] boolValue]];
+    }
+    return w.data;
+}
+
+
+static NSArray * decodeRecords(NSData * data) {
+    BinaryReader * r = [[BinaryReader alloc] initWithData:data];
+    NSUInteger count = (NSUInteger)[r readVarUInt];
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count && r.error == nil; i++) {
+        uint64_t ident = [r readVarUInt];
+        NSString * subject = [r readString];
+        NSString * from = [r readString];
+        double date = [r readDouble];
+        BOOL unread = [r readBool];
+        if (r.error != nil) {
+            return nil;
+        }
+        [result addObject:@{@"id": @(ident), @"subject": subject, @"from": from, @"date": @(date), @"unread": @(unread)}];
+    }
+    return result;
+}
+
+
+-(void)testPerformance {
+    const NSUInteger count = 10000;
+    const NSUInteger reps = 5;
+    NSArray * records = makeRecords(count);
+    XCTAssertEqualObjects(decodeRecords(encodeRecords(records, [[BinaryWriter alloc] init])), records);
+
+    __block NSData * archived;
+    __block NSData * json;
+    __block NSData * binary;
+    BinaryWriter * w = [[BinaryWriter alloc] init];
+
+    NSTimeInterval archiverEncode = [self time:reps block:^{ archived = [NSKeyedArchiver archivedDataWithRootObject:records]; }];
+    NSTimeInterval archiverDecode = [self time:reps block:^{ (void)[NSKeyedUnarchiver unarchiveObjectWithData:archived]; }];
+    NSTimeInterval jsonEncode = [self time:reps block:^{ json = [NSJSONSerialization dataWithJSONObject:records options:0 error:NULL]; }];
+    NSTimeInterval jsonDecode = [self time:reps block:^{ (void)[NSJSONSerialization JSONObjectWithData:json options:0 error:NULL]; }];
+    NSTimeInterval binaryEncode = [self time:reps block:^{ binary = encodeRecords(records, w); }];
+    NSTimeInterval binaryDecode = [self time:reps block:^{ (void)decodeRecords(binary); }];
+
+    NSLog(@"BinaryWriter x %lu: %0.6f sec, %0.6f ratio vs NSKeyedArchiver, %0.6f ratio vs NSJSONSerialization.",
+          (unsigned long)(count * reps), binaryEncode, binaryEncode / archiverEncode, binaryEncode / jsonEncode);
+    NSLog(@"BinaryReader x %lu: %0.6f sec, %0.6f ratio vs NSKeyedUnarchiver, %0.6f ratio vs NSJSONSerialization.",
+          (unsigned long)(count * reps), binaryDecode, binaryDecode / archiverDecode, binaryDecode / jsonDecode);
+    NSLog(@"Sizes: binary %lu bytes, NSKeyedArchiver %lu bytes, JSON %lu bytes.",
+          (unsigned long)binary.length, (unsigned long)archived.length, (unsigned long)json.length);
+}
+
+
+-(NSTimeInterval)time:(NSUInteger)reps block:(void (^)())block {
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < reps; i++) {
+        @autoreleasepool {
+            block();
+        }
+    }
+    return [NSDate timeIntervalSinceReferenceDate] - start;
+}
+
+
+@end
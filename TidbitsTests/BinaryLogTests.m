@@ -0,0 +1,398 @@
+//
+//  BinaryLogTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "BinaryLog.h"
+#import "LogCollector.h"
+#import "LogFormatter.h"
+
+#import "TBTestCaseBase.h"
+
+
+#define PERF_TEST_COUNT 20000
+#define PERF_TEST_BATCH 500
+
+// The length of "yyyy-MM-dd HH:mm:ss.SSS " at the start of each LogFormatter line.
+#define TIMESTAMP_LENGTH 24
+
+
+/**
+ * BLogInfo the given format and arguments, flush, and check that the result is the same as LogFormatter would
+ * have given for NSLog.
+ */
+#define CHECK_BLOG(__fmt, ...) \
+    do { \
+        BLogInfo(__fmt, ##__VA_ARGS__); \
+        NSString * expected = [NSString stringWithFormat:@"info  %s:%i | " __fmt, __FUNCTION__, __LINE__, ##__VA_ARGS__]; \
+        NSArray * lines = [self flushedLines]; \
+        XCTAssertEqual(lines.count, (NSUInteger)1); \
+        XCTAssertEqualStrings([lines[0] substringFromIndex:TIMESTAMP_LENGTH], expected); \
+    } while (0)
+
+
+/**
+ * An object that logs from its -copy, which BinaryLog calls at the call site.
+ */
+@interface BinaryLogTestsLoggingCopy : NSObject <NSCopying>
+
+@end
+
+
+@implementation BinaryLogTestsLoggingCopy
+
+
+-(id)copyWithZone:(NSZone *)zone {
+    BLogInfo(@"Nested in copy %d", 1);
+    return self;
+}
+
+
+-(NSString *)description {
+    return @"copied";
+}
+
+
+@end
+
+
+/**
+ * An object that logs from its -description, which BinaryLog calls at the call site because it isn't NSCopying.
+ */
+@interface BinaryLogTestsLoggingDescription : NSObject
+
+@end
+
+
+@implementation BinaryLogTestsLoggingDescription
+
+
+-(NSString *)description {
+    BLogInfo(@"Nested in description %@", @"!");
+    return @"described";
+}
+
+
+@end
+
+
+/**
+ * An object that logs an error from its -description, which BinaryLog calls during the flush because it is
+ * NSCopying.
+ */
+@interface BinaryLogTestsErrorInDescription : NSObject <NSCopying>
+
+@end
+
+
+@implementation BinaryLogTestsErrorInDescription
+
+
+-(id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+
+-(NSString *)description {
+    BLogError(@"Nested error %d", 3);
+    [BinaryLog flush];
+    return @"described";
+}
+
+
+@end
+
+
+@interface BinaryLogTests : TBTestCaseBase
+
+@end
+
+
+@implementation BinaryLogTests {
+    NSTimeInterval savedFlushInterval;
+}
+
+
+-(void)setUp {
+    [super setUp];
+
+    // Stop the timer from flushing our messages to Lumberjack before we can check them.
+    savedFlushInterval = [BinaryLog flushInterval];
+    [BinaryLog setFlushInterval:0.0];
+    [self flushedLines];
+}
+
+
+-(void)tearDown {
+    [BinaryLog setFlushInterval:savedFlushInterval];
+    [super tearDown];
+}
+
+
+-(void)testFormatsMatchStringWithFormat {
+    CHECK_BLOG(@"Plain message");
+    CHECK_BLOG(@"%d %i %u %x %X %o %c", -5, 7, 4000000000u, 255, 255, 8, 'A');
+    CHECK_BLOG(@"%ld %lu %lld %llu %qd %zu %zd %td %jd", -1L, 2UL, -3LL, 4ULL, 5LL, (size_t)6, (ssize_t)-7, (ptrdiff_t)8, (intmax_t)-9);
+    CHECK_BLOG(@"%hhd %hd %#x %+d % d %05d %-5d|", 300, 70000, 255, 3, 3, 42, 42);
+    CHECK_BLOG(@"%f %.3f %e %g %10.2f %-8.1f| %lf", 1.5, M_PI, 123456.789, 0.0001, -2.25, 9.99, 1e100);
+    CHECK_BLOG(@"%*d|%-*d|%.*f|%*.*f", 5, 42, 5, 42, 2, M_PI, 8, 1, 2.5);
+    CHECK_BLOG(@"%s|%10s|%-6s|%s", "abc", "right", "left", "");
+    CHECK_BLOG(@"%s", (char *)NULL);
+    CHECK_BLOG(@"%p %p", (void *)0x1234, (void *)NULL);
+    CHECK_BLOG(@"%@ %@ %@ %@", @"str", @42, nil, @[@1, @2]);
+    CHECK_BLOG(@"100%% done%@", @"!");
+    CHECK_BLOG(@"héllo ⟦tag⟧ %d ☃", 1);
+    CHECK_BLOG(@"%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+}
+
+
+-(void)testUnusualFormatsMatchStringWithFormat {
+    CHECK_BLOG(@"%1$@ %1$@ %2$d", @"pos", 3);
+    CHECK_BLOG(@"%C", (unichar)0x263A);
+    CHECK_BLOG(@"%.2s", "abcdef");
+    CHECK_BLOG(@"%5@|", @"x");
+    CHECK_BLOG(@"%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17);
+
+    char * longString = malloc(2001);
+    memset(longString, 'x', 2000);
+    longString[2000] = '\0';
+    CHECK_BLOG(@"%s %d", longString, 5);
+    free(longString);
+}
+
+
+-(void)testCopiesMutableArguments {
+    NSMutableString * s = [NSMutableString stringWithString:@"before"];
+    char buf[8];
+    strcpy(buf, "before");
+
+    BLogInfo(@"%@ %s", s, buf);
+    [s setString:@"after"];
+    strcpy(buf, "after");
+
+    NSArray * lines = [self flushedLines];
+    XCTAssertEqual(lines.count, (NSUInteger)1);
+    XCTAssert([lines[0] hasSuffix:@"| before before"]);
+}
+
+
+-(void)testDescribesNonCopyingObjectsAtCallSite {
+    NSObject * obj = [[NSObject alloc] init];
+    NSString * expected = [obj description];
+    BLogInfo(@"%@", obj);
+
+    NSArray * lines = [self flushedLines];
+    XCTAssertEqual(lines.count, (NSUInteger)1);
+    XCTAssert([lines[0] hasSuffix:expected]);
+}
+
+
+-(void)testLogFromArgumentAtCallSite {
+    BLogInfo(@"Outer %@ %@ %d", [[BinaryLogTestsLoggingCopy alloc] init], [[BinaryLogTestsLoggingDescription alloc] init], 2);
+    BLogInfo(@"After");
+
+    NSArray * lines = [self flushedLines];
+    XCTAssertEqual(lines.count, (NSUInteger)4);
+    XCTAssert([lines[0] hasSuffix:@"| Nested in copy 1"], @"%@", lines[0]);
+    XCTAssert([lines[1] hasSuffix:@"| Nested in description !"], @"%@", lines[1]);
+    XCTAssert([lines[2] hasSuffix:@"| Outer copied described 2"], @"%@", lines[2]);
+    XCTAssert([lines[3] hasSuffix:@"| After"], @"%@", lines[3]);
+
+    // A positional argument means that this one is formatted at the call site.
+    BLogInfo(@"Eager %1$@", [[BinaryLogTestsLoggingDescription alloc] init]);
+
+    lines = [self flushedLines];
+    XCTAssertEqual(lines.count, (NSUInteger)2);
+    XCTAssert([lines[0] hasSuffix:@"| Nested in description !"], @"%@", lines[0]);
+    XCTAssert([lines[1] hasSuffix:@"| Eager described"], @"%@", lines[1]);
+}
+
+
+-(void)testLevels {
+    BLogWarn(@"w");
+    BLogUser(@"u");
+    BLog(@"i");
+
+    NSArray * lines = [self flushedLines];
+    XCTAssertEqual(lines.count, (NSUInteger)3);
+    NSArray * levels = @[@"warn ", @"user ", @"info "];
+    for (NSUInteger i = 0; i < lines.count; i++) {
+        XCTAssertEqualStrings([lines[i] substringWithRange:NSMakeRange(TIMESTAMP_LENGTH, 5)], levels[i]);
+    }
+}
+
+
+-(void)testMergesThreadsInOrder {
+    // dispatch_apply may run every iteration on one thread, and that thread's ring must stay under half full, or
+    // it will be flushed to Lumberjack behind our back.  This is about 20 KiB, against 32 KiB.
+    NSUInteger threadCount = 4;
+    int perThread = 100;
+    dispatch_apply(threadCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t t) {
+        for (int i = 0; i < perThread; i++) {
+            BLogInfo(@"thread %zu message %d", t, i);
+        }
+    });
+
+    NSArray * lines = [self flushedLines];
+    XCTAssertEqual(lines.count, threadCount * (NSUInteger)perThread);
+
+    NSMutableArray * next = [NSMutableArray array];
+    for (NSUInteger t = 0; t < threadCount; t++) {
+        [next addObject:@0];
+    }
+    NSString * lastTimestamp = @"";
+    for (NSString * line in lines) {
+        NSString * timestamp = [line substringToIndex:TIMESTAMP_LENGTH];
+        XCTAssert([timestamp compare:lastTimestamp] != NSOrderedAscending);
+        lastTimestamp = timestamp;
+
+        NSArray * words = [[line componentsSeparatedByString:@"| "].lastObject componentsSeparatedByString:@" "];
+        NSUInteger t = (NSUInteger)[words[1] integerValue];
+        XCTAssertEqualObjects(words[3], [next[t] stringValue]);
+        next[t] = @([next[t] intValue] + 1);
+    }
+}
+
+
+-(void)testFlushToLumberjack {
+    LogCollector * collector = [[LogCollector alloc] init];
+    collector.logFormatter = [[LogFormatter alloc] init];
+    [DDLog addLogger:collector];
+
+    BLogWarn(@"To Lumberjack %d", 1);
+    int line = __LINE__ - 1;
+    [BinaryLog flush];
+
+    NSArray * collected = [collector collect];
+    [DDLog removeLogger:collector];
+
+    NSString * expected = [NSString stringWithFormat:@"warn  %s:%i | To Lumberjack 1", __FUNCTION__, line];
+    NSUInteger matches = 0;
+    for (NSString * msg in collected) {
+        if (msg.length > TIMESTAMP_LENGTH && [[msg substringFromIndex:TIMESTAMP_LENGTH] isEqualToString:expected]) {
+            matches++;
+        }
+    }
+    XCTAssertEqual(matches, (NSUInteger)1);
+}
+
+
+-(void)testErrorIsFlushedImmediately {
+    LogCollector * collector = [[LogCollector alloc] init];
+    collector.logFormatter = [[LogFormatter alloc] init];
+    [DDLog addLogger:collector];
+
+    BLogInfo(@"Before the error");
+    BLogError(@"Error %d", 1);
+    int line = __LINE__ - 1;
+
+    // No call to flush: BLogError has already done it, taking the earlier message with it.
+    NSArray * collected = [collector collect];
+    [DDLog removeLogger:collector];
+    XCTAssertEqual([self flushedLines].count, (NSUInteger)0);
+
+    NSString * expected = [NSString stringWithFormat:@"error %s:%i | Error 1", __FUNCTION__, line];
+    NSUInteger errors = 0;
+    NSUInteger infos = 0;
+    for (NSString * msg in collected) {
+        if (msg.length <= TIMESTAMP_LENGTH) {
+            continue;
+        }
+        NSString * rest = [msg substringFromIndex:TIMESTAMP_LENGTH];
+        if ([rest isEqualToString:expected]) {
+            errors++;
+        }
+        else if ([rest hasSuffix:@"| Before the error"]) {
+            infos++;
+        }
+    }
+    XCTAssertEqual(errors, (NSUInteger)1);
+    XCTAssertEqual(infos, (NSUInteger)1);
+}
+
+
+-(void)testErrorFromDescriptionDuringFlush {
+    LogCollector * collector = [[LogCollector alloc] init];
+    collector.logFormatter = [[LogFormatter alloc] init];
+    [DDLog addLogger:collector];
+
+    BLogInfo(@"Outer %@", [[BinaryLogTestsErrorInDescription alloc] init]);
+
+    // This would deadlock if the nested BLogError or flush tried to take the flush lock again.
+    NSArray * lines = [self flushedLines];
+    NSArray * collected = [collector collect];
+    [DDLog removeLogger:collector];
+
+    XCTAssertEqual(lines.count, (NSUInteger)1);
+    XCTAssert([lines[0] hasSuffix:@"| Outer described"], @"%@", lines[0]);
+
+    NSUInteger errors = 0;
+    for (NSString * msg in collected) {
+        if ([msg hasSuffix:@"| Nested error 3"]) {
+            errors++;
+        }
+    }
+    XCTAssertEqual(errors, (NSUInteger)1);
+}
+
+
+-(void)testCallSitePerformance {
+    LogFormatter * formatter = [[LogFormatter alloc] init];
+    NSString * name = @"benchmark";
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        for (int i = 0; i < PERF_TEST_COUNT; i++) {
+            NSString * logMsg = [NSString stringWithFormat:@"Message %d of %@ at %f", i, name, 1.5];
+            DDLogMessage * msg = [[DDLogMessage alloc] initWithLogMsg:logMsg level:LOG_LEVEL_INFO flag:LOG_FLAG_INFO context:0 file:__FILE__ function:__FUNCTION__ line:__LINE__ tag:nil options:0];
+            [formatter formatLogMessage:msg];
+        }
+    }
+    NSTimeInterval baseline = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"Format at call site x %d: %0.6f sec.", PERF_TEST_COUNT, baseline);
+
+    NSTimeInterval callSite = 0.0;
+    NSTimeInterval flush = 0.0;
+    for (int batch = 0; batch < PERF_TEST_COUNT / PERF_TEST_BATCH; batch++) {
+        start = [NSDate timeIntervalSinceReferenceDate];
+        for (int i = 0; i < PERF_TEST_BATCH; i++) {
+            BLogInfo(@"Message %d of %@ at %f", i, name, 1.5);
+        }
+        NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+        @autoreleasepool {
+            [self flushedLines];
+        }
+        callSite += mid - start;
+        flush += [NSDate timeIntervalSinceReferenceDate] - mid;
+    }
+    NSLog(@"BLogInfo x %d: %0.6f sec, %0.6f ratio vs baseline.", PERF_TEST_COUNT, callSite, callSite / baseline);
+    NSLog(@"BinaryLog flushToStream x %d: %0.6f sec, %0.6f ratio vs baseline.", PERF_TEST_COUNT, flush, flush / baseline);
+}
+
+
+/**
+ * Flush BinaryLog through LogFormatter to a memory stream, and return the lines.
+ */
+-(NSArray *)flushedLines {
+    NSOutputStream * stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    NSError * error = nil;
+    BOOL ok = [BinaryLog flushToStream:stream formatter:nil error:&error];
+    XCTAssert(ok);
+    XCTAssertNil(error);
+    NSData * data = [stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+    [stream close];
+
+    NSString * text = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+    if (text.length == 0) {
+        return @[];
+    }
+    XCTAssert([text hasSuffix:@"\n"]);
+    return [[text substringToIndex:text.length - 1] componentsSeparatedByString:@"\n"];
+}
+
+
+@end
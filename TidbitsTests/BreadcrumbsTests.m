@@ -0,0 +1,199 @@
+//
+//  BreadcrumbsTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "Breadcrumbs.h"
+
+#import "TBTestCaseBase.h"
+
+
+// Must match MAX_CRUMBS in Breadcrumbs.m.
+#define MAX_CRUMBS 30
+// More than TAG_LIMIT in Breadcrumbs.m.
+#define MORE_THAN_TAG_LIMIT 5000
+
+
+@interface BreadcrumbsTestsDelegate : NSObject <BreadcrumbsDelegate>
+
+@property (nonatomic) NSArray * savedTrail;
+@property (nonatomic) NSMutableArray * trackedTags;
+
+@end
+
+
+@implementation BreadcrumbsTestsDelegate
+
+
+-(instancetype)init {
+    self = [super init];
+    if (self) {
+        _trackedTags = [NSMutableArray array];
+    }
+    return self;
+}
+
+
+-(void)breadcrumbsSaveTrail:(NSArray *)trail {
+    self.savedTrail = trail;
+}
+
+
+-(void)breadcrumbsTrack:(NSString *)tag method:(TrackMethod)method {
+    [self.trackedTags addObject:tag];
+}
+
+
+@end
+
+
+@interface BreadcrumbsTests : TBTestCaseBase
+
+@end
+
+
+@implementation BreadcrumbsTests
+
+
+-(void)testCoalescesRepeats {
+    Breadcrumbs * crumbs = [self makeBreadcrumbs];
+    [crumbs track:@"a" method:Track];
+    [crumbs track:[NSMutableString stringWithString:@"a"] method:Track];
+    [crumbs track:@"a" method:Track];
+    [crumbs track:@"b" method:Track];
+    [crumbs track:@"a" method:Track];
+
+    XCTAssertEqualObjects([crumbs trail], (@[@"a*3", @"b", @"a"]));
+}
+
+
+-(void)testKeepsMostRecentCrumbs {
+    Breadcrumbs * crumbs = [self makeBreadcrumbs];
+    for (NSUInteger i = 0; i < MAX_CRUMBS + 10; i++) {
+        [crumbs track:[NSString stringWithFormat:@"crumb-%lu", (unsigned long)i] method:Track];
+    }
+
+    NSArray * trail = [crumbs trail];
+    XCTAssertEqual(trail.count, (NSUInteger)MAX_CRUMBS);
+    XCTAssertEqualObjects(trail[0], @"crumb-10");
+    XCTAssertEqualObjects(trail.lastObject, ([NSString stringWithFormat:@"crumb-%d", MAX_CRUMBS + 9]));
+}
+
+
+-(void)testTagsBeyondTableLimit {
+    Breadcrumbs * crumbs = [self makeBreadcrumbs];
+    for (NSUInteger i = 0; i < MORE_THAN_TAG_LIMIT; i++) {
+        [crumbs track:[NSString stringWithFormat:@"many-tags-%lu", (unsigned long)i] method:Track];
+    }
+
+    NSArray * trail = [crumbs trail];
+    XCTAssertEqual(trail.count, (NSUInteger)MAX_CRUMBS);
+    XCTAssertEqualObjects(trail[0], ([NSString stringWithFormat:@"many-tags-%d", MORE_THAN_TAG_LIMIT - MAX_CRUMBS]));
+    XCTAssertEqualObjects(trail.lastObject, ([NSString stringWithFormat:@"many-tags-%d", MORE_THAN_TAG_LIMIT - 1]));
+
+    // The table is full now, so these are all kept as strings, and must still be coalesced and popped properly.
+    [crumbs track:[NSMutableString stringWithString:@"many-tags-repeated"] method:Track];
+    [crumbs track:@"many-tags-repeated" method:Track];
+    [crumbs track:@"many-tags-other" method:Track];
+    [crumbs push:@"many-tags-pushed"];
+    [crumbs pop:@"many-tags-pushed"];
+
+    trail = [crumbs trail];
+    XCTAssertEqualObjects([trail subarrayWithRange:NSMakeRange(trail.count - 4, 4)], (@[@"many-tags-repeated*2", @"many-tags-other", @"many-tags-pushed", @"<many-tags-pushed"]));
+    BreadcrumbsEntry * last = [crumbs trailEntries].lastObject;
+    XCTAssertEqualObjects(last.tag, @"<many-tags-pushed");
+}
+
+
+-(void)testPushAndPop {
+    Breadcrumbs * crumbs = [self makeBreadcrumbs];
+    [crumbs push:@"outer"];
+    [crumbs push:@"inner"];
+    [crumbs pop:@"inner"];
+    [crumbs push:@"inner"];
+    [crumbs pop:nil];
+    [crumbs pop:@"outer"];
+
+    XCTAssertEqualObjects([crumbs trail], (@[@"outer", @"inner", @"<inner", @"inner", @"<inner", @"<outer"]));
+}
+
+
+-(void)testEntries {
+    Breadcrumbs * crumbs = [self makeBreadcrumbs];
+    NSDate * start = [NSDate dateWithTimeIntervalSinceNow:-0.01];
+    [crumbs track:@"x" method:Track];
+    [crumbs track:@"x" method:Track];
+    [crumbs track:@"y" method:Track];
+    NSDate * end = [NSDate dateWithTimeIntervalSinceNow:0.01];
+
+    NSArray * entries = [crumbs trailEntries];
+    XCTAssertEqual(entries.count, (NSUInteger)2);
+    BreadcrumbsEntry * x = entries[0];
+    XCTAssertEqualObjects(x.tag, @"x");
+    XCTAssertEqual(x.count, (NSUInteger)2);
+    XCTAssertEqualObjects(x.description, @"x*2");
+    for (BreadcrumbsEntry * entry in entries) {
+        XCTAssert([entry.date compare:start] != NSOrderedAscending);
+        XCTAssert([entry.date compare:end] != NSOrderedDescending);
+    }
+}
+
+
+-(void)testDelegate {
+    Breadcrumbs * crumbs = [self makeBreadcrumbs];
+    BreadcrumbsTestsDelegate * delegate = [[BreadcrumbsTestsDelegate alloc] init];
+    crumbs.delegate = delegate;
+
+    [crumbs track:@"first" method:Track];
+    [crumbs track:@"second" method:Track];
+    [crumbs track:@"second" method:Track];
+
+    XCTAssertEqualObjects(delegate.savedTrail, (@[@"first", @"second*2"]));
+    XCTAssertEqualObjects(delegate.trackedTags, (@[@"first", @"second", @"second"]));
+}
+
+
+-(void)testConcurrentRepeatsAreAllCounted {
+    Breadcrumbs * crumbs = [self makeBreadcrumbs];
+    NSUInteger threadCount = 4;
+    NSUInteger perThread = 5000;
+    dispatch_apply(threadCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t t) {
+        for (NSUInteger i = 0; i < perThread; i++) {
+            [crumbs track:@"concurrent" method:Track];
+        }
+    });
+
+    NSUInteger total = 0;
+    for (BreadcrumbsEntry * entry in [crumbs trailEntries]) {
+        XCTAssertEqualObjects(entry.tag, @"concurrent");
+        total += entry.count;
+    }
+    XCTAssertEqual(total, threadCount * perThread);
+}
+
+
+-(void)testTrackPerformance {
+    Breadcrumbs * crumbs = [self makeBreadcrumbs];
+    NSArray * tags = @[@"inbox", @"inbox", @"thread", @"compose", @"inbox"];
+    NSUInteger count = 100000;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < count; i++) {
+        [crumbs track:tags[i % tags.count] method:Track];
+    }
+    NSTimeInterval elapsed = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"Breadcrumbs track x %lu: %0.6f sec.", (unsigned long)count, elapsed);
+}
+
+
+-(Breadcrumbs *)makeBreadcrumbs {
+    Breadcrumbs * crumbs = [[Breadcrumbs alloc] init];
+    crumbs.logsToConsole = NO;
+    return crumbs;
+}
+
+
+@end
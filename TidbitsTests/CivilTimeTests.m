@@ -0,0 +1,216 @@
+//
+//  CivilTimeTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/8/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "CivilTime.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface CivilTimeTests : TBTestCaseBase
+
+@end
+
+
+@implementation CivilTimeTests
+
+
+/**
+ * Zones with ordinary DST, DST of 30 minutes (Lord Howe), transitions at midnight (Sao Paulo), changes of standard
+ * time with no DST (Moscow), and no changes at all (Kolkata, Kathmandu).
+ */
+static NSArray * testTimeZones() {
+    return @[@"America/Los_Angeles", @"Europe/London", @"Australia/Lord_Howe", @"America/Sao_Paulo",
+             @"Europe/Moscow", @"Asia/Kolkata", @"Asia/Kathmandu"];
+}
+
+
+static NSCalendar * gregorianCalendar(NSTimeZone * tz) {
+    NSCalendar * cal = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar];
+    cal.timeZone = tz;
+    return cal;
+}
+
+
+-(void)testDaysFromDate {
+    XCTAssertEqual(CivilTimeDaysFromDate(1970, 1, 1), 0LL);
+    XCTAssertEqual(CivilTimeDaysFromDate(2000, 3, 1), 11017LL);
+    XCTAssertEqual(CivilTimeDaysFromDate(1969, 12, 31), -1LL);
+    XCTAssertEqual(CivilTimeDaysFromDate(2015, 2, 29), CivilTimeDaysFromDate(2015, 3, 1));
+    XCTAssertEqual(CivilTimeDaysFromDate(2015, 1, 0), CivilTimeDaysFromDate(2014, 12, 31));
+
+    NSCalendar * cal = gregorianCalendar([NSTimeZone timeZoneForSecondsFromGMT:0]);
+    for (int64_t day = -800000; day < 800000; day += 997) {
+        int y, m, d;
+        CivilTimeDateFromDays(day, &y, &m, &d);
+        XCTAssertEqual(CivilTimeDaysFromDate(y, m, d), day);
+
+        NSDate * date = [NSDate dateWithTimeIntervalSince1970:day * 86400.0];
+        NSDateComponents * comps = [cal components:(NSYearCalendarUnit | NSMonthCalendarUnit | NSDayCalendarUnit | NSWeekdayCalendarUnit | NSEraCalendarUnit) fromDate:date];
+        if (comps.era == 1) {
+            XCTAssertEqual((NSInteger)y, comps.year);
+            XCTAssertEqual((NSInteger)m, comps.month);
+            XCTAssertEqual((NSInteger)d, comps.day);
+        }
+        XCTAssertEqual((NSInteger)CivilTimeWeekdayFromDays(day) + 1, comps.weekday);
+    }
+}
+
+
+-(void)testDaysFromSeconds {
+    XCTAssertEqual(CivilTimeDaysFromSeconds(0), 0LL);
+    XCTAssertEqual(CivilTimeDaysFromSeconds(86399), 0LL);
+    XCTAssertEqual(CivilTimeDaysFromSeconds(86400), 1LL);
+    XCTAssertEqual(CivilTimeDaysFromSeconds(-1), -1LL);
+    XCTAssertEqual(CivilTimeDaysFromSeconds(-86400), -1LL);
+    XCTAssertEqual(CivilTimeDaysFromSeconds(-86401), -2LL);
+}
+
+
+-(void)testLocalFromUTCMatchesNSTimeZone {
+    for (NSString * name in testTimeZones()) {
+        NSTimeZone * tz = [NSTimeZone timeZoneWithName:name];
+        CivilTimeZoneTable * table = CivilTimeZoneTableCreate(tz);
+
+        for (int64_t utc = CIVIL_TIME_TABLE_START; utc < CIVIL_TIME_TABLE_END; utc += 6 * 3600 + 7) {
+            [self checkLocalFromUTC:utc table:table tz:tz];
+        }
+        for (NSNumber * transition in transitionsOf(tz)) {
+            int64_t t = transition.longLongValue;
+            [self checkLocalFromUTC:t - 1 table:table tz:tz];
+            [self checkLocalFromUTC:t table:table tz:tz];
+        }
+
+        int64_t local;
+        XCTAssertFalse(CivilTimeZoneTableLocalFromUTC(table, CIVIL_TIME_TABLE_START - 1, &local));
+        XCTAssertFalse(CivilTimeZoneTableLocalFromUTC(table, CIVIL_TIME_TABLE_END, &local));
+
+        CivilTimeZoneTableFree(table);
+    }
+}
+
+
+-(void)checkLocalFromUTC:(int64_t)utc table:(CivilTimeZoneTable *)table tz:(NSTimeZone *)tz {
+    int64_t local;
+    XCTAssertTrue(CivilTimeZoneTableLocalFromUTC(table, utc, &local));
+    NSInteger expected = [tz secondsFromGMTForDate:[NSDate dateWithTimeIntervalSince1970:utc]];
+    XCTAssertEqual(local - utc, (int64_t)expected, @"%@ at %lld", tz.name, utc);
+}
+
+
+/**
+ * Every hour, and every 15 minutes either side of each transition, from 2010 to 2020.
+ */
+-(void)testUTCFromLocalMatchesNSCalendar {
+    for (NSString * name in testTimeZones()) {
+        NSTimeZone * tz = [NSTimeZone timeZoneWithName:name];
+        NSCalendar * cal = gregorianCalendar(tz);
+        CivilTimeZoneTable * table = CivilTimeZoneTableCreate(tz);
+
+        NSMutableArray * locals = [NSMutableArray array];
+        int64_t start = CivilTimeDaysFromDate(2010, 1, 1) * 86400;
+        int64_t end = CivilTimeDaysFromDate(2020, 1, 1) * 86400;
+        for (int64_t local = start; local < end; local += 3600) {
+            [locals addObject:@(local)];
+        }
+        for (NSNumber * transition in transitionsOf(tz)) {
+            int64_t t = transition.longLongValue;
+            if (t < start || t >= end) {
+                continue;
+            }
+            int64_t localT = t + [tz secondsFromGMTForDate:[NSDate dateWithTimeIntervalSince1970:t - 1]];
+            for (int64_t local = localT - 3 * 3600; local <= localT + 3 * 3600; local += 15 * 60) {
+                [locals addObject:@(local)];
+            }
+        }
+
+        NSUInteger fallbacks = 0;
+        for (NSNumber * n in locals) {
+            int64_t local = n.longLongValue;
+            int64_t utc;
+            if (!CivilTimeZoneTableUTCFromLocal(table, local, &utc)) {
+                fallbacks++;
+                continue;
+            }
+
+            int y, m, d;
+            int64_t day = CivilTimeDaysFromSeconds(local);
+            CivilTimeDateFromDays(day, &y, &m, &d);
+            NSDateComponents * comps = [[NSDateComponents alloc] init];
+            comps.year = y;
+            comps.month = m;
+            comps.day = d;
+            comps.hour = (local - day * 86400) / 3600;
+            comps.minute = (local - day * 86400) / 60 % 60;
+            NSDate * expected = [cal dateFromComponents:comps];
+            XCTAssertEqual((double)utc, expected.timeIntervalSince1970, @"%@ at local %lld", name, local);
+        }
+
+        // Only the times inside a transition should need NSCalendar.
+        XCTAssertLessThanOrEqual(fallbacks, transitionsOf(tz).count * 8, @"%@", name);
+
+        CivilTimeZoneTableFree(table);
+    }
+}
+
+
+-(void)testUTCFromLocalSkippedAndRepeated {
+    NSTimeZone * tz = [NSTimeZone timeZoneWithName:@"America/Los_Angeles"];
+    CivilTimeZoneTable * table = CivilTimeZoneTableCreate(tz);
+    int64_t utc;
+
+    // 2015-03-08 02:30 doesn't exist, and 2015-11-01 01:30 happens twice.
+    int64_t march8 = CivilTimeDaysFromDate(2015, 3, 8) * 86400;
+    int64_t nov1 = CivilTimeDaysFromDate(2015, 11, 1) * 86400;
+    XCTAssertFalse(CivilTimeZoneTableUTCFromLocal(table, march8 + 2 * 3600 + 30 * 60, &utc));
+    XCTAssertFalse(CivilTimeZoneTableUTCFromLocal(table, nov1 + 3600 + 30 * 60, &utc));
+
+    XCTAssertTrue(CivilTimeZoneTableUTCFromLocal(table, march8 + 3 * 3600, &utc));
+    XCTAssertEqual(utc, march8 + 10 * 3600);
+    XCTAssertTrue(CivilTimeZoneTableUTCFromLocal(table, nov1 + 2 * 3600, &utc));
+    XCTAssertEqual(utc, nov1 + 10 * 3600);
+
+    CivilTimeZoneTableFree(table);
+}
+
+
+-(void)testSystemTimeZoneTable {
+    NSTimeZone * tz = [NSTimeZone systemTimeZone];
+    const CivilTimeZoneTable * table = CivilTimeZoneTableForSystemTimeZone();
+    XCTAssert(table != NULL);
+    XCTAssertEqual(CivilTimeZoneTableForTimeZone(tz), table);
+    XCTAssertEqual(CivilTimeZoneTableForSystemTimeZone(), table);
+    XCTAssert(CivilTimeZoneTableForTimeZone(nil) == NULL);
+    NSTimeZone * other = [NSTimeZone timeZoneWithName:([tz.name isEqualToString:@"Asia/Tokyo"] ? @"Europe/Paris" : @"Asia/Tokyo")];
+    XCTAssert(CivilTimeZoneTableForTimeZone(other) == NULL);
+
+    CivilTimeZoneTableInvalidateSystemTimeZone();
+    const CivilTimeZoneTable * rebuilt = CivilTimeZoneTableForSystemTimeZone();
+    XCTAssert(rebuilt != NULL);
+    XCTAssert(rebuilt != table);
+
+    int64_t local;
+    XCTAssertTrue(CivilTimeZoneTableLocalFromUTC(CivilTimeZoneTableForUTC(), 1428451200, &local));
+    XCTAssertEqual(local, 1428451200LL);
+}
+
+
+static NSArray * transitionsOf(NSTimeZone * tz) {
+    NSMutableArray * result = [NSMutableArray array];
+    NSDate * date = [NSDate dateWithTimeIntervalSince1970:CIVIL_TIME_TABLE_START];
+    while (true) {
+        date = [tz nextDaylightSavingTimeTransitionAfterDate:date];
+        if (date == nil || date.timeIntervalSince1970 >= CIVIL_TIME_TABLE_END) {
+            break;
+        }
+        [result addObject:@((int64_t)ceil(date.timeIntervalSince1970))];
+    }
+    return result;
+}
+
+
+@end
@@ -0,0 +1,180 @@
+//
+//  ComplexKeyPathTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/3/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "ComplexKeyPath.h"
+#import "NSObject+MTJSONUtils.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface ComplexKeyPathTests : TBTestCaseBase
+
+@end
+
+
+@implementation ComplexKeyPathTests
+
+
+/**
+ * The original MTJSONUtils implementation, for comparison.
+ */
+static id legacyValueForComplexKeyPath(id self, NSString * keyPath) {
+    id currentObject = self;
+
+    NSMutableString * path = [NSMutableString string];
+    NSMutableString * subscriptKey = [NSMutableString string];
+    NSMutableString * string = path;
+
+    for (NSUInteger i = 0; i < keyPath.length; i++) {
+        unichar c = [keyPath characterAtIndex:i];
+
+        if (c == '[') {
+            NSString * trimmedPath = [path stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@". \n"]];
+            currentObject = [currentObject valueForKeyPath:trimmedPath];
+            [subscriptKey setString:@""];
+            string = subscriptKey;
+            continue;
+        }
+
+        if (c == ']') {
+            if (!currentObject) return nil;
+            if (![currentObject isKindOfClass:[NSArray class]]) return nil;
+            NSArray * currentArray = currentObject;
+            NSUInteger index = 0;
+            if ([subscriptKey isEqualToString:@"first"]) {
+                index = 0;
+            }
+            else if ([subscriptKey isEqualToString:@"last"]) {
+                index = [currentArray count] - 1;
+            }
+            else {
+                index = [subscriptKey intValue];
+            }
+            if ([currentArray count] == 0) return nil;
+            if (index > [currentArray count] - 1) return nil;
+            currentObject = [currentArray objectAtIndex:index];
+            if ([currentObject isKindOfClass:[NSNull class]]) return nil;
+            [path setString:@""];
+            string = path;
+            continue;
+        }
+
+        [string appendString:[NSString stringWithCharacters:&c length:1]];
+
+        if (i == keyPath.length - 1) {
+            NSString * trimmedPath = [path stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@". \n"]];
+            currentObject = [currentObject valueForKeyPath:trimmedPath];
+            break;
+        }
+    }
+
+    return currentObject;
+}
+
+
+static NSDictionary * makeRecord(NSUInteger i) {
+    return @{@"id": @(i),
+             @"subject": [NSString stringWithFormat:@"Subject %lu", (unsigned long)i],
+             @"from": @{@"name": @"Someone", @"email": @"someone@example.com"},
+             @"to": @[@{@"email": @"a@example.com"}, @{@"email": @"b@example.com"}, [NSNull null]],
+             @"labels": @[],
+             @"meta": @{@"counts": @[@1, @2, @3], @"none": [NSNull null]}};
+}
+
+
+-(void)testMatchesLegacy {
+    NSDictionary * record = makeRecord(7);
+    NSArray * paths = @[@"id", @"subject", @"from.email", @" .from.name. ", @"to[0].email", @"to[first].email", @"to[last]",
+                        @"to[1]", @"to[2]", @"to[5].email", @"to[-1]", @"labels[0]", @"labels[last]", @"meta.counts[last]",
+                        @"meta.counts.@count", @"meta.counts.@sum.self", @"meta.none", @"subject[0]", @"nosuch.key",
+                        @"nosuch[0]", @"from.email[0]"];
+    for (NSString * path in paths) {
+        XCTAssertEqualObjects([[ComplexKeyPath keyPathWithString:path] valueForObject:record], legacyValueForComplexKeyPath(record, path), @"%@", path);
+        XCTAssertEqualObjects([record valueForComplexKeyPath:path], legacyValueForComplexKeyPath(record, path), @"%@", path);
+    }
+}
+
+
+-(void)testSubscriptsWithoutKeys {
+    NSArray * arr = @[@[@"a", @"b"], @[@"c"]];
+    XCTAssertEqualObjects([arr valueForComplexKeyPath:@"[0][1]"], @"b");
+    XCTAssertEqualObjects([arr valueForComplexKeyPath:@"[last][first]"], @"c");
+    XCTAssertNil([arr valueForComplexKeyPath:@"[0"]);
+    XCTAssertEqual([arr valueForComplexKeyPath:@""], arr);
+}
+
+
+-(void)testCache {
+    ComplexKeyPath * a = [ComplexKeyPath keyPathWithString:@"from.email"];
+    ComplexKeyPath * b = [ComplexKeyPath keyPathWithString:[NSMutableString stringWithString:@"from.email"]];
+    XCTAssertEqual(a, b);
+    XCTAssertEqualObjects(a.string, @"from.email");
+}
+
+
+-(void)testBatch {
+    NSMutableArray * records = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 100; i++) {
+        [records addObject:makeRecord(i)];
+    }
+    [records addObject:@{}];
+
+    NSArray * paths = @[@"id", @"from.name", @"from.email", @"to[0].email", @"to[1].email", @"to[2]", [ComplexKeyPath keyPathWithString:@"meta.counts[last]"], @"bad["];
+    NSArray * columns = [ComplexKeyPath valuesForKeyPaths:paths ofObjects:records];
+    XCTAssertEqual(columns.count, paths.count);
+    for (NSUInteger j = 0; j < paths.count; j++) {
+        ComplexKeyPath * path = ([paths[j] isKindOfClass:[ComplexKeyPath class]] ? paths[j] : [ComplexKeyPath keyPathWithString:paths[j]]);
+        NSArray * column = columns[j];
+        XCTAssertEqual(column.count, records.count);
+        for (NSUInteger i = 0; i < records.count; i++) {
+            id expected = [path valueForObject:records[i]];
+            XCTAssertEqualObjects(column[i], (expected == nil ? [NSNull null] : expected), @"%@ %lu", path, (unsigned long)i);
+        }
+    }
+}
+
+
+-(void)testPerformance {
+    NSMutableArray * records = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 5000; i++) {
+        [records addObject:makeRecord(i)];
+    }
+    NSArray * paths = @[@"id", @"from.email", @"to[0].email", @"meta.counts[last]"];
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        for (NSDictionary * record in records) {
+            for (NSString * path in paths) {
+                (void)legacyValueForComplexKeyPath(record, path);
+            }
+        }
+    }
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        for (NSDictionary * record in records) {
+            for (NSString * path in paths) {
+                (void)[record valueForComplexKeyPath:path];
+            }
+        }
+    }
+    NSTimeInterval mid2 = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        (void)[ComplexKeyPath valuesForKeyPaths:paths ofObjects:records];
+    }
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+    NSTimeInterval baseline = mid - start;
+    NSTimeInterval result = mid2 - mid;
+    NSTimeInterval batch = end - mid2;
+    NSUInteger count = records.count * paths.count;
+    NSLog(@"valueForComplexKeyPath x %lu: %0.6f sec, %0.6f ratio vs baseline.", (unsigned long)count, result, result / baseline);
+    NSLog(@"valuesForKeyPaths:ofObjects: x %lu: %0.6f sec, %0.6f ratio vs baseline.", (unsigned long)count, batch, batch / baseline);
+}
+
+
+@end
@@ -0,0 +1,260 @@
+//
+//  GeoDistanceTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <CoreLocation/CoreLocation.h>
+
+#import "GeoDistance.h"
+#import "TTTLocationFormatter.h"
+
+#import "TBTestCaseBase.h"
+
+
+#define RANDOM_COUNT 10000
+#define PERF_TEST_DESTINATIONS 500
+#define PERF_TEST_REPEATS 200
+
+
+@interface GeoDistanceTests : TBTestCaseBase
+
+@end
+
+
+@implementation GeoDistanceTests
+
+
+/**
+ * Vincenty's own example, Flinders Peak to Buninyong.
+ */
+-(void)testVincentyReference {
+    double distance;
+    double bearing;
+    GeoDistanceAndBearing(GeoDistanceVincenty, -dms(37, 57, 3.72030), dms(144, 25, 29.52440), -dms(37, 39, 10.15610), dms(143, 55, 35.38390), &distance, &bearing);
+    XCTAssertEqualWithAccuracy(distance, 54972.271, 0.001);
+    XCTAssertEqualWithAccuracy(bearing, dms(306, 52, 5.37), 0.01 / 3600);
+}
+
+
+-(void)testHaversineMatchesScalarFormula {
+    double * latitudes = malloc(RANDOM_COUNT * sizeof(double));
+    double * longitudes = malloc(RANDOM_COUNT * sizeof(double));
+    double * distances = malloc(RANDOM_COUNT * sizeof(double));
+    double * bearings = malloc(RANDOM_COUNT * sizeof(double));
+    randomCoordinates(latitudes, longitudes, RANDOM_COUNT);
+
+    double lat1 = 37.7749;
+    double lon1 = -122.4194;
+    GeoDistancesAndBearings(GeoDistanceHaversine, lat1, lon1, latitudes, longitudes, RANDOM_COUNT, distances, bearings, false);
+
+    double phi1 = lat1 * M_PI / 180;
+    for (NSUInteger i = 0; i < RANDOM_COUNT; i++) {
+        double phi2 = latitudes[i] * M_PI / 180;
+        double dLambda = (longitudes[i] - lon1) * M_PI / 180;
+        double a = pow(sin((phi2 - phi1) / 2), 2) + cos(phi1) * cos(phi2) * pow(sin(dLambda / 2), 2);
+        double expectedDistance = 2 * GEO_EARTH_MEAN_RADIUS * asin(sqrt(a));
+        double expectedBearing = fmod(atan2(sin(dLambda) * cos(phi2), cos(phi1) * sin(phi2) - sin(phi1) * cos(phi2) * cos(dLambda)) * 180 / M_PI + 360, 360);
+        double bearingError = fabs(bearings[i] - expectedBearing);
+
+        XCTAssertEqualWithAccuracy(distances[i], expectedDistance, 1e-3, @"%f %f", latitudes[i], longitudes[i]);
+        XCTAssert(MIN(bearingError, 360 - bearingError) < 1e-9, @"%f %f", latitudes[i], longitudes[i]);
+        XCTAssert(bearings[i] >= 0 && bearings[i] < 360, @"%f", bearings[i]);
+    }
+
+    free(latitudes);
+    free(longitudes);
+    free(distances);
+    free(bearings);
+}
+
+
+-(void)testMatchesCLLocation {
+    double latitudes[RANDOM_COUNT / 10];
+    double longitudes[RANDOM_COUNT / 10];
+    double haversine[RANDOM_COUNT / 10];
+    double vincenty[RANDOM_COUNT / 10];
+    NSUInteger count = RANDOM_COUNT / 10;
+    randomCoordinates(latitudes, longitudes, count);
+
+    CLLocation * origin = [[CLLocation alloc] initWithLatitude:51.5074 longitude:-0.1278];
+    GeoDistancesAndBearings(GeoDistanceHaversine, 51.5074, -0.1278, latitudes, longitudes, count, haversine, NULL, false);
+    GeoDistancesAndBearings(GeoDistanceVincenty, 51.5074, -0.1278, latitudes, longitudes, count, vincenty, NULL, false);
+
+    for (NSUInteger i = 0; i < count; i++) {
+        CLLocation * destination = [[CLLocation alloc] initWithLatitude:latitudes[i] longitude:longitudes[i]];
+        CLLocationDistance expected = [destination distanceFromLocation:origin];
+        XCTAssertEqualWithAccuracy(haversine[i], expected, expected * 0.01 + 1, @"%f %f", latitudes[i], longitudes[i]);
+        if (!isnan(vincenty[i])) {
+            XCTAssertEqualWithAccuracy(vincenty[i], expected, expected * 0.01 + 1, @"%f %f", latitudes[i], longitudes[i]);
+        }
+    }
+}
+
+
+-(void)testEdgeCases {
+    double distance;
+    double bearing;
+
+    GeoDistanceAndBearing(GeoDistanceHaversine, 10, 20, 10, 20, &distance, &bearing);
+    XCTAssertEqual(distance, 0.0);
+    XCTAssertEqual(bearing, 0.0);
+    GeoDistanceAndBearing(GeoDistanceVincenty, 10, 20, 10, 20, &distance, &bearing);
+    XCTAssertEqual(distance, 0.0);
+    XCTAssertEqual(bearing, 0.0);
+
+    // Across the antimeridian.
+    GeoDistanceAndBearing(GeoDistanceVincenty, 0, -179.5, 0, 179.5, &distance, &bearing);
+    XCTAssertEqualWithAccuracy(distance, 111319.491, 0.001);
+    XCTAssertEqualWithAccuracy(bearing, 270.0, 1e-9);
+
+    // Due north.
+    GeoDistanceAndBearing(GeoDistanceHaversine, 51.5, 0, 51.6, 0, &distance, &bearing);
+    XCTAssertEqualWithAccuracy(distance, GEO_EARTH_MEAN_RADIUS * 0.1 * M_PI / 180, 1e-6);
+    XCTAssertEqual(bearing, 0.0);
+
+    // Nearly antipodal points don't converge.
+    GeoDistanceAndBearing(GeoDistanceVincenty, 0, 0, 0.5, 179.7, &distance, &bearing);
+    XCTAssert(isnan(distance));
+    XCTAssert(isnan(bearing));
+    GeoDistanceAndBearing(GeoDistanceHaversine, 0, 0, 0, 180, &distance, &bearing);
+    XCTAssertEqualWithAccuracy(distance, GEO_EARTH_MEAN_RADIUS * M_PI, 1e-6);
+
+    // Either output may be skipped.
+    GeoDistanceAndBearing(GeoDistanceHaversine, 0, 0, 1, 1, NULL, &bearing);
+    XCTAssertEqualWithAccuracy(bearing, 45.0, 0.01);
+    GeoDistanceAndBearing(GeoDistanceVincenty, 0, 0, 1, 1, &distance, NULL);
+    XCTAssertEqualWithAccuracy(distance, 156899.568, 0.001);
+}
+
+
+-(void)testConcurrentMatchesSerial {
+    for (GeoDistanceMethod method = GeoDistanceHaversine; method <= GeoDistanceVincenty; method++) {
+        size_t size = RANDOM_COUNT * sizeof(double);
+        double * latitudes = malloc(size);
+        double * longitudes = malloc(size);
+        double * serialDistances = malloc(size);
+        double * serialBearings = malloc(size);
+        double * concurrentDistances = malloc(size);
+        double * concurrentBearings = malloc(size);
+        randomCoordinates(latitudes, longitudes, RANDOM_COUNT);
+
+        GeoDistancesAndBearings(method, -33.8688, 151.2093, latitudes, longitudes, RANDOM_COUNT, serialDistances, serialBearings, false);
+        GeoDistancesAndBearings(method, -33.8688, 151.2093, latitudes, longitudes, RANDOM_COUNT, concurrentDistances, concurrentBearings, true);
+
+        // NAN != NAN, so compare the bytes.
+        XCTAssertEqual(memcmp(serialDistances, concurrentDistances, size), 0);
+        XCTAssertEqual(memcmp(serialBearings, concurrentBearings, size), 0);
+
+        free(latitudes);
+        free(longitudes);
+        free(serialDistances);
+        free(serialBearings);
+        free(concurrentDistances);
+        free(concurrentBearings);
+    }
+}
+
+
+-(void)testFormatterStringsFromDistances {
+    TTTLocationFormatter * formatter = [[TTTLocationFormatter alloc] init];
+    CLLocation * origin = [[CLLocation alloc] initWithLatitude:40.7128 longitude:-74.0060];
+    double latitudes[100];
+    double longitudes[100];
+    double distances[100];
+    double bearings[100];
+    randomCoordinates(latitudes, longitudes, 100);
+    GeoDistancesAndBearings(GeoDistanceHaversine, origin.coordinate.latitude, origin.coordinate.longitude, latitudes, longitudes, 100, NULL, bearings, false);
+
+    for (NSUInteger i = 0; i < 100; i++) {
+        CLLocation * destination = [[CLLocation alloc] initWithLatitude:latitudes[i] longitude:longitudes[i]];
+        distances[i] = [destination distanceFromLocation:origin];
+    }
+
+    NSArray * withBearings = [formatter stringsFromDistances:distances bearings:bearings count:100];
+    NSArray * withoutBearings = [formatter stringsFromDistances:distances bearings:NULL count:100];
+    XCTAssertEqual(withBearings.count, (NSUInteger)100);
+    for (NSUInteger i = 0; i < 100; i++) {
+        CLLocation * destination = [[CLLocation alloc] initWithLatitude:latitudes[i] longitude:longitudes[i]];
+        XCTAssertEqualObjects(withBearings[i], [formatter stringFromDistanceAndBearingFromLocation:origin toLocation:destination]);
+        XCTAssertEqualObjects(withoutBearings[i], [formatter stringFromDistanceFromLocation:origin toLocation:destination]);
+    }
+}
+
+
+-(void)testPerformance {
+    double latitudes[PERF_TEST_DESTINATIONS];
+    double longitudes[PERF_TEST_DESTINATIONS];
+    double distances[PERF_TEST_DESTINATIONS];
+    double bearings[PERF_TEST_DESTINATIONS];
+    randomCoordinates(latitudes, longitudes, PERF_TEST_DESTINATIONS);
+
+    CLLocation * origin = [[CLLocation alloc] initWithLatitude:37.7749 longitude:-122.4194];
+    NSMutableArray * destinations = [NSMutableArray array];
+    for (NSUInteger i = 0; i < PERF_TEST_DESTINATIONS; i++) {
+        [destinations addObject:[[CLLocation alloc] initWithLatitude:latitudes[i] longitude:longitudes[i]]];
+    }
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger r = 0; r < PERF_TEST_REPEATS; r++) {
+        for (NSUInteger i = 0; i < PERF_TEST_DESTINATIONS; i++) {
+            distances[i] = [destinations[i] distanceFromLocation:origin];
+        }
+    }
+    NSTimeInterval baseline = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"CLLocation distanceFromLocation: %d x %d: %0.6f sec.", PERF_TEST_DESTINATIONS, PERF_TEST_REPEATS, baseline);
+
+    start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger r = 0; r < PERF_TEST_REPEATS; r++) {
+        GeoDistancesAndBearings(GeoDistanceHaversine, 37.7749, -122.4194, latitudes, longitudes, PERF_TEST_DESTINATIONS, distances, bearings, false);
+    }
+    NSTimeInterval haversine = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"Haversine distance and bearing %d x %d: %0.6f sec, %0.6f ratio vs baseline.", PERF_TEST_DESTINATIONS, PERF_TEST_REPEATS, haversine, haversine / baseline);
+
+    start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger r = 0; r < PERF_TEST_REPEATS; r++) {
+        GeoDistancesAndBearings(GeoDistanceVincenty, 37.7749, -122.4194, latitudes, longitudes, PERF_TEST_DESTINATIONS, distances, bearings, false);
+    }
+    NSTimeInterval vincenty = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"Vincenty distance and bearing %d x %d: %0.6f sec, %0.6f ratio vs baseline.", PERF_TEST_DESTINATIONS, PERF_TEST_REPEATS, vincenty, vincenty / baseline);
+
+    size_t bigCount = PERF_TEST_DESTINATIONS * PERF_TEST_REPEATS;
+    double * bigLatitudes = malloc(bigCount * sizeof(double));
+    double * bigLongitudes = malloc(bigCount * sizeof(double));
+    double * bigDistances = malloc(bigCount * sizeof(double));
+    randomCoordinates(bigLatitudes, bigLongitudes, bigCount);
+
+    start = [NSDate timeIntervalSinceReferenceDate];
+    GeoDistancesAndBearings(GeoDistanceVincenty, 37.7749, -122.4194, bigLatitudes, bigLongitudes, bigCount, bigDistances, NULL, true);
+    NSTimeInterval concurrent = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"Concurrent Vincenty distance x %zu: %0.6f sec, %0.6f ratio vs baseline.", bigCount, concurrent, concurrent / baseline);
+
+    free(bigLatitudes);
+    free(bigLongitudes);
+    free(bigDistances);
+}
+
+
+static double dms(double degrees, double minutes, double seconds) {
+    return degrees + minutes / 60 + seconds / 3600;
+}
+
+
+/**
+ * Deterministic points, uniform over latitude and longitude.
+ */
+static void randomCoordinates(double * latitudes, double * longitudes, size_t count) {
+    uint64_t x = 88172645463325252ULL;
+    for (size_t i = 0; i < count; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        latitudes[i] = (double)(x >> 11) / (double)(1ULL << 53) * 180 - 90;
+        longitudes[i] = (double)(x & 0xffffffff) / (double)0xffffffffULL * 360 - 180;
+    }
+}
+
+
+@end
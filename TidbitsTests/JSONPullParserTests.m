@@ -0,0 +1,312 @@
+//
+//  JSONPullParserTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/1/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <malloc/malloc.h>
+
+#import "JSONPullParser.h"
+#import "NSJSONSerialization+Misc.h"
+#import "StringPool.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface JSONPullParserTests : TBTestCaseBase
+
+@end
+
+
+@implementation JSONPullParserTests
+
+
+static NSData * utf8(NSString * s) {
+    return [s dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+
+static JSONPullParser * streamParser(NSData * data) {
+    NSInputStream * is = [NSInputStream inputStreamWithData:data];
+    [is open];
+    // The minimum buffer, so that tokens straddle refills and long strings make it grow.
+    return [[JSONPullParser alloc] initWithInputStream:is bufferSize:1];
+}
+
+
+-(void)testTokens {
+    JSONPullParser * p = [[JSONPullParser alloc] initWithData:utf8(@" {\"a\": [1, -2.5e3, true, false, null], \"b\": {}, \"c\": \"x\"} ")];
+    JSONPullToken expected[] = {
+        JSONPullTokenObjectStart,
+        JSONPullTokenKey, JSONPullTokenArrayStart,
+        JSONPullTokenNumber, JSONPullTokenNumber, JSONPullTokenTrue, JSONPullTokenFalse, JSONPullTokenNull,
+        JSONPullTokenArrayEnd,
+        JSONPullTokenKey, JSONPullTokenObjectStart, JSONPullTokenObjectEnd,
+        JSONPullTokenKey, JSONPullTokenString,
+        JSONPullTokenObjectEnd,
+        JSONPullTokenEnd,
+    };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        XCTAssertEqual([p next], expected[i], @"Token %zu", i);
+        if (i == 3) {
+            XCTAssertEqual(p.longLongValue, 1LL);
+            XCTAssertEqual(p.depth, (NSUInteger)2);
+        }
+        if (i == 4) {
+            XCTAssertEqual(p.doubleValue, -2500.0);
+            XCTAssertEqual(p.valueLength, (NSUInteger)6);
+        }
+        if (i == 12) {
+            XCTAssertTrue([p valueIsEqualToCString:"c"]);
+        }
+    }
+    XCTAssertNil(p.error);
+    XCTAssertEqual(p.depth, (NSUInteger)0);
+}
+
+
+-(void)testBorrowedRange {
+    NSData * data = utf8(@"[\"plain\", \"tab\\there\"]");
+    JSONPullParser * p = [[JSONPullParser alloc] initWithData:data];
+    [p next];
+    [p next];
+    // Unescaped strings point straight into the input.
+    XCTAssertEqual(p.valueBytes, (const uint8_t *)data.bytes + 2);
+    XCTAssertEqual(p.valueLength, (NSUInteger)5);
+    [p next];
+    XCTAssertEqualObjects(p.stringValue, @"tab\there");
+}
+
+
+-(void)testEscapes {
+    NSString * json = @"[\"\\\"\\\\\\/\\b\\f\\n\\r\\t\", \"\\u00e9\\u4e2d\", \"\\ud83d\\ude00\", \"\\ud83d.\", \"caf\u00e9\"]";
+    NSArray * expected = [NSJSONSerialization JSONObjectWithData:utf8(json) options:0 error:NULL];
+
+    JSONPullParser * p = [[JSONPullParser alloc] initWithData:utf8(json)];
+    [p next];
+    NSArray * result = [p objectValue];
+    XCTAssertEqualObjects(result[0], expected[0]);
+    XCTAssertEqualObjects(result[1], @"\u00e9\u4e2d");
+    XCTAssertEqualObjects(result[2], @"\U0001F600");
+    XCTAssertEqualObjects(result[3], @"\uFFFD.");
+    XCTAssertEqualObjects(result[4], @"caf\u00e9");
+}
+
+
+-(void)testObjectValueMatchesNSJSONSerialization {
+    NSString * json = @"{\"id\": 12345678901234, \"big\": 123456789012345678901234, \"pi\": 3.14159, \"neg\": -0.5e-3, "
+                      @"\"list\": [[], [{}], [1, [2, [3]]]], \"flags\": {\"on\": true, \"off\": false, \"none\": null}, \"s\": \"\"}";
+    id expected = [NSJSONSerialization JSONObjectWithData:utf8(json) options:0 error:NULL];
+
+    JSONPullParser * p = [[JSONPullParser alloc] initWithData:utf8(json)];
+    XCTAssertEqual([p next], JSONPullTokenObjectStart);
+    id result = [p objectValue];
+    XCTAssertEqualObjects(result[@"list"], expected[@"list"]);
+    XCTAssertEqualObjects(result[@"flags"], expected[@"flags"]);
+    XCTAssertEqualObjects(result[@"id"], expected[@"id"]);
+    XCTAssertEqualWithAccuracy([result[@"big"] doubleValue], [expected[@"big"] doubleValue], 1e10);
+    XCTAssertEqualObjects(result[@"pi"], @3.14159);
+    XCTAssertEqualObjects(result[@"neg"], @-0.0005);
+    XCTAssertEqualObjects(result[@"s"], @"");
+    XCTAssertEqual([p next], JSONPullTokenEnd);
+
+    p = streamParser(utf8(json));
+    [p next];
+    XCTAssertEqualObjects([p objectValue][@"flags"], expected[@"flags"]);
+}
+
+
+-(void)testSubtree {
+    NSString * json = @"{\"skip\": {\"deep\": [1, 2, {\"x\": \"y\"}]}, \"want\": {\"a\": [1, 2]}, \"after\": 3}";
+    JSONPullParser * p = [[JSONPullParser alloc] initWithData:utf8(json)];
+    XCTAssertEqual([p next], JSONPullTokenObjectStart);
+    XCTAssertEqual([p next], JSONPullTokenKey);
+    XCTAssertEqual([p next], JSONPullTokenObjectStart);
+    XCTAssertTrue([p skipValue]);
+    XCTAssertEqual([p next], JSONPullTokenKey);
+    XCTAssertEqualObjects(p.stringValue, @"want");
+    [p next];
+    XCTAssertEqualObjects([p objectValue], (@{@"a": @[@1, @2]}));
+    XCTAssertEqual([p next], JSONPullTokenKey);
+    XCTAssertEqualObjects(p.stringValue, @"after");
+    XCTAssertEqual([p next], JSONPullTokenNumber);
+    XCTAssertEqual([p next], JSONPullTokenObjectEnd);
+    XCTAssertEqual([p next], JSONPullTokenEnd);
+}
+
+
+-(void)testKeyPool {
+    StringPool * pool = [[StringPool alloc] init];
+    NSString * canonical = [pool intern:@"name"];
+    JSONPullParser * p = [[JSONPullParser alloc] initWithData:utf8(@"[{\"name\": 1}, {\"name\": 2, \"n\\u00e9\": 3}]")];
+    p.keyPool = pool;
+    [p next];
+    NSArray * result = [p objectValue];
+    XCTAssertEqualObjects(result, (@[@{@"name": @1}, @{@"name": @2, @"né": @3}]));
+    XCTAssertEqual([result[0] allKeys][0], canonical);
+    XCTAssertEqual([[result[1] allKeys] filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF == 'name'"]][0], canonical);
+    XCTAssertEqual(pool.count, (NSUInteger)2);
+}
+
+
+-(void)testStreamLongTokens {
+    NSMutableString * longString = [NSMutableString string];
+    for (int i = 0; i < 2000; i++) {
+        [longString appendFormat:@"%d\u00e9\\n", i];
+    }
+    NSString * json = [NSString stringWithFormat:@"[\"%@\", 1234.5, \"%@\"]", longString, longString];
+    id expected = [NSJSONSerialization JSONObjectWithData:utf8(json) options:0 error:NULL];
+
+    JSONPullParser * p = streamParser(utf8(json));
+    [p next];
+    XCTAssertEqualObjects([p objectValue], expected);
+    XCTAssertEqual([p next], JSONPullTokenEnd);
+    XCTAssertNil(p.error);
+}
+
+
+-(void)testErrors {
+    NSArray * bad = @[@"", @"{", @"[1,]", @"{\"a\" 1}", @"{1: 2}", @"[01]", @"[1.]", @"[-]", @"[1e]", @"[tru]",
+                      @"\"unterminated", @"[\"\\x\"]", @"[\"\\u12\"]", @"{\"a\": 1]", @"[1] 2", @"\"a\tb\""];
+    for (NSString * json in bad) {
+        JSONPullParser * p = [[JSONPullParser alloc] initWithData:utf8(json)];
+        JSONPullToken t;
+        do {
+            t = [p next];
+            if (t == JSONPullTokenString) {
+                (void)p.stringValue;
+            }
+        } while (t != JSONPullTokenError && t != JSONPullTokenEnd);
+        XCTAssertEqual(t, JSONPullTokenError, @"%@", json);
+        XCTAssertEqualObjects(p.error.domain, NSCocoaErrorDomain, @"%@", json);
+        XCTAssertEqual(p.error.code, (NSInteger)NSPropertyListReadCorruptError, @"%@", json);
+        XCTAssertEqual([p next], JSONPullTokenError);
+    }
+
+    NSMutableString * deep = [NSMutableString string];
+    for (int i = 0; i < 1000; i++) {
+        [deep appendString:@"["];
+    }
+    JSONPullParser * p = [[JSONPullParser alloc] initWithData:utf8(deep)];
+    while ([p next] == JSONPullTokenArrayStart) {
+    }
+    XCTAssertNotNil(p.error);
+}
+
+
+-(void)testTopLevelScalar {
+    JSONPullParser * p = [[JSONPullParser alloc] initWithData:utf8(@" 42 ")];
+    XCTAssertEqual([p next], JSONPullTokenNumber);
+    XCTAssertEqualObjects([p objectValue], @42);
+    XCTAssertEqual([p next], JSONPullTokenEnd);
+}
+
+
+-(void)testJSONPullParserFromBundle {
+    NSError * err = nil;
+    JSONPullParser * p = [NSJSONSerialization JSONPullParserFromBundle:[NSBundle bundleForClass:self.class] resourceName:@"NSJSONSerialization+MiscTests" error:&err];
+    XCTAssertNotNil(p);
+    XCTAssertNil(err);
+    [p next];
+    XCTAssertEqualObjects([p objectValue], (@{@"key1": @"val1"}));
+
+    p = [NSJSONSerialization JSONPullParserFromBundle:[NSBundle bundleForClass:self.class] resourceName:@"NoSuchFile" error:&err];
+    XCTAssertNil(p);
+    XCTAssertEqual(err.code, (NSInteger)NSFileNoSuchFileError);
+}
+
+
+#pragma mark - Performance
+
+
+static size_t mallocBytesInUse() {
+    malloc_statistics_t stats;
+    malloc_zone_statistics(NULL, &stats);
+    return stats.size_in_use;
+}
+
+
+static NSData * makeLargeJSON(NSUInteger count) {
+    NSMutableArray * messages = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [messages addObject:@{@"id": @(i),
+                              @"subject": [NSString stringWithFormat:@"Re: meeting notes %lu", (unsigned long)i],
+                              @"from": @{@"name": @"Someone", @"email": @"someone@example.com"},
+                              @"labels": @[@"inbox", @"work"],
+                              @"unread": @(i % 3 == 0)}];
+    }
+    return [NSJSONSerialization dataWithJSONObject:@{@"version": @1, @"messages": messages} options:0 error:NULL];
+}
+
+
+-(void)testPerformance {
+    NSData * data = makeLargeJSON(50000);
+
+    // Time to first value: the first message's subject.
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    NSString * baselineFirst;
+    size_t baselineMemory;
+    @autoreleasepool {
+        size_t before = mallocBytesInUse();
+        NSDictionary * json = [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+        baselineFirst = json[@"messages"][0][@"subject"];
+        baselineMemory = mallocBytesInUse() - before;
+    }
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    NSString * first = nil;
+    size_t memory;
+    @autoreleasepool {
+        size_t before = mallocBytesInUse();
+        JSONPullParser * p = [[JSONPullParser alloc] initWithData:data];
+        while (first == nil && [p next] > JSONPullTokenEnd) {
+            if (p.token == JSONPullTokenKey && [p valueIsEqualToCString:"subject"]) {
+                [p next];
+                first = p.stringValue;
+            }
+        }
+        memory = mallocBytesInUse() - before;
+    }
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+    XCTAssertEqualObjects(first, baselineFirst);
+
+    NSTimeInterval baseline = mid - start;
+    NSTimeInterval result = end - mid;
+    NSLog(@"JSONPullParser time to first value: %0.6f sec, %0.6f ratio vs NSJSONSerialization.", result, result / baseline);
+    NSLog(@"JSONPullParser memory to first value: %lu bytes vs NSJSONSerialization %lu bytes.", (unsigned long)memory, (unsigned long)baselineMemory);
+
+    // Full pass, counting unread messages, streaming from the data with a small buffer.
+    start = [NSDate timeIntervalSinceReferenceDate];
+    NSUInteger baselineUnread = 0;
+    @autoreleasepool {
+        NSInputStream * is = [NSInputStream inputStreamWithData:data];
+        [is open];
+        NSDictionary * json = [NSJSONSerialization JSONObjectWithStream:is options:0 error:NULL];
+        for (NSDictionary * msg in json[@"messages"]) {
+            baselineUnread += [msg[@"unread"] boolValue];
+        }
+    }
+    mid = [NSDate timeIntervalSinceReferenceDate];
+    NSUInteger unread = 0;
+    @autoreleasepool {
+        NSInputStream * is = [NSInputStream inputStreamWithData:data];
+        [is open];
+        JSONPullParser * p = [[JSONPullParser alloc] initWithInputStream:is bufferSize:16384];
+        while ([p next] > JSONPullTokenEnd) {
+            if (p.token == JSONPullTokenKey && [p valueIsEqualToCString:"unread"]) {
+                unread += ([p next] == JSONPullTokenTrue);
+            }
+        }
+        XCTAssertNil(p.error);
+    }
+    end = [NSDate timeIntervalSinceReferenceDate];
+    XCTAssertEqual(unread, baselineUnread);
+
+    baseline = mid - start;
+    result = end - mid;
+    NSLog(@"JSONPullParser full stream pass: %0.6f sec, %0.6f ratio vs NSJSONSerialization.", result, result / baseline);
+}
+
+
+@end
@@ -0,0 +1,263 @@
+//
+//  JSONSnapshotTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/6/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "JSONPullParser.h"
+#import "JSONSnapshot.h"
+#import "NSJSONSerialization+Misc.h"
+#import "StringPool.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface JSONSnapshotTests : TBTestCaseBase
+
+@end
+
+
+@implementation JSONSnapshotTests
+
+
+static NSData * utf8(NSString * s) {
+    return [s dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+
+static id roundTrip(NSString * s) {
+    NSData * snapshot = [JSONSnapshot snapshotDataWithJSONData:utf8(s) error:NULL];
+    return (snapshot == nil ? nil : [JSONSnapshot JSONObjectWithSnapshotData:snapshot error:NULL]);
+}
+
+
+/**
+ * What JSONObjectFromBundle does when there is no snapshot.
+ */
+static id pullParse(NSString * s) {
+    JSONPullParser * parser = [[JSONPullParser alloc] initWithData:utf8(s)];
+    [parser next];
+    return [parser objectValue];
+}
+
+
+static NSString * tempPath(NSString * name) {
+    return [NSTemporaryDirectory() stringByAppendingPathComponent:name];
+}
+
+
+-(void)testMatchesPythonTool {
+    // JSONSnapshotTests.jsonsnap was made by json-snapshot.py.
+    NSBundle * bundle = [NSBundle bundleForClass:self.class];
+    NSData * json = [NSData dataWithContentsOfFile:[bundle pathForResource:@"JSONSnapshotTests" ofType:@"json"]];
+    NSData * expected = [NSData dataWithContentsOfFile:[bundle pathForResource:@"JSONSnapshotTests" ofType:@"jsonsnap"]];
+    XCTAssertNotNil(expected);
+    XCTAssertEqualObjects([JSONSnapshot snapshotDataWithJSONData:json error:NULL], expected);
+}
+
+
+-(void)testJSONObjectFromBundle {
+    NSError * err = nil;
+    NSDictionary * d = [NSJSONSerialization JSONObjectFromBundle:[NSBundle bundleForClass:self.class] resourceName:@"JSONSnapshotTests" error:&err];
+    XCTAssertNil(err);
+    XCTAssertEqualObjects(NSStringFromClass(d.class), @"JSONSnapshotDictionary");
+
+    // 11 members, one of which is a repeated key.
+    XCTAssertEqual(d.count, (NSUInteger)10);
+    XCTAssertEqualObjects(d[@"version"], @3);
+    XCTAssertEqualObjects(d[@"name"], @"Sample resource");
+    XCTAssertEqualObjects(d[@"enabled"], @YES);
+    XCTAssertEqualObjects(d[@"ratio"], @0.75);
+    XCTAssertEqualObjects(d[@"big"], @9007199254740993LL);
+    XCTAssertEqualObjects(d[@"small"], @(-268435456));
+    XCTAssertEqualObjects(d[@"nothing"], [NSNull null]);
+    XCTAssertEqualObjects(d[@"tags"], (@[@"a", @"b", @"a", @"café", @"😀", @""]));
+    XCTAssertEqualObjects(d[@"nested"][@"deep"][1], (@{@"x": @2, @"y": @[@[], @{}]}));
+    XCTAssertEqualObjects(d[@"duplicate"], @2);
+    XCTAssertNil(d[@"nosuch"]);
+    XCTAssertNil(d[@3]);
+
+    // Keys are interned.
+    NSString * key = [d.allKeys firstObject];
+    XCTAssertEqual([d.allKeys firstObject], key);
+    XCTAssertEqualObjects(key, @"version");
+}
+
+
+-(void)testRoundTrip {
+    NSArray * docs = @[@"{}", @"[]", @"42", @"-7", @"1.5", @"\"s\"", @"true", @"false", @"null",
+                       @"[268435455, 268435456, -268435456, -268435457, 9223372036854775807, -9223372036854775808]",
+                       @"{\"a\":{\"b\":{\"c\":[1,{\"d\":\"\\u00e9\\n\"}]}}}",
+                       @"[1e3, -0, 0.1, 1E-2]"];
+    for (NSString * doc in docs) {
+        XCTAssertEqualObjects(roundTrip(doc), pullParse(doc), @"%@", doc);
+    }
+
+    NSMutableDictionary * big = [NSMutableDictionary dictionary];
+    for (int i = 0; i < 1000; i++) {
+        big[[NSString stringWithFormat:@"key%d", i]] = @[@(i), [NSString stringWithFormat:@"value%d", i % 10]];
+    }
+    NSData * data = [NSJSONSerialization dataWithJSONObject:big options:0 error:NULL];
+    NSDictionary * d = [JSONSnapshot JSONObjectWithSnapshotData:[JSONSnapshot snapshotDataWithJSONData:data error:NULL] error:NULL];
+    XCTAssertEqualObjects(d, big);
+    XCTAssertEqualObjects(d[@"key777"][1], @"value7");
+}
+
+
+/**
+ * JSONObjectFromBundle gives the snapshot if there is one and the parsed JSON if not, so they must agree on the
+ * cases where JSON parsers differ.
+ */
+-(void)testMatchesPullParser {
+    NSString * doc = @"{\"a\": 1, \"b\": 2, \"a\": [3], \"n\": {\"x\": 1, \"x\": 2},"
+                     @" \"digits18\": -123456789012345678, \"digits19\": 1234567890123456789,"
+                     @" \"max\": 9223372036854775807, \"huge\": 123456789012345678901234567890}";
+    NSDictionary * snapshot = roundTrip(doc);
+    NSDictionary * parsed = pullParse(doc);
+    XCTAssertEqualObjects(snapshot, parsed);
+
+    XCTAssertEqualObjects(snapshot[@"a"], @[@3]);
+    XCTAssertEqualObjects(snapshot[@"n"], @{@"x": @2});
+    XCTAssertEqual(snapshot.count, (NSUInteger)7);
+    XCTAssertEqual([snapshot[@"digits18"] longLongValue], -123456789012345678LL);
+    for (NSString * key in @[@"digits19", @"max", @"huge"]) {
+        XCTAssertEqual(strcmp([snapshot[key] objCType], @encode(double)), 0, @"%@", key);
+        XCTAssertEqual(strcmp([parsed[key] objCType], @encode(double)), 0, @"%@", key);
+        XCTAssertEqual([snapshot[key] doubleValue], [parsed[key] doubleValue], @"%@", key);
+    }
+}
+
+
+-(void)testInvalidJSON {
+    NSError * err = nil;
+    XCTAssertNil([JSONSnapshot snapshotDataWithJSONData:utf8(@"[1,") error:&err]);
+    XCTAssertNotNil(err);
+    XCTAssertNil([JSONSnapshot snapshotDataWithJSONData:utf8(@"[1] x") error:NULL]);
+    XCTAssertNil([JSONSnapshot snapshotDataWithJSONData:utf8(@"") error:NULL]);
+}
+
+
+-(void)testStale {
+    NSString * jsonPath = tempPath(@"JSONSnapshotTests-stale.json");
+    NSString * snapPath = tempPath(@"JSONSnapshotTests-stale.jsonsnap");
+    NSData * json = utf8(@"{\"a\": 1}");
+    XCTAssertTrue([json writeToFile:jsonPath atomically:YES]);
+    XCTAssertTrue([[JSONSnapshot snapshotDataWithJSONData:json error:NULL] writeToFile:snapPath atomically:YES]);
+
+    NSError * err = nil;
+    XCTAssertEqualObjects([JSONSnapshot JSONObjectWithContentsOfFile:snapPath sourcePath:jsonPath error:&err], @{@"a": @1});
+    XCTAssertNil(err);
+
+    // Same length, different content.
+    XCTAssertTrue([utf8(@"{\"a\": 2}") writeToFile:jsonPath atomically:YES]);
+    XCTAssertNil([JSONSnapshot JSONObjectWithContentsOfFile:snapPath sourcePath:jsonPath error:&err]);
+    XCTAssertEqual(err.code, (NSInteger)NSFileReadCorruptFileError);
+
+    err = nil;
+    XCTAssertNil([JSONSnapshot JSONObjectWithContentsOfFile:tempPath(@"JSONSnapshotTests-nosuch.jsonsnap") sourcePath:nil error:&err]);
+    XCTAssertNotNil(err);
+
+    [[NSFileManager defaultManager] removeItemAtPath:jsonPath error:NULL];
+    [[NSFileManager defaultManager] removeItemAtPath:snapPath error:NULL];
+}
+
+
+-(void)testCorrupt {
+    NSError * err = nil;
+    XCTAssertNil([JSONSnapshot JSONObjectWithSnapshotData:utf8(@"{\"a\": 1}") error:&err]);
+    XCTAssertEqual(err.code, (NSInteger)NSFileReadCorruptFileError);
+
+    // Truncations and bit flips must not crash.
+    NSBundle * bundle = [NSBundle bundleForClass:self.class];
+    NSData * good = [NSData dataWithContentsOfFile:[bundle pathForResource:@"JSONSnapshotTests" ofType:@"jsonsnap"]];
+    for (NSUInteger len = 0; len < good.length; len += 4) {
+        id obj = [JSONSnapshot JSONObjectWithSnapshotData:[good subdataWithRange:NSMakeRange(0, len)] error:NULL];
+        (void)[obj description];
+    }
+    for (NSUInteger i = 32; i < good.length; i++) {
+        NSMutableData * bad = [good mutableCopy];
+        ((uint8_t *)bad.mutableBytes)[i] ^= 0xa5;
+        id obj = [JSONSnapshot JSONObjectWithSnapshotData:bad error:NULL];
+        (void)[obj description];
+    }
+}
+
+
+#pragma mark - Performance
+
+
+static NSData * makeLargeResource(NSUInteger count) {
+    NSMutableArray * items = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [items addObject:@{@"id": @(i),
+                           @"name": [NSString stringWithFormat:@"Item %lu", (unsigned long)i],
+                           @"category": (i % 2 ? @"odd" : @"even"),
+                           @"price": @(i * 0.99),
+                           @"tags": @[@"featured", @"sale"],
+                           @"attributes": @{@"color": @"red", @"size": @(i % 5), @"available": @(i % 3 == 0)}}];
+    }
+    return [NSJSONSerialization dataWithJSONObject:@{@"version": @1, @"items": items} options:0 error:NULL];
+}
+
+
+-(void)testPerformance {
+    for (NSNumber * count in @[@1000, @20000]) {
+        NSString * jsonPath = tempPath(@"JSONSnapshotTests-perf.json");
+        NSString * snapPath = tempPath(@"JSONSnapshotTests-perf.jsonsnap");
+        NSData * json = makeLargeResource(count.unsignedIntegerValue);
+        [json writeToFile:jsonPath atomically:YES];
+        [[JSONSnapshot snapshotDataWithJSONData:json error:NULL] writeToFile:snapPath atomically:YES];
+        NSUInteger snapLength = [[NSData dataWithContentsOfFile:snapPath] length];
+
+        // What JSONObjectFromBundle does without a snapshot, up to reading the first item.
+        NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+        id expected;
+        @autoreleasepool {
+            JSONPullParser * parser = [[JSONPullParser alloc] initWithData:[NSData dataWithContentsOfFile:jsonPath options:NSDataReadingMappedIfSafe error:NULL]];
+            parser.keyPool = [StringPool sharedPool];
+            [parser next];
+            NSDictionary * d = [parser objectValue];
+            expected = d[@"items"][0][@"name"];
+        }
+        NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+        id checked;
+        @autoreleasepool {
+            NSDictionary * d = [JSONSnapshot JSONObjectWithContentsOfFile:snapPath sourcePath:jsonPath error:NULL];
+            checked = d[@"items"][0][@"name"];
+        }
+        NSTimeInterval mid2 = [NSDate timeIntervalSinceReferenceDate];
+        id lengthChecked;
+        @autoreleasepool {
+            // What JSONObjectFromBundle does with a snapshot.
+            unsigned long long sourceLength = [[NSFileManager defaultManager] attributesOfItemAtPath:jsonPath error:NULL].fileSize;
+            NSDictionary * d = [JSONSnapshot JSONObjectWithContentsOfFile:snapPath sourceLength:sourceLength error:NULL];
+            lengthChecked = d[@"items"][0][@"name"];
+        }
+        NSTimeInterval mid3 = [NSDate timeIntervalSinceReferenceDate];
+        id unchecked;
+        @autoreleasepool {
+            NSDictionary * d = [JSONSnapshot JSONObjectWithContentsOfFile:snapPath sourcePath:nil error:NULL];
+            unchecked = d[@"items"][0][@"name"];
+        }
+        NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+        XCTAssertEqualObjects(checked, expected);
+        XCTAssertEqualObjects(lengthChecked, expected);
+        XCTAssertEqualObjects(unchecked, expected);
+
+        NSTimeInterval baseline = mid - start;
+        NSTimeInterval result = mid2 - mid;
+        NSTimeInterval resultLengthChecked = mid3 - mid2;
+        NSTimeInterval resultUnchecked = end - mid3;
+        NSLog(@"JSONSnapshot startup, %lu byte JSON, %lu byte snapshot: %0.6f sec, %0.6f ratio vs parsing the JSON.", (unsigned long)json.length, (unsigned long)snapLength, result, result / baseline);
+        NSLog(@"JSONSnapshot startup with length check only: %0.6f sec, %0.6f ratio vs parsing the JSON.", resultLengthChecked, resultLengthChecked / baseline);
+        NSLog(@"JSONSnapshot startup without staleness check: %0.6f sec, %0.6f ratio vs parsing the JSON.", resultUnchecked, resultUnchecked / baseline);
+
+        [[NSFileManager defaultManager] removeItemAtPath:jsonPath error:NULL];
+        [[NSFileManager defaultManager] removeItemAtPath:snapPath error:NULL];
+    }
+}
+
+
+@end
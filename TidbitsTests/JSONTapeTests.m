@@ -0,0 +1,201 @@
+//
+//  JSONTapeTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/4/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "JSONTape.h"
+#import "NSJSONSerialization+Misc.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface JSONTapeTests : TBTestCaseBase
+
+@end
+
+
+@implementation JSONTapeTests
+
+
+static NSData * utf8(NSString * s) {
+    return [s dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+
+static id tape(NSString * s) {
+    return [JSONTape JSONObjectWithData:utf8(s) error:NULL];
+}
+
+
+-(void)testMatchesNSJSONSerialization {
+    NSArray * docs = @[@"{}", @"[]", @"42", @"-0.5e+3", @"\"s\"", @"true", @"null", @" [ 1 , 2 ,3 ] ",
+                       @"{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":\"x\\\\\",\"e\":[[],{}]}}",
+                       @"[\"a\\\"b\", \"tab\\t\", \"\\u00e9\\ud83d\\ude00\", \"café\", \"\\/\"]",
+                       @"[123456789012345678, -9, 0, 1.5, 1e3, -2E-2]",
+                       @"{\"\\u0061\": \"escaped key\", \"b\": 2}"];
+    for (NSString * doc in docs) {
+        id expected = [NSJSONSerialization JSONObjectWithData:utf8(doc) options:NSJSONReadingAllowFragments error:NULL];
+        XCTAssertNotNil(expected, @"%@", doc);
+        XCTAssertEqualObjects(tape(doc), expected, @"%@", doc);
+    }
+}
+
+
+-(void)testLazyAccess {
+    NSDictionary * d = tape(@"{\"from\": {\"name\": \"Someone\", \"email\": \"someone@example.com\"}, \"\\u0074o\": [1, [2, 3], {\"x\": null}], \"n\": 7}");
+    XCTAssertTrue([d isKindOfClass:[NSDictionary class]]);
+    XCTAssertEqual(d.count, (NSUInteger)3);
+    XCTAssertEqualObjects(d[@"from"][@"email"], @"someone@example.com");
+    XCTAssertEqualObjects(d[@"to"][1][0], @2);
+    XCTAssertEqualObjects(d[@"to"][2][@"x"], [NSNull null]);
+    XCTAssertEqualObjects(d[@"n"], @7);
+    XCTAssertNil(d[@"nosuch"]);
+    XCTAssertNil(d[@1]);
+    XCTAssertEqualObjects([d.allKeys sortedArrayUsingSelector:@selector(compare:)], (@[@"from", @"n", @"to"]));
+
+    NSArray * arr = d[@"to"];
+    XCTAssertEqual(arr.count, (NSUInteger)3);
+    XCTAssertThrowsSpecificNamed(arr[3], NSException, NSRangeException);
+    NSUInteger n = 0;
+    for (id x in arr) {
+        XCTAssertNotNil(x);
+        n++;
+    }
+    XCTAssertEqual(n, (NSUInteger)3);
+
+    __block NSUInteger seen = 0;
+    [d enumerateKeysAndObjectsUsingBlock:^(id key, id obj, BOOL * stop) {
+        XCTAssertEqualObjects(obj, d[key]);
+        seen++;
+    }];
+    XCTAssertEqual(seen, (NSUInteger)3);
+
+    XCTAssertEqualObjects([d mutableCopy], d);
+}
+
+
+-(void)testLargeObject {
+    NSMutableDictionary * dict = [NSMutableDictionary dictionary];
+    for (int i = 0; i < 100; i++) {
+        dict[[NSString stringWithFormat:@"key %d é", i]] = @(i);
+    }
+    NSData * data = [NSJSONSerialization dataWithJSONObject:@[dict] options:0 error:NULL];
+    NSDictionary * d = [JSONTape JSONObjectWithData:data error:NULL][0];
+    XCTAssertEqual(d.count, (NSUInteger)100);
+    XCTAssertEqualObjects(d[@"key 57 é"], @57);
+    XCTAssertNil(d[@"key 100 é"]);
+    XCTAssertEqualObjects(d, dict);
+}
+
+
+-(void)testLongStrings {
+    // Strings and escapes that cross the 64-byte blocks of stage 1.
+    NSMutableString * s = [NSMutableString string];
+    for (int i = 0; i < 500; i++) {
+        [s appendString:(i % 7 == 0 ? @"\\\"" : i % 11 == 0 ? @"\\\\" : @"a")];
+    }
+    for (NSUInteger pad = 0; pad < 70; pad++) {
+        NSString * doc = [NSString stringWithFormat:@"%@[\"%@\", {\"k\" : [1,2,3]}, \"%@\"]", [@"" stringByPaddingToLength:pad withString:@" " startingAtIndex:0], s, s];
+        id expected = [NSJSONSerialization JSONObjectWithData:utf8(doc) options:0 error:NULL];
+        XCTAssertEqualObjects(tape(doc), expected, @"%lu", (unsigned long)pad);
+    }
+}
+
+
+-(void)testErrors {
+    NSArray * bad = @[@"", @"  ", @"[1 2]", @"{\"a\" 1}", @"[tru]", @"[truex]", @"01", @"[1,]", @"{\"a\":1}x",
+                      @"\"abc", @"[\"a\"1]", @"{1:2}", @"[1.]", @"[-]", @"[", @"{\"a\":", @"]", @"[1}", @"{\"a\":1]"];
+    for (NSString * doc in bad) {
+        NSError * error = nil;
+        XCTAssertNil([JSONTape JSONObjectWithData:utf8(doc) error:&error], @"%@", doc);
+        XCTAssertEqualObjects(error.domain, NSCocoaErrorDomain, @"%@", doc);
+        XCTAssertEqual(error.code, (NSInteger)NSPropertyListReadCorruptError, @"%@", doc);
+    }
+
+    NSMutableString * deep = [NSMutableString string];
+    for (int i = 0; i < 600; i++) {
+        [deep appendString:@"["];
+    }
+    XCTAssertNil(tape(deep));
+}
+
+
+-(void)testLazyJSONObjectFromBundle {
+    NSError * err = nil;
+    id json = [NSJSONSerialization lazyJSONObjectFromBundle:[NSBundle bundleForClass:self.class] resourceName:@"NSJSONSerialization+MiscTests" error:&err];
+    XCTAssertNil(err);
+    XCTAssertEqualObjects(json, (@{@"key1": @"val1"}));
+
+    json = [NSJSONSerialization lazyJSONObjectFromBundle:[NSBundle bundleForClass:self.class] resourceName:@"NoSuchFile" error:&err];
+    XCTAssertNil(json);
+    XCTAssertEqual(err.code, (NSInteger)NSFileNoSuchFileError);
+}
+
+
+#pragma mark - Performance
+
+
+static NSData * makeSamplePayload(NSUInteger count) {
+    NSMutableArray * messages = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        [messages addObject:@{@"id": @(i),
+                              @"subject": [NSString stringWithFormat:@"Re: meeting notes %lu", (unsigned long)i],
+                              @"from": @{@"name": @"Someone", @"email": @"someone@example.com"},
+                              @"to": @[@{@"name": @"A", @"email": @"a@example.com"}, @{@"name": @"B", @"email": @"b@example.com"}],
+                              @"body": @"Lorem ipsum dolor sit amet, consectetur adipiscing elit, \"quoted\" text.",
+                              @"labels": @[@"inbox", @"work"],
+                              @"score": @(i * 0.25),
+                              @"unread": @(i % 3 == 0)}];
+    }
+    return [NSJSONSerialization dataWithJSONObject:@{@"version": @1, @"messages": messages} options:0 error:NULL];
+}
+
+
+/**
+ * A typical consumer: a handful of fields from a large document.
+ */
+static NSArray * readFewFields(NSDictionary * json) {
+    NSArray * messages = json[@"messages"];
+    NSMutableArray * result = [NSMutableArray array];
+    for (NSUInteger i = 0; i < messages.count; i += messages.count / 8) {
+        NSDictionary * msg = messages[i];
+        [result addObject:@[msg[@"subject"], msg[@"from"][@"email"], msg[@"unread"]]];
+    }
+    [result addObject:json[@"version"]];
+    return result;
+}
+
+
+-(void)testPerformance {
+    for (NSNumber * count in @[@100, @5000, @50000]) {
+        NSData * data = makeSamplePayload(count.unsignedIntegerValue);
+        const NSUInteger reps = MAX(1, 100000 / count.unsignedIntegerValue);
+
+        NSArray * expected = nil;
+        NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+        for (NSUInteger i = 0; i < reps; i++) {
+            @autoreleasepool {
+                expected = readFewFields([NSJSONSerialization JSONObjectWithData:data options:0 error:NULL]);
+            }
+        }
+        NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+        NSArray * actual = nil;
+        for (NSUInteger i = 0; i < reps; i++) {
+            @autoreleasepool {
+                actual = readFewFields([NSJSONSerialization lazyJSONObjectWithData:data error:NULL]);
+            }
+        }
+        NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+        XCTAssertEqualObjects(actual, expected);
+
+        NSTimeInterval baseline = mid - start;
+        NSTimeInterval result = end - mid;
+        NSLog(@"JSONTape %lu bytes x %lu: %0.6f sec, %0.6f ratio vs NSJSONSerialization.", (unsigned long)data.length, (unsigned long)reps, result, result / baseline);
+    }
+}
+
+
+@end
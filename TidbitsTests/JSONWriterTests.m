@@ -0,0 +1,217 @@
+//
+//  JSONWriterTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/2/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "JSONWriter.h"
+#import "NSJSONSerialization+Misc.h"
+#import "NSObject+MTJSONUtils.h"
+#import "NSString+Misc.h"
+
+#import "TBTestCaseBase.h"
+
+
+/**
+ * An object whose description throws, to check that JSONWriter cleans up when that happens.
+ */
+@interface JSONWriterTestsThrowingKey : NSObject <NSCopying>
+
+@end
+
+
+@implementation JSONWriterTestsThrowingKey
+
+
+-(id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+
+-(NSString *)description {
+    [NSException raise:NSInternalInconsistencyException format:@"Deliberate"];
+    return nil;
+}
+
+
+@end
+
+
+@interface JSONWriterTests : TBTestCaseBase
+
+@end
+
+
+@implementation JSONWriterTests
+
+
+static NSString * writeJSON(id obj, JSONWriterOptions opt) {
+    return [JSONWriter stringWithJSONSafeObject:obj options:opt error:NULL];
+}
+
+
+-(void)testScalars {
+    XCTAssertEqualObjects(writeJSON(@"s", 0), @"\"s\"");
+    XCTAssertEqualObjects(writeJSON(@42, 0), @"42");
+    XCTAssertEqualObjects(writeJSON(@-7LL, 0), @"-7");
+    XCTAssertEqualObjects(writeJSON(@(UINT64_MAX), 0), @"18446744073709551615");
+    XCTAssertEqualObjects(writeJSON(@1.5, 0), @"1.5");
+    XCTAssertEqualObjects(writeJSON(@0.1f, 0), @"0.1");
+    XCTAssertEqualObjects(writeJSON(@YES, 0), @"true");
+    XCTAssertEqualObjects(writeJSON(@NO, 0), @"false");
+    XCTAssertEqualObjects(writeJSON([NSNull null], 0), @"null");
+    XCTAssertEqualObjects(writeJSON([NSDecimalNumber decimalNumberWithString:@"12.345"], 0), @"12.345");
+}
+
+
+-(void)testEscaping {
+    NSString * s = [NSString stringWithFormat:@"a\"b\\c/d\n\t%Cé\U0001F600", (unichar)1];
+    XCTAssertEqualObjects(writeJSON(@[s], 0), @"[\"a\\\"b\\\\c\\/d\\n\\t\\u0001é\U0001F600\"]");
+
+    // The same as NSJSONSerialization.
+    NSString * expected = [NSJSONSerialization stringWithJSONObject:@[s] error:NULL];
+    XCTAssertEqualObjects(writeJSON(@[s], 0), expected);
+}
+
+
+-(void)testCoercions {
+    NSDate * date = [NSDate dateWithTimeIntervalSince1970:1427846400.75];
+    id obj = @{@"date": date,
+               @"url": [NSURL URLWithString:@"http://example.com/"],
+               @"set": [NSSet setWithObject:@"x"],
+               @"list": @[[NSSet setWithObject:@"y"], date, [NSNull null]]};
+    NSString * result = writeJSON(obj, JSONWriterSortedKeys);
+    XCTAssertEqualObjects(result, ([NSString stringWithFormat:@"{\"date\":\"2015-04-01T00:00:00Z\",\"list\":[[\"y\"],\"2015-04-01T00:00:00Z\",null],\"set\":%@,\"url\":\"http:\\/\\/example.com\\/\"}",
+                                    writeJSON([[NSSet setWithObject:@"x"] description], 0)]));
+
+    // And the same as going through MTJSONUtils.
+    id expected = [obj objectWithJSONSafeObjects];
+    id roundTripped = [NSJSONSerialization JSONObjectWithData:[JSONWriter dataWithJSONSafeObject:obj options:0 error:NULL] options:0 error:NULL];
+    XCTAssertEqualObjects(roundTripped, expected);
+}
+
+
+-(void)testNonStringKeys {
+    XCTAssertEqualObjects(writeJSON(@{@1: @"one"}, 0), @"{\"1\":\"one\"}");
+}
+
+
+-(void)testExceptionInLargeDictionary {
+    NSMutableDictionary * dict = [NSMutableDictionary dictionary];
+    for (int i = 0; i < 50; i++) {
+        dict[[NSString stringWithFormat:@"k%02d", i]] = @(i);
+    }
+    dict[[[JSONWriterTestsThrowingKey alloc] init]] = @"boom";
+
+    XCTAssertThrows(writeJSON(dict, 0));
+    XCTAssertThrows(writeJSON(dict, JSONWriterSortedKeys));
+    XCTAssertThrows(writeJSON(@{@"outer": dict}, JSONWriterSortedKeys));
+}
+
+
+-(void)testSortedKeys {
+    NSMutableDictionary * dict = [NSMutableDictionary dictionary];
+    NSMutableString * expected = [NSMutableString stringWithString:@"{"];
+    for (int i = 0; i < 50; i++) {
+        NSString * key = [NSString stringWithFormat:@"k%02d", i];
+        dict[key] = @(i);
+        [expected appendFormat:@"%@\"%@\":%d", (i == 0 ? @"" : @","), key, i];
+    }
+    [expected appendString:@"}"];
+    XCTAssertEqualObjects(writeJSON(dict, JSONWriterSortedKeys), expected);
+}
+
+
+-(void)testPretty {
+    id obj = @{@"a": @[@1, @{@"b": [NSNull null]}, @[]], @"c": @{}};
+    NSString * expected = @"{\n  \"a\" : [\n    1,\n    {\n      \"b\" : null\n    },\n    []\n  ],\n  \"c\" : {}\n}";
+    XCTAssertEqualObjects(writeJSON(obj, JSONWriterPrettyPrinted | JSONWriterSortedKeys), expected);
+}
+
+
+-(void)testErrors {
+    NSError * error = nil;
+    XCTAssertNil([JSONWriter stringWithJSONSafeObject:@[@(NAN)] options:0 error:&error]);
+    XCTAssertEqualObjects(error.domain, NSCocoaErrorDomain);
+    XCTAssertEqual(error.code, (NSInteger)NSFormattingError);
+
+    NSMutableArray * cycle = [NSMutableArray array];
+    [cycle addObject:cycle];
+    error = nil;
+    XCTAssertNil([JSONWriter dataWithJSONSafeObject:cycle options:0 error:&error]);
+    XCTAssertNotNil(error);
+    [cycle removeAllObjects];
+}
+
+
+-(void)testStream {
+    NSMutableArray * big = [NSMutableArray array];
+    for (int i = 0; i < 10000; i++) {
+        [big addObject:@{@"i": @(i), @"s": @"some text to make this bigger than the flush threshold"}];
+    }
+
+    NSOutputStream * os = [NSOutputStream outputStreamToMemory];
+    [os open];
+    NSError * error = nil;
+    XCTAssertTrue([JSONWriter writeJSONSafeObject:big toStream:os options:0 error:&error]);
+    NSData * data = [os propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+    [os close];
+    XCTAssertNil(error);
+    XCTAssertEqualObjects(data, [JSONWriter dataWithJSONSafeObject:big options:0 error:NULL]);
+    XCTAssertEqualObjects([NSJSONSerialization JSONObjectWithData:data options:0 error:NULL], big);
+}
+
+
+-(void)testStringWithJSONObjectMadeSafe {
+    id obj = @{@"date": [NSDate dateWithTimeIntervalSince1970:0], @"n": @[@1, @2]};
+    NSString * result = [NSJSONSerialization stringWithJSONObjectMadeSafe:obj error:NULL];
+    id parsed = [NSJSONSerialization JSONObjectWithData:[result dataUsingEncoding:NSUTF8StringEncoding] options:0 error:NULL];
+    XCTAssertEqualObjects(parsed, [obj objectWithJSONSafeObjects]);
+
+    result = [NSJSONSerialization stringWithJSONObjectMadeSafe:@[@1] options:NSJSONWritingPrettyPrinted error:NULL];
+    XCTAssertEqualObjects(result, @"[\n  1\n]");
+}
+
+
+#pragma mark - Performance
+
+
+static NSString * legacyStringWithJSONObjectMadeSafe(id obj) {
+    return [NSString stringWithUTF8Data:[NSJSONSerialization dataWithJSONObject:[obj objectWithJSONSafeObjects] options:0 error:NULL]];
+}
+
+
+-(void)testPerformance {
+    NSMutableArray * messages = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 2000; i++) {
+        [messages addObject:@{@"id": @(i),
+                              @"subject": [NSString stringWithFormat:@"Re: café meeting %lu", (unsigned long)i],
+                              @"date": [NSDate dateWithTimeIntervalSince1970:1427846400 + i],
+                              @"to": @[@"a@example.com", @"b@example.com"],
+                              @"unread": @(i % 3 == 0)}];
+    }
+    const NSUInteger reps = 10;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < reps; i++) {
+        @autoreleasepool {
+            (void)legacyStringWithJSONObjectMadeSafe(messages);
+        }
+    }
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < reps; i++) {
+        @autoreleasepool {
+            (void)[NSJSONSerialization stringWithJSONObjectMadeSafe:messages error:NULL];
+        }
+    }
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+    NSTimeInterval baseline = mid - start;
+    NSTimeInterval result = end - mid;
+    NSLog(@"JSONWriter x %lu: %0.6f sec, %0.6f ratio vs objectWithJSONSafeObjects + NSJSONSerialization + NSString.", (unsigned long)(reps * messages.count), result, result / baseline);
+}
+
+
+@end
@@ -0,0 +1,110 @@
+//
+//  LRUCacheTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/24/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "LRUCache.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface LRUCacheTests : TBTestCaseBase
+
+@end
+
+
+@implementation LRUCacheTests
+
+
+-(void)testMiss {
+    LRUCache * cache = [[LRUCache alloc] initWithCountLimit:2];
+    XCTAssertNil([cache objectForKey:@"a"]);
+    XCTAssertNil([cache objectForKey:nil]);
+}
+
+
+-(void)testHit {
+    LRUCache * cache = [[LRUCache alloc] initWithCountLimit:2];
+    [cache setObject:@1 forKey:@"a"];
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @1);
+    XCTAssertEqual(cache.count, (NSUInteger)1);
+}
+
+
+-(void)testReplace {
+    LRUCache * cache = [[LRUCache alloc] initWithCountLimit:2];
+    [cache setObject:@1 forKey:@"a"];
+    [cache setObject:@2 forKey:@"a"];
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @2);
+    XCTAssertEqual(cache.count, (NSUInteger)1);
+}
+
+
+-(void)testEvictsLeastRecentlyUsed {
+    LRUCache * cache = [[LRUCache alloc] initWithCountLimit:2];
+    [cache setObject:@1 forKey:@"a"];
+    [cache setObject:@2 forKey:@"b"];
+    [cache objectForKey:@"a"];
+    [cache setObject:@3 forKey:@"c"];
+
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @1);
+    XCTAssertNil([cache objectForKey:@"b"]);
+    XCTAssertEqualObjects([cache objectForKey:@"c"], @3);
+    XCTAssertEqual(cache.count, (NSUInteger)2);
+}
+
+
+-(void)testCountLimitOne {
+    LRUCache * cache = [[LRUCache alloc] initWithCountLimit:1];
+    [cache setObject:@1 forKey:@"a"];
+    [cache setObject:@2 forKey:@"b"];
+    XCTAssertNil([cache objectForKey:@"a"]);
+    XCTAssertEqualObjects([cache objectForKey:@"b"], @2);
+}
+
+
+-(void)testRemove {
+    LRUCache * cache = [[LRUCache alloc] initWithCountLimit:3];
+    [cache setObject:@1 forKey:@"a"];
+    [cache setObject:@2 forKey:@"b"];
+    [cache setObject:@3 forKey:@"c"];
+    [cache removeObjectForKey:@"b"];
+    [cache setObject:@4 forKey:@"d"];
+
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @1);
+    XCTAssertNil([cache objectForKey:@"b"]);
+    XCTAssertEqual(cache.count, (NSUInteger)3);
+
+    [cache removeAllObjects];
+    XCTAssertEqual(cache.count, (NSUInteger)0);
+    XCTAssertNil([cache objectForKey:@"a"]);
+    [cache setObject:@5 forKey:@"e"];
+    XCTAssertEqualObjects([cache objectForKey:@"e"], @5);
+}
+
+
+-(void)testKeyIsCopied {
+    LRUCache * cache = [[LRUCache alloc] initWithCountLimit:2];
+    NSMutableString * key = [NSMutableString stringWithString:@"a"];
+    [cache setObject:@1 forKey:key];
+    [key appendString:@"b"];
+    XCTAssertEqualObjects([cache objectForKey:@"a"], @1);
+    XCTAssertNil([cache objectForKey:@"ab"]);
+}
+
+
+-(void)testLargeCacheDealloc {
+    @autoreleasepool {
+        LRUCache * cache = [[LRUCache alloc] initWithCountLimit:100000];
+        for (NSUInteger i = 0; i < 100000; i++) {
+            [cache setObject:@(i) forKey:@(i)];
+        }
+        XCTAssertEqual(cache.count, (NSUInteger)100000);
+    }
+}
+
+
+@end
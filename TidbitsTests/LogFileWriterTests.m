@@ -0,0 +1,238 @@
+//
+//  LogFileWriterTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#import "LogFileWriter.h"
+#import "LogFormatter.h"
+#import "LoggingMacros.h"
+#import "WaitFor.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface LogFileWriterTests : TBTestCaseBase
+
+@property (nonatomic) NSString * directory;
+
+@end
+
+
+@implementation LogFileWriterTests
+
+
+-(void)setUp {
+    [super setUp];
+    self.directory = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"LogFileWriterTests-%@", [NSUUID UUID].UUIDString]];
+}
+
+
+-(void)tearDown {
+    [[NSFileManager defaultManager] removeItemAtPath:self.directory error:NULL];
+    [super tearDown];
+}
+
+
+-(void)testWritesFormattedLines {
+    LogFileWriter * writer = [[LogFileWriter alloc] initWithDirectory:self.directory baseName:@"test"];
+    LogFormatter * formatter = [[LogFormatter alloc] init];
+
+    NSMutableArray * expected = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 3; i++) {
+        DDLogMessage * msg = makeMessage([NSString stringWithFormat:@"Message %lu ☃", (unsigned long)i]);
+        [writer logMessage:msg];
+        [expected addObject:[formatter formatLogMessage:msg]];
+    }
+    [writer flush];
+
+    XCTAssertEqualObjects([self linesOfFile:writer.currentFilePath], expected);
+    XCTAssertEqual(writer.droppedMessageCount, 0ULL);
+    XCTAssertNil(writer.lastError);
+    [writer close];
+}
+
+
+-(void)testAppendsToExistingFile {
+    LogFileWriter * writer = [[LogFileWriter alloc] initWithDirectory:self.directory baseName:@"test"];
+    writer.logFormatter = nil;
+    [writer logMessage:makeMessage(@"First")];
+    [writer close];
+
+    writer = [[LogFileWriter alloc] initWithDirectory:self.directory baseName:@"test"];
+    writer.logFormatter = nil;
+    [writer logMessage:makeMessage(@"Second")];
+    [writer close];
+
+    XCTAssertEqualObjects([self linesOfFile:writer.currentFilePath], (@[@"First", @"Second"]));
+}
+
+
+-(void)testRotatesAndCompresses {
+    LogFileWriter * writer = [[LogFileWriter alloc] initWithDirectory:self.directory baseName:@"test"];
+    writer.logFormatter = nil;
+    writer.maximumFileSize = 1000;
+    writer.maximumNumberOfArchivedFiles = 3;
+
+    NSString * payload = [@"" stringByPaddingToLength:90 withString:@"x" startingAtIndex:0];
+    for (NSUInteger i = 0; i < 100; i++) {
+        [writer logMessage:makeMessage(payload)];
+        if (i % 5 == 4) {
+            [writer flush];
+        }
+    }
+    [writer close];
+
+    NSDictionary * attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:writer.currentFilePath error:NULL];
+    XCTAssertLessThanOrEqual(attrs.fileSize, 1000ULL);
+
+    NSString * directory = self.directory;
+    bool (^archived)(void) = ^bool {
+        NSArray * names = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:directory error:NULL];
+        NSArray * compressed = [names filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF BEGINSWITH 'test-' AND SELF ENDSWITH '.log.gz'"]];
+        NSArray * uncompressed = [names filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF BEGINSWITH 'test-' AND SELF ENDSWITH '.log'"]];
+        return compressed.count == 3 && uncompressed.count == 0;
+    };
+    XCTAssert(WaitFor(archived));
+    XCTAssertNil(writer.lastError);
+}
+
+
+-(void)testDropPolicyAccountsForEveryMessage {
+    LogFileWriter * writer = [[LogFileWriter alloc] initWithDirectory:self.directory baseName:@"test" bufferSize:4096];
+    writer.logFormatter = nil;
+    writer.writeInterval = 10.0;
+
+    NSUInteger count = 2000;
+    for (NSUInteger i = 0; i < count; i++) {
+        [writer logMessage:makeMessage([NSString stringWithFormat:@"Message %lu", (unsigned long)i])];
+    }
+    [writer close];
+
+    NSArray * lines = [self linesOfFile:writer.currentFilePath];
+    XCTAssertEqual(lines.count + writer.droppedMessageCount, (unsigned long long)count);
+}
+
+
+-(void)testBlockPolicyDropsNothingOffMainThread {
+    LogFileWriter * writer = [[LogFileWriter alloc] initWithDirectory:self.directory baseName:@"test" bufferSize:4096];
+    writer.logFormatter = nil;
+    writer.overflowPolicy = LogFileWriterOverflowBlock;
+    writer.maximumFileSize = 0;
+
+    NSUInteger threadCount = 4;
+    NSUInteger perThread = 1000;
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger t = 0; t < threadCount; t++) {
+        dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            for (NSUInteger i = 0; i < perThread; i++) {
+                [writer logMessage:makeMessage([NSString stringWithFormat:@"Thread %lu message %lu", (unsigned long)t, (unsigned long)i])];
+            }
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    [writer close];
+
+    XCTAssertEqual(writer.droppedMessageCount, 0ULL);
+    XCTAssertEqual([self linesOfFile:writer.currentFilePath].count, threadCount * perThread);
+}
+
+
+/**
+ * The log file is a FIFO with no reader, so the writer thread is stuck opening it until we read from it.
+ * Messages logged through DDLog arrive on DDLog's queue, so this checks that the writer goes by the thread that
+ * logged the message, and drops main-thread and error messages rather than blocking.
+ */
+-(void)testBlockPolicyDropsMainThreadMessagesThroughDDLog {
+    [[NSFileManager defaultManager] createDirectoryAtPath:self.directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    NSString * path = [self.directory stringByAppendingPathComponent:@"test.log"];
+    XCTAssertEqual(mkfifo(path.fileSystemRepresentation, 0644), 0);
+
+    LogFileWriter * writer = [[LogFileWriter alloc] initWithDirectory:self.directory baseName:@"test" bufferSize:4096];
+    writer.logFormatter = nil;
+    writer.overflowPolicy = LogFileWriterOverflowBlock;
+    writer.maximumFileSize = 0;
+    XCTAssertEqualObjects(writer.currentFilePath, path);
+    [DDLog addLogger:writer];
+
+    // Few enough that DDLog's queue never fills, so this doesn't hang if the writer does block.
+    NSUInteger count = 500;
+    for (NSUInteger i = 0; i < count; i++) {
+        NSLogInfo(@"Main thread message %lu", (unsigned long)i);
+    }
+    XCTAssert(WaitFor(^bool{
+        return writer.droppedMessageCount > 0;
+    }));
+
+    __block BOOL errorLogged = NO;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        NSLogError(@"Background error message");
+        errorLogged = YES;
+    });
+    XCTAssert(WaitFor(^bool{
+        return errorLogged;
+    }));
+
+    NSMutableData * contents = [NSMutableData data];
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_group_async(group, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        int fifo = open(path.fileSystemRepresentation, O_RDONLY);
+        uint8_t buf[4096];
+        ssize_t n;
+        while (fifo >= 0 && (n = read(fifo, buf, sizeof(buf))) > 0) {
+            [contents appendBytes:buf length:(NSUInteger)n];
+        }
+        close(fifo);
+    });
+
+    [DDLog flushLog];
+    [DDLog removeLogger:writer];
+    [writer close];
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+    NSString * text = [[NSString alloc] initWithData:contents encoding:NSUTF8StringEncoding];
+    NSPredicate * mine = [NSPredicate predicateWithFormat:@"SELF BEGINSWITH 'Main thread message '"];
+    NSArray * lines = [[text componentsSeparatedByString:@"\n"] filteredArrayUsingPredicate:mine];
+    XCTAssertGreaterThan(lines.count, (NSUInteger)0);
+    XCTAssertEqual(lines.count + writer.droppedMessageCount, (unsigned long long)count + 1);
+}
+
+
+-(void)testTruncatesLongMessage {
+    LogFileWriter * writer = [[LogFileWriter alloc] initWithDirectory:self.directory baseName:@"test" bufferSize:4096];
+    writer.logFormatter = nil;
+
+    NSString * longMessage = [@"" stringByPaddingToLength:10000 withString:@"é" startingAtIndex:0];
+    [writer logMessage:makeMessage(longMessage)];
+    [writer close];
+
+    NSArray * lines = [self linesOfFile:writer.currentFilePath];
+    XCTAssertEqual(lines.count, (NSUInteger)1);
+    XCTAssertEqual([lines[0] length], (NSUInteger)2047);
+    XCTAssert([longMessage hasPrefix:lines[0]]);
+}
+
+
+-(NSArray *)linesOfFile:(NSString *)path {
+    NSString * text = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+    XCTAssertNotNil(text);
+    if (text.length == 0) {
+        return @[];
+    }
+    XCTAssert([text hasSuffix:@"\n"]);
+    return [[text substringToIndex:text.length - 1] componentsSeparatedByString:@"\n"];
+}
+
+
+static DDLogMessage * makeMessage(NSString * logMsg) {
+    return [[DDLogMessage alloc] initWithLogMsg:logMsg level:LOG_LEVEL_INFO flag:LOG_FLAG_INFO context:0 file:__FILE__ function:__FUNCTION__ line:__LINE__ tag:nil options:0];
+}
+
+
+@end
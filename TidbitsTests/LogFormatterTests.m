@@ -47,6 +47,34 @@
 }
 
 
+-(void)testCachedTimestampsMatchUncached {
+    NSArray * formatters = @[[[LogFormatter alloc] init], [[LogFormatterTTY alloc] init]];
+    DDLogMessage * msg = [self makeTestMessage];
+
+    // Steps of 137 ms cross a second boundary every 7 or 8 messages, and the jumps cross days and years.
+    NSTimeInterval ts = 1420070399.0;
+    for (NSUInteger i = 0; i < 5000; i++) {
+        ts += (i % 1000 == 999 ? 86400.0 * 40 : 0.137);
+        msg->timestamp = [NSDate dateWithTimeIntervalSince1970:ts];
+        for (id formatter in formatters) {
+            XCTAssertEqualStrings([formatter formatLogMessage:msg], [formatter formatLogMessageB:msg]);
+        }
+    }
+}
+
+
+-(void)testLogFormatterPerformanceComparison {
+    LogFormatter * formatter = [[LogFormatter alloc] init];
+    DDLogMessage * msg = [self makeTestMessage];
+
+    comparePerformanceAndLogResult(^{
+        [formatter formatLogMessage:msg];
+    }, ^{
+        [formatter formatLogMessageB:msg];
+    });
+}
+
+
 -(void)testLogFormatterTTYPerformanceComparison {
     LogFormatterTTY * formatter = [[LogFormatterTTY alloc] init];
     DDLogMessage * msg = [self makeTestMessage];
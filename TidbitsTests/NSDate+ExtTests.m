@@ -6,6 +6,10 @@
 //  Copyright (c) 2014 Tipbit, Inc. All rights reserved.
 //
 
+#if TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR
+#import <UIKit/UIApplication.h>
+#endif
+
 #import "NSDate+Ext.h"
 #import "NSDate+ISO8601.h"
 
@@ -37,4 +41,519 @@
 }
 
 
+#pragma mark - Civil time
+
+
+/**
+ * Every 3 hours and 7 minutes over 2014 to 2016 in the system timezone, so it crosses any DST transitions there.
+ * Also every 15 minutes around midnight on the days of those transitions.
+ */
+static NSArray * civilSampleDates() {
+    NSMutableArray * result = [NSMutableArray array];
+    NSTimeInterval start = [[NSDate dateFromIso8601:@"2014-01-01T00:00:00Z"] timeIntervalSince1970];
+    NSTimeInterval end = [[NSDate dateFromIso8601:@"2017-01-01T00:00:00Z"] timeIntervalSince1970];
+    for (NSTimeInterval t = start; t < end; t += 3 * 3600 + 7 * 60 + 0.5) {
+        [result addObject:[NSDate dateWithTimeIntervalSince1970:t]];
+    }
+    NSTimeZone * tz = [NSTimeZone systemTimeZone];
+    NSDate * transition = [NSDate dateWithTimeIntervalSince1970:start];
+    while ((transition = [tz nextDaylightSavingTimeTransitionAfterDate:transition]) != nil && transition.timeIntervalSince1970 < end) {
+        for (NSInteger i = -4 * 26; i <= 4 * 26; i++) {
+            [result addObject:[transition dateByAddingTimeInterval:i * 15 * 60]];
+        }
+    }
+    return result;
+}
+
+
+-(void)testCivilTimeMatchesNSCalendar {
+    NSTimeZone * utc = [NSTimeZone timeZoneWithName:@"UTC"];
+    NSTimeZone * system = [NSTimeZone systemTimeZone];
+    NSDate * previous = nil;
+    for (NSDate * date in civilSampleDates()) {
+        XCTAssertEqualObjects([date startOfDay], legacyThisDayAtHour(date, 0, 0, 0, system), @"%@", date);
+        XCTAssertEqualObjects([date startOfMonth], legacyStartOfMonth(date), @"%@", date);
+        XCTAssertEqualObjects([date startOfNextWeek], legacyStartOfNextWeek(date), @"%@", date);
+        XCTAssertEqualObjects([date thisDayAtHour:13 minute:5 second:9 tz:system], legacyThisDayAtHour(date, 13, 5, 9, system), @"%@", date);
+        XCTAssertEqualObjects([date thisDayAtHour:2 minute:30 second:0 tz:system], legacyThisDayAtHour(date, 2, 30, 0, system), @"%@", date);
+        XCTAssertEqualObjects([date thisDayAtHour:23 minute:59 second:59 tz:nil], legacyThisDayAtHour(date, 23, 59, 59, utc), @"%@", date);
+        if (previous != nil) {
+            XCTAssertEqual([date isSameDayAs:previous], legacyIsSameDayAs(date, previous), @"%@", date);
+        }
+        previous = date;
+    }
+}
+
+
+-(void)testCivilTimeOutOfRange {
+    // Outside 1970-2038, and out-of-range hours, go to NSCalendar.
+    NSTimeZone * system = [NSTimeZone systemTimeZone];
+    NSDate * old = [NSDate dateFromIso8601:@"1900-06-15T12:00:00Z"];
+    NSDate * future = [NSDate dateFromIso8601:@"2100-06-15T12:00:00Z"];
+    XCTAssertEqualObjects([old startOfDay], legacyThisDayAtHour(old, 0, 0, 0, system));
+    XCTAssertEqualObjects([future startOfMonth], legacyStartOfMonth(future));
+    NSDate * date = [NSDate dateFromIso8601:@"2015-04-08T12:00:00Z"];
+    XCTAssertEqualObjects([date thisDayAtHour:25 minute:0 second:0 tz:system], legacyThisDayAtHour(date, 25, 0, 0, system));
+    XCTAssertEqualObjects([date thisDayAtHour:1 minute:0 second:0 tz:[NSTimeZone timeZoneWithName:@"Asia/Tokyo"]],
+                          legacyThisDayAtHour(date, 1, 0, 0, [NSTimeZone timeZoneWithName:@"Asia/Tokyo"]));
+}
+
+
+-(void)testCivilTimePerformance {
+    NSArray * dates = civilSampleDates();
+    NSTimeZone * system = [NSTimeZone systemTimeZone];
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        for (NSDate * date in dates) {
+            legacyThisDayAtHour(date, 0, 0, 0, system);
+            legacyStartOfMonth(date);
+            legacyIsSameDayAs(date, dates[0]);
+        }
+    }
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        for (NSDate * date in dates) {
+            [date startOfDay];
+            [date startOfMonth];
+            [date isSameDayAs:dates[0]];
+        }
+    }
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+    NSTimeInterval baseline = mid - start;
+    NSTimeInterval result = end - mid;
+    NSLog(@"startOfDay, startOfMonth, isSameDayAs: x %lu: %0.6f sec, %0.6f ratio vs NSCalendar.", (unsigned long)dates.count, result, result / baseline);
+}
+
+
+// The NSCalendar implementations, for comparison.
+
+static NSDate * legacyThisDayAtHour(NSDate * date, NSInteger hour, NSInteger minute, NSInteger second, NSTimeZone * tz) {
+    NSCalendar *cal = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar];
+    [cal setTimeZone:tz];
+    NSDateComponents * comp = [cal components:( NSYearCalendarUnit| NSMonthCalendarUnit | NSDayCalendarUnit | NSHourCalendarUnit | NSMinuteCalendarUnit) fromDate:date];
+    [comp setHour:hour];
+    [comp setMinute:minute];
+    [comp setSecond:second];
+    return [cal dateFromComponents:comp];
+}
+
+
+static NSDate * legacyStartOfMonth(NSDate * date) {
+    NSCalendar *cal = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar];
+    [cal setTimeZone:[NSTimeZone systemTimeZone]];
+    NSDateComponents * comp = [cal components:(NSYearCalendarUnit | NSMonthCalendarUnit) fromDate:date];
+    [comp setDay:1];
+    [comp setHour:0];
+    [comp setMinute:0];
+    [comp setSecond:0];
+    return [cal dateFromComponents:comp];
+}
+
+
+static NSDate * legacyStartOfNextWeek(NSDate * date) {
+    NSCalendar *cal = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar];
+    [cal setTimeZone:[NSTimeZone systemTimeZone]];
+    NSDate * startOfDay = legacyThisDayAtHour(date, 0, 0, 0, [NSTimeZone systemTimeZone]);
+    NSInteger weekdayOfDate = [cal ordinalityOfUnit:NSWeekdayCalendarUnit inUnit:NSWeekCalendarUnit forDate:startOfDay];
+    NSDateComponents *oneWeek = [[NSDateComponents alloc] init];
+    [oneWeek setWeekOfYear:1];
+    [oneWeek setDay:-(weekdayOfDate - 1)];
+    return [cal dateByAddingComponents:oneWeek toDate:startOfDay options:0];
+}
+
+
+static BOOL legacyIsSameDayAs(NSDate * a, NSDate * b) {
+    NSCalendar *cal = [[NSCalendar alloc] initWithCalendarIdentifier:NSGregorianCalendar];
+    [cal setTimeZone:[NSTimeZone systemTimeZone]];
+    NSDateComponents *compA = [cal components:( NSYearCalendarUnit| NSMonthCalendarUnit | NSDayCalendarUnit) fromDate:a];
+    NSDateComponents *compB = [cal components:( NSYearCalendarUnit| NSMonthCalendarUnit | NSDayCalendarUnit) fromDate:b];
+    return compA.year==compB.year && compA.month==compB.month && compA.day==compB.day;
+}
+
+
+#pragma mark - Formatter pool
+
+
+-(void)testUserStringsMatchUnpooled {
+    for (NSDate * date in sampleDates(200)) {
+        XCTAssertEqualObjects([date userShortDateString], legacyShortDateString(date));
+        XCTAssertEqualObjects([date userShortTimeString], legacyShortTimeString(date));
+        XCTAssertEqualObjects([date userYearlessDateString], legacyYearlessDateString(date));
+        XCTAssertEqualObjects([date userShortDateAndTimeString], legacyShortDateAndTimeString(date));
+        XCTAssertEqualObjects([date userYearlessOrShortDateIfNotTodayAndTimeString], legacyYearlessOrShortDateIfNotTodayAndTimeString(date));
+    }
+}
+
+
+-(void)testFormatterPoolIsPerThread {
+    NSArray * dates = sampleDates(200);
+    NSMutableArray * expected = [NSMutableArray array];
+    for (NSDate * date in dates) {
+        [expected addObject:[date userShortDateAndTimeString]];
+    }
+
+    const NSUInteger threads = 4;
+    NSMutableArray * results = [NSMutableArray array];
+    for (NSUInteger i = 0; i < threads; i++) {
+        [results addObject:[NSMutableArray array]];
+    }
+    dispatch_apply(threads, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+        NSMutableArray * result = results[i];
+        for (NSDate * date in dates) {
+            [result addObject:[date userShortDateAndTimeString]];
+        }
+    });
+    for (NSArray * result in results) {
+        XCTAssertEqualObjects(result, expected);
+    }
+}
+
+
+-(void)testFormatterPoolInvalidatedByTimeZoneChange {
+    NSDate * date = [NSDate dateFromIso8601:@"2015-04-07T12:00:00"];
+    NSTimeZone * original = [NSTimeZone defaultTimeZone];
+
+    [NSTimeZone setDefaultTimeZone:[NSTimeZone timeZoneWithName:@"UTC"]];
+    [[NSNotificationCenter defaultCenter] postNotificationName:NSSystemTimeZoneDidChangeNotification object:nil];
+    NSString * utc = [date userShortTimeString];
+    XCTAssertEqualObjects(utc, legacyShortTimeString(date));
+
+    [NSTimeZone setDefaultTimeZone:[NSTimeZone timeZoneWithName:@"Asia/Tokyo"]];
+    XCTAssertEqualObjects([date userShortTimeString], utc);  // Still cached.
+    [[NSNotificationCenter defaultCenter] postNotificationName:NSSystemTimeZoneDidChangeNotification object:nil];
+    NSString * tokyo = [date userShortTimeString];
+    XCTAssertEqualObjects(tokyo, legacyShortTimeString(date));
+    XCTAssertNotEqualObjects(tokyo, utc);
+
+    [NSTimeZone setDefaultTimeZone:original];
+    [[NSNotificationCenter defaultCenter] postNotificationName:NSSystemTimeZoneDidChangeNotification object:nil];
+}
+
+
+/**
+ * Formats the dates for a message list of 500 cells, as a table view would when scrolling through it
+ * three times.
+ */
+-(void)testScrollPerformance {
+    NSArray * dates = sampleDates(500);
+    const NSUInteger passes = 3;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < passes; i++) {
+        @autoreleasepool {
+            for (NSDate * date in dates) {
+                legacyYearlessOrShortDateIfNotTodayAndTimeString(date);
+                legacyShortDateAndTimeString(date);
+            }
+        }
+    }
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < passes; i++) {
+        @autoreleasepool {
+            for (NSDate * date in dates) {
+                [date userYearlessOrShortDateIfNotTodayAndTimeString];
+                [date userShortDateAndTimeString];
+            }
+        }
+    }
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+    NSTimeInterval baseline = mid - start;
+    NSTimeInterval result = end - mid;
+    NSLog(@"Scrolling %lu cells x %lu: %0.6f sec, %0.6f ratio vs unpooled formatters.", (unsigned long)dates.count, (unsigned long)passes, result, result / baseline);
+}
+
+
+-(void)testDateBucketsMatchPerDate {
+    NSArray * dates = bucketSampleDates();
+    NSUInteger count = dates.count;
+    NSTimeInterval * intervals = malloc(count * sizeof(NSTimeInterval));
+    DateBucket * buckets = malloc(count * sizeof(DateBucket));
+    for (NSUInteger i = 0; i < count; i++) {
+        intervals[i] = [dates[i] timeIntervalSinceReferenceDate];
+    }
+
+    [NSDate dateBuckets:buckets ofIntervals:intervals count:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        DateBucket expected = legacyDateBucket(dates[i]);
+        XCTAssertEqual(buckets[i], expected, @"%@", dates[i]);
+        XCTAssertEqual([dates[i] dateBucket], expected, @"%@", dates[i]);
+    }
+
+    free(intervals);
+    free(buckets);
+}
+
+
+-(void)testDateBucketRanges {
+    NSArray * dates = bucketSampleDates();
+    NSUInteger count = dates.count;
+    NSTimeInterval * intervals = malloc(count * sizeof(NSTimeInterval));
+    NSRange ranges[DateBucketCount];
+
+    for (NSUInteger pass = 0; pass < 2; pass++) {
+        BOOL ascending = (pass == 1);
+        for (NSUInteger i = 0; i < count; i++) {
+            intervals[i] = [dates[ascending ? count - 1 - i : i] timeIntervalSinceReferenceDate];
+        }
+
+        [NSDate dateBucketRanges:ranges ofSortedIntervals:intervals count:count];
+        NSUInteger total = 0;
+        for (NSUInteger b = 0; b < DateBucketCount; b++) {
+            total += ranges[b].length;
+            for (NSUInteger i = ranges[b].location; i < NSMaxRange(ranges[b]); i++) {
+                XCTAssertEqual(legacyDateBucket([NSDate dateWithTimeIntervalSinceReferenceDate:intervals[i]]), (DateBucket)b);
+            }
+        }
+        XCTAssertEqual(total, count);
+        XCTAssertGreaterThan(ranges[DateBucketToday].length, (NSUInteger)0);
+        XCTAssertGreaterThan(ranges[DateBucketOlder].length, (NSUInteger)0);
+    }
+
+    [NSDate dateBucketRanges:ranges ofSortedIntervals:intervals count:0];
+    for (NSUInteger b = 0; b < DateBucketCount; b++) {
+        XCTAssertEqual(ranges[b].length, (NSUInteger)0);
+    }
+
+    free(intervals);
+}
+
+
+/**
+ * Europe/Berlin went back an hour on 25 October 2015, so on 31 October the start of the month was 30 days and an
+ * hour before the start of today.  America/New_York went forward an hour on 8 March 2015, the other way around.
+ */
+-(void)testDateBucketThresholdsDescendAcrossDST {
+    NSArray * cases = @[@[@"Europe/Berlin", @"2015-10-31T11:00:00.000Z", @"2015-09-30T22:30:00.000Z"],
+                        @[@"America/New_York", @"2015-03-31T16:00:00.000Z", @"2015-03-01T05:30:00.000Z"]];
+    for (NSArray * c in cases) {
+        NSTimeZone * tz = [NSTimeZone timeZoneWithName:c[0]];
+        NSTimeInterval thresholds[DateBucketCount - 1];
+        [NSDate dateBucketThresholds:thresholds now:[NSDate dateFromIso8601:c[1]] timeZone:tz];
+        for (NSUInteger i = 1; i < DateBucketCount - 1; i++) {
+            XCTAssertLessThanOrEqual(thresholds[i], thresholds[i - 1], @"%@ %lu", c[0], (unsigned long)i);
+        }
+
+        // Half an hour into the 1st of the month is in this month, not in the last 30 or 60 days.
+        NSTimeInterval t = [NSDate dateFromIso8601:c[2]].timeIntervalSinceReferenceDate;
+        NSUInteger bucket = 0;
+        for (NSUInteger i = 0; i < DateBucketCount - 1; i++) {
+            bucket += (t < thresholds[i]);
+        }
+        XCTAssertEqual(bucket, (NSUInteger)DateBucketThisMonth, @"%@", c[0]);
+    }
+}
+
+
+#if TARGET_OS_IPHONE || TARGET_IPHONE_SIMULATOR
+/**
+ * Buckets on several threads while the boundaries are invalidated on another.
+ */
+-(void)testDateBucketsThreadSafe {
+    NSArray * dates = bucketSampleDates();
+    NSUInteger count = dates.count;
+    NSTimeInterval * intervals = malloc(count * sizeof(NSTimeInterval));
+    DateBucket * expected = malloc(count * sizeof(DateBucket));
+    for (NSUInteger i = 0; i < count; i++) {
+        intervals[i] = [dates[i] timeIntervalSinceReferenceDate];
+    }
+    [NSDate dateBuckets:expected ofIntervals:intervals count:count];
+
+    const NSUInteger threads = 4;
+    __block NSUInteger mismatches = 0;
+    dispatch_apply(threads + 1, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t t) {
+        for (NSUInteger pass = 0; pass < 200; pass++) {
+            if (t == threads) {
+                [[NSNotificationCenter defaultCenter] postNotificationName:UIApplicationSignificantTimeChangeNotification object:nil];
+                continue;
+            }
+            DateBucket * buckets = malloc(count * sizeof(DateBucket));
+            [NSDate dateBuckets:buckets ofIntervals:intervals count:count];
+            if (memcmp(buckets, expected, count * sizeof(DateBucket)) != 0) {
+                @synchronized (self) {
+                    mismatches++;
+                }
+            }
+            free(buckets);
+        }
+    });
+    XCTAssertEqual(mismatches, (NSUInteger)0);
+
+    free(intervals);
+    free(expected);
+}
+#endif
+
+
+/**
+ * Groups a message list of 2000 rows, the old way (isToday etc. on each NSDate), with dateBuckets:, and with
+ * dateBucketRanges:.
+ */
+-(void)testDateBucketsPerformance {
+    NSArray * dates = sampleDates(2000);
+    NSUInteger count = dates.count;
+    NSTimeInterval * intervals = malloc(count * sizeof(NSTimeInterval));
+    DateBucket * buckets = malloc(count * sizeof(DateBucket));
+    NSRange ranges[DateBucketCount];
+    for (NSUInteger i = 0; i < count; i++) {
+        intervals[i] = [dates[i] timeIntervalSinceReferenceDate];
+    }
+    const NSUInteger passes = 10;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < passes; i++) {
+        @autoreleasepool {
+            for (NSDate * date in dates) {
+                legacyDateBucket(date);
+            }
+        }
+    }
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < passes; i++) {
+        [NSDate dateBuckets:buckets ofIntervals:intervals count:count];
+    }
+    NSTimeInterval mid2 = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < passes; i++) {
+        [NSDate dateBucketRanges:ranges ofSortedIntervals:intervals count:count];
+    }
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+    NSTimeInterval baseline = mid - start;
+    NSLog(@"dateBuckets %lu rows x %lu: %0.6f sec, %0.6f ratio vs per-date.", (unsigned long)count, (unsigned long)passes, mid2 - mid, (mid2 - mid) / baseline);
+    NSLog(@"dateBucketRanges %lu rows x %lu: %0.6f sec, %0.6f ratio vs per-date.", (unsigned long)count, (unsigned long)passes, end - mid2, (end - mid2) / baseline);
+
+    free(intervals);
+    free(buckets);
+}
+
+
+/**
+ * sampleDates, plus a few in the future, and some around each boundary.  Newest first.
+ */
+static NSArray * bucketSampleDates() {
+    NSMutableArray * result = [NSMutableArray array];
+    NSDate * today = [NSDate startOfToday];
+    NSArray * boundaries = @[[today dateByAddingTimeInterval:2 * 86400.0], [today dateByAddingTimeInterval:86400.0],
+                             today, [today dateByAddingTimeInterval:-86400.0], [today dateByAddingTimeInterval:-2 * 86400.0],
+                             [NSDate startOf7DaysAgo], [NSDate startOfThisMonth], [NSDate startOf30DaysAgo],
+                             [NSDate startOf60DaysAgo]];
+    for (NSDate * boundary in boundaries) {
+        [result addObject:[boundary dateByAddingTimeInterval:1.0]];
+        [result addObject:boundary];
+        [result addObject:[boundary dateByAddingTimeInterval:-1.0]];
+    }
+    [result addObjectsFromArray:sampleDates(1000)];
+    return [result sortedArrayUsingComparator:^NSComparisonResult(NSDate * a, NSDate * b) {
+        return [b compare:a];
+    }];
+}
+
+
+/**
+ * How the message list grouped its rows before dateBuckets:.
+ */
+static DateBucket legacyDateBucket(NSDate * date) {
+    NSDate * tomorrow = [[[NSDate startOfToday] dateByAddingTimeInterval:86400.0 * 1.5] startOfDay];
+    if (![date isBefore:tomorrow]) {
+        return DateBucketFuture;
+    }
+    if (date.isToday) {
+        return DateBucketToday;
+    }
+    if (date.isYesterday) {
+        return DateBucketYesterday;
+    }
+    if (date.isDayBefore) {
+        return DateBucketDayBefore;
+    }
+    if (![date isBefore:[NSDate startOf7DaysAgo]]) {
+        return DateBucketLast7Days;
+    }
+    if (![date isBefore:[NSDate startOfThisMonth]]) {
+        return DateBucketThisMonth;
+    }
+    if (![date isBefore:[NSDate startOf30DaysAgo]]) {
+        return DateBucketLast30Days;
+    }
+    if (![date isBefore:[NSDate startOf60DaysAgo]]) {
+        return DateBucketLast60Days;
+    }
+    return DateBucketOlder;
+}
+
+
+/**
+ * Dates spread over the last two years, newest first, with a run of them today.
+ */
+static NSArray * sampleDates(NSUInteger count) {
+    NSMutableArray * result = [NSMutableArray arrayWithCapacity:count];
+    NSDate * now = [NSDate date];
+    for (NSUInteger i = 0; i < count; i++) {
+        NSTimeInterval ago = (i < count / 10 ? i * 60.0 : i * (2 * 365 * 86400.0 / count));
+        [result addObject:[now dateByAddingTimeInterval:-ago]];
+    }
+    return result;
+}
+
+
+// The implementations before the formatter pool, for comparison.
+
+static NSString * legacyShortDateString(NSDate * date) {
+    NSDateFormatter* formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [NSLocale autoupdatingCurrentLocale];
+    formatter.dateStyle = NSDateFormatterShortStyle;
+    return [formatter stringFromDate:date];
+}
+
+
+static NSString * legacyYearlessDateString(NSDate * date) {
+    NSDateFormatter* formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [NSLocale autoupdatingCurrentLocale];
+    formatter.dateFormat = [NSDateFormatter dateFormatFromTemplate:@"M d" options:0 locale:NSLocale.currentLocale];
+    return [formatter stringFromDate:date];
+}
+
+
+static NSString * legacyShortTimeString(NSDate * date) {
+    NSDateFormatter* formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [NSLocale autoupdatingCurrentLocale];
+    formatter.timeStyle = NSDateFormatterShortStyle;
+    return [[formatter stringFromDate:date] lowercaseString];
+}
+
+
+static NSString * legacyYearlessOrShortDateAndTimeString(NSDate * date) {
+    NSDateFormatter* formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [NSLocale autoupdatingCurrentLocale];
+    if (date.isThisYear)
+        formatter.dateFormat = [NSDateFormatter dateFormatFromTemplate:@"M d" options:0 locale:NSLocale.currentLocale];
+    else
+        formatter.dateStyle = NSDateFormatterShortStyle;
+    NSString* dateStr = [formatter stringFromDate:date];
+    formatter.dateStyle = NSDateFormatterNoStyle;
+    formatter.timeStyle = NSDateFormatterShortStyle;
+    NSString* time = [formatter stringFromDate:date];
+    return [[NSString stringWithFormat:@"%@ %@", dateStr, time] lowercaseString];
+}
+
+
+static NSString * legacyShortDateAndTimeString(NSDate * date) {
+    NSDateFormatter* formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [NSLocale autoupdatingCurrentLocale];
+    formatter.dateStyle = NSDateFormatterShortStyle;
+    NSString* dateStr = [formatter stringFromDate:date];
+    formatter.dateStyle = NSDateFormatterNoStyle;
+    formatter.timeStyle = NSDateFormatterShortStyle;
+    NSString* time = [formatter stringFromDate:date];
+    return [[NSString stringWithFormat:@"%@ %@", dateStr, time] lowercaseString];
+}
+
+
+static NSString * legacyYearlessOrShortDateIfNotTodayAndTimeString(NSDate * date) {
+    return date.isToday ? legacyShortTimeString(date) : legacyYearlessOrShortDateAndTimeString(date);
+}
+
+
 @end
@@ -6,6 +6,7 @@
 //  Copyright (c) 2014 Tipbit, Inc. All rights reserved.
 //
 
+#import "CBLParseDate.h"
 #import "NSDate+ISO8601.h"
 
 #import "TBTestCaseBase.h"
@@ -56,6 +57,72 @@
 }
 
 
+-(void)testDateFromIso8601MillisMatchesNSDateFormatter {
+    NSDateFormatter * formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.dateFormat = @"yyyy-MM-dd'T'HH:mm:ss.SSS'Z'";
+    formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:0];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        NSString * input = generateSampleDate24();
+        NSDate * expected = [formatter dateFromString:input];
+        XCTAssertEqualWithAccuracy([NSDate timeIntervalSinceReferenceDateFromIso8601:input], expected.timeIntervalSinceReferenceDate, 0.0005, @"%@", input);
+    }
+}
+
+
+-(void)testCBLParseISO8601Date24 {
+    int64_t msec = -1;
+    XCTAssertEqual(CBLParseISO8601Date24("1970-01-01T00:00:00.000Z", &msec), 0);
+    XCTAssertEqual(msec, 0LL);
+    XCTAssertEqual(CBLParseISO8601Date24("2013-04-01T20:42:33.388Z", &msec), 0);
+    XCTAssertEqual(msec, 1364848953388LL);
+    XCTAssertEqual(CBLParseISO8601Date24("1969-12-31T23:59:59.999Z", &msec), 0);
+    XCTAssertEqual(msec, -1LL);
+    XCTAssertEqual(CBLParseISO8601Date24("2000-02-29T24:00:00.000Z", &msec), 0);
+    XCTAssertEqual(msec, 951868800000LL);
+
+    // Other forms are left to the general parser.
+    const char * others[] = {"2013-04-01T20:42:33Z", "2013-04-01T20:42:33.388z", "2013-04-01 20:42:33.388Z",
+                             "2013-04-01T20:42:33.388Z ", "2013-04-01T20:42:33.388", "-2013-04-01T20:42:33.388Z",
+                             "2013-04-01T20:42:33.3889", ""};
+    for (size_t i = 0; i < sizeof(others) / sizeof(others[0]); i++) {
+        msec = -1;
+        XCTAssertEqual(CBLParseISO8601Date24(others[i], &msec), 1, @"%s", others[i]);
+        XCTAssertEqual(msec, -1LL, @"%s", others[i]);
+    }
+
+    // Invalid.
+    const char * invalid[] = {"2013-13-01T20:42:33.388Z", "2013-00-01T20:42:33.388Z", "2013-04-32T20:42:33.388Z",
+                              "2013-04-01T25:42:33.388Z", "2013-04-01T20:60:33.388Z", "2013-04-01T20:42:60.388Z",
+                              "2013-04-01T20:42:33.38xZ", "2013/04/01T20:42:33.388Z", "2O13-04-01T20:42:33.388Z"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        XCTAssertEqual(CBLParseISO8601Date24(invalid[i], &msec), 1, @"%s", invalid[i]);
+        XCTAssertTrue(isnan(CBLParseISO8601Date(invalid[i])), @"%s", invalid[i]);
+    }
+}
+
+
+-(void)testCBLParseISO8601Date24MatchesGeneralParser {
+    for (NSUInteger i = 0; i < 10000; i++) {
+        // Lowercase z isn't accepted by the fast path, so this goes through the general parser instead.
+        NSString * input = generateSampleDate24();
+        NSString * general = [input stringByReplacingOccurrencesOfString:@"Z" withString:@"z"];
+        XCTAssertEqualWithAccuracy(CBLParseISO8601Date(input.UTF8String), CBLParseISO8601Date(general.UTF8String), 0.0011, @"%@", input);
+    }
+}
+
+
+-(void)testCBLParseISO8601Dates {
+    const char * inputs[] = {"2013-04-01T20:42:33.388Z", "2013-04-01T20:42:33Z", NULL, "garbage"};
+    double results[4];
+    CBLParseISO8601Dates(inputs, 4, results);
+    XCTAssertEqualWithAccuracy(results[0], 1364848953.388, 0.0001);
+    XCTAssertEqualWithAccuracy(results[1], 1364848953.0, 0.0001);
+    XCTAssertTrue(isnan(results[2]));
+    XCTAssertTrue(isnan(results[3]));
+}
+
+
 -(void)testIso8601StringMillis {
     NSDate* input = [NSDate dateWithTimeIntervalSinceReferenceDate:386541753.401];
     NSString* expected = @"2013-04-01T20:42:33"; // Note millis and Z are dropped because iso8601String outputs the 19 char form.
@@ -109,6 +176,34 @@
 }
 
 
+-(void)testIso8601String_local_23MatchesLocaltime {
+    NSMutableArray * dates = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 10000; i++) {
+        [dates addObject:[NSDate dateWithTimeIntervalSinceReferenceDate:randomInterval()]];
+    }
+    NSDate * transition = [NSDate dateWithTimeIntervalSinceReferenceDate:386541753.0];
+    for (NSUInteger i = 0; i < 8; i++) {
+        transition = [[NSTimeZone systemTimeZone] nextDaylightSavingTimeTransitionAfterDate:transition];
+        if (transition == nil) {
+            break;
+        }
+        for (NSTimeInterval delta = -3600.0; delta <= 3600.0; delta += 599.5) {
+            [dates addObject:[transition dateByAddingTimeInterval:delta]];
+        }
+    }
+
+    for (NSDate * date in dates) {
+        NSTimeInterval ts = [date timeIntervalSince1970];
+        time_t ts_whole = (time_t)ts;
+        struct tm tm;
+        localtime_r(&ts_whole, &tm);
+        NSString * expected = [NSString stringWithFormat:@"%04d-%02d-%02dT%02d:%02d:%02d.%03d", tm.tm_year + 1900, tm.tm_mon + 1,
+                               tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, (int)((ts - (double)ts_whole) * 1000.0)];
+        XCTAssertEqualObjects([date iso8601String_local_23], expected);
+    }
+}
+
+
 -(void)testIso8601String_24PerformanceComparison {
     NSDate* input = [NSDate dateWithTimeIntervalSinceReferenceDate:386541753.0];
 
@@ -120,6 +215,115 @@
 }
 
 
+-(void)testIso8601String_24MatchesLegacy {
+    NSTimeInterval intervals[] = {0.0, 386541753.401, -978307200.0, 86399.999, 1234567890.5};
+    for (size_t i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+        NSDate * date = [NSDate dateWithTimeIntervalSinceReferenceDate:intervals[i]];
+        XCTAssertEqualObjects([date iso8601String_24], [date iso8601String_24_B], @"%f", intervals[i]);
+    }
+    for (NSUInteger i = 0; i < 10000; i++) {
+        NSDate * date = [NSDate dateWithTimeIntervalSinceReferenceDate:randomInterval()];
+        XCTAssertEqualObjects([date iso8601String_24], [date iso8601String_24_B]);
+        XCTAssertEqualObjects([date iso8601String_23], [[date iso8601String_24_B] substringToIndex:23]);
+        XCTAssertEqualObjects([date iso8601String], [[date iso8601String_24_B] substringToIndex:19]);
+        XCTAssertEqualObjects([date iso8601String_16], [[date iso8601String_24_B] substringToIndex:16]);
+    }
+}
+
+
+-(void)testIso8601String_24Before1970 {
+    // The old implementation gave a negative msec field here.
+    NSDate * date = [NSDate dateWithTimeIntervalSince1970:-0.25];
+    XCTAssertEqualObjects([date iso8601String_24], @"1969-12-31T23:59:59.750Z");
+}
+
+
+-(void)testIso8601Strings_24 {
+    const NSUInteger count = 1000;
+    NSTimeInterval intervals[count];
+    for (NSUInteger i = 0; i < count; i++) {
+        intervals[i] = (i % 2 ? randomInterval() : 386541753.0 + i * 0.25);
+    }
+
+    char buffer[count * ISO8601_24_LENGTH];
+    [NSDate iso8601Strings_24:intervals count:count buffer:buffer];
+    NSArray * strings = [NSDate iso8601Strings_24:intervals count:count];
+    XCTAssertEqual(strings.count, count);
+    for (NSUInteger i = 0; i < count; i++) {
+        NSString * expected = [[NSDate dateWithTimeIntervalSinceReferenceDate:intervals[i]] iso8601String_24_B];
+        NSString * fromBuffer = [[NSString alloc] initWithBytes:buffer + i * ISO8601_24_LENGTH length:ISO8601_24_LENGTH encoding:NSASCIIStringEncoding];
+        XCTAssertEqualObjects(fromBuffer, expected);
+        XCTAssertEqualObjects(strings[i], expected);
+    }
+
+    XCTAssertEqualObjects([NSDate iso8601Strings_24:intervals count:0], @[]);
+}
+
+
+/**
+ * Compares iso8601String_24 and the batch methods against iso8601String_24_B (the old snprintf implementation), with
+ * timestamps that are all the same, close together (like log lines), and scattered (like a list of messages).
+ */
+-(void)testIso8601String_24PerformanceSuite {
+    const NSUInteger count = 100000;
+    NSTimeInterval * same = malloc(count * sizeof(NSTimeInterval));
+    NSTimeInterval * close = malloc(count * sizeof(NSTimeInterval));
+    NSTimeInterval * scattered = malloc(count * sizeof(NSTimeInterval));
+    for (NSUInteger i = 0; i < count; i++) {
+        same[i] = 386541753.401;
+        close[i] = 386541753.0 + i * 0.013;
+        scattered[i] = randomInterval();
+    }
+    char * buffer = malloc(count * ISO8601_24_LENGTH);
+
+    NSArray * workloads = @[@"same", @"close", @"scattered"];
+    NSTimeInterval * inputs[] = {same, close, scattered};
+    for (NSUInteger w = 0; w < workloads.count; w++) {
+        NSTimeInterval * intervals = inputs[w];
+        NSMutableArray * dates = [NSMutableArray arrayWithCapacity:count];
+        for (NSUInteger i = 0; i < count; i++) {
+            [dates addObject:[NSDate dateWithTimeIntervalSinceReferenceDate:intervals[i]]];
+        }
+
+        NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+        @autoreleasepool {
+            for (NSDate * date in dates) {
+                [date iso8601String_24_B];
+            }
+        }
+        NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+        @autoreleasepool {
+            for (NSDate * date in dates) {
+                [date iso8601String_24];
+            }
+        }
+        NSTimeInterval mid2 = [NSDate timeIntervalSinceReferenceDate];
+        @autoreleasepool {
+            [NSDate iso8601Strings_24:intervals count:count];
+        }
+        NSTimeInterval mid3 = [NSDate timeIntervalSinceReferenceDate];
+        [NSDate iso8601Strings_24:intervals count:count buffer:buffer];
+        NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+        NSTimeInterval baseline = mid - start;
+        NSLog(@"iso8601String_24 %@ x %lu: %0.6f sec, %0.6f ratio vs baseline.", workloads[w], (unsigned long)count, mid2 - mid, (mid2 - mid) / baseline);
+        NSLog(@"iso8601Strings_24:count: %@ x %lu: %0.6f sec, %0.6f ratio vs baseline.", workloads[w], (unsigned long)count, mid3 - mid2, (mid3 - mid2) / baseline);
+        NSLog(@"iso8601Strings_24:count:buffer: %@ x %lu: %0.6f sec, %0.6f ratio vs baseline.", workloads[w], (unsigned long)count, end - mid3, (end - mid3) / baseline);
+    }
+
+    free(same);
+    free(close);
+    free(scattered);
+    free(buffer);
+}
+
+
+static NSTimeInterval randomInterval() {
+    // Somewhere between 1970 and 2037, to the msec.
+    return -978307200.0 + (double)arc4random_uniform(2100000000) + arc4random_uniform(1000) / 1000.0;
+}
+
+
 //
 // This test is derived from a test in CBLJSON.m in http://github.com/couchbase/couchbase-lite-ios
 // Copyright (c) 2012-2013 Couchbase, Inc and licensed under the Apache License 2.0.
@@ -137,6 +341,42 @@
 }
 
 
+-(void)testDateFromIso8601_24Performance {
+    const NSUInteger count = 100000;
+    NSMutableArray * dates = [NSMutableArray arrayWithCapacity:count];
+    NSMutableArray * generalDates = [NSMutableArray arrayWithCapacity:count];
+    @autoreleasepool {
+        for (NSUInteger i = 0; i < count; i++) {
+            NSString * date = generateSampleDate24();
+            [dates addObject:date];
+            // Lowercase z skips the fast path, so these take the general parser, which is what every date used to take.
+            [generalDates addObject:[date stringByReplacingOccurrencesOfString:@"Z" withString:@"z"]];
+        }
+    }
+
+    NSTimeInterval baseline = benchmarkDateFromIso8601(generalDates);
+    NSTimeInterval result = benchmarkDateFromIso8601(dates);
+    NSLog(@"dateFromIso8601 24 char x %lu: %0.6f sec, %0.6f ratio vs general parser.", (unsigned long)count, result, result / baseline);
+
+    const char ** strs = malloc(count * sizeof(const char *));
+    const char ** generalStrs = malloc(count * sizeof(const char *));
+    double * results = malloc(count * sizeof(double));
+    for (NSUInteger i = 0; i < count; i++) {
+        strs[i] = [dates[i] UTF8String];
+        generalStrs[i] = [generalDates[i] UTF8String];
+    }
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    CBLParseISO8601Dates(generalStrs, count, results);
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    CBLParseISO8601Dates(strs, count, results);
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+    NSLog(@"CBLParseISO8601Dates 24 char x %lu: %0.6f sec, %0.6f ratio vs general parser.", (unsigned long)count, end - mid, (end - mid) / (mid - start));
+    free(strs);
+    free(generalStrs);
+    free(results);
+}
+
+
 static NSTimeInterval benchmarkDateFromIso8601(NSArray* dates) {
     NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
 
@@ -185,6 +425,19 @@ static NSString* generateSampleDate() {
 }
 
 
+static NSString* generateSampleDate24() {
+    unsigned year = randomNumberInRange(1980, 2013);
+    unsigned month = randomNumberInRange(1, 12);
+    unsigned date = randomNumberInRange(1, 28);
+    unsigned hour = randomNumberInRange(0, 23);
+    unsigned minute = randomNumberInRange(0, 59);
+    unsigned second = randomNumberInRange(0, 59);
+    unsigned msec = randomNumberInRange(0, 999);
+    return [NSString stringWithFormat:@"%u-%02u-%02uT%02u:%02u:%02u.%03uZ",
+            year, month, date, hour, minute, second, msec];
+}
+
+
 static unsigned randomNumberInRange(unsigned start, unsigned end) {
     unsigned span = end - start;
     return start + (unsigned)arc4random_uniform(span);
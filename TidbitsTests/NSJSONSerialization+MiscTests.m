@@ -7,6 +7,7 @@
 //
 
 #import "NSJSONSerialization+Misc.h"
+#import "StringPool.h"
 
 #import "TBTestCaseBase.h"
 
@@ -30,6 +31,25 @@
 }
 
 
+-(void)testJSONObjectFromBundleInternsKeys {
+    NSDictionary * result = [NSJSONSerialization JSONObjectFromBundle:[NSBundle bundleForClass:self.class] resourceName:@"NSJSONSerialization+MiscTests" error:NULL];
+    NSString * key = result.allKeys[0];
+    XCTAssertEqual(key, [[StringPool sharedPool] intern:[NSMutableString stringWithString:@"key1"]]);
+}
+
+
+-(void)testJSONObjectWithInternedKeys {
+    NSData * data = [@"{\"a\": [{\"b\": 1}, {\"b\": 2}], \"c\": null}" dataUsingEncoding:NSUTF8StringEncoding];
+    id json = [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+    NSDictionary * result = [NSJSONSerialization JSONObjectWithInternedKeys:json];
+    XCTAssertEqualObjects(result, json);
+
+    NSArray * arr = result[@"a"];
+    XCTAssertEqual([arr[0] allKeys][0], [arr[1] allKeys][0]);
+    XCTAssertNil([NSJSONSerialization JSONObjectWithInternedKeys:nil]);
+}
+
+
 -(void)testJSONObjectFromBundleAsync {
     __block id result = nil;
     __block NSError * error = nil;
@@ -0,0 +1,193 @@
+//
+//  RFC2822DateTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/9/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "RFC2822Date.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface RFC2822DateTests : TBTestCaseBase
+
+@end
+
+
+@implementation RFC2822DateTests
+
+
+-(void)testStandard {
+    XCTAssertEqual(RFC2822ParseDate("Tue, 1 Jul 2014 10:52:37 +0200 (CEST)"), 1404204757.0);
+    XCTAssertEqual(RFC2822ParseDate("Tue, 01 Jul 2014 08:52:37 +0000"), 1404204757.0);
+    XCTAssertEqual(RFC2822ParseDate("Fri, 21 Nov 1997 09:55:06 -0600"), 880127706.0);
+    XCTAssertEqual(RFC2822ParseDate("Thu, 1 Jan 1970 00:00:00 +0000"), 0.0);
+    XCTAssertEqual(RFC2822ParseDate("Wed, 31 Dec 1969 23:59:59 +0000"), -1.0);
+    XCTAssertEqual(RFC2822ParseDate("Mon, 29 Feb 2016 00:00:00 +0000"), 1456704000.0);
+    XCTAssertEqual(RFC2822ParseDate("Tue, 29 Feb 2000 00:00:00 +0000"), 951782400.0);
+    XCTAssertEqual(RFC2822ParseDate("29 Feb 16 00:00:00 +0000"), 1456704000.0);
+    XCTAssertEqual(RFC2822ParseDate("Tue, 1 Jul 2014 10:52:37 +0200 (CEST)"), RFC2822ParseDate("1 Jul 2014 08:52:37 GMT"));
+}
+
+
+/**
+ * The variants that we see in real mail.  These are all the same time.
+ */
+-(void)testVariants {
+    const char * variants[] = {
+        "1 Jul 2014 10:52:37 +0200",
+        "tuesday, 1 JULY 14 08:52:37 UT",
+        "Tue, 1 Jul 2014 08:52:37 GMT",
+        "Tue, 1 Jul 2014 08:52:37 Z",
+        "Tue, 1 Jul 2014 01:52:37 PDT",
+        "Tue, 1 Jul 2014 03:52:37 CDT",
+        "Tue, 1 Jul 2014 10:52:37 CEST",
+        "Tue, 1 Jul 2014 09:52:37 BST",
+        "Tue, 1 Jul 2014 17:52:37 JST",
+        "Tue, 1 Jul 2014 10:52:37 +02:00",
+        "Tue, 1 Jul 2014 10:52:37 +02",
+        "Tue, 1 Jul 2014 10:52:37 GMT+0200",
+        "Tue, 1 Jul 2014 8:52:37",
+        "Tue,1 Jul 2014 08:52:37 +0000",
+        "Tue, 1 Jul 2014 08:52:37 A",
+        "Tue, 1 Jul 2014 08:52:37 XYZ",
+        "Wed, 1 Jul 2014 08:52:37 +0000",
+        "Tue Jul  1 08:52:37 2014",
+        "Tue Jul  1 08:52:37 GMT 2014",
+        "Tue Jul  1 08:52:37 2014 +0000",
+        "Jul 1 08:52:37 2014",
+        " (comment (nested) \\) ) Tue,\r\n 1 Jul (x) 2014 08:52:37 (y) GMT (z) ",
+    };
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        XCTAssertEqual(RFC2822ParseDate(variants[i]), 1404204757.0, @"%s", variants[i]);
+    }
+
+    XCTAssertEqual(RFC2822ParseDate("Tue, 1 Jul 2014 08:52 GMT"), 1404204720.0);
+    XCTAssertEqual(RFC2822ParseDate("Fri, 21 Nov 97 09:55:06 -0600"), 880127706.0);
+    XCTAssertEqual(RFC2822ParseDate("Fri, 21 Nov 097 09:55:06 -0600"), 880127706.0);
+    XCTAssertEqual(RFC2822ParseDate("Tue, 30 Jun 2015 23:59:60 +0000"), RFC2822ParseDate("Wed, 1 Jul 2015 00:00:00 +0000"));
+}
+
+
+-(void)testInvalid {
+    const char * invalid[] = {
+        "",
+        "   ",
+        "Tue,",
+        "Tue, 1 Jul 2014",
+        "Tue, 1 Jul 2014 10:52:37 +0200 junk",
+        "Tue, 32 Jul 2014 10:52:37 +0000",
+        "Tue, 0 Jul 2014 10:52:37 +0000",
+        "Tue, 31 Feb 2015 10:52:37 +0000",
+        "Sun, 29 Feb 2015 10:52:37 +0000",
+        "Thu, 29 Feb 1900 10:52:37 +0000",
+        "Sat, 31 Apr 2015 10:52:37 +0000",
+        "Tue, 1 Foo 2014 10:52:37 +0000",
+        "Tue, 1 Jul 2014 24:52:37 +0000",
+        "Tue, 1 Jul 2014 10:60:37 +0000",
+        "Tue, 1 Jul 2014 10:52:61 +0000",
+        "Tue, 1 Jul 2014 10:52:37 +2",
+        "Tue, 1 Jul 2014 10:52:37 +02000",
+        "Tue, 1 Jul 20145 10:52:37 +0000",
+        "2014-07-01T08:52:37.000Z",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        XCTAssertTrue(isnan(RFC2822ParseDate(invalid[i])), @"%s", invalid[i]);
+    }
+}
+
+
+-(void)testWithLength {
+    const char * header = "Date: Tue, 1 Jul 2014 10:52:37 +0200\r\nFrom: a@example.com\r\n";
+    XCTAssertEqual(RFC2822ParseDateWithLength(header + 6, 30), 1404204757.0);
+    XCTAssertTrue(isnan(RFC2822ParseDateWithLength(header + 6, 26)));
+}
+
+
+-(void)testBatch {
+    const char * dates[] = {
+        "Tue, 1 Jul 2014 10:52:37 +0200 (CEST)",
+        NULL,
+        "garbage",
+        "Fri, 21 Nov 1997 09:55:06 -0600",
+    };
+    double results[4];
+    RFC2822ParseDates(dates, 4, results);
+    XCTAssertEqual(results[0], 1404204757.0);
+    XCTAssertTrue(isnan(results[1]));
+    XCTAssertTrue(isnan(results[2]));
+    XCTAssertEqual(results[3], 880127706.0);
+}
+
+
+-(void)testMatchesNSDateFormatter {
+    NSDateFormatter * formatter = rfc2822DateFormatter();
+    for (NSUInteger i = 0; i < 10000; i++) {
+        NSString * s = generateSampleDate(formatter);
+        NSDate * expected = [formatter dateFromString:s];
+        XCTAssertEqual(RFC2822ParseDate(s.UTF8String), expected.timeIntervalSince1970, @"%@", s);
+    }
+}
+
+
+/**
+ * A sync page's worth of Date headers, parsed with NSDateFormatter (what we used to do), RFC2822ParseDate, and
+ * RFC2822ParseDates.
+ */
+-(void)testPerformance {
+    const NSUInteger count = 100000;
+    NSDateFormatter * formatter = rfc2822DateFormatter();
+    NSMutableArray * dates = [NSMutableArray arrayWithCapacity:count];
+    const char ** strs = malloc(count * sizeof(const char *));
+    double * results = malloc(count * sizeof(double));
+    @autoreleasepool {
+        for (NSUInteger i = 0; i < count; i++) {
+            [dates addObject:generateSampleDate(formatter)];
+        }
+    }
+    for (NSUInteger i = 0; i < count; i++) {
+        strs[i] = [dates[i] UTF8String];
+    }
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        for (NSString * s in dates) {
+            [formatter dateFromString:s];
+        }
+    }
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    for (NSString * s in dates) {
+        RFC2822ParseDate(s.UTF8String);
+    }
+    NSTimeInterval mid2 = [NSDate timeIntervalSinceReferenceDate];
+    RFC2822ParseDates(strs, count, results);
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+    NSTimeInterval baseline = mid - start;
+    NSLog(@"RFC2822ParseDate x %lu: %0.6f sec, %0.6f ratio vs NSDateFormatter.", (unsigned long)count, mid2 - mid, (mid2 - mid) / baseline);
+    NSLog(@"RFC2822ParseDates x %lu: %0.6f sec, %0.6f ratio vs NSDateFormatter.", (unsigned long)count, end - mid2, (end - mid2) / baseline);
+
+    free(strs);
+    free(results);
+}
+
+
+static NSDateFormatter * rfc2822DateFormatter() {
+    NSDateFormatter * formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.dateFormat = @"EEE, d MMM yyyy HH:mm:ss Z";
+    return formatter;
+}
+
+
+static NSString * generateSampleDate(NSDateFormatter * formatter) {
+    // Somewhere between 1970 and 2037, in a zone between -12:00 and +14:00 in quarter hours.
+    NSInteger offset = ((NSInteger)arc4random_uniform(105) - 48) * 15 * 60;
+    formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT:offset];
+    return [formatter stringFromDate:[NSDate dateWithTimeIntervalSince1970:arc4random_uniform(2100000000)]];
+}
+
+
+@end
@@ -0,0 +1,279 @@
+//
+//  StringPoolTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/28/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import <malloc/malloc.h>
+
+#import "StringPool.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface StringPoolTests : TBTestCaseBase
+
+@end
+
+
+@implementation StringPoolTests
+
+
+-(void)testIntern {
+    StringPool * pool = [[StringPool alloc] init];
+    NSString * a = [pool intern:[NSMutableString stringWithString:@"inbox"]];
+    NSString * b = [pool intern:[NSMutableString stringWithString:@"inbox"]];
+    XCTAssertEqualObjects(a, @"inbox");
+    XCTAssertEqual(a, b);
+    XCTAssertEqual(pool.count, (NSUInteger)1);
+    XCTAssertNil([pool intern:nil]);
+}
+
+
+-(void)testInternImmutableReturnsSelf {
+    StringPool * pool = [[StringPool alloc] init];
+    NSString * s = [NSString stringWithFormat:@"thread-%d", 42];
+    XCTAssertEqual([pool intern:s], s);
+}
+
+
+-(void)testInternMutableIsCopied {
+    StringPool * pool = [[StringPool alloc] init];
+    NSMutableString * s = [NSMutableString stringWithString:@"abc"];
+    NSString * interned = [pool intern:s];
+    [s appendString:@"def"];
+    XCTAssertEqualObjects(interned, @"abc");
+    XCTAssertEqual([pool intern:@"abc"], interned);
+}
+
+
+-(void)testHashesAgree {
+    NSArray * strings = @[@"", @"id", @"café", @"例え", @"\U0001F600 smile"];
+    for (NSString * s in strings) {
+        NSData * utf8 = [s dataUsingEncoding:NSUTF8StringEncoding];
+        unichar chars[64];
+        [s getCharacters:chars range:NSMakeRange(0, s.length)];
+
+        uint32_t h = StringPoolHashString(s);
+        XCTAssertEqual(StringPoolHashUTF8(utf8.bytes, utf8.length), h, @"%@", s);
+        XCTAssertEqual(StringPoolHashCharacters(chars, s.length), h, @"%@", s);
+    }
+}
+
+
+-(void)testUTF8AndCharactersAgree {
+    StringPool * pool = [[StringPool alloc] init];
+    NSArray * strings = @[@"", @"id", @"café", @"例え", @"\U0001F600 smile"];
+    for (NSString * s in strings) {
+        NSData * utf8 = [s dataUsingEncoding:NSUTF8StringEncoding];
+        unichar chars[64];
+        [s getCharacters:chars range:NSMakeRange(0, s.length)];
+
+        NSString * a = [pool internUTF8:utf8.bytes length:utf8.length hash:StringPoolHashUTF8(utf8.bytes, utf8.length)];
+        NSString * b = [pool internCharacters:chars length:s.length hash:StringPoolHashCharacters(chars, s.length)];
+        NSString * c = [pool intern:[s mutableCopy]];
+        XCTAssertEqualObjects(a, s);
+        XCTAssertEqual(a, b, @"%@", s);
+        XCTAssertEqual(a, c, @"%@", s);
+    }
+    XCTAssertEqual(pool.count, strings.count);
+}
+
+
+-(void)testUTF8Prefix {
+    // "ab" and "abc" must not match just because one is a prefix of the other.
+    StringPool * pool = [[StringPool alloc] init];
+    const char * bytes = "abc";
+    NSString * ab = [pool internUTF8:bytes length:2 hash:StringPoolHashUTF8(bytes, 2)];
+    NSString * abc = [pool internUTF8:bytes length:3 hash:StringPoolHashUTF8(bytes, 3)];
+    XCTAssertEqualObjects(ab, @"ab");
+    XCTAssertEqualObjects(abc, @"abc");
+}
+
+
+-(void)testInvalidUTF8 {
+    StringPool * pool = [[StringPool alloc] init];
+    const char * bytes = "a\xC3";
+    XCTAssertNil([pool internUTF8:bytes length:2 hash:StringPoolHashUTF8(bytes, 2)]);
+    XCTAssertEqual(pool.count, (NSUInteger)0);
+}
+
+
+-(void)testGrowth {
+    StringPool * pool = [[StringPool alloc] init];
+    NSMutableArray * interned = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 10000; i++) {
+        [interned addObject:[pool intern:[NSString stringWithFormat:@"key-%lu", (unsigned long)i]]];
+    }
+    XCTAssertEqual(pool.count, (NSUInteger)10000);
+    for (NSUInteger i = 0; i < 10000; i++) {
+        XCTAssertEqual([pool intern:[NSString stringWithFormat:@"key-%lu", (unsigned long)i]], interned[i]);
+    }
+
+    [pool removeAllObjects];
+    XCTAssertEqual(pool.count, (NSUInteger)0);
+    XCTAssertEqualObjects([pool intern:@"key-0"], @"key-0");
+}
+
+
+-(void)testCountLimit {
+    StringPool * pool = [[StringPool alloc] initWithCountLimit:160];
+    for (NSUInteger i = 0; i < 10000; i++) {
+        [pool intern:[NSString stringWithFormat:@"key-%lu", (unsigned long)i]];
+        XCTAssertLessThanOrEqual(pool.count, (NSUInteger)160);
+    }
+
+    // Whatever has been evicted, everything that's left must still be findable.
+    for (NSUInteger i = 0; i < 10000; i++) {
+        NSString * s = [NSString stringWithFormat:@"key-%lu", (unsigned long)i];
+        XCTAssertEqualObjects([pool intern:s], s);
+    }
+}
+
+
+-(void)testCountLimitKeepsHotStrings {
+    StringPool * pool = [[StringPool alloc] initWithCountLimit:1600];
+    NSString * hot = [pool intern:[NSMutableString stringWithString:@"hot"]];
+    for (NSUInteger i = 0; i < 10000; i++) {
+        [pool intern:[NSString stringWithFormat:@"cold-%lu", (unsigned long)i]];
+        XCTAssertEqual([pool intern:[NSMutableString stringWithString:@"hot"]], hot);
+    }
+}
+
+
+-(void)testConcurrent {
+    StringPool * pool = [[StringPool alloc] initWithCountLimit:0];
+    NSArray * keys = typicalKeys();
+    NSMutableArray * results = [NSMutableArray array];
+    for (NSUInteger t = 0; t < 8; t++) {
+        [results addObject:[NSMutableArray arrayWithCapacity:keys.count]];
+    }
+
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t t) {
+        NSMutableArray * mine = results[t];
+        for (NSString * key in keys) {
+            [mine addObject:[pool intern:[key mutableCopy]]];
+        }
+    });
+
+    XCTAssertEqual(pool.count, [NSSet setWithArray:keys].count);
+    for (NSUInteger i = 0; i < keys.count; i++) {
+        for (NSUInteger t = 1; t < 8; t++) {
+            XCTAssertEqual(results[t][i], results[0][i]);
+        }
+    }
+}
+
+
+/**
+ * A mixture of JSON keys, settings keys, and Breadcrumb tags, similar to what we see in the app, plus a long
+ * tail of one-offs.
+ */
+static NSArray * typicalKeys() {
+    NSArray * common = @[@"id", @"name", @"email", @"first_name", @"last_name", @"created_at", @"updated_at",
+                         @"thread_id", @"message_id", @"subject", @"snippet", @"from", @"to", @"cc", @"date",
+                         @"labels", @"unread", @"starred", @"attachments", @"size", @"mime_type",
+                         @"ShowUnreadCount", @"LastSyncDate", @"NotificationsEnabled", @"SwipeActions",
+                         @"inbox", @"thread-view", @"compose", @"<compose", @"settings", @"search", @"<search"];
+    NSMutableArray * result = [NSMutableArray array];
+    for (NSUInteger i = 0; i < 2000; i++) {
+        [result addObject:common[(i * i) % common.count]];
+        [result addObject:[NSString stringWithFormat:@"contact-%lu", (unsigned long)(i % 500)]];
+    }
+    return result;
+}
+
+
+static size_t mallocBytesInUse() {
+    malloc_statistics_t stats;
+    malloc_zone_statistics(NULL, &stats);
+    return stats.size_in_use;
+}
+
+
+-(void)testMemory {
+    NSArray * keys = typicalKeys();
+    const NSUInteger repeats = 25;
+    StringPool * pool = [[StringPool alloc] init];
+
+    size_t before = mallocBytesInUse();
+    NSMutableArray * plain = [NSMutableArray arrayWithCapacity:keys.count * repeats];
+    for (NSUInteger r = 0; r < repeats; r++) {
+        for (NSString * key in keys) {
+            [plain addObject:[NSString stringWithFormat:@"%@", key]];
+        }
+    }
+    size_t plainBytes = mallocBytesInUse() - before;
+    plain = nil;
+
+    before = mallocBytesInUse();
+    NSMutableArray * interned = [NSMutableArray arrayWithCapacity:keys.count * repeats];
+    for (NSUInteger r = 0; r < repeats; r++) {
+        for (NSString * key in keys) {
+            @autoreleasepool {
+                [interned addObject:[pool intern:[NSString stringWithFormat:@"%@", key]]];
+            }
+        }
+    }
+    size_t internedBytes = mallocBytesInUse() - before;
+
+    NSLog(@"StringPool memory for %lu keys (%lu distinct): %lu bytes plain, %lu bytes interned (%lu of that is table).",
+          (unsigned long)interned.count, (unsigned long)pool.count, (unsigned long)plainBytes, (unsigned long)internedBytes, (unsigned long)pool.tableSize);
+}
+
+
+-(void)testThroughput {
+    NSArray * keys = typicalKeys();
+    NSMutableArray * utf8 = [NSMutableArray arrayWithCapacity:keys.count];
+    for (NSString * key in keys) {
+        [utf8 addObject:[key dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+    StringPool * pool = [[StringPool alloc] init];
+    const NSUInteger repeats = 25;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger r = 0; r < repeats; r++) {
+        @autoreleasepool {
+            for (NSData * d in utf8) {
+                (void)[[NSString alloc] initWithBytes:d.bytes length:d.length encoding:NSUTF8StringEncoding];
+            }
+        }
+    }
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger r = 0; r < repeats; r++) {
+        @autoreleasepool {
+            for (NSData * d in utf8) {
+                [pool internUTF8:d.bytes length:d.length hash:StringPoolHashUTF8(d.bytes, d.length)];
+            }
+        }
+    }
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+    NSTimeInterval baseline = mid - start;
+    NSTimeInterval result = end - mid;
+    NSLog(@"StringPool internUTF8 x %lu: %0.6f sec, %0.6f ratio vs initWithBytes.", (unsigned long)(utf8.count * repeats), result, result / baseline);
+}
+
+
+-(void)testConcurrentThroughput {
+    NSArray * keys = typicalKeys();
+    StringPool * pool = [[StringPool alloc] initWithCountLimit:16384];
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t t) {
+        for (NSUInteger r = 0; r < 10; r++) {
+            @autoreleasepool {
+                for (NSString * key in keys) {
+                    [pool intern:key];
+                }
+            }
+        }
+    });
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+    NSLog(@"StringPool intern x %lu on 8 threads: %0.6f sec.", (unsigned long)(keys.count * 10 * 8), end - start);
+}
+
+
+@end
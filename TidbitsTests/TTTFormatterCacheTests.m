@@ -0,0 +1,281 @@
+//
+//  TTTFormatterCacheTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/10/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "TTTFormatterCache.h"
+#import "TTTOrdinalNumberFormatter.h"
+#import "TTTTimeIntervalFormatter.h"
+#import "TTTUnitOfInformationFormatter.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface TTTFormatterCacheTests : TBTestCaseBase
+
+@end
+
+
+@implementation TTTFormatterCacheTests
+
+
+-(void)setUp {
+    [super setUp];
+    [[TTTFormatterCache sharedCache] removeAllStrings];
+    [[TTTFormatterCache sharedCache] resetStatistics];
+}
+
+
+-(void)testCacheHitsAndMisses {
+    TTTFormatterCache * cache = [[TTTFormatterCache alloc] initWithCountLimit:10];
+    XCTAssertNil([cache stringForConfiguration:@"a" input:1]);
+    [cache setString:@"one" forConfiguration:@"a" input:1];
+    XCTAssertEqualObjects([cache stringForConfiguration:@"a" input:1], @"one");
+    XCTAssertEqualObjects([cache stringForConfiguration:[@"a" mutableCopy] input:1], @"one");
+    XCTAssertNil([cache stringForConfiguration:@"a" input:2]);
+    XCTAssertNil([cache stringForConfiguration:@"b" input:1]);
+
+    XCTAssertEqual(cache.hits, 2ULL);
+    XCTAssertEqual(cache.misses, 3ULL);
+    XCTAssertEqualWithAccuracy(cache.hitRate, 0.4, 1e-9);
+
+    [cache resetStatistics];
+    XCTAssertEqual(cache.hits, 0ULL);
+    XCTAssertEqual(cache.hitRate, 0.0);
+}
+
+
+-(void)testCacheIsBounded {
+    TTTFormatterCache * cache = [[TTTFormatterCache alloc] initWithCountLimit:10];
+    for (int64_t i = 0; i < 100; i++) {
+        [cache setString:[NSString stringWithFormat:@"%lld", i] forConfiguration:@"a" input:i];
+    }
+    NSUInteger found = 0;
+    for (int64_t i = 0; i < 100; i++) {
+        if ([cache stringForConfiguration:@"a" input:i] != nil) {
+            found++;
+        }
+    }
+    XCTAssertEqual(found, (NSUInteger)10);
+    XCTAssertEqualObjects([cache stringForConfiguration:@"a" input:99], @"99");
+}
+
+
+-(void)testCacheClearedByLocaleChange {
+    TTTFormatterCache * cache = [[TTTFormatterCache alloc] initWithCountLimit:10];
+    [cache setString:@"one" forConfiguration:@"a" input:1];
+    [[NSNotificationCenter defaultCenter] postNotificationName:NSCurrentLocaleDidChangeNotification object:nil];
+    XCTAssertNil([cache stringForConfiguration:@"a" input:1]);
+}
+
+
+-(void)testTimeIntervalMatchesUncached {
+    TTTTimeIntervalFormatter * uncached = [[TTTTimeIntervalFormatter alloc] init];
+    TTTTimeIntervalFormatter * cached = [[TTTTimeIntervalFormatter alloc] init];
+    cached.cachesResults = YES;
+
+    for (NSUInteger pass = 0; pass < 2; pass++) {
+        for (NSNumber * n in timeIntervals()) {
+            NSTimeInterval t = n.doubleValue;
+            XCTAssertEqualObjects([cached stringForTimeInterval:t], [uncached stringForTimeInterval:t], @"%f", t);
+        }
+    }
+    XCTAssertGreaterThan([TTTFormatterCache sharedCache].hits, 0ULL);
+
+    uncached.usesAbbreviatedCalendarUnits = YES;
+    cached.usesAbbreviatedCalendarUnits = YES;
+    XCTAssertEqualObjects([cached stringForTimeInterval:-300.0], [uncached stringForTimeInterval:-300.0]);
+    uncached.locale = [NSLocale localeWithLocaleIdentifier:@"fr_FR"];
+    uncached.usesIdiomaticDeicticExpressions = YES;
+    cached.locale = [NSLocale localeWithLocaleIdentifier:@"fr_FR"];
+    cached.usesIdiomaticDeicticExpressions = YES;
+    XCTAssertEqualObjects([cached stringForTimeInterval:-86400.0], [uncached stringForTimeInterval:-86400.0]);
+}
+
+
+-(void)testTimeIntervalPresentMargin {
+    TTTTimeIntervalFormatter * formatter = [[TTTTimeIntervalFormatter alloc] init];
+    formatter.cachesResults = YES;
+    formatter.presentTimeIntervalMargin = 1.5;
+    XCTAssertEqualObjects([formatter stringForTimeInterval:-1.2], formatter.presentDeicticExpression);
+    XCTAssertNotEqualObjects([formatter stringForTimeInterval:-1.7], formatter.presentDeicticExpression);
+    XCTAssertEqualObjects([formatter stringForTimeInterval:-1.2], formatter.presentDeicticExpression);
+}
+
+
+-(void)testTimeIntervalSharedBetweenFormatters {
+    TTTTimeIntervalFormatter * a = [[TTTTimeIntervalFormatter alloc] init];
+    TTTTimeIntervalFormatter * b = [[TTTTimeIntervalFormatter alloc] init];
+    TTTTimeIntervalFormatter * c = [[TTTTimeIntervalFormatter alloc] init];
+    a.cachesResults = YES;
+    b.cachesResults = YES;
+    c.cachesResults = YES;
+    c.pastDeicticExpression = @"back";
+
+    [a stringForTimeInterval:-300.0];
+    [[TTTFormatterCache sharedCache] resetStatistics];
+    [b stringForTimeInterval:-300.0];
+    XCTAssertEqual([TTTFormatterCache sharedCache].hits, 1ULL);
+    XCTAssert([[c stringForTimeInterval:-300.0] hasSuffix:@"back"]);
+    XCTAssertEqual([TTTFormatterCache sharedCache].misses, 1ULL);
+}
+
+
+-(void)testUnitOfInformationMatchesUncached {
+    TTTUnitOfInformationFormatter * uncached = [[TTTUnitOfInformationFormatter alloc] init];
+    TTTUnitOfInformationFormatter * cached = [[TTTUnitOfInformationFormatter alloc] init];
+    cached.cachesResults = YES;
+
+    for (NSUInteger config = 0; config < 4; config++) {
+        uncached.usesIECBinaryPrefixesForDisplay = cached.usesIECBinaryPrefixesForDisplay = (config & 1);
+        uncached.displaysInTermsOfBytes = cached.displaysInTermsOfBytes = !(config & 2);
+        for (NSUInteger pass = 0; pass < 2; pass++) {
+            for (NSNumber * n in byteCounts()) {
+                XCTAssertEqualObjects([cached stringFromNumber:n ofUnit:TTTByte], [uncached stringFromNumber:n ofUnit:TTTByte], @"%@", n);
+            }
+            XCTAssertEqualObjects([cached stringFromNumberOfBits:@1234.5], [uncached stringFromNumberOfBits:@1234.5]);
+        }
+    }
+}
+
+
+-(void)testUnitOfInformationNumberFormatterChange {
+    TTTUnitOfInformationFormatter * formatter = [[TTTUnitOfInformationFormatter alloc] init];
+    formatter.cachesResults = YES;
+    formatter.numberFormatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US"];
+    NSString * us = [formatter stringFromNumber:@1536 ofUnit:TTTByte];
+
+    formatter.numberFormatter.locale = [NSLocale localeWithLocaleIdentifier:@"de_DE"];
+    NSString * de = [formatter stringFromNumber:@1536 ofUnit:TTTByte];
+    XCTAssertNotEqualObjects(us, de);
+    XCTAssert([de rangeOfString:@","].location != NSNotFound, @"%@", de);
+}
+
+
+-(void)testUnitOfInformationSeesNumberFormatterChangesWithoutHook {
+    TTTUnitOfInformationFormatter * formatter = [[TTTUnitOfInformationFormatter alloc] init];
+    formatter.numberFormatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US"];
+    XCTAssertEqualObjects([formatter stringFromNumber:@1536 ofUnit:TTTByte], @"1.5 KB");
+
+    formatter.numberFormatter.minimumFractionDigits = 2;
+    XCTAssertEqualObjects([formatter stringFromNumber:@1536 ofUnit:TTTByte], @"1.50 KB");
+
+    formatter.numberFormatter.decimalSeparator = @"_";
+    XCTAssertEqualObjects([formatter stringFromNumber:@1536 ofUnit:TTTByte], @"1_50 KB");
+
+    NSNumberFormatter * replaced = formatter.numberFormatter;
+    TTTUnitOfInformationFormatter * copy = [formatter copy];
+    replaced.decimalSeparator = @".";
+    XCTAssertEqualObjects([formatter stringFromNumber:@1536 ofUnit:TTTByte], @"1.50 KB");
+    XCTAssertEqualObjects([copy stringFromNumber:@1536 ofUnit:TTTByte], @"1_50 KB");
+}
+
+
+-(void)testOrdinalMatchesUncached {
+    for (NSString * localeIdentifier in @[@"en_US", @"fr_FR", @"es_ES", @"zh_Hans", @"ca_ES"]) {
+        TTTOrdinalNumberFormatter * uncached = [[TTTOrdinalNumberFormatter alloc] init];
+        TTTOrdinalNumberFormatter * cached = [[TTTOrdinalNumberFormatter alloc] init];
+        uncached.locale = cached.locale = [NSLocale localeWithLocaleIdentifier:localeIdentifier];
+        cached.cachesResults = YES;
+
+        for (NSUInteger pass = 0; pass < 2; pass++) {
+            for (NSInteger i = 0; i < 150; i++) {
+                XCTAssertEqualObjects([cached stringFromNumber:@(i)], [uncached stringFromNumber:@(i)], @"%@ %ld", localeIdentifier, (long)i);
+            }
+            XCTAssertEqualObjects([cached stringFromNumber:@2.5], [uncached stringFromNumber:@2.5]);
+        }
+
+        uncached.grammaticalGender = cached.grammaticalGender = TTTOrdinalNumberFormatterFemaleGender;
+        XCTAssertEqualObjects([cached stringFromNumber:@1], [uncached stringFromNumber:@1], @"%@", localeIdentifier);
+    }
+}
+
+
+-(void)testOrdinalConfigurationsDontShareStrings {
+    TTTOrdinalNumberFormatter * plain = [[TTTOrdinalNumberFormatter alloc] init];
+    TTTOrdinalNumberFormatter * padded = [[TTTOrdinalNumberFormatter alloc] init];
+    plain.locale = padded.locale = [NSLocale localeWithLocaleIdentifier:@"en_US"];
+    plain.cachesResults = padded.cachesResults = YES;
+    padded.minimumIntegerDigits = 3;
+
+    XCTAssertEqualObjects([plain stringFromNumber:@7], @"7th");
+    XCTAssertEqualObjects([padded stringFromNumber:@7], @"007th");
+
+    // Changed after the configuration was built, without touching cachesResults.
+    padded.minimumIntegerDigits = 1;
+    padded.multiplier = @10;
+    XCTAssertEqualObjects([padded stringFromNumber:@7], @"70th");
+    padded.multiplier = @1;
+    padded.formatWidth = 6;
+    padded.paddingCharacter = @"*";
+    TTTOrdinalNumberFormatter * uncached = [[TTTOrdinalNumberFormatter alloc] init];
+    uncached.locale = padded.locale;
+    uncached.formatWidth = 6;
+    uncached.paddingCharacter = @"*";
+    XCTAssertEqualObjects([padded stringFromNumber:@7], [uncached stringFromNumber:@7]);
+    XCTAssertNotEqualObjects([padded stringFromNumber:@7], @"7th");
+    XCTAssertEqualObjects([plain stringFromNumber:@7], @"7th");
+}
+
+
+/**
+ * Formats the labels for a message list of 500 cells (a relative time, a file size, and an ordinal), as a table
+ * view would when scrolling through it three times, with and without the cache.
+ */
+-(void)testScrollPerformance {
+    const NSUInteger rows = 500;
+    const NSUInteger passes = 3;
+    NSMutableArray * intervals = [NSMutableArray arrayWithCapacity:rows];
+    NSMutableArray * sizes = [NSMutableArray arrayWithCapacity:rows];
+    for (NSUInteger i = 0; i < rows; i++) {
+        // Newest first, a few minutes apart, and then further apart.
+        [intervals addObject:@(-(i < 100 ? i * 180.0 : i * 7200.0) - 30.0)];
+        [sizes addObject:@((unsigned long long)arc4random_uniform(50) * 1024 * (1 + i % 7))];
+    }
+
+    NSTimeInterval baseline = [self scroll:NO rows:rows passes:passes intervals:intervals sizes:sizes];
+    [[TTTFormatterCache sharedCache] resetStatistics];
+    NSTimeInterval result = [self scroll:YES rows:rows passes:passes intervals:intervals sizes:sizes];
+    NSLog(@"Formatter scrolling %lu cells x %lu: %0.6f sec, %0.6f ratio vs uncached, %0.3f hit rate.", (unsigned long)rows, (unsigned long)passes, result, result / baseline, [TTTFormatterCache sharedCache].hitRate);
+}
+
+
+-(NSTimeInterval)scroll:(BOOL)cachesResults rows:(NSUInteger)rows passes:(NSUInteger)passes intervals:(NSArray *)intervals sizes:(NSArray *)sizes {
+    TTTTimeIntervalFormatter * timeIntervalFormatter = [[TTTTimeIntervalFormatter alloc] init];
+    TTTUnitOfInformationFormatter * unitOfInformationFormatter = [[TTTUnitOfInformationFormatter alloc] init];
+    TTTOrdinalNumberFormatter * ordinalNumberFormatter = [[TTTOrdinalNumberFormatter alloc] init];
+    timeIntervalFormatter.cachesResults = cachesResults;
+    unitOfInformationFormatter.cachesResults = cachesResults;
+    ordinalNumberFormatter.cachesResults = cachesResults;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger pass = 0; pass < passes; pass++) {
+        @autoreleasepool {
+            for (NSUInteger i = 0; i < rows; i++) {
+                [timeIntervalFormatter stringForTimeInterval:[intervals[i] doubleValue]];
+                [unitOfInformationFormatter stringFromNumber:sizes[i] ofUnit:TTTByte];
+                [ordinalNumberFormatter stringFromNumber:@(i % 31 + 1)];
+            }
+        }
+    }
+    return [NSDate timeIntervalSinceReferenceDate] - start;
+}
+
+
+static NSArray * timeIntervals() {
+    return @[@-0.5, @-1.0, @-1.9, @-59.0, @-59.9, @-60.0, @-61.5, @-300.0, @-3599.0, @-3600.0, @-7200.7, @-86399.0,
+             @-86400.0, @-172800.0, @-604800.0, @-2592000.0, @-31536000.0, @-63072000.5,
+             @0.5, @59.0, @300.0, @86400.0, @604800.0];
+}
+
+
+static NSArray * byteCounts() {
+    return @[@0ULL, @1ULL, @999ULL, @1023ULL, @1024ULL, @1025ULL, @1536ULL, @1048575ULL, @1048576ULL, @1500000ULL,
+             @1073741824ULL, @1610612736ULL, @1099511627776ULL, @1125899906842624ULL, @(1ULL << 58)];
+}
+
+
+@end
@@ -0,0 +1,277 @@
+//
+//  TTTURLRequestFormatterTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "TTTURLRequestFormatter.h"
+
+#import "TBTestCaseBase.h"
+
+
+#define PERF_TEST_BODY_LENGTH (8 * 1024 * 1024)
+
+
+@interface TTTURLRequestFormatterTests : TBTestCaseBase
+
+@end
+
+
+@implementation TTTURLRequestFormatterTests
+
+
+-(void)testCURLMatchesLegacy {
+    for (NSURLRequest * request in sampleRequests()) {
+        for (int escape = 0; escape < 2; escape++) {
+            NSString * expected = legacyCURLCommand(request, escape);
+            XCTAssertEqualObjects([TTTURLRequestFormatter cURLCommandFromURLRequest:request escape:escape], expected);
+
+            NSOutputStream * stream = [NSOutputStream outputStreamToMemory];
+            [stream open];
+            NSError * err = nil;
+            XCTAssert([TTTURLRequestFormatter writeCURLCommandFromURLRequest:request escape:escape bodyFileURL:nil toStream:stream error:&err]);
+            XCTAssertNil(err);
+            XCTAssertEqualObjects([stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey], [expected dataUsingEncoding:NSUTF8StringEncoding]);
+            [stream close];
+        }
+    }
+}
+
+
+-(void)testWgetMatchesLegacy {
+    for (NSURLRequest * request in sampleRequests()) {
+        if (![request.HTTPMethod isEqualToString:@"GET"] && ![request.HTTPMethod isEqualToString:@"POST"]) {
+            XCTAssertThrows([TTTURLRequestFormatter WgetCommandFromURLRequest:request]);
+            continue;
+        }
+        XCTAssertEqualObjects([TTTURLRequestFormatter WgetCommandFromURLRequest:request], legacyWgetCommand(request));
+    }
+}
+
+
+-(void)testBodyFile {
+    NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"https://example.com/upload"]];
+    request.HTTPMethod = @"POST";
+    request.HTTPBody = largeBody(100000);
+    NSURL * bodyFileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"TTTURLRequestFormatterTests body"]];
+
+    NSOutputStream * stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    NSError * err = nil;
+    XCTAssert([TTTURLRequestFormatter writeCURLCommandFromURLRequest:request escape:YES bodyFileURL:bodyFileURL toStream:stream error:&err]);
+    NSString * command = [[NSString alloc] initWithData:[stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey] encoding:NSUTF8StringEncoding];
+    [stream close];
+
+    NSString * expected = [NSString stringWithFormat:@"curl -X POST \"https://example.com/upload\"\n--data-binary \"@%@\"", bodyFileURL.path];
+    XCTAssertEqualObjects(command, expected);
+    XCTAssertEqualObjects([NSData dataWithContentsOfURL:bodyFileURL], request.HTTPBody);
+
+    stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    XCTAssert([TTTURLRequestFormatter writeWgetCommandFromURLRequest:request bodyFileURL:bodyFileURL toStream:stream error:&err]);
+    command = [[NSString alloc] initWithData:[stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey] encoding:NSUTF8StringEncoding];
+    [stream close];
+
+    expected = [NSString stringWithFormat:@"wget\n--post-file=\"%@\"\n\"https://example.com/upload\"", bodyFileURL.path];
+    XCTAssertEqualObjects(command, expected);
+
+    [[NSFileManager defaultManager] removeItemAtURL:bodyFileURL error:NULL];
+}
+
+
+-(void)testBodyFilePathIsEscaped {
+    NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"https://example.com/upload"]];
+    request.HTTPMethod = @"POST";
+    request.HTTPBody = [@"body" dataUsingEncoding:NSUTF8StringEncoding];
+    NSURL * bodyFileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"TTTURLRequestFormatterTests \"$HOME`id`\\"]];
+    NSString * escapedPath = [bodyFileURL.path stringByReplacingOccurrencesOfString:@"\\" withString:@"\\\\"];
+    for (NSString * c in @[@"\"", @"$", @"`"]) {
+        escapedPath = [escapedPath stringByReplacingOccurrencesOfString:c withString:[@"\\" stringByAppendingString:c]];
+    }
+
+    NSOutputStream * stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    NSError * err = nil;
+    XCTAssert([TTTURLRequestFormatter writeCURLCommandFromURLRequest:request escape:YES bodyFileURL:bodyFileURL toStream:stream error:&err]);
+    NSString * command = [[NSString alloc] initWithData:[stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey] encoding:NSUTF8StringEncoding];
+    [stream close];
+    XCTAssertEqualObjects(command, ([NSString stringWithFormat:@"curl -X POST \"https://example.com/upload\"\n--data-binary \"@%@\"", escapedPath]));
+
+    stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    XCTAssert([TTTURLRequestFormatter writeWgetCommandFromURLRequest:request bodyFileURL:bodyFileURL toStream:stream error:&err]);
+    command = [[NSString alloc] initWithData:[stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey] encoding:NSUTF8StringEncoding];
+    [stream close];
+    XCTAssertEqualObjects(command, ([NSString stringWithFormat:@"wget\n--post-file=\"%@\"\n\"https://example.com/upload\"", escapedPath]));
+
+    [[NSFileManager defaultManager] removeItemAtURL:bodyFileURL error:NULL];
+}
+
+
+-(void)testStreamError {
+    NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"https://example.com/upload"]];
+    request.HTTPMethod = @"POST";
+    request.HTTPBody = largeBody(100000);
+
+    uint8_t buffer[1000];
+    NSOutputStream * stream = [[NSOutputStream alloc] initToBuffer:buffer capacity:sizeof(buffer)];
+    [stream open];
+    NSError * err = nil;
+    XCTAssertFalse([TTTURLRequestFormatter writeCURLCommandFromURLRequest:request escape:NO bodyFileURL:nil toStream:stream error:&err]);
+    XCTAssertNotNil(err);
+    [stream close];
+}
+
+
+-(void)testPerformance {
+    NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:@"https://example.com/upload"]];
+    request.HTTPMethod = @"POST";
+    request.HTTPBody = largeBody(PERF_TEST_BODY_LENGTH);
+    [request setValue:@"multipart/form-data; boundary=xyz" forHTTPHeaderField:@"Content-Type"];
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        legacyCURLCommand(request, YES);
+    }
+    NSTimeInterval baseline = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"Legacy cURL command with %d byte body: %0.6f sec.", PERF_TEST_BODY_LENGTH, baseline);
+
+    NSString * path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"TTTURLRequestFormatterTests command"];
+    start = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        NSOutputStream * stream = [NSOutputStream outputStreamToFileAtPath:path append:NO];
+        [stream open];
+        [TTTURLRequestFormatter writeCURLCommandFromURLRequest:request escape:YES bodyFileURL:nil toStream:stream error:NULL];
+        [stream close];
+    }
+    NSTimeInterval streaming = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"Streamed cURL command with %d byte body: %0.6f sec, %0.6f ratio vs baseline.", PERF_TEST_BODY_LENGTH, streaming, streaming / baseline);
+
+    [[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+}
+
+
+static NSArray * sampleRequests() {
+    NSMutableArray * result = [NSMutableArray array];
+    NSURL * url = [NSURL URLWithString:@"https://example.com/path?q=1&r=2"];
+
+    [result addObject:[NSURLRequest requestWithURL:url]];
+
+    NSArray * bodies = @[@"a=1&b=2",
+                         @"{\"name\": \"O'Brien\", \"cost\": \"$5\", \"path\": \"C:\\\\dir\", \"cmd\": \"`ls`\"}",
+                         @"caf\u00e9 \u65e5\u672c \U0001F600",
+                         @"trailing space   ",
+                         @"trailing nbsp\u00a0\t",
+                         @"   ",
+                         @"\n"];
+    for (NSString * body in bodies) {
+        NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:url];
+        request.HTTPMethod = @"POST";
+        request.HTTPBody = [body dataUsingEncoding:NSUTF8StringEncoding];
+        [result addObject:request];
+    }
+
+    NSMutableURLRequest * request = [NSMutableURLRequest requestWithURL:url];
+    request.HTTPMethod = @"POST";
+    uint8_t invalid[] = {'a', 0xff, 'b'};
+    request.HTTPBody = [NSData dataWithBytes:invalid length:sizeof(invalid)];
+    [result addObject:request];
+
+    request = [NSMutableURLRequest requestWithURL:url];
+    request.HTTPMethod = @"PUT";
+    request.HTTPBody = largeBody(100000);
+    [request setValue:@"gzip, deflate" forHTTPHeaderField:@"Accept-Encoding"];
+    [request setValue:@"it's" forHTTPHeaderField:@"X-Quote"];
+    [request setValue:@"text/plain" forHTTPHeaderField:@"Content-Type"];
+    [result addObject:request];
+
+    return result;
+}
+
+
+/**
+ * Text with characters that need escaping, longer than the formatter's buffer.
+ */
+static NSData * largeBody(NSUInteger length) {
+    NSMutableData * result = [NSMutableData dataWithLength:length];
+    uint8_t * bytes = result.mutableBytes;
+    const char * pattern = "--xyz\r\nContent-Disposition: form-data; name=\"f\"\r\n\r\n$HOME `x` \\n \xc3\xa9\r\n";
+    size_t patternLength = strlen(pattern);
+    for (NSUInteger i = 0; i < length; i++) {
+        bytes[i] = (uint8_t)pattern[i % patternLength];
+    }
+    // Don't end part-way through the é.
+    if (length > 0 && bytes[length - 1] == 0xc3) {
+        bytes[length - 1] = 'x';
+    }
+    return result;
+}
+
+
+static void legacyAppendCommandLineArgument(NSMutableString * command, NSString * arg) {
+    [command appendFormat:@"\n%@", [arg stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]]];
+}
+
+
+/**
+ * +[TTTURLRequestFormatter cURLCommandFromURLRequest:escape:] before it was streamed.
+ */
+static NSString * legacyCURLCommand(NSURLRequest * request, BOOL escape) {
+    NSMutableString * command = [NSMutableString stringWithFormat:@"curl -X %@ \"%@\"", [request HTTPMethod], [[request URL] absoluteString]];
+
+    if ([[request HTTPBody] length] > 0) {
+        NSMutableString * HTTPBodyString = [[NSMutableString alloc] initWithData:[request HTTPBody] encoding:NSUTF8StringEncoding];
+        if (escape) {
+            [HTTPBodyString replaceOccurrencesOfString:@"\\" withString:@"\\\\" options:0 range:NSMakeRange(0, [HTTPBodyString length])];
+            [HTTPBodyString replaceOccurrencesOfString:@"`" withString:@"\\`" options:0 range:NSMakeRange(0, [HTTPBodyString length])];
+            [HTTPBodyString replaceOccurrencesOfString:@"\"" withString:@"\\\"" options:0 range:NSMakeRange(0, [HTTPBodyString length])];
+            [HTTPBodyString replaceOccurrencesOfString:@"$" withString:@"\\$" options:0 range:NSMakeRange(0, [HTTPBodyString length])];
+        }
+
+        legacyAppendCommandLineArgument(command, [NSString stringWithFormat:@"-d \"%@\"", HTTPBodyString]);
+    }
+
+    for (id field in [request allHTTPHeaderFields]) {
+        legacyAppendCommandLineArgument(command, [NSString stringWithFormat:@"-H %@", [NSString stringWithFormat:@"'%@: %@'", field, [[request valueForHTTPHeaderField:field] stringByReplacingOccurrencesOfString:@"\'" withString:@"\\\'"]]]);
+    }
+
+    if ([request URL]) {
+        NSArray * cookies = [[NSHTTPCookieStorage sharedHTTPCookieStorage] cookiesForURL:[request URL]];
+        for (NSHTTPCookie * cookie in cookies) {
+            legacyAppendCommandLineArgument(command, [NSString stringWithFormat:@"--cookie \"%@=%@\"", [cookie name], [cookie value]]);
+        }
+    }
+
+    NSString * acceptEncodingHeader = [[request allHTTPHeaderFields] valueForKey:@"Accept-Encoding"];
+    if ([acceptEncodingHeader rangeOfString:@"gzip"].location != NSNotFound) {
+        legacyAppendCommandLineArgument(command, @"--compressed");
+    }
+
+    return [NSString stringWithString:command];
+}
+
+
+/**
+ * +[TTTURLRequestFormatter WgetCommandFromURLRequest:] before it was streamed.
+ */
+static NSString * legacyWgetCommand(NSURLRequest * request) {
+    NSMutableString * command = [NSMutableString stringWithString:@"wget"];
+
+    if ([[request HTTPBody] length] > 0) {
+        NSString * HTTPBodyString = [[NSString alloc] initWithData:[request HTTPBody] encoding:NSUTF8StringEncoding];
+        legacyAppendCommandLineArgument(command, [NSString stringWithFormat:@"-d %@", HTTPBodyString]);
+    }
+
+    for (id field in [request allHTTPHeaderFields]) {
+        legacyAppendCommandLineArgument(command, [NSString stringWithFormat:@"--header=%@", [NSString stringWithFormat:@"'%@: %@'", field, [[request valueForHTTPHeaderField:field] stringByReplacingOccurrencesOfString:@"\'" withString:@"\\\'"]]]);
+    }
+
+    legacyAppendCommandLineArgument(command, [NSString stringWithFormat:@"\"%@\"", [[request URL] absoluteString]]);
+
+    return [NSString stringWithString:command];
+}
+
+
+@end
@@ -0,0 +1,205 @@
+//
+//  TTTUnitOfInformationFormatterTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 4/11/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "TTTUnitOfInformationFormatter.h"
+
+#import "TBTestCaseBase.h"
+
+
+#define PERF_TEST_COUNT 20000
+
+
+@interface TTTUnitOfInformationFormatterTests : TBTestCaseBase
+
+@end
+
+
+@implementation TTTUnitOfInformationFormatterTests
+
+
+-(void)testMatchesNumberFormatterAcrossLocales {
+    NSArray * sizes = sampleSizes();
+    uint64_t * bytes = malloc(sizes.count * sizeof(uint64_t));
+    for (NSUInteger i = 0; i < sizes.count; i++) {
+        bytes[i] = [sizes[i] unsignedLongLongValue];
+    }
+
+    for (NSString * localeIdentifier in @[@"en_US", @"en_GB", @"en_IN", @"de_DE", @"de_CH", @"fr_FR", @"fr_CH", @"es_ES", @"it_IT", @"pl_PL", @"ru_RU", @"sv_SE", @"pt_BR", @"ja_JP", @"zh_Hans", @"hi_IN", @"ar_SA", @"fa_IR"]) {
+        for (NSUInteger config = 0; config < 8; config++) {
+            TTTUnitOfInformationFormatter * formatter = [[TTTUnitOfInformationFormatter alloc] init];
+            formatter.numberFormatter.locale = [NSLocale localeWithLocaleIdentifier:localeIdentifier];
+            formatter.displaysInTermsOfBytes = !(config & 1);
+            formatter.usesIECBinaryPrefixesForDisplay = !!(config & 2);
+            formatter.usesIECBinaryPrefixesForCalculation = !(config & 4);
+
+            NSArray * batch = [formatter stringsFromNumbersOfBytes:bytes count:sizes.count];
+            XCTAssertEqual(batch.count, sizes.count);
+            for (NSUInteger i = 0; i < sizes.count; i++) {
+                NSString * expected = legacyStringFromNumberOfBits(formatter, @(bytes[i] * 8));
+                XCTAssertEqualObjects([formatter stringFromNumber:sizes[i] ofUnit:TTTByte], expected, @"%@ %lu %@", localeIdentifier, (unsigned long)config, sizes[i]);
+                XCTAssertEqualObjects(batch[i], expected, @"%@ %lu %@", localeIdentifier, (unsigned long)config, sizes[i]);
+            }
+
+            for (NSNumber * bits in @[@0.5, @12, @1234.5, @8191.9, @-8]) {
+                XCTAssertEqualObjects([formatter stringFromNumberOfBits:bits], legacyStringFromNumberOfBits(formatter, bits), @"%@ %lu %@", localeIdentifier, (unsigned long)config, bits);
+            }
+        }
+    }
+
+    free(bytes);
+}
+
+
+-(void)testBatchMatchesSingleWhenCaching {
+    TTTUnitOfInformationFormatter * formatter = [[TTTUnitOfInformationFormatter alloc] init];
+    formatter.cachesResults = YES;
+    uint64_t bytes[] = {0, 1, 1023, 1024, 1536, 1536, 1048576, 1073741824, 1ULL << 58};
+    NSUInteger count = sizeof(bytes) / sizeof(bytes[0]);
+
+    NSArray * batch = [formatter stringsFromNumbersOfBytes:bytes count:count];
+    for (NSUInteger i = 0; i < count; i++) {
+        XCTAssertEqualObjects(batch[i], legacyStringFromNumberOfBits(formatter, @(bytes[i] * 8)), @"%llu", bytes[i]);
+    }
+    XCTAssertEqual([formatter stringsFromNumbersOfBytes:bytes count:0].count, (NSUInteger)0);
+}
+
+
+-(void)testNumberFormatterDidChange {
+    TTTUnitOfInformationFormatter * formatter = [[TTTUnitOfInformationFormatter alloc] init];
+    formatter.numberFormatter.locale = [NSLocale localeWithLocaleIdentifier:@"en_US"];
+    XCTAssertEqualObjects([formatter stringFromNumber:@1100 ofUnit:TTTByte], legacyStringFromNumberOfBits(formatter, @8800));
+
+    formatter.numberFormatter.maximumFractionDigits = 1;
+    formatter.numberFormatter.roundingIncrement = @0.1;
+    [formatter numberFormatterDidChange];
+    NSString * result = [formatter stringFromNumber:@1100 ofUnit:TTTByte];
+    XCTAssertEqualObjects(result, legacyStringFromNumberOfBits(formatter, @8800));
+    XCTAssertEqualObjects(result, @"1.1 KB");
+
+    formatter.numberFormatter.locale = [NSLocale localeWithLocaleIdentifier:@"de_DE"];
+    [formatter numberFormatterDidChange];
+    XCTAssertEqualObjects([formatter stringFromNumber:@1100 ofUnit:TTTByte], legacyStringFromNumberOfBits(formatter, @8800));
+}
+
+
+-(void)testPerformance {
+    TTTUnitOfInformationFormatter * formatter = [[TTTUnitOfInformationFormatter alloc] init];
+    uint64_t * bytes = malloc(PERF_TEST_COUNT * sizeof(uint64_t));
+    uint64_t x = 88172645463325252ULL;
+    for (NSUInteger i = 0; i < PERF_TEST_COUNT; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        bytes[i] = x >> (x % 48 + 16);
+    }
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        for (NSUInteger i = 0; i < PERF_TEST_COUNT; i++) {
+            legacyStringFromNumberOfBits(formatter, @(bytes[i] * 8));
+        }
+    }
+    NSTimeInterval baseline = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"NSNumberFormatter x %d: %0.6f sec.", PERF_TEST_COUNT, baseline);
+
+    start = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        for (NSUInteger i = 0; i < PERF_TEST_COUNT; i++) {
+            [formatter stringFromNumber:@(bytes[i]) ofUnit:TTTByte];
+        }
+    }
+    NSTimeInterval single = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"stringFromNumber:ofUnit: x %d: %0.6f sec, %0.6f ratio vs baseline.", PERF_TEST_COUNT, single, single / baseline);
+
+    start = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        [formatter stringsFromNumbersOfBytes:bytes count:PERF_TEST_COUNT];
+    }
+    NSTimeInterval batch = [NSDate timeIntervalSinceReferenceDate] - start;
+    NSLog(@"stringsFromNumbersOfBytes:count: x %d: %0.6f sec, %0.6f ratio vs baseline.", PERF_TEST_COUNT, batch, batch / baseline);
+
+    free(bytes);
+}
+
+
+/**
+ * Sizes around every prefix boundary for both calculation bases, plus rounding edges and a spread of others.
+ */
+static NSArray * sampleSizes() {
+    NSMutableArray * result = [NSMutableArray arrayWithArray:@[@0ULL, @1ULL, @2ULL, @5ULL, @999ULL, @1000ULL, @1001ULL,
+                                                              @1023ULL, @1024ULL, @1025ULL, @1029ULL, @1030ULL, @1035ULL,
+                                                              @1536ULL, @10239ULL, @10240ULL, @1048575ULL, @1048576ULL,
+                                                              @1500000ULL, @999999ULL, @1000000ULL, @1073741823ULL,
+                                                              @1073741824ULL, @1610612736ULL, @1099511627776ULL,
+                                                              @1125899906842624ULL, @(1ULL << 58), @(1ULL << 60),
+                                                              @UINT64_MAX]];
+    for (uint64_t base = 1000; base < (1ULL << 62); base *= 1000) {
+        [result addObject:@(base - 1)];
+        [result addObject:@(base + 1)];
+        [result addObject:@(base * 1023 / 1000)];
+    }
+    for (uint64_t base = 1024; base < (1ULL << 62); base *= 1024) {
+        [result addObject:@(base - 1)];
+        [result addObject:@(base + 1)];
+        [result addObject:@(base * 1000 / 1024)];
+        [result addObject:@(base * 1023 - 1)];
+        for (uint64_t n = 1; n < 200; n += 7) {
+            [result addObject:@(base * n + base / 200 * n)];
+        }
+    }
+    uint64_t x = 2463534242ULL;
+    for (NSUInteger i = 0; i < 500; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        [result addObject:@(x >> (x % 56 + 8))];
+    }
+    return result;
+}
+
+
+/**
+ * The implementation of -[TTTUnitOfInformationFormatter stringFromNumberOfBits:] before it had the fast path.
+ */
+static NSString * legacyStringFromNumberOfBits(TTTUnitOfInformationFormatter * formatter, NSNumber * number) {
+    NSString * bytesSI[] = {@"KB", @"MB", @"GB", @"TB", @"PB", @"EB"};
+    NSString * bytesIEC[] = {@"KiB", @"MiB", @"GiB", @"TiB", @"PiB", @"EiB"};
+    NSString * bitsSI[] = {@"kbit", @"Mbit", @"Gbit", @"Tbit", @"Pbit", nil};
+    NSString * bitsIEC[] = {@"Kibit", @"Mibit", @"Gibit", @"Tibit", @"Pibit", nil};
+
+    double base = formatter.usesIECBinaryPrefixesForCalculation ? 1024.0 : 1000.0;
+    double doubleValue = [number doubleValue];
+    if (formatter.displaysInTermsOfBytes) {
+        doubleValue /= 8;
+    }
+
+    NSString * unitString;
+    if (doubleValue < base) {
+        unitString = formatter.displaysInTermsOfBytes ? @"bytes" : @"bits";
+    }
+    else {
+        NSUInteger value = (NSUInteger)round(doubleValue);
+        int prefix = TTTExa;
+        while (prefix > TTTKilo && !(pow(base, prefix + 1) < value)) {
+            prefix--;
+        }
+        NSString * __strong * table = (formatter.displaysInTermsOfBytes ?
+                                       (formatter.usesIECBinaryPrefixesForDisplay ? bytesIEC : bytesSI) :
+                                       (formatter.usesIECBinaryPrefixesForDisplay ? bitsIEC : bitsSI));
+        unitString = table[prefix];
+        doubleValue /= pow(base, prefix + 1);
+    }
+    if (unitString != nil) {
+        unitString = NSLocalizedStringFromTable(unitString, @"FormatterKit", nil);
+    }
+
+    return [NSString stringWithFormat:NSLocalizedStringWithDefaultValue(@"Unit of Information Format String", @"FormatterKit", [NSBundle mainBundle], @"%@ %@", @"#{Value} #{Unit}"), [formatter.numberFormatter stringFromNumber:@(doubleValue)], unitString];
+}
+
+
+@end
@@ -0,0 +1,225 @@
+//
+//  URLQueryStringTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/27/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "GTMNSDictionary+URLArguments.h"
+#import "GTMNSString+URLArguments.h"
+#import "URLQueryString.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface URLQueryStringTests : TBTestCaseBase
+
+@end
+
+
+@implementation URLQueryStringTests
+
+
+-(void)testEnumerate {
+    NSString * query = @"a=1&&b&=c&d=e=f&";
+    NSMutableArray * keys = [NSMutableArray array];
+    NSMutableArray * values = [NSMutableArray array];
+    enumerateURLQueryArguments(query, ^(NSRange keyRange, NSRange valueRange, BOOL * stop) {
+        [keys addObject:[query substringWithRange:keyRange]];
+        [values addObject:(valueRange.location == NSNotFound ? [NSNull null] : [query substringWithRange:valueRange])];
+    });
+
+    XCTAssertEqualObjects(keys, (@[@"a", @"b", @"", @"d"]));
+    XCTAssertEqualObjects(values, (@[@"1", [NSNull null], @"c", @"e=f"]));
+}
+
+
+-(void)testEnumerateStop {
+    __block NSUInteger count = 0;
+    enumerateURLQueryArguments(@"a=1&b=2&c=3", ^(NSRange keyRange, NSRange valueRange, BOOL * stop) {
+        count++;
+        *stop = (count == 2);
+    });
+    XCTAssertEqual(count, (NSUInteger)2);
+}
+
+
+-(void)testEnumerateNil {
+    enumerateURLQueryArguments(nil, ^(NSRange keyRange, NSRange valueRange, BOOL * stop) {
+        XCTFail(@"Should not be called");
+    });
+}
+
+
+-(void)testUnescapeRange {
+    NSString * s = @"x=caf%C3%A9+au+lait";
+    XCTAssertEqualObjects(URLQueryUnescapeRange(s, NSMakeRange(2, s.length - 2)), @"café au lait");
+    XCTAssertEqualObjects(URLQueryUnescapeRange(s, NSMakeRange(0, 1)), @"x");
+    XCTAssertEqualObjects(URLQueryUnescapeRange(@"ü", NSMakeRange(0, 1)), @"ü");
+}
+
+
+-(void)testUnescapeMalformed {
+    XCTAssertNil([@"a%" gtm_stringByUnescapingFromURLArgument]);
+    XCTAssertNil([@"a%4" gtm_stringByUnescapingFromURLArgument]);
+    XCTAssertNil([@"a%zz" gtm_stringByUnescapingFromURLArgument]);
+    // Invalid UTF-8.
+    XCTAssertNil([@"a%C3" gtm_stringByUnescapingFromURLArgument]);
+    XCTAssertNil([@"a%FF" gtm_stringByUnescapingFromURLArgument]);
+}
+
+
+-(void)testEscapeAstralPlane {
+    XCTAssertEqualObjects(URLQueryEscape(@"\U0001F600"), @"%F0%9F%98%80");
+    XCTAssertEqualObjects(URLQueryEscape(@"a-b.c_d~e"), @"a-b.c_d~e");
+    XCTAssertEqualObjects(URLQueryEscape(@""), @"");
+}
+
+
+-(void)testEscapeLong {
+    NSMutableString * s = [NSMutableString string];
+    NSMutableString * expected = [NSMutableString string];
+    for (NSUInteger i = 0; i < 1000; i++) {
+        [s appendString:@"é "];
+        [expected appendString:@"%C3%A9%20"];
+    }
+    XCTAssertEqualObjects(URLQueryEscape(s), expected);
+    XCTAssertEqualObjects([expected gtm_stringByUnescapingFromURLArgument], s);
+}
+
+
+-(void)testHttpArgumentsString {
+    XCTAssertEqualObjects([@{} gtm_httpArgumentsString], @"");
+    XCTAssertEqualObjects([@{@"foo": @"bar"} gtm_httpArgumentsString], @"foo=bar");
+    XCTAssertEqualObjects([@{@"a b": @"c&d=e"} gtm_httpArgumentsString], @"a%20b=c%26d%3De");
+    XCTAssertEqualObjects([@{@"n": @42} gtm_httpArgumentsString], @"n=42");
+
+    NSDictionary * dict = @{@"foo": @"bar", @"baz": @"café", @"empty": @""};
+    NSString * args = [dict gtm_httpArgumentsString];
+    NSArray * components = [[args componentsSeparatedByString:@"&"] sortedArrayUsingSelector:@selector(compare:)];
+    XCTAssertEqualObjects(components, (@[@"baz=caf%C3%A9", @"empty=", @"foo=bar"]));
+}
+
+
+-(void)testDictionaryWithHttpArgumentsString {
+    XCTAssertEqualObjects([NSDictionary gtm_dictionaryWithHttpArgumentsString:@""], @{});
+    XCTAssertEqualObjects([NSDictionary gtm_dictionaryWithHttpArgumentsString:nil], @{});
+
+    NSDictionary * expected = @{@"foo": @"bar", @"baz": @"café au lait", @"flag": @"", @"x": @"1=2"};
+    XCTAssertEqualObjects([NSDictionary gtm_dictionaryWithHttpArgumentsString:@"foo=bar&baz=caf%C3%A9+au+lait&&flag&x=1=2"], expected);
+
+    // The first occurrence of a key wins.
+    XCTAssertEqualObjects([NSDictionary gtm_dictionaryWithHttpArgumentsString:@"a=1&a=2"], @{@"a": @"1"});
+
+    // Invalid escapes become empty strings rather than nil.
+    XCTAssertEqualObjects([NSDictionary gtm_dictionaryWithHttpArgumentsString:@"a=%FF&%zz=b"], (@{@"a": @"", @"": @"b"}));
+}
+
+
+-(void)testRoundTrip {
+    NSDictionary * dict = @{@"to": @"someone@example.com", @"subject": @"Re: 100% café & more", @"body": @"line 1\nline 2+3"};
+    XCTAssertEqualObjects([NSDictionary gtm_dictionaryWithHttpArgumentsString:[dict gtm_httpArgumentsString]], dict);
+}
+
+
+-(void)testBuilderData {
+    URLQueryStringBuilder * builder = [[URLQueryStringBuilder alloc] init];
+    [builder appendKey:@"a" value:@"1"];
+    [builder appendKey:@"b c" value:@"d"];
+    XCTAssertEqualObjects(builder.string, @"a=1&b%20c=d");
+    XCTAssertEqualObjects(builder.data, [@"a=1&b%20c=d" dataUsingEncoding:NSASCIIStringEncoding]);
+    XCTAssertEqual(builder.totalLength, (unsigned long long)11);
+}
+
+
+-(void)testBuilderStream {
+    NSOutputStream * stream = [NSOutputStream outputStreamToMemory];
+    [stream open];
+    URLQueryStringBuilder * builder = [[URLQueryStringBuilder alloc] initWithOutputStream:stream];
+
+    NSMutableString * expected = [NSMutableString string];
+    for (NSUInteger i = 0; i < 10000; i++) {
+        NSString * value = [NSString stringWithFormat:@"value %lu", (unsigned long)i];
+        [builder appendKey:@"key" value:value];
+        [expected appendFormat:@"%@key=value%%20%lu", (i == 0 ? @"" : @"&"), (unsigned long)i];
+    }
+    XCTAssert([builder flush]);
+    XCTAssertNil(builder.streamError);
+    [stream close];
+
+    NSData * data = [stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+    XCTAssertEqualObjects([[NSString alloc] initWithData:data encoding:NSASCIIStringEncoding], expected);
+    XCTAssertEqual(builder.totalLength, (unsigned long long)data.length);
+}
+
+
+-(void)testBuilderStreamError {
+    NSOutputStream * stream = [NSOutputStream outputStreamToFileAtPath:@"/nonexistent/dir/file" append:NO];
+    [stream open];
+    URLQueryStringBuilder * builder = [[URLQueryStringBuilder alloc] initWithOutputStream:stream];
+    [builder appendKey:@"a" value:@"b"];
+    XCTAssertFalse([builder flush]);
+    XCTAssertNotNil(builder.streamError);
+}
+
+
+static NSString * legacyHttpArgumentsString(NSDictionary * dict) {
+    NSMutableArray * arguments = [NSMutableArray arrayWithCapacity:dict.count];
+    for (NSString * key in dict) {
+        NSString * escapedKey = CFBridgingRelease(CFURLCreateStringByAddingPercentEscapes(NULL, (__bridge CFStringRef)key, NULL, CFSTR("!*'();:@&=+$,/?%#[]"), kCFStringEncodingUTF8));
+        NSString * escapedValue = CFBridgingRelease(CFURLCreateStringByAddingPercentEscapes(NULL, (__bridge CFStringRef)[dict[key] description], NULL, CFSTR("!*'();:@&=+$,/?%#[]"), kCFStringEncodingUTF8));
+        [arguments addObject:[NSString stringWithFormat:@"%@=%@", escapedKey, escapedValue]];
+    }
+    return [arguments componentsJoinedByString:@"&"];
+}
+
+
+-(void)testHttpArgumentsStringMatchesLegacy {
+    NSDictionary * dict = @{@"q": @"tipbit email search", @"lang": @"en-US", @"page": @3, @"filter": @"from:me@example.com is:unread", @"ü": @"ö/ä?"};
+    NSArray * expected = [[legacyHttpArgumentsString(dict) componentsSeparatedByString:@"&"] sortedArrayUsingSelector:@selector(compare:)];
+    NSArray * actual = [[[dict gtm_httpArgumentsString] componentsSeparatedByString:@"&"] sortedArrayUsingSelector:@selector(compare:)];
+    XCTAssertEqualObjects(actual, expected);
+}
+
+
+-(void)testHttpArgumentsStringPerformance {
+    NSDictionary * dict = @{@"q": @"tipbit email search", @"lang": @"en-US", @"page": @3, @"filter": @"from:me@example.com is:unread", @"client_id": @"1234567890.apps.googleusercontent.com"};
+    const NSUInteger count = 20000;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < count; i++) {
+        @autoreleasepool {
+            legacyHttpArgumentsString(dict);
+        }
+    }
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < count; i++) {
+        @autoreleasepool {
+            [dict gtm_httpArgumentsString];
+        }
+    }
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+    NSTimeInterval baseline = mid - start;
+    NSTimeInterval result = end - mid;
+    NSLog(@"gtm_httpArgumentsString x %lu: %0.6f sec, %0.6f ratio vs legacy.", (unsigned long)count, result, result / baseline);
+}
+
+
+-(void)testDictionaryWithHttpArgumentsStringPerformance {
+    NSString * query = @"q=tipbit+email+search&lang=en-US&page=3&filter=from%3Ame%40example.com%20is%3Aunread&client_id=1234567890.apps.googleusercontent.com";
+    const NSUInteger count = 20000;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    for (NSUInteger i = 0; i < count; i++) {
+        @autoreleasepool {
+            [NSDictionary gtm_dictionaryWithHttpArgumentsString:query];
+        }
+    }
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+    NSLog(@"gtm_dictionaryWithHttpArgumentsString x %lu: %0.6f sec.", (unsigned long)count, end - start);
+}
+
+
+@end
@@ -0,0 +1,201 @@
+//
+//  UTF8BuilderTests.m
+//  Tidbits
+//
+//  Created by Ewan Mellor on 3/30/15.
+//  Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+//
+
+#import "NSMutableData+UTF8.h"
+#import "UTF8Builder.h"
+
+#import "TBTestCaseBase.h"
+
+
+@interface UTF8BuilderTests : TBTestCaseBase
+
+@end
+
+
+@implementation UTF8BuilderTests
+
+
+-(void)testEmpty {
+    UTF8Builder * b = [[UTF8Builder alloc] init];
+    XCTAssertEqual(b.length, (NSUInteger)0);
+    XCTAssertEqualObjects(b.string, @"");
+    XCTAssertEqualObjects(b.data, [NSData data]);
+}
+
+
+-(void)testAppendString {
+    UTF8Builder * b = [[UTF8Builder alloc] init];
+    [b appendString:@"plain "];
+    [b appendString:@"café "];
+    [b appendString:@"\U0001F600"];
+    [b appendString:nil];
+    XCTAssertEqualObjects(b.string, @"plain café \U0001F600");
+    XCTAssertEqual(b.length, (NSUInteger)(6 + 6 + 4));
+}
+
+
+-(void)testAppendUnpairedSurrogate {
+    unichar chars[] = { 'a', 0xD800, 'b' };
+    UTF8Builder * b = [[UTF8Builder alloc] init];
+    [b appendString:[NSString stringWithCharacters:chars length:3]];
+    XCTAssertEqualObjects(b.string, @"a?b");
+}
+
+
+-(void)testAppendFormat {
+    UTF8Builder * b = [[UTF8Builder alloc] initWithCapacity:4];
+    [b appendFormat:"%s:%d | ", "main.m", 42];
+    [b appendFormat:"%0.3f", 1.5];
+    XCTAssertEqualObjects(b.string, @"main.m:42 | 1.500");
+}
+
+
+-(void)testAppendFormatLong {
+    // Longer than the initial guess, so that the retry path is used.
+    char big[1000];
+    memset(big, 'x', sizeof(big) - 1);
+    big[sizeof(big) - 1] = '\0';
+
+    UTF8Builder * b = [[UTF8Builder alloc] init];
+    [b appendFormat:"<%s>", big];
+    XCTAssertEqual(b.length, (NSUInteger)1001);
+    XCTAssertEqual(b.bytes[0], (uint8_t)'<');
+    XCTAssertEqual(b.bytes[1000], (uint8_t)'>');
+}
+
+
+-(void)testAppendStringWithFormat {
+    UTF8Builder * b = [[UTF8Builder alloc] init];
+    [b appendStringWithFormat:@"%@ = %@", @"ключ", @42];
+    XCTAssertEqualObjects(b.string, @"ключ = 42");
+}
+
+
+-(void)testAppendInteger {
+    long long values[] = { 0, 7, -7, 10, 99, 100, -12345, 9876543210LL, LLONG_MAX, LLONG_MIN };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        UTF8Builder * b = [[UTF8Builder alloc] init];
+        [b appendInteger:values[i]];
+        XCTAssertEqualObjects(b.string, ([NSString stringWithFormat:@"%lld", values[i]]));
+    }
+
+    UTF8Builder * b = [[UTF8Builder alloc] init];
+    [b appendUnsignedInteger:ULLONG_MAX];
+    XCTAssertEqualObjects(b.string, ([NSString stringWithFormat:@"%llu", ULLONG_MAX]));
+}
+
+
+-(void)testAppendDouble {
+    double values[] = { 0.0, -0.0, 42.0, -1.5, 0.1, 1.0 / 3.0, 1e300, NAN, INFINITY, -INFINITY };
+    NSArray * expected = @[@"0", @"-0", @"42", @"-1.5", @"0.1", @"0.33333333333333331", @"1e+300", @"nan", @"inf", @"-inf"];
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        UTF8Builder * b = [[UTF8Builder alloc] init];
+        [b appendDouble:values[i]];
+        XCTAssertEqualObjects(b.string, expected[i]);
+        if (isfinite(values[i])) {
+            XCTAssertEqual(strtod([b.string UTF8String], NULL), values[i]);
+        }
+    }
+}
+
+
+-(void)testAppendDoubleFractionDigits {
+    double values[] = { 0, 1.5, -0.001, 123.456789, 1.005, 99.9999, -3.14159, 1e10, 1e300, NAN,
+                        0.015, 0.035, 1.115, -2.675, 0.125, 0.375, 4503599627370495.5 };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        for (int digits = 0; digits < 7; digits++) {
+            UTF8Builder * b = [[UTF8Builder alloc] init];
+            [b appendDouble:values[i] fractionDigits:digits];
+            XCTAssertEqualObjects(b.string, ([NSString stringWithFormat:@"%.*f", digits, values[i]]), @"%g %d", values[i], digits);
+        }
+    }
+}
+
+
+-(void)testAppendDoubleFractionDigitsMatchesPrintf {
+    UTF8Builder * b = [[UTF8Builder alloc] init];
+    for (int i = 0; i < 100000; i++) {
+        double d = i / 1000.0;
+        [b truncateToLength:0];
+        [b appendDouble:d fractionDigits:2];
+        XCTAssertEqualObjects(b.string, ([NSString stringWithFormat:@"%.2f", d]), @"%.3f", d);
+    }
+}
+
+
+-(void)testReserve {
+    UTF8Builder * b = [[UTF8Builder alloc] init];
+    [b appendByte:'['];
+    uint8_t * tail = [b reserve:3];
+    memcpy(tail, "abc", 3);
+    [b didAppend:3];
+    [b appendByte:']'];
+    XCTAssertEqualObjects(b.string, @"[abc]");
+
+    [b truncateToLength:1];
+    XCTAssertEqualObjects(b.string, @"[");
+}
+
+
+-(void)testDataHandsOff {
+    UTF8Builder * b = [[UTF8Builder alloc] init];
+    [b appendString:@"hello"];
+    const uint8_t * bytes = b.bytes;
+    NSData * data = b.data;
+    XCTAssertEqualObjects(data, [@"hello" dataUsingEncoding:NSUTF8StringEncoding]);
+    XCTAssertEqual(data.bytes, (const void *)bytes);
+    XCTAssertEqual(b.length, (NSUInteger)0);
+
+    // The builder is still usable afterwards.
+    [b appendString:@"again"];
+    XCTAssertEqualObjects(b.string, @"again");
+}
+
+
+-(void)testNSMutableDataAppendUTF8 {
+    NSMutableData * data = [NSMutableData data];
+    [data appendUTF8:@"café "];
+    [data appendUTF8Format:@"%@ %d", @"x", 1];
+    [data appendUTF8:nil];
+    XCTAssertEqualObjects(data, [@"café x 1" dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+
+-(void)testPerformance {
+    const NSUInteger count = 100000;
+
+    NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        NSMutableData * data = [NSMutableData data];
+        for (NSUInteger i = 0; i < count; i++) {
+            [data appendUTF8Format:@"%s:%d | %lu %0.3f\n", "function", 123, (unsigned long)i, i / 7.0];
+        }
+    }
+    NSTimeInterval mid = [NSDate timeIntervalSinceReferenceDate];
+    @autoreleasepool {
+        UTF8Builder * b = [[UTF8Builder alloc] init];
+        for (NSUInteger i = 0; i < count; i++) {
+            [b appendCString:"function:"];
+            [b appendInteger:123];
+            [b appendBytes:" | " length:3];
+            [b appendUnsignedInteger:i];
+            [b appendByte:' '];
+            [b appendDouble:i / 7.0 fractionDigits:3];
+            [b appendByte:'\n'];
+        }
+        (void)b.data;
+    }
+    NSTimeInterval end = [NSDate timeIntervalSinceReferenceDate];
+
+    NSTimeInterval baseline = mid - start;
+    NSTimeInterval result = end - mid;
+    NSLog(@"UTF8Builder x %lu: %0.6f sec, %0.6f ratio vs appendUTF8Format:.", (unsigned long)count, result, result / baseline);
+}
+
+
+@end
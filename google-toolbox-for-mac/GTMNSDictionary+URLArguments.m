@@ -19,49 +19,34 @@
 #import "GTMNSDictionary+URLArguments.h"
 #import "GTMNSString+URLArguments.h"
 #import "GTMDefines.h"
+#import "URLQueryString.h"
 
 @implementation NSDictionary (GTMNSDictionaryURLArgumentsAdditions)
 
 + (NSDictionary *)gtm_dictionaryWithHttpArgumentsString:(NSString *)argString {
   NSMutableDictionary* ret = [NSMutableDictionary dictionary];
-  NSArray* components = [argString componentsSeparatedByString:@"&"];
-  NSString* component;
-  // Use reverse order so that the first occurrence of a key replaces
-  // those subsequent.
-  GTM_FOREACH_ENUMEREE(component, [components reverseObjectEnumerator]) {
-    if ([component length] == 0)
-      continue;
-    NSRange pos = [component rangeOfString:@"="];
-    NSString *key;
-    NSString *val;
-    if (pos.location == NSNotFound) {
-      key = [component gtm_stringByUnescapingFromURLArgument];
-      val = @"";
-    } else {
-      key = [[component substringToIndex:pos.location]
-             gtm_stringByUnescapingFromURLArgument];
-      val = [[component substringFromIndex:pos.location + pos.length]
-             gtm_stringByUnescapingFromURLArgument];
-    }
-    // gtm_stringByUnescapingFromURLArgument returns nil on invalid UTF8
+  // Arguments are split into ranges in place, and only unescaped when
+  // needed.  The first occurrence of a key wins.
+  enumerateURLQueryArguments(argString, ^(NSRange keyRange, NSRange valRange, BOOL *stop) {
+    NSString *key = URLQueryUnescapeRange(argString, keyRange);
+    // URLQueryUnescapeRange returns nil on invalid UTF8
     // and NSMutableDictionary raises an exception when passed nil values.
     if (!key) key = @"";
+    if ([ret objectForKey:key] != nil)
+      return;
+    NSString *val = (valRange.location == NSNotFound ?
+                     @"" : URLQueryUnescapeRange(argString, valRange));
     if (!val) val = @"";
     [ret setObject:val forKey:key];
-  }
+  });
   return ret;
 }
 
 - (NSString *)gtm_httpArgumentsString {
-  NSMutableArray* arguments = [NSMutableArray arrayWithCapacity:[self count]];
-  NSString* key;
-  GTM_FOREACH_KEY(key, self) {
-    [arguments addObject:[NSString stringWithFormat:@"%@=%@",
-                          [key gtm_stringByEscapingForURLArgument],
-                          [[[self objectForKey:key] description] gtm_stringByEscapingForURLArgument]]];
-  }
-
-  return [arguments componentsJoinedByString:@"&"];
+  // Keys and values are escaped straight into a single buffer.
+  URLQueryStringBuilder *builder = [[URLQueryStringBuilder alloc] init];
+  [builder appendDictionary:self];
+  return [builder string];
 }
 
 @end
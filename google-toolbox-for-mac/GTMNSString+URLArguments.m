@@ -17,28 +17,20 @@
 //
 
 #import "GTMNSString+URLArguments.h"
+#import "URLQueryString.h"
 
 @implementation NSString (GTMNSStringURLArgumentsAdditions)
 
 - (NSString*)gtm_stringByEscapingForURLArgument {
   // Encode all the reserved characters, per RFC 3986
-  // (<http://www.ietf.org/rfc/rfc3986.txt>)
-  CFStringRef escaped = 
-    CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault,
-                                            (CFStringRef)self,
-                                            NULL,
-                                            (CFStringRef)@"!*'();:@&=+$,/?%#[]",
-                                            kCFStringEncodingUTF8);
-  return CFBridgingRelease(escaped);
+  // (<http://www.ietf.org/rfc/rfc3986.txt>).  This is table-driven rather
+  // than going through CFURLCreateStringByAddingPercentEscapes, but the
+  // results are the same.
+  return URLQueryEscape(self);
 }
 
 - (NSString*)gtm_stringByUnescapingFromURLArgument {
-  NSMutableString *resultString = [NSMutableString stringWithString:self];
-  [resultString replaceOccurrencesOfString:@"+"
-                                withString:@" "
-                                   options:NSLiteralSearch
-                                     range:NSMakeRange(0, [resultString length])];
-  return [resultString stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+  return URLQueryUnescapeRange(self, NSMakeRange(0, [self length]));
 }
 
 @end
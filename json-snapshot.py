@@ -0,0 +1,243 @@
+#!/usr/bin/env python
+#
+# json-snapshot.py
+# Tidbits
+#
+# Created by Ewan Mellor on 4/6/15.
+# Copyright (c) 2015 Tipbit, Inc. All rights reserved.
+#
+# Convert JSON resources into the binary snapshots read by JSONSnapshot (see
+# Tidbits/JSONSnapshot.h for the format).  The output is byte-for-byte the
+# same as +[JSONSnapshot snapshotDataWithJSONData:error:].
+#
+# Usage: json-snapshot.py [-o OUTPUT_DIR] FILE.json...
+#
+# Each FILE.json is written to FILE.jsonsnap, next to the input or in
+# OUTPUT_DIR.  To snapshot an app's bundled JSON, add a Run Script build phase
+# after Copy Bundle Resources:
+#
+#   python path/to/Tidbits/json-snapshot.py -o "$TARGET_BUILD_DIR/$UNLOCALIZED_RESOURCES_FOLDER_PATH" \
+#       "$SRCROOT"/Resources/*.json
+#
+# +[NSJSONSerialization JSONObjectFromBundle:resourceName:error:] then uses
+# the snapshot whenever it matches the JSON beside it.
+
+import json
+import os
+import struct
+import sys
+
+
+MAGIC = b'TBJS'
+VERSION = 1
+HEADER_SIZE = 32
+
+REF_LITERAL = 0
+REF_INT = 1
+REF_INT64 = 2
+REF_DOUBLE = 3
+REF_STRING = 4
+REF_ARRAY = 5
+REF_OBJECT = 6
+
+SMALL_INT_MIN = -(1 << 28)
+SMALL_INT_MAX = (1 << 28) - 1
+INT64_MIN = -(1 << 63)
+INT64_MAX = (1 << 63) - 1
+
+MASK32 = 0xffffffff
+MASK64 = 0xffffffffffffffff
+
+
+def make_ref(kind, payload):
+    return (kind << 29) | (payload & 0x1fffffff)
+
+
+def string_pool_hash(s):
+    """StringPoolHashString: FNV-1a over the UTF-16 code units."""
+    h = 2166136261
+    utf16 = s.encode('utf-16-le')
+    for i in range(0, len(utf16), 2):
+        unit = struct.unpack_from('<H', utf16, i)[0]
+        h = ((h ^ unit) * 16777619) & MASK32
+    return h
+
+
+def source_hash(data):
+    """JSONSnapshotSourceHash: FNV-1a over 64-bit little-endian words, then the remaining bytes."""
+    h = 0xcbf29ce484222325
+    prime = 0x100000001b3
+    n = len(data) // 8
+    for word in struct.unpack_from('<%dQ' % n, data):
+        h = ((h ^ word) * prime) & MASK64
+    for b in bytearray(data[n * 8:]):
+        h = ((h ^ b) * prime) & MASK64
+    return h
+
+
+class Builder(object):
+    def __init__(self):
+        self.out = bytearray(HEADER_SIZE)
+        self.string_indexes = {}
+        self.strings = []
+
+    def align(self, alignment):
+        pad = (alignment - len(self.out) % alignment) % alignment
+        self.out.extend(b'\0' * pad)
+
+    def intern(self, s):
+        index = self.string_indexes.get(s)
+        if index is None:
+            index = len(self.strings)
+            self.string_indexes[s] = index
+            self.strings.append(s)
+        return index
+
+    def eight_bytes(self, fmt, value, kind):
+        self.align(8)
+        offset = len(self.out)
+        self.out.extend(struct.pack(fmt, value))
+        return make_ref(kind, offset // 4)
+
+    def value(self, v):
+        if v is None:
+            return make_ref(REF_LITERAL, 0)
+        if v is False:
+            return make_ref(REF_LITERAL, 1)
+        if v is True:
+            return make_ref(REF_LITERAL, 2)
+        if isinstance(v, (int, long_type)):
+            if SMALL_INT_MIN <= v <= SMALL_INT_MAX:
+                return make_ref(REF_INT, v)
+            if INT64_MIN <= v <= INT64_MAX:
+                return self.eight_bytes('<q', v, REF_INT64)
+            return self.eight_bytes('<d', float(v), REF_DOUBLE)
+        if isinstance(v, float):
+            return self.eight_bytes('<d', v, REF_DOUBLE)
+        if isinstance(v, text_type):
+            return make_ref(REF_STRING, self.intern(v))
+        if isinstance(v, Pairs):
+            return self.object(v)
+        return self.array(v)
+
+    def array(self, items):
+        refs = [self.value(item) for item in items]
+        self.align(4)
+        offset = len(self.out)
+        self.out.extend(struct.pack('<%dI' % (1 + len(refs)), len(refs), *refs))
+        return make_ref(REF_ARRAY, offset // 4)
+
+    def object(self, pairs):
+        # pairs is the list of (key, value) from object_pairs_hook, in document order.
+        # A repeated key keeps its first position but takes the last value, like
+        # -[JSONPullParser objectValue].
+        keys = []
+        refs = []
+        members = {}
+        for key, value in pairs:
+            key_index = self.intern(key)
+            ref = self.value(value)
+            if key in members:
+                refs[members[key]] = ref
+                continue
+            members[key] = len(keys)
+            refs.append(ref)
+            keys.append(key_index)
+
+        count = len(keys)
+        table_size = 0
+        if count > 0:
+            table_size = 1
+            while table_size < 2 * count:
+                table_size <<= 1
+        table = [0] * table_size
+        for m in range(count):
+            i = string_pool_hash(self.strings[keys[m]]) & (table_size - 1)
+            while table[i] != 0:
+                i = (i + 1) & (table_size - 1)
+            table[i] = m + 1
+
+        self.align(4)
+        offset = len(self.out)
+        words = [count, table_size] + table + keys + refs
+        self.out.extend(struct.pack('<%dI' % len(words), *words))
+        return make_ref(REF_OBJECT, offset // 4)
+
+    def string_table(self):
+        self.align(4)
+        table_offset = len(self.out)
+        count = len(self.strings)
+        self.out.extend(struct.pack('<I', count))
+        offsets_start = len(self.out)
+        self.out.extend(b'\0' * (4 * count))
+        for i, s in enumerate(self.strings):
+            struct.pack_into('<I', self.out, offsets_start + 4 * i, len(self.out))
+            utf8 = s.encode('utf-8')
+            self.out.extend(struct.pack('<II', len(utf8), string_pool_hash(s)))
+            self.out.extend(utf8)
+            self.out.extend(b'\0')
+            self.align(4)
+        return table_offset
+
+    def build(self, source):
+        doc = json.loads(source.decode('utf-8'), object_pairs_hook=Pairs, parse_int=parse_int,
+                         parse_constant=reject_constant)
+        root = self.value(doc)
+        table_offset = self.string_table()
+        struct.pack_into('<4sIQQII', self.out, 0, MAGIC, VERSION, len(source), source_hash(source), root, table_offset)
+        return bytes(self.out)
+
+
+class Pairs(list):
+    """An object's members, kept as a list so that order and repeated keys survive."""
+    pass
+
+
+def parse_int(s):
+    # The same rule as -[JSONPullParser numberValue]: up to 18 digits is an
+    # integer, and anything longer is a double, even if it would fit in 64 bits.
+    if len(s.lstrip('-')) <= 18:
+        return int(s)
+    return float(s)
+
+
+def reject_constant(name):
+    # Python accepts NaN and Infinity, but JSON (and JSONPullParser) doesn't.
+    raise ValueError('Invalid value %s' % name)
+
+
+try:
+    long_type = long
+    text_type = unicode
+except NameError:
+    long_type = int
+    text_type = str
+
+
+def main(argv):
+    args = argv[1:]
+    output_dir = None
+    if len(args) >= 2 and args[0] == '-o':
+        output_dir = args[1]
+        args = args[2:]
+    if not args:
+        sys.stderr.write('Usage: %s [-o OUTPUT_DIR] FILE.json...\n' % os.path.basename(argv[0]))
+        return 2
+
+    for path in args:
+        with open(path, 'rb') as f:
+            source = f.read()
+        try:
+            snapshot = Builder().build(source)
+        except (ValueError, UnicodeError) as e:
+            sys.stderr.write('%s: %s\n' % (path, e))
+            return 1
+        base = os.path.splitext(os.path.basename(path))[0] + '.jsonsnap'
+        dest = os.path.join(output_dir if output_dir is not None else os.path.dirname(path), base)
+        with open(dest, 'wb') as f:
+            f.write(snapshot)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))